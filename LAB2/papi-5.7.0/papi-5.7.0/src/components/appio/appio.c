@@ -34,6 +34,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
 
 /* Headers required by PAPI */
 #include "papi.h"
@@ -112,13 +115,28 @@ typedef enum {
   SOCK_WRITE_USEC,
   SEEK_CALLS,
   SEEK_ABS_STRIDE_SIZE,
-  SEEK_USEC
+  SEEK_USEC,
+  PREAD_CALLS,
+  PWRITE_CALLS,
+  READV_CALLS,
+  WRITEV_CALLS,
+  XFER_BYTES,
+  XFER_CALLS,
+  XFER_ERR,
+  XFER_USEC,
+  MMAP_CALLS,
+  MMAP_BYTES,
+  /* APPIO_LAT_BUCKETS histogram counters for each call class follow */
+  READ_LAT = APPIO_BASIC_COUNTERS,
+  WRITE_LAT = READ_LAT + APPIO_LAT_BUCKETS,
+  RECV_LAT = WRITE_LAT + APPIO_LAT_BUCKETS,
+  XFER_LAT = RECV_LAT + APPIO_LAT_BUCKETS
 } _appio_stats_t ;
 
 static const struct appio_counters {
     const char *name;
     const char *description;
-} _appio_counter_info[APPIO_MAX_COUNTERS] = {
+} _appio_counter_info[APPIO_BASIC_COUNTERS] = {
     { "READ_BYTES",      "Bytes read"},
     { "READ_CALLS",      "Number of read calls"},
     { "READ_ERR",        "Number of read calls that resulted in an error"},
@@ -163,14 +181,83 @@ static const struct appio_counters {
     { "SOCK_WRITE_USEC", "Real microseconds spent in write(s) to socket(s)"},
     { "SEEK_CALLS",      "Number of seek calls"},
     { "SEEK_ABS_STRIDE_SIZE", "Average absolute stride size of seeks"},
-    { "SEEK_USEC",       "Real microseconds spent in seek calls"}
+    { "SEEK_USEC",       "Real microseconds spent in seek calls"},
+    { "PREAD_CALLS",     "Number of pread/preadv/preadv2 calls"},
+    { "PWRITE_CALLS",    "Number of pwrite/pwritev/pwritev2 calls"},
+    { "READV_CALLS",     "Number of readv/preadv/preadv2 calls"},
+    { "WRITEV_CALLS",    "Number of writev/pwritev/pwritev2 calls"},
+    { "XFER_BYTES",      "Bytes moved by sendfile/splice"},
+    { "XFER_CALLS",      "Number of sendfile/splice calls"},
+    { "XFER_ERR",        "Number of sendfile/splice calls that resulted in an error"},
+    { "XFER_USEC",       "Real microseconds spent in sendfile/splice"},
+    { "MMAP_CALLS",      "Number of mmap calls that mapped a file"},
+    { "MMAP_BYTES",      "Bytes of files mapped by mmap"}
 };
 
+/* the call classes with a latency histogram, in _appio_stats_t order */
+static const struct appio_lat_classes {
+    const char *prefix;
+    const char *calls;
+} _appio_lat_info[APPIO_LAT_CLASSES] = {
+    { "READ",  "read"},
+    { "WRITE", "write"},
+    { "RECV",  "recv/recvmsg/recvfrom"},
+    { "XFER",  "sendfile/splice"}
+};
+
+/* names and descriptions of the histogram events, built at init */
+static char _appio_lat_names[APPIO_LAT_CLASSES * APPIO_LAT_BUCKETS][PAPI_MIN_STR_LEN];
+static char _appio_lat_descrs[APPIO_LAT_CLASSES * APPIO_LAT_BUCKETS][PAPI_MAX_STR_LEN];
+
 
 /*********************************************************************
  ***  BEGIN FUNCTIONS  USED INTERNALLY SPECIFIC TO THIS COMPONENT ****
  ********************************************************************/
 
+/* All the bookkeeping below only touches the __thread registers, so
+   none of it takes a lock on the I/O path. */
+
+/* count a call of duration usec in the histogram starting at lat */
+static inline void _appio_count_latency(int lat, long long duration) {
+  int bucket = 0;
+  if (duration > 0) {
+    bucket = 64 - __builtin_clzll((unsigned long long) duration);
+    if (bucket >= APPIO_LAT_BUCKETS) bucket = APPIO_LAT_BUCKETS - 1;
+  }
+  _appio_register_current[lat + bucket]++;
+}
+
+static inline int _appio_is_socket(int fd) {
+  struct stat st;
+  if ((fstat(fd, &st) == 0) && ((st.st_mode & S_IFMT) == S_IFSOCK)) return 1;
+  return 0;
+}
+
+/* bytes asked for by an iovec array */
+static inline size_t _appio_iov_bytes(const struct iovec *iov, int iovcnt) {
+  size_t count = 0;
+  int i;
+  for (i = 0; i < iovcnt; i++) count += iov[i].iov_len;
+  return count;
+}
+
+// The PIC test implies it's built for shared linkage
+#ifdef PIC
+/* the next definition of symbol, i.e. the one in libc */
+static void *_appio_next(const char *symbol) {
+  void *fn = dlsym(RTLD_NEXT, symbol);
+  if (!fn) {
+    fprintf(stderr, "appio,c Internal Error: Could not obtain handle for real %s\n", symbol);
+    exit(1);
+  }
+  return fn;
+}
+#endif /* PIC */
+
+/* The replacements have to be seen by the application even though the
+   shared library is built with hidden visibility */
+#pragma GCC visibility push(default)
+
 int __close(int fd);
 int close(int fd) {
   int retval;
@@ -220,37 +307,36 @@ off_t lseek(int fd, off_t offset, int whence) {
   return retval;
 }
 
-extern int errno;
-ssize_t __read(int fd, void *buf, size_t count);
-ssize_t read(int fd, void *buf, size_t count) {
-  int retval;
-  SUBDBG("appio: intercepted read(%d,%p,%lu)\n", fd, buf, (unsigned long)count);
-
-  struct stat st;
-  int issocket = 0;
-  if (fstat(fd, &st) == 0) {
-    if ((st.st_mode & S_IFMT) == S_IFSOCK) issocket = 1;
-  }
-  // check if read would block on descriptor
-  fd_set readfds;
-  FD_ZERO(&readfds);
-  FD_SET(fd, &readfds);
-  int ready = __select(fd+1, &readfds, NULL, NULL, &zerotv);
+/* check if a read (or write) would block on the descriptor */
+static void _appio_check_block(int fd, int writing, int issocket) {
+  fd_set fds;
+  FD_ZERO(&fds);
+  FD_SET(fd, &fds);
+  int ready = writing ? __select(fd+1, NULL, &fds, NULL, &zerotv)
+                      : __select(fd+1, &fds, NULL, NULL, &zerotv);
   if (ready == 0) {
-     _appio_register_current[READ_WOULD_BLOCK]++; 
-     if (issocket) _appio_register_current[SOCK_READ_WOULD_BLOCK]++; 
+    if (writing) {
+      _appio_register_current[WRITE_WOULD_BLOCK]++;
+      if (issocket) _appio_register_current[SOCK_WRITE_WOULD_BLOCK]++;
+    } else {
+      _appio_register_current[READ_WOULD_BLOCK]++;
+      if (issocket) _appio_register_current[SOCK_READ_WOULD_BLOCK]++;
+    }
   }
+}
 
-  long long start_ts = PAPI_get_real_usec();
-  retval = __read(fd,buf, count);
-  long long duration = PAPI_get_real_usec() - start_ts;
+extern int errno;
+
+/* account a read of count bytes that returned retval after duration usec */
+static void _appio_count_read(ssize_t retval, size_t count, int issocket, long long duration) {
   int n = _appio_register_current[READ_CALLS]++; // read calls
   if (issocket) _appio_register_current[SOCK_READ_CALLS]++; // read calls
+  _appio_count_latency(READ_LAT, duration);
   if (retval > 0) {
     _appio_register_current[READ_BLOCK_SIZE]= (n * _appio_register_current[READ_BLOCK_SIZE] + count)/(n+1); // mean size
     _appio_register_current[READ_BYTES] += retval; // read bytes
     if (issocket) _appio_register_current[SOCK_READ_BYTES] += retval;
-    if (retval < (int)count) {
+    if ((size_t)retval < count) {
        _appio_register_current[READ_SHORT]++; // read short
        if (issocket) _appio_register_current[SOCK_READ_SHORT]++; // read short
     }
@@ -268,6 +354,63 @@ ssize_t read(int fd, void *buf, size_t count) {
     //}
   }
   if (retval == 0) _appio_register_current[READ_EOF]++; // read eof
+}
+
+/* account a write of count bytes that returned retval after duration usec */
+static void _appio_count_write(ssize_t retval, size_t count, int issocket, long long duration) {
+  int n = _appio_register_current[WRITE_CALLS]++; // write calls
+  if (issocket) _appio_register_current[SOCK_WRITE_CALLS]++; // socket write
+  _appio_count_latency(WRITE_LAT, duration);
+  if (retval >= 0) {
+    _appio_register_current[WRITE_BLOCK_SIZE]= (n * _appio_register_current[WRITE_BLOCK_SIZE] + count)/(n+1); // mean size
+    _appio_register_current[WRITE_BYTES]+= retval; // write bytes
+    if (issocket) _appio_register_current[SOCK_WRITE_BYTES] += retval;
+    if ((size_t)retval < count) {
+      _appio_register_current[WRITE_SHORT]++; // short write
+      if (issocket) _appio_register_current[SOCK_WRITE_SHORT]++; 
+    }
+    _appio_register_current[WRITE_USEC] += duration;
+    if (issocket) _appio_register_current[SOCK_WRITE_USEC] += duration;
+  }
+  if (retval < 0) {
+    _appio_register_current[WRITE_ERR]++; // err
+    if (issocket) _appio_register_current[SOCK_WRITE_ERR]++;
+    if (EINTR == errno)
+      _appio_register_current[WRITE_INTERRUPTED]++; // signal interrupted the op
+    //if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) {
+    //  _appio_register_current[WRITE_WOULD_BLOCK]++; //op would block on descriptor marked as non-blocking
+    //  if (issocket) _appio_register_current[SOCK_WRITE_WOULD_BLOCK]++;
+    //}
+  }
+}
+
+ssize_t __read(int fd, void *buf, size_t count);
+ssize_t read(int fd, void *buf, size_t count) {
+  ssize_t retval;
+  SUBDBG("appio: intercepted read(%d,%p,%lu)\n", fd, buf, (unsigned long)count);
+
+  int issocket = _appio_is_socket(fd);
+  _appio_check_block(fd, 0, issocket);
+
+  long long start_ts = PAPI_get_real_usec();
+  retval = __read(fd,buf, count);
+  long long duration = PAPI_get_real_usec() - start_ts;
+  _appio_count_read(retval, count, issocket, duration);
+  return retval;
+}
+
+/* positional I/O only works on seekable files, which are never
+   sockets and never block, so those checks are skipped.  libc's
+   __pread64/__pwrite64 take a 64 bit offset even where off_t is 32 bit */
+ssize_t __pread64(int fd, void *buf, size_t count, __off64_t offset);
+ssize_t pread(int fd, void *buf, size_t count, off_t offset) {
+  ssize_t retval;
+  SUBDBG("appio: intercepted pread(%d,%p,%lu,%ld)\n", fd, buf, (unsigned long)count, (long)offset);
+  long long start_ts = PAPI_get_real_usec();
+  retval = __pread64(fd, buf, count, (__off64_t) offset);
+  long long duration = PAPI_get_real_usec() - start_ts;
+  _appio_register_current[PREAD_CALLS]++;
+  _appio_count_read(retval, count, 0, duration);
   return retval;
 }
 
@@ -279,6 +422,7 @@ size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
   retval = _IO_fread(ptr,size,nmemb,stream);
   long long duration = PAPI_get_real_usec() - start_ts;
   int n = _appio_register_current[READ_CALLS]++; // read calls
+  _appio_count_latency(READ_LAT, duration);
   if (retval > 0) {
     _appio_register_current[READ_BLOCK_SIZE]= (n * _appio_register_current[READ_BLOCK_SIZE]+ size*nmemb)/(n+1);//mean size
     _appio_register_current[READ_BYTES]+= retval * size; // read bytes
@@ -296,50 +440,28 @@ size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
 
 ssize_t __write(int fd, const void *buf, size_t count);
 ssize_t write(int fd, const void *buf, size_t count) {
-  int retval;
+  ssize_t retval;
   SUBDBG("appio: intercepted write(%d,%p,%lu)\n", fd, buf, (unsigned long)count);
-  struct stat st;
-  int issocket = 0;
-  if (fstat(fd, &st) == 0) {
-    if ((st.st_mode & S_IFMT) == S_IFSOCK) issocket = 1;
-  }
 
-  // check if write would block on descriptor
-  fd_set writefds;
-  FD_ZERO(&writefds);
-  FD_SET(fd, &writefds);
-  int ready = __select(fd+1, NULL, &writefds, NULL, &zerotv);
-  if (ready == 0) {
-    _appio_register_current[WRITE_WOULD_BLOCK]++; 
-    if (issocket) _appio_register_current[SOCK_WRITE_WOULD_BLOCK]++; 
-  }
+  int issocket = _appio_is_socket(fd);
+  _appio_check_block(fd, 1, issocket);
 
   long long start_ts = PAPI_get_real_usec();
   retval = __write(fd,buf, count);
   long long duration = PAPI_get_real_usec() - start_ts;
-  int n = _appio_register_current[WRITE_CALLS]++; // write calls
-  if (issocket) _appio_register_current[SOCK_WRITE_CALLS]++; // socket write
-  if (retval >= 0) {
-    _appio_register_current[WRITE_BLOCK_SIZE]= (n * _appio_register_current[WRITE_BLOCK_SIZE] + count)/(n+1); // mean size
-    _appio_register_current[WRITE_BYTES]+= retval; // write bytes
-    if (issocket) _appio_register_current[SOCK_WRITE_BYTES] += retval;
-    if (retval < (int)count) {
-      _appio_register_current[WRITE_SHORT]++; // short write
-      if (issocket) _appio_register_current[SOCK_WRITE_SHORT]++; 
-    }
-    _appio_register_current[WRITE_USEC] += duration;
-    if (issocket) _appio_register_current[SOCK_WRITE_USEC] += duration;
-  }
-  if (retval < 0) {
-    _appio_register_current[WRITE_ERR]++; // err
-    if (issocket) _appio_register_current[SOCK_WRITE_ERR]++;
-    if (EINTR == errno)
-      _appio_register_current[WRITE_INTERRUPTED]++; // signal interrupted the op
-    //if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) {
-    //  _appio_register_current[WRITE_WOULD_BLOCK]++; //op would block on descriptor marked as non-blocking
-    //  if (issocket) _appio_register_current[SOCK_WRITE_WOULD_BLOCK]++;
-    //}
-  }
+  _appio_count_write(retval, count, issocket, duration);
+  return retval;
+}
+
+ssize_t __pwrite64(int fd, const void *buf, size_t count, __off64_t offset);
+ssize_t pwrite(int fd, const void *buf, size_t count, off_t offset) {
+  ssize_t retval;
+  SUBDBG("appio: intercepted pwrite(%d,%p,%lu,%ld)\n", fd, buf, (unsigned long)count, (long)offset);
+  long long start_ts = PAPI_get_real_usec();
+  retval = __pwrite64(fd, buf, count, (__off64_t) offset);
+  long long duration = PAPI_get_real_usec() - start_ts;
+  _appio_register_current[PWRITE_CALLS]++;
+  _appio_count_write(retval, count, 0, duration);
   return retval;
 }
 
@@ -365,6 +487,7 @@ ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
   retval = __recv(sockfd, buf, len, flags);
   long long duration = PAPI_get_real_usec() - start_ts;
   int n = _appio_register_current[RECV_CALLS]++; // read calls
+  _appio_count_latency(RECV_LAT, duration);
   if (retval > 0) {
     _appio_register_current[RECV_BLOCK_SIZE]= (n * _appio_register_current[RECV_BLOCK_SIZE] + len)/(n+1); // mean size
     _appio_register_current[RECV_BYTES] += retval; // read bytes
@@ -381,6 +504,152 @@ ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
   if (retval == 0) _appio_register_current[RECV_EOF]++; // read eof
   return retval;
 }
+
+/* libc exports no internal aliases for the calls below, so they
+   are only intercepted when PAPI is linked as a shared library */
+
+static ssize_t (*__readv)(int fd, const struct iovec *iov, int iovcnt) = NULL;
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+  ssize_t retval;
+  SUBDBG("appio: intercepted readv(%d,%p,%d)\n", fd, (void*) iov, iovcnt);
+  if (!__readv) __readv = _appio_next("readv");
+
+  int issocket = _appio_is_socket(fd);
+  _appio_check_block(fd, 0, issocket);
+
+  long long start_ts = PAPI_get_real_usec();
+  retval = __readv(fd, iov, iovcnt);
+  long long duration = PAPI_get_real_usec() - start_ts;
+  _appio_register_current[READV_CALLS]++;
+  _appio_count_read(retval, _appio_iov_bytes(iov, iovcnt), issocket, duration);
+  return retval;
+}
+
+static ssize_t (*__writev)(int fd, const struct iovec *iov, int iovcnt) = NULL;
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+  ssize_t retval;
+  SUBDBG("appio: intercepted writev(%d,%p,%d)\n", fd, (void*) iov, iovcnt);
+  if (!__writev) __writev = _appio_next("writev");
+
+  int issocket = _appio_is_socket(fd);
+  _appio_check_block(fd, 1, issocket);
+
+  long long start_ts = PAPI_get_real_usec();
+  retval = __writev(fd, iov, iovcnt);
+  long long duration = PAPI_get_real_usec() - start_ts;
+  _appio_register_current[WRITEV_CALLS]++;
+  _appio_count_write(retval, _appio_iov_bytes(iov, iovcnt), issocket, duration);
+  return retval;
+}
+
+static ssize_t (*__preadv)(int fd, const struct iovec *iov, int iovcnt, off_t offset) = NULL;
+ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+  ssize_t retval;
+  SUBDBG("appio: intercepted preadv(%d,%p,%d,%ld)\n", fd, (void*) iov, iovcnt, (long)offset);
+  if (!__preadv) __preadv = _appio_next("preadv");
+  long long start_ts = PAPI_get_real_usec();
+  retval = __preadv(fd, iov, iovcnt, offset);
+  long long duration = PAPI_get_real_usec() - start_ts;
+  _appio_register_current[PREAD_CALLS]++;
+  _appio_register_current[READV_CALLS]++;
+  _appio_count_read(retval, _appio_iov_bytes(iov, iovcnt), 0, duration);
+  return retval;
+}
+
+static ssize_t (*__pwritev)(int fd, const struct iovec *iov, int iovcnt, off_t offset) = NULL;
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+  ssize_t retval;
+  SUBDBG("appio: intercepted pwritev(%d,%p,%d,%ld)\n", fd, (void*) iov, iovcnt, (long)offset);
+  if (!__pwritev) __pwritev = _appio_next("pwritev");
+  long long start_ts = PAPI_get_real_usec();
+  retval = __pwritev(fd, iov, iovcnt, offset);
+  long long duration = PAPI_get_real_usec() - start_ts;
+  _appio_register_current[PWRITE_CALLS]++;
+  _appio_register_current[WRITEV_CALLS]++;
+  _appio_count_write(retval, _appio_iov_bytes(iov, iovcnt), 0, duration);
+  return retval;
+}
+
+/* preadv2/pwritev2 appeared in glibc 2.26, together with the RWF_ flags */
+#ifdef RWF_HIPRI
+static ssize_t (*__preadv2)(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags) = NULL;
+ssize_t preadv2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags) {
+  ssize_t retval;
+  SUBDBG("appio: intercepted preadv2(%d,%p,%d,%ld,%d)\n", fd, (void*) iov, iovcnt, (long)offset, flags);
+  if (!__preadv2) __preadv2 = _appio_next("preadv2");
+  long long start_ts = PAPI_get_real_usec();
+  retval = __preadv2(fd, iov, iovcnt, offset, flags);
+  long long duration = PAPI_get_real_usec() - start_ts;
+  _appio_register_current[PREAD_CALLS]++;
+  _appio_register_current[READV_CALLS]++;
+  _appio_count_read(retval, _appio_iov_bytes(iov, iovcnt), 0, duration);
+  return retval;
+}
+
+static ssize_t (*__pwritev2)(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags) = NULL;
+ssize_t pwritev2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags) {
+  ssize_t retval;
+  SUBDBG("appio: intercepted pwritev2(%d,%p,%d,%ld,%d)\n", fd, (void*) iov, iovcnt, (long)offset, flags);
+  if (!__pwritev2) __pwritev2 = _appio_next("pwritev2");
+  long long start_ts = PAPI_get_real_usec();
+  retval = __pwritev2(fd, iov, iovcnt, offset, flags);
+  long long duration = PAPI_get_real_usec() - start_ts;
+  _appio_register_current[PWRITE_CALLS]++;
+  _appio_register_current[WRITEV_CALLS]++;
+  _appio_count_write(retval, _appio_iov_bytes(iov, iovcnt), 0, duration);
+  return retval;
+}
+#endif /* RWF_HIPRI */
+
+/* account a sendfile/splice that returned retval after duration usec */
+static void _appio_count_xfer(ssize_t retval, long long duration) {
+  _appio_register_current[XFER_CALLS]++;
+  _appio_count_latency(XFER_LAT, duration);
+  if (retval >= 0) {
+    _appio_register_current[XFER_BYTES] += retval;
+    _appio_register_current[XFER_USEC] += duration;
+  }
+  else _appio_register_current[XFER_ERR]++;
+}
+
+static ssize_t (*__sendfile)(int out_fd, int in_fd, off_t *offset, size_t count) = NULL;
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+  ssize_t retval;
+  SUBDBG("appio: intercepted sendfile(%d,%d,%p,%lu)\n", out_fd, in_fd, (void*) offset, (unsigned long)count);
+  if (!__sendfile) __sendfile = _appio_next("sendfile");
+  long long start_ts = PAPI_get_real_usec();
+  retval = __sendfile(out_fd, in_fd, offset, count);
+  long long duration = PAPI_get_real_usec() - start_ts;
+  _appio_count_xfer(retval, duration);
+  return retval;
+}
+
+static ssize_t (*__splice)(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags) = NULL;
+ssize_t splice(int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags) {
+  ssize_t retval;
+  SUBDBG("appio: intercepted splice(%d,%p,%d,%p,%lu,%u)\n", fd_in, (void*) off_in, fd_out, (void*) off_out, (unsigned long)len, flags);
+  if (!__splice) __splice = _appio_next("splice");
+  long long start_ts = PAPI_get_real_usec();
+  retval = __splice(fd_in, off_in, fd_out, off_out, len, flags);
+  long long duration = PAPI_get_real_usec() - start_ts;
+  _appio_count_xfer(retval, duration);
+  return retval;
+}
+
+/* The I/O done through a mapping happens in page faults, which can not
+   be intercepted, so only the mappings of files themselves are counted */
+static void *(*__mmap)(void *addr, size_t length, int prot, int flags, int fd, off_t offset) = NULL;
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+  void *retval;
+  if (!__mmap) __mmap = _appio_next("mmap");
+  retval = __mmap(addr, length, prot, flags, fd, offset);
+  if ((fd >= 0) && !(flags & MAP_ANONYMOUS)) {
+    SUBDBG("appio: intercepted mmap(%p,%lu,%d,%d,%d,%ld)\n", addr, (unsigned long)length, prot, flags, fd, (long)offset);
+    _appio_register_current[MMAP_CALLS]++;
+    if (retval != MAP_FAILED) _appio_register_current[MMAP_BYTES] += length;
+  }
+  return retval;
+}
 #endif /* PIC */
 
 size_t _IO_fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream);
@@ -391,6 +660,7 @@ size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
   retval = _IO_fwrite(ptr,size,nmemb,stream);
   long long duration = PAPI_get_real_usec() - start_ts;
   int n = _appio_register_current[WRITE_CALLS]++; // write calls
+  _appio_count_latency(WRITE_LAT, duration);
   if (retval > 0) {
     _appio_register_current[WRITE_BLOCK_SIZE]= (n * _appio_register_current[WRITE_BLOCK_SIZE] + size*nmemb)/(n+1); // mean block size
     _appio_register_current[WRITE_BYTES]+= retval * size; // write bytes
@@ -401,6 +671,8 @@ size_t fwrite(const void *ptr, size_t size, size_t nmemb, FILE *stream) {
   return retval;
 }
 
+#pragma GCC visibility pop
+
 
 /*********************************************************************
  ***************  BEGIN PAPI's COMPONENT REQUIRED FUNCTIONS  *********
@@ -434,11 +706,36 @@ _appio_init_component( int cidx  )
       return PAPI_ENOMEM;
     }
     int i;
-    for (i=0; i<APPIO_MAX_COUNTERS; i++) {
+    for (i=0; i<APPIO_BASIC_COUNTERS; i++) {
       _appio_native_events[i].name = _appio_counter_info[i].name;
       _appio_native_events[i].description = _appio_counter_info[i].description;
       _appio_native_events[i].resources.selector = i + 1;
     }
+
+    /* CLASS_LAT_<n>US counts the calls that took n usec up to 2n usec */
+    for (i=0; i<APPIO_LAT_CLASSES * APPIO_LAT_BUCKETS; i++) {
+      const struct appio_lat_classes *lat = &_appio_lat_info[i / APPIO_LAT_BUCKETS];
+      int bucket = i % APPIO_LAT_BUCKETS;
+      long long low = bucket ? 1LL << (bucket - 1) : 0;
+
+      snprintf(_appio_lat_names[i], PAPI_MIN_STR_LEN, "%s_LAT_%lldUS", lat->prefix, low);
+      if (bucket == 0)
+        snprintf(_appio_lat_descrs[i], PAPI_MAX_STR_LEN,
+                 "Number of %s calls that took less than 1 real microsecond", lat->calls);
+      else if (bucket == 1)
+        snprintf(_appio_lat_descrs[i], PAPI_MAX_STR_LEN,
+                 "Number of %s calls that took 1 real microsecond", lat->calls);
+      else if (bucket == APPIO_LAT_BUCKETS - 1)
+        snprintf(_appio_lat_descrs[i], PAPI_MAX_STR_LEN,
+                 "Number of %s calls that took %lld or more real microseconds", lat->calls, low);
+      else
+        snprintf(_appio_lat_descrs[i], PAPI_MAX_STR_LEN,
+                 "Number of %s calls that took %lld to %lld real microseconds", lat->calls, low, 2 * low - 1);
+
+      _appio_native_events[READ_LAT + i].name = _appio_lat_names[i];
+      _appio_native_events[READ_LAT + i].description = _appio_lat_descrs[i];
+      _appio_native_events[READ_LAT + i].resources.selector = READ_LAT + i + 1;
+    }
   
     /* Export the total number of events available */
     _appio_vector.cmp_info.num_native_events = APPIO_MAX_COUNTERS;;
@@ -660,7 +957,7 @@ _appio_ntv_name_to_code( const char *name, unsigned int *EventCode )
     int i;
 
     for ( i=0; i<APPIO_MAX_COUNTERS; i++) {
-        if (strcmp(name, _appio_counter_info[i].name) == 0) {
+        if (strcmp(name, _appio_native_events[i].name) == 0) {
             *EventCode = i;
             return PAPI_OK;
         }
@@ -679,7 +976,7 @@ _appio_ntv_code_to_name( unsigned int EventCode, char *name, int len )
     int index = EventCode;
 
     if ( index >= 0 && index < APPIO_MAX_COUNTERS ) {
-        strncpy( name, _appio_counter_info[index].name, len );
+        strncpy( name, _appio_native_events[index].name, len );
         return PAPI_OK;
     }
 
@@ -696,7 +993,7 @@ _appio_ntv_code_to_descr( unsigned int EventCode, char *desc, int len )
     int index = EventCode;
 
     if ( index >= 0 && index < APPIO_MAX_COUNTERS ) {
-        strncpy(desc, _appio_counter_info[index].description, len );
+        strncpy(desc, _appio_native_events[index].description, len );
         return PAPI_OK;
     }
 
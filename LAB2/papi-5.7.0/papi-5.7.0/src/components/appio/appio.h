@@ -29,7 +29,15 @@
 /*************************  DEFINES SECTION  ***********************************/
 
 /* Set this equal to the number of elements in _appio_counter_info array */
-#define APPIO_MAX_COUNTERS 45
+#define APPIO_BASIC_COUNTERS 55
+
+/* Latency histograms: one per call class (read, write, recv, sendfile/splice),
+ * bucket 0 counts calls under 1 usec, bucket k>0 those of 2^(k-1) usec up to
+ * 2^k usec, the last bucket also everything slower */
+#define APPIO_LAT_CLASSES 4
+#define APPIO_LAT_BUCKETS 16
+
+#define APPIO_MAX_COUNTERS (APPIO_BASIC_COUNTERS + APPIO_LAT_CLASSES * APPIO_LAT_BUCKETS)
 
 /** Structure that stores private information of each event */
 typedef struct APPIO_register
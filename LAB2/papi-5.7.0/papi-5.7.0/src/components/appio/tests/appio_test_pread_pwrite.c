@@ -0,0 +1,109 @@
+/*
+ * Test case for appio
+ *
+ * Description: This test case copies /etc/group into a temporary
+ *              file using pread and pwrite, and checks that every
+ *              read landed in exactly one READ_LAT_* bucket.
+ */
+#include <papi.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define NUM_CALLS 6
+#define NUM_BUCKETS 16
+#define NUM_EVENTS (NUM_CALLS + NUM_BUCKETS)
+
+int main(int argc, char** argv) {
+  int Events[NUM_EVENTS];
+  const char* calls[NUM_CALLS] = {"READ_CALLS", "PREAD_CALLS", "READ_BYTES", "WRITE_CALLS", "PWRITE_CALLS", "WRITE_BYTES"};
+  char names[NUM_EVENTS][PAPI_MIN_STR_LEN];
+  long long values[NUM_EVENTS];
+  long long total;
+
+  char *infile = "/etc/group";
+  char outfile[] = "/tmp/appio_test_pread_pwrite.XXXXXX";
+
+  /* Set TESTS_QUIET variable */
+  tests_quiet( argc, argv );
+
+  int version = PAPI_library_init (PAPI_VER_CURRENT);
+  if (version != PAPI_VER_CURRENT) {
+    fprintf(stderr, "PAPI_library_init version mismatch\n");
+    exit(1);
+  }
+
+  int retval;
+  int e;
+  for (e=0; e<NUM_CALLS; e++)
+    snprintf(names[e], PAPI_MIN_STR_LEN, "%s", calls[e]);
+  for (e=0; e<NUM_BUCKETS; e++)
+    snprintf(names[NUM_CALLS+e], PAPI_MIN_STR_LEN, "READ_LAT_%lldUS", e ? 1LL << (e-1) : 0);
+
+  for (e=0; e<NUM_EVENTS; e++) {
+    retval = PAPI_event_name_to_code(names[e], &Events[e]);
+    if (retval != PAPI_OK) {
+      fprintf(stderr, "Error getting code for %s\n", names[e]);
+      exit(2);
+    }
+  }
+
+  int fdin = open(infile, O_RDONLY);
+  if (fdin < 0) {
+    perror("Could not open file for reading: \n");
+    exit(1);
+  }
+  int fdout = mkstemp(outfile);
+  if (fdout < 0) {
+    perror("Could not create temporary file: \n");
+    exit(1);
+  }
+
+  /* Start counting events */
+  if (PAPI_start_counters(Events, NUM_EVENTS) != PAPI_OK) {
+    fprintf(stderr, "Error in PAPI_start_counters\n");
+    exit(1);
+  }
+
+  ssize_t bytes;
+  off_t offset = 0;
+  char buf[64];
+  while ((bytes = pread(fdin, buf, sizeof(buf), offset)) > 0) {
+    if (pwrite(fdout, buf, bytes, offset) != bytes) break;
+    offset += bytes;
+  }
+
+  /* Stop counting events */
+  if (PAPI_stop_counters(values, NUM_EVENTS) != PAPI_OK) {
+    fprintf(stderr, "Error in PAPI_stop_counters\n");
+    exit(1);
+  }
+
+  close(fdin);
+  close(fdout);
+  unlink(outfile);
+
+  if (!TESTS_QUIET) {
+    printf("----\n");
+    for (e=0; e<NUM_EVENTS; e++)
+      printf("%s: %lld\n", names[e], values[e]);
+  }
+
+  total = 0;
+  for (e=0; e<NUM_BUCKETS; e++) total += values[NUM_CALLS+e];
+
+  if ((values[0] != values[1]) || (values[3] != values[4]) ||
+      (values[2] != offset) || (values[5] != offset) || (total != values[0])) {
+    test_fail( __FILE__, __LINE__, "pread/pwrite counts do not add up", PAPI_EMISC );
+  }
+
+  test_pass( __FILE__ );
+  return 0;
+}
@@ -1,4 +1,6 @@
 #include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
 
 /* Headers required by PAPI */
 #include "papi.h"
@@ -12,6 +14,13 @@
  * but I have not explored this widely yet*/
 #define REFRESH_LAT 4000
 
+/* hwmon drivers typically only update about once a second, so the
+ * minimum time between reads (usec) can be raised with this variable
+ */
+#define REFRESH_LAT_ENV "PAPI_CORETEMP_REFRESH"
+
+static long long refresh_lat = REFRESH_LAT;
+
 #define INVALID_RESULT -1000000L
 
 papi_vector_t _coretemp_vector;
@@ -311,28 +320,51 @@ done_error:
 static long long
 getEventValue( int index ) 
 {
-    char buf[PAPI_MAX_STR_LEN];
-    FILE* fp;
-    long result;
+    CORETEMP_native_event_entry_t *event = &_coretemp_native_events[index];
+    char buf[PAPI_MIN_STR_LEN];
+    ssize_t bytes;
+    int fd;
 
-    if (_coretemp_native_events[index].stone) {
-       return _coretemp_native_events[index].value;
+    if (event->stone) {
+       return event->value;
     }
 
-    fp = fopen(_coretemp_native_events[index].path, "r");
-    if (fp==NULL) {
-       return INVALID_RESULT;
+    /* The sysfs file is opened on first use and then kept open,  */
+    /* sysfs regenerates the value on every read from offset 0.   */
+    fd = event->fd;
+    if (fd < 0) {
+       fd = open(event->path, O_RDONLY);
+       if (fd < 0) {
+          return INVALID_RESULT;
+       }
+       /* another thread may have beaten us to it */
+       if (!__sync_bool_compare_and_swap(&event->fd, -1, fd)) {
+          close(fd);
+          fd = event->fd;
+       }
     }
 
-    if (fgets(buf, PAPI_MAX_STR_LEN, fp)==NULL) {
-        result=INVALID_RESULT;
-    }
-    else {
-        result=strtoll(buf, NULL, 10);
+    bytes = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (bytes <= 0) {
+       return INVALID_RESULT;
     }
-    fclose(fp);
+    buf[bytes] = '\0';
 
-    return result;
+    return strtoll(buf, NULL, 10);
+}
+
+/*
+ * refresh every event of an EventSet in one pass
+ */
+static void
+refreshEventValues( CORETEMP_control_state_t *control, long long now )
+{
+    int i;
+
+    for ( i = 0; i < control->num_events; i++ ) {
+	control->counts[i] = getEventValue( control->which[i] );
+    }
+    control->lastupdate = now;
 }
 
 /*****************************************************************************
@@ -360,12 +392,20 @@ _coretemp_init_component( int cidx )
 {
      int i = 0;
      struct temp_event *t,*last;
+     char *env;
 
      if ( is_initialized )
 	return (PAPI_OK );
 
      is_initialized = 1;
 
+     env = getenv( REFRESH_LAT_ENV );
+     if ( env != NULL ) {
+	refresh_lat = strtoll( env, NULL, 10 );
+	SUBDBG("Refreshing coretemp values at most every %lld usec\n",
+	       refresh_lat);
+     }
+
      /* This is the prefered method, all coretemp sensors are symlinked here
       * see $(kernel_src)/Documentation/hwmon/sysfs-interface */
   
@@ -398,6 +438,7 @@ _coretemp_init_component( int cidx )
 	strncpy(_coretemp_native_events[i].description,t->description,PAPI_MAX_STR_LEN);
         _coretemp_native_events[i].description[PAPI_MAX_STR_LEN-1] = '\0';
 	_coretemp_native_events[i].stone = 0;
+	_coretemp_native_events[i].fd = -1;
 	_coretemp_native_events[i].resources.selector = i + 1;
 	last	= t;
 	t		= t->next;
@@ -425,16 +466,11 @@ _coretemp_init_component( int cidx )
 static int
 _coretemp_init_control_state( hwd_control_state_t * ctl)
 {
-    int i;
-
     CORETEMP_control_state_t *coretemp_ctl = (CORETEMP_control_state_t *) ctl;
 
-    for ( i=0; i < num_events; i++ ) {
-	coretemp_ctl->counts[i] = getEventValue(i);
-    }
-
-    /* Set last access time for caching results */
-    coretemp_ctl->lastupdate = PAPI_get_real_usec();
+    /* Nothing is cached until the first read */
+    coretemp_ctl->num_events = 0;
+    coretemp_ctl->lastupdate = 0;
 
     return PAPI_OK;
 }
@@ -457,16 +493,12 @@ _coretemp_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
 
     CORETEMP_control_state_t* control = (CORETEMP_control_state_t*) ctl;
     long long now = PAPI_get_real_usec();
-    int i;
 
     /* Only read the values from the kernel if enough time has passed */
     /* since the last read.  Otherwise return cached values.          */
 
-    if ( now - control->lastupdate > REFRESH_LAT ) {
-	for ( i = 0; i < num_events; i++ ) {
-	   control->counts[i] = getEventValue( i );
-	}
-	control->lastupdate = now;
+    if ( now - control->lastupdate > refresh_lat ) {
+	refreshEventValues( control, now );
     }
 
     /* Pass back a pointer to our results */
@@ -481,11 +513,8 @@ _coretemp_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
     (void) ctx;
     /* read values */
     CORETEMP_control_state_t* control = (CORETEMP_control_state_t*) ctl;
-    int i;
 
-    for ( i = 0; i < num_events; i++ ) {
-	control->counts[i] = getEventValue( i );
-    }
+    refreshEventValues( control, PAPI_get_real_usec() );
 
     return PAPI_OK;
 }
@@ -505,8 +534,15 @@ _coretemp_shutdown_thread( hwd_context_t * ctx )
 static int
 _coretemp_shutdown_component( ) 
 {
+    int i;
+
     if ( is_initialized ) {
        is_initialized = 0;
+       for ( i = 0; i < num_events; i++ ) {
+	  if ( _coretemp_native_events[i].fd >= 0 ) {
+	     close( _coretemp_native_events[i].fd );
+	  }
+       }
        papi_free(_coretemp_native_events);
        _coretemp_native_events = NULL;
     }
@@ -536,12 +572,20 @@ _coretemp_update_control_state(	hwd_control_state_t *ptr,
 {
     int i, index;
     ( void ) ctx;
-    ( void ) ptr;
 
+    CORETEMP_control_state_t *control = (CORETEMP_control_state_t *) ptr;
+
+    /* Only the events in the EventSet are refreshed on read */
     for ( i = 0; i < count; i++ ) {
 	index = native[i].ni_event;
-	native[i].ni_position = _coretemp_native_events[index].resources.selector - 1;
+	native[i].ni_position = i;
+	control->which[i] = _coretemp_native_events[index].resources.selector - 1;
     }
+    control->num_events = count;
+
+    /* Make the next read go to the kernel */
+    control->lastupdate = 0;
+
     return PAPI_OK;
 }
 
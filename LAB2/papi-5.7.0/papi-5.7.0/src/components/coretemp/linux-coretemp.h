@@ -59,6 +59,7 @@ typedef struct CORETEMP_native_event_entry
   char path[PATH_MAX];
   int stone; /* some counters are set in stone, a max temperature is just that... */
   long value;
+  int fd;    /* kept open once read, -1 until then */
   CORETEMP_register_t resources;
 } CORETEMP_native_event_entry_t;
 
@@ -70,6 +71,8 @@ typedef struct CORETEMP_reg_alloc
 
 typedef struct CORETEMP_control_state
 {
+	int num_events;
+	int which[CORETEMP_MAX_COUNTERS];		// native event at each position
 	long long counts[CORETEMP_MAX_COUNTERS];	// used for caching
 	long long lastupdate;
 } CORETEMP_control_state_t;
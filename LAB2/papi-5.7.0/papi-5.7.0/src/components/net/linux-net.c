@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <net/if.h>
 
 /* Headers required by PAPI */
@@ -43,10 +45,10 @@ papi_vector_t _net_vector;
 
 #define NET_PROC_FILE          "/proc/net/dev"
 
-/* /proc/net/dev line size
- * interface name + 8 RX counters + 8 TX counters + separators
+/* initial size of the buffer /proc/net/dev is read into,
+ * it is doubled whenever the file does not fit
  */
-#define NET_PROC_MAX_LINE      (IFNAMSIZ + 16 * (20 + 1) + 16)
+#define NET_PROC_BUFSIZE       4096
 
 #define NET_INVALID_RESULT     -1
 
@@ -56,16 +58,16 @@ static NET_native_event_entry_t * _net_native_events=NULL;
 static int num_events       = 0;
 static int is_initialized   = 0;
 
-static long long _net_register_start[NET_MAX_COUNTERS];
-static long long _net_register_current[NET_MAX_COUNTERS];
+/* /proc/net/dev stays open, every read is a pread from offset 0 */
+static int net_fd = -1;
 
-/* temporary event */
-struct temp_event {
-    char name[PAPI_MAX_STR_LEN];
-    char description[PAPI_MAX_STR_LEN];
-    struct temp_event *next;
-};
-static struct temp_event* root = NULL;
+/* interface names, event i is counter i % 16 of interface i / 16 */
+static char **net_ifnames = NULL;
+static int num_ifs = 0;
+
+/* open addressing hash of net_ifnames, slots hold index+1 */
+static int *net_if_hash = NULL;
+static unsigned int net_if_mask = 0;
 
 /* /proc/net/dev: network counters by interface */
 #define NET_INTERFACE_COUNTERS 16
@@ -100,181 +102,324 @@ static const struct net_counters {
  ********************************************************************/
 
 /*
- * find all network interfaces listed in /proc/net/dev
+ * read all of /proc/net/dev into *buf (NUL terminated), growing it
+ * as needed; returns the number of bytes read or NET_INVALID_RESULT
  */
-static int
-generateNetEventList( void )
+static ssize_t
+read_proc_net_dev( char **buf, size_t *bufsize )
 {
-    FILE *fin;
-    char line[NET_PROC_MAX_LINE];
-    char *retval, *ifname;
-    int count = 0;
-    struct temp_event *temp;
-    struct temp_event *last = NULL;
-    int i, j;
-
-    fin = fopen(NET_PROC_FILE, "r");
-    if (fin == NULL) {
-        SUBDBG("Can't find %s, are you sure the /proc file-system is mounted?\n",
-           NET_PROC_FILE);
-        return 0;
+    ssize_t bytes;
+    char *bigger;
+
+    if (*buf == NULL) {
+        *buf = papi_malloc(NET_PROC_BUFSIZE);
+        if (*buf == NULL) {
+            return NET_INVALID_RESULT;
+        }
+        *bufsize = NET_PROC_BUFSIZE;
     }
 
-    /* skip the 2 header lines */
-    for (i=0; i<2; i++) {
-        retval = fgets (line, NET_PROC_MAX_LINE, fin);
-        if (retval == NULL) {
-        	fclose(fin);
-            SUBDBG("Not enough lines in %s\n", NET_PROC_FILE);
-            return 0;
+    while (1) {
+        bytes = pread(net_fd, *buf, *bufsize - 1, 0);
+        if (bytes < 0) {
+            SUBDBG("Error reading %s\n", NET_PROC_FILE);
+            return NET_INVALID_RESULT;
         }
+        if ((size_t)bytes < *bufsize - 1) {
+            break;
+        }
+
+        /* a full buffer may mean there is more, try a bigger one */
+        bigger = papi_malloc(*bufsize * 2);
+        if (bigger == NULL) {
+            return NET_INVALID_RESULT;
+        }
+        papi_free(*buf);
+        *buf = bigger;
+        *bufsize *= 2;
     }
 
-    while ((fgets (line, NET_PROC_MAX_LINE, fin)) == line) {
+    (*buf)[bytes] = '\0';
 
-        /* split the interface name from the 16 counters */
-        retval = strstr(line, ":");
-        if (retval == NULL) {
-            SUBDBG("Wrong line format <%s>\n", line);
-            continue;
+    return bytes;
+}
+
+
+/* skip the 2 header lines of /proc/net/dev */
+static char *
+skip_header( char *buf )
+{
+    int i;
+
+    for (i=0; i<2 && buf != NULL; i++) {
+        buf = strchr(buf, '\n');
+        if (buf != NULL) {
+            buf++;
         }
+    }
 
-        *retval = '\0';
-        ifname = line;
-        while (isspace(*ifname)) { ifname++; }
+    if (buf == NULL) {
+        SUBDBG("Not enough lines in %s\n", NET_PROC_FILE);
+    }
 
-        for (j=0; j<NET_INTERFACE_COUNTERS; j++) {
+    return buf;
+}
+
+
+/*
+ * split the /proc/net/dev line at *line into its interface name and
+ * counters, advancing *line to the next one; returns a pointer to
+ * the counters, or NULL at the end of the buffer
+ */
+static char *
+next_interface( char **line, char **ifname, size_t *len )
+{
+    char *p = *line, *colon, *eol;
+
+    while (*p != '\0') {
+        eol = strchr(p, '\n');
+        *line = (eol == NULL) ? p + strlen(p) : eol + 1;
+
+        colon = memchr(p, ':', *line - p);
+        if (colon != NULL) {
+            while (isspace(*p)) { p++; }
+            *ifname = p;
+            *len = colon - p;
+            return colon + 1;
+        }
+
+        SUBDBG("Wrong line format in %s\n", NET_PROC_FILE);
+        p = *line;
+    }
+
+    return NULL;
+}
+
+
+/* FNV-1a over an interface name */
+static unsigned int
+net_if_hashval( const char *name, size_t len )
+{
+    unsigned int h = 2166136261U;
 
-            /* keep the interface name around */
-            temp = (struct temp_event *)papi_malloc(sizeof(struct temp_event));
-            if (!temp) {
+    while (len--) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+
+/* index of the interface called name[0..len), or -1 */
+static int
+net_if_lookup( const char *name, size_t len )
+{
+    unsigned int slot;
+    int index;
+
+    if (net_if_hash == NULL) {
+        return -1;
+    }
+
+    for (slot = net_if_hashval(name, len); ; slot++) {
+        index = net_if_hash[slot & net_if_mask] - 1;
+        if (index < 0) {
+            return -1;
+        }
+        if ((strncmp(net_ifnames[index], name, len) == 0) &&
+            (net_ifnames[index][len] == '\0')) {
+            return index;
+        }
+    }
+}
+
+
+/*
+ * find all network interfaces listed in /proc/net/dev, build their
+ * hash and the native event table; returns the number of events
+ */
+static int
+generateNetEventList( void )
+{
+    char *buf = NULL, *line, *ifname;
+    size_t bufsize = 0, len;
+    int i, j, size, max_ifs = 0;
+    unsigned int slot;
+    char **names;
+
+    if (read_proc_net_dev(&buf, &bufsize) < 0) {
+        if (buf != NULL) papi_free(buf);
+        return 0;
+    }
+
+    line = skip_header(buf);
+
+    while (line != NULL && next_interface(&line, &ifname, &len) != NULL) {
+
+        if (num_ifs == max_ifs) {
+            max_ifs = (max_ifs == 0) ? 32 : 2 * max_ifs;
+            names = realloc(net_ifnames, max_ifs * sizeof(char *));
+            if (names == NULL) {
                 PAPIERROR("out of memory!");
-                fclose(fin);
+                papi_free(buf);
                 return PAPI_ENOMEM;
             }
-            temp->next = NULL;
+            net_ifnames = names;
+        }
 
-            if (root == NULL) {
-                root = temp;
-            } else if (last) {
-                last->next = temp;
-            } else {
-                free(temp);
-                fclose(fin);
-                PAPIERROR("This shouldn't be possible\n");
-                return PAPI_ECMP;
-            }
-            last = temp;
+        net_ifnames[num_ifs] = strndup(ifname, len);
+        if (net_ifnames[num_ifs] == NULL) {
+            PAPIERROR("out of memory!");
+            papi_free(buf);
+            return PAPI_ENOMEM;
+        }
+        num_ifs++;
+    }
 
-            snprintf(temp->name, PAPI_MAX_STR_LEN, "%s:%s",
-                    ifname, _net_counter_info[j].name);
-            snprintf(temp->description, PAPI_MAX_STR_LEN, "%s %s",
-                    ifname, _net_counter_info[j].description);
+    papi_free(buf);
 
-            count++;
-        }
+    if (num_ifs == 0) {
+        return 0;
+    }
+
+    /* keep the hash at most half full */
+    for (size = 64; size < 2 * num_ifs; size *= 2);
+    net_if_hash = calloc(size, sizeof(int));
+    _net_native_events = (NET_native_event_entry_t*)
+        papi_malloc(sizeof(NET_native_event_entry_t) *
+                    num_ifs * NET_INTERFACE_COUNTERS);
+    if (net_if_hash == NULL || _net_native_events == NULL) {
+        PAPIERROR("out of memory!");
+        return PAPI_ENOMEM;
     }
+    net_if_mask = size - 1;
 
-    fclose(fin);
+    for (i=0; i<num_ifs; i++) {
+        slot = net_if_hashval(net_ifnames[i], strlen(net_ifnames[i]));
+        while (net_if_hash[slot & net_if_mask]) { slot++; }
+        net_if_hash[slot & net_if_mask] = i + 1;
 
-    return count;
+        for (j=0; j<NET_INTERFACE_COUNTERS; j++) {
+            NET_native_event_entry_t *e =
+                &_net_native_events[i * NET_INTERFACE_COUNTERS + j];
+
+            snprintf(e->name, PAPI_MAX_STR_LEN, "%s:%s",
+                    net_ifnames[i], _net_counter_info[j].name);
+            snprintf(e->description, PAPI_MAX_STR_LEN, "%s %s",
+                    net_ifnames[i], _net_counter_info[j].description);
+            e->resources.selector = i * NET_INTERFACE_COUNTERS + j + 1;
+        }
+    }
+
+    return num_ifs * NET_INTERFACE_COUNTERS;
 }
 
 
-static int
-getInterfaceBaseIndex(const char *ifname)
+/* parse the unsigned decimal number at *p, leaving *p after it */
+static inline int
+scan_counter( char **p, long long *value )
 {
-    int i;
+    char *s = *p;
+    unsigned long long v = 0;
 
-    for ( i=0; i<num_events; i+=NET_INTERFACE_COUNTERS ) {
-        if (strncmp(_net_native_events[i].name, ifname, strlen(ifname)) == 0) {
-            return i;
-        }
+    while (*s == ' ') { s++; }
+    if (*s < '0' || *s > '9') {
+        return 0;
+    }
+    while (*s >= '0' && *s <= '9') {
+        v = v * 10 + (*s - '0');
+        s++;
     }
 
-    return -1;  /* Not found */
+    *p = s;
+    *value = (long long)v;
+    return 1;
 }
 
 
+/*
+ * read the counters of the events in ctl into values (one per position),
+ * only parsing the lines of the interfaces those events are on; the
+ * values of interfaces that have gone away are left untouched
+ */
 static int
-read_net_counters( long long *values )
+read_net_counters( NET_context_t *ctx, NET_control_state_t *ctl,
+        long long *values )
 {
-    FILE *fin;
-    char line[NET_PROC_MAX_LINE];
-    char *retval, *ifname, *data;
-    int i, nf, if_bidx;
+    long long counters[NET_INTERFACE_COUNTERS];
+    char *line, *ifname, *data;
+    size_t len;
+    int i, j, ifidx, found = 0;
 
-    fin = fopen(NET_PROC_FILE, "r");
-    if (fin == NULL) {
-        SUBDBG("Can't find %s, are you sure the /proc file-system is mounted?\n",
-           NET_PROC_FILE);
-        return NET_INVALID_RESULT;
+    if (ctl->num_ifs == 0) {
+        return 0;
     }
 
-    /* skip the 2 header lines */
-    for (i=0; i<2; i++) {
-        retval = fgets (line, NET_PROC_MAX_LINE, fin);
-        if (retval == NULL) {
-            SUBDBG("Not enough lines in %s\n", NET_PROC_FILE);
-			fclose(fin);
-            return 0;
-        }
+    if (read_proc_net_dev(&ctx->buf, &ctx->bufsize) < 0) {
+        return NET_INVALID_RESULT;
     }
 
-    while ((fgets (line, NET_PROC_MAX_LINE, fin)) == line) {
+    line = skip_header(ctx->buf);
+
+    while (line != NULL &&
+           (data = next_interface(&line, &ifname, &len)) != NULL) {
 
-        /* split the interface name from its 16 counters */
-        retval = strstr(line, ":");
-        if (retval == NULL) {
-            SUBDBG("Wrong line format <%s>\n", line);
+        ifidx = net_if_lookup(ifname, len);
+        if (ifidx < 0) {
+            SUBDBG("Interface <%.*s> not found\n", (int)len, ifname);
             continue;
         }
 
-        *retval = '\0';
-        data = retval + 1;
-        ifname = line;
-        while (isspace(*ifname)) { ifname++; }
-
-        if_bidx = getInterfaceBaseIndex(ifname);
-        if (if_bidx < 0) {
-            SUBDBG("Interface <%s> not found\n", ifname);
-        } else {
-            nf = sscanf( data,
-                "%lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld\n",
-                &values[if_bidx + 0],  &values[if_bidx + 1],
-                &values[if_bidx + 2],  &values[if_bidx + 3],
-                &values[if_bidx + 4],  &values[if_bidx + 5],
-                &values[if_bidx + 6],  &values[if_bidx + 7],
-                &values[if_bidx + 8],  &values[if_bidx + 9],
-                &values[if_bidx + 10], &values[if_bidx + 11],
-                &values[if_bidx + 12], &values[if_bidx + 13],
-                &values[if_bidx + 14], &values[if_bidx + 15]);
-
-            SUBDBG("\nRead "
-                "%lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld %lld\n",
-                values[if_bidx + 0],  values[if_bidx + 1],
-                values[if_bidx + 2],  values[if_bidx + 3],
-                values[if_bidx + 4],  values[if_bidx + 5],
-                values[if_bidx + 6],  values[if_bidx + 7],
-                values[if_bidx + 8],  values[if_bidx + 9],
-                values[if_bidx + 10], values[if_bidx + 11],
-                values[if_bidx + 12], values[if_bidx + 13],
-                values[if_bidx + 14], values[if_bidx + 15]);
-
-            if ( nf != NET_INTERFACE_COUNTERS ) {
+        for (i=0; i<ctl->num_ifs; i++) {
+            if (ctl->ifs[i] == ifidx) break;
+        }
+        if (i == ctl->num_ifs) {
+            continue;
+        }
+
+        for (j=0; j<NET_INTERFACE_COUNTERS; j++) {
+            if (!scan_counter(&data, &counters[j])) {
                 /* This shouldn't happen */
                 SUBDBG("/proc line with wrong number of fields\n");
+                break;
             }
         }
 
-    }
+        if (j == NET_INTERFACE_COUNTERS) {
+            for (i=0; i<ctl->num_events; i++) {
+                if (ctl->which[i] / NET_INTERFACE_COUNTERS == ifidx) {
+                    values[i] = counters[ctl->which[i] % NET_INTERFACE_COUNTERS];
+                }
+            }
+        }
 
-    fclose(fin);
+        /* stop once every interface we want was seen */
+        if (++found == ctl->num_ifs) {
+            break;
+        }
+    }
 
     return 0;
 }
 
 
+/* refresh the values of ctl, relative to when it was started */
+static void
+update_net_values( NET_context_t *ctx, NET_control_state_t *ctl )
+{
+    long long current[NET_MAX_COUNTERS];
+    int i;
+
+    memcpy(current, ctl->start, ctl->num_events * sizeof(current[0]));
+
+    if (read_net_counters(ctx, ctl, current) == 0) {
+        for (i=0; i<ctl->num_events; i++) {
+            ctl->values[i] = current[i] - ctl->start[i];
+        }
+    }
+}
+
+
 /*********************************************************************
  ***************  BEGIN PAPI's COMPONENT REQUIRED FUNCTIONS  *********
  *********************************************************************/
@@ -285,7 +430,10 @@ read_net_counters( long long *values )
 static int
 _net_init_thread( hwd_context_t *ctx )
 {
-    ( void ) ctx;
+    NET_context_t *net_ctx = (NET_context_t *) ctx;
+
+    net_ctx->buf = NULL;
+    net_ctx->bufsize = 0;
 
     return PAPI_OK;
 }
@@ -298,19 +446,18 @@ _net_init_thread( hwd_context_t *ctx )
 static int
 _net_init_component( int cidx  )
 {
-    int i = 0;
-    struct temp_event *t, *last;
-
     if ( is_initialized )
         return PAPI_OK;
 
-    memset(_net_register_start, 0,
-    		NET_MAX_COUNTERS*sizeof(_net_register_start[0]));
-    memset(_net_register_current, 0, 
-    		NET_MAX_COUNTERS*sizeof(_net_register_current[0]));
-
     is_initialized = 1;
 
+    net_fd = open(NET_PROC_FILE, O_RDONLY);
+    if (net_fd < 0) {
+        SUBDBG("Can't find %s, are you sure the /proc file-system is mounted?\n",
+           NET_PROC_FILE);
+        return PAPI_OK;
+    }
+
     /* The network interfaces are listed in /proc/net/dev */
     num_events = generateNetEventList();
 
@@ -320,22 +467,6 @@ _net_init_component( int cidx  )
     if ( num_events == 0 )  /* No network interfaces found */
         return PAPI_OK;
 
-    t = root;
-    _net_native_events = (NET_native_event_entry_t*)
-        papi_malloc(sizeof(NET_native_event_entry_t) * num_events);
-    do {
-        strncpy(_net_native_events[i].name, t->name, PAPI_MAX_STR_LEN-1);
-        _net_native_events[i].name[PAPI_MAX_STR_LEN-1] = '\0';
-        strncpy(_net_native_events[i].description, t->description, PAPI_MAX_STR_LEN-1);
-        _net_native_events[i].description[PAPI_MAX_STR_LEN-1] = '\0';
-        _net_native_events[i].resources.selector = i + 1;
-        last    = t;
-        t       = t->next;
-        papi_free(last);
-        i++;
-    } while (t != NULL);
-    root = NULL;
-
     /* Export the total number of events available */
     _net_vector.cmp_info.num_native_events = num_events;
 
@@ -362,14 +493,12 @@ _net_init_control_state( hwd_control_state_t *ctl )
 static int
 _net_start( hwd_context_t *ctx, hwd_control_state_t *ctl )
 {
-    ( void ) ctx;
-
+    NET_context_t *net_ctx = (NET_context_t *) ctx;
     NET_control_state_t *net_ctl = (NET_control_state_t *) ctl;
     long long now = PAPI_get_real_usec();
 
-    read_net_counters(_net_register_start);
-    memcpy(_net_register_current, _net_register_start,
-            NET_MAX_COUNTERS * sizeof(_net_register_start[0]));
+    memset(net_ctl->start, 0, NET_MAX_COUNTERS*sizeof(net_ctl->start[0]));
+    read_net_counters(net_ctx, net_ctl, net_ctl->start);
 
     /* set initial values to 0 */
     memset(net_ctl->values, 0, NET_MAX_COUNTERS*sizeof(net_ctl->values[0]));
@@ -386,21 +515,17 @@ _net_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
     long long ** events, int flags )
 {
     (void) flags;
-    (void) ctx;
 
+    NET_context_t *net_ctx = (NET_context_t *) ctx;
     NET_control_state_t *net_ctl = (NET_control_state_t *) ctl;
     long long now = PAPI_get_real_usec();
-    int i;
 
     /* Caching
      * Only read new values from /proc if enough time has passed
      * since the last read.
      */
     if ( now - net_ctl->lastupdate > NET_REFRESH_LATENCY ) {
-        read_net_counters(_net_register_current);
-        for ( i=0; i<NET_MAX_COUNTERS; i++ ) {
-            net_ctl->values[i] = _net_register_current[i] - _net_register_start[i];
-        }
+        update_net_values(net_ctx, net_ctl);
         net_ctl->lastupdate = now;
     }
     *events = net_ctl->values;
@@ -412,16 +537,11 @@ _net_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
 static int
 _net_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
 {
-    (void) ctx;
-
+    NET_context_t *net_ctx = (NET_context_t *) ctx;
     NET_control_state_t *net_ctl = (NET_control_state_t *) ctl;
     long long now = PAPI_get_real_usec();
-    int i;
 
-    read_net_counters(_net_register_current);
-    for ( i=0; i<NET_MAX_COUNTERS; i++ ) {
-        net_ctl->values[i] = _net_register_current[i] - _net_register_start[i];
-    }
+    update_net_values(net_ctx, net_ctl);
     net_ctl->lastupdate = now;
 
     return PAPI_OK;
@@ -434,7 +554,12 @@ _net_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
 static int
 _net_shutdown_thread( hwd_context_t *ctx )
 {
-    ( void ) ctx;
+    NET_context_t *net_ctx = (NET_context_t *) ctx;
+
+    if (net_ctx->buf != NULL) {
+        papi_free(net_ctx->buf);
+        net_ctx->buf = NULL;
+    }
 
     return PAPI_OK;
 }
@@ -446,6 +571,8 @@ _net_shutdown_thread( hwd_context_t *ctx )
 static int
 _net_shutdown_component( void )
 {
+    int i;
+
     if ( is_initialized )
     {
       is_initialized = 0;
@@ -454,6 +581,19 @@ _net_shutdown_component( void )
          papi_free(_net_native_events);
          _net_native_events = NULL;
       }
+      for (i=0; i<num_ifs; i++) {
+         free(net_ifnames[i]);
+      }
+      free(net_ifnames);
+      net_ifnames = NULL;
+      num_ifs = 0;
+      free(net_if_hash);
+      net_if_hash = NULL;
+      num_events = 0;
+      if (net_fd >= 0) {
+         close(net_fd);
+         net_fd = -1;
+      }
     }
 
     return PAPI_OK;
@@ -481,13 +621,26 @@ _net_update_control_state( hwd_control_state_t *ctl,
         NativeInfo_t *native, int count, hwd_context_t *ctx )
 {
     ( void ) ctx;
-    ( void ) ctl;
 
-    int i, index;
+    NET_control_state_t *net_ctl = (NET_control_state_t *) ctl;
+    int i, j, index, ifidx;
+
+    /* remember each event, and the interfaces to parse for them */
+    net_ctl->num_events = count;
+    net_ctl->num_ifs = 0;
 
     for ( i = 0; i < count; i++ ) {
         index = native[i].ni_event;
-        native[i].ni_position = _net_native_events[index].resources.selector - 1;
+        native[i].ni_position = i;
+        net_ctl->which[i] = _net_native_events[index].resources.selector - 1;
+
+        ifidx = net_ctl->which[i] / NET_INTERFACE_COUNTERS;
+        for ( j = 0; j < net_ctl->num_ifs; j++ ) {
+            if ( net_ctl->ifs[j] == ifidx ) break;
+        }
+        if ( j == net_ctl->num_ifs ) {
+            net_ctl->ifs[net_ctl->num_ifs++] = ifidx;
+        }
     }
 
     return PAPI_OK;
@@ -566,11 +719,19 @@ _net_ntv_enum_events( unsigned int *EventCode, int modifier )
 static int
 _net_ntv_name_to_code( const char *name, unsigned int *EventCode )
 {
-    int i;
-
-    for ( i=0; i<num_events; i++) {
-        if (strcmp(name, _net_native_events[i].name) == 0) {
-	   *EventCode = i;
+    size_t len = strlen(name), clen;
+    int j, ifidx;
+
+    /* names are <interface>:<counter>, look the interface up */
+    for ( j=0; j<NET_INTERFACE_COUNTERS; j++ ) {
+        clen = strlen(_net_counter_info[j].name);
+        if ( len > clen + 1 && name[len - clen - 1] == ':' &&
+             strcmp(name + len - clen, _net_counter_info[j].name) == 0 ) {
+            ifidx = net_if_lookup(name, len - clen - 1);
+            if ( ifidx < 0 ) {
+                break;
+            }
+            *EventCode = ifidx * NET_INTERFACE_COUNTERS + j;
 
             return PAPI_OK;
         }
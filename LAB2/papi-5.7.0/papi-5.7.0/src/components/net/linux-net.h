@@ -65,6 +65,11 @@ typedef struct NET_reg_alloc
 
 typedef struct NET_control_state
 {
+    int num_events;
+    int which[NET_MAX_COUNTERS];        // native event at each position
+    int num_ifs;
+    int ifs[NET_MAX_COUNTERS];          // interfaces these events are on
+    long long start[NET_MAX_COUNTERS];
     long long values[NET_MAX_COUNTERS]; // used for caching
     long long lastupdate;
 } NET_control_state_t;
@@ -73,6 +78,8 @@ typedef struct NET_control_state
 typedef struct NET_context
 {
     NET_control_state_t state;
+    char *buf;                          // last /proc/net/dev contents
+    size_t bufsize;
 } NET_context_t;
 
 
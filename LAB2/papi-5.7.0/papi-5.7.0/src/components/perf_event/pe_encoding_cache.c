@@ -0,0 +1,790 @@
+/*
+* File:    pe_encoding_cache.c
+*
+* Persistent cache of libpfm4 event encodings for the perf_event components
+*
+* Resolving an event name with pfm_find_event() and
+* pfm_get_os_event_encoding() parses the string and walks the libpfm4
+* event tables, which is a large part of the start up cost of short
+* lived tools.  When PAPI_PERF_EVENT_CACHE names a file, every name
+* resolved by libpfm4 is saved there with its perf_event_attr, cpu and
+* libpfm4 index, and later processes map the file and skip libpfm4 for
+* the names it holds.
+*
+* The file is only used when its key matches this system: the cpu
+* vendor/family/model/stepping, the libpfm4 version, the LIBPFM_*
+* environment variables that change encodings, and the name and type of
+* every PMU under /sys/bus/event_source/devices.  Otherwise it is ignored
+* and replaced.
+*
+* A new name is appended to a journal next to the file, <file>.log, as
+* soon as libpfm4 resolves it, so a process that never shuts PAPI down
+* still leaves it for the next one.  Appends hold an exclusive flock on
+* the journal.  The last user in a process takes the same lock, folds
+* the current file, the journal and its own names into a temporary file
+* that is renamed over the old one, and empties the journal.
+*
+* Layout, in native byte order:
+*    struct pe_cache_header
+*    unsigned int slots[num_slots]          record index+1, 0 is empty
+*    struct pe_cache_record records[num_records]
+*    char strings[strings_size]             NUL terminated names
+*
+* The journal is a struct pe_cache_header with no slots, records or
+* strings, then per name a struct pe_cache_log_record followed by the
+* NUL terminated name.
+*
+* Bump PE_CACHE_VERSION if the layout, or the way allocate_native_event
+* asks libpfm4 for an encoding, changes.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "papi.h"
+#include "papi_internal.h"
+#include "papi_vector.h"
+
+#include "papi_libpfm4_events.h"
+#include "pe_encoding_cache.h"
+
+#define PE_CACHE_MAGIC     "PAPIPEC"
+#define PE_CACHE_VERSION   1
+#define PE_CACHE_MIN_SLOTS 256
+#define PE_CACHE_SYSFS     "/sys/bus/event_source/devices"
+
+struct pe_cache_header {
+	char magic[8];
+	unsigned int version;
+	unsigned int attr_size;
+	unsigned long long key;
+	unsigned int num_slots;
+	unsigned int num_records;
+	unsigned int strings_size;
+	unsigned int pad;
+};
+
+struct pe_cache_record {
+	unsigned int hash;
+	unsigned int name_offset;
+	int libpfm4_idx;
+	int cpu;
+	perf_event_attr_t attr;
+};
+
+struct pe_cache_log_record {
+	unsigned int name_size;		/* with the NUL */
+	int libpfm4_idx;
+	int cpu;
+	unsigned int pad;
+	perf_event_attr_t attr;
+};
+
+static int cache_users=0;
+static char *cache_path=NULL;
+static unsigned long long cache_key;
+
+/* the journal, open while there is a cache */
+static char *log_path=NULL;
+static int log_fd=-1;
+
+/* the cache file, if it was valid for this system */
+static void *cache_map=NULL;
+static size_t cache_map_size=0;
+static const struct pe_cache_header *cache_header;
+static const unsigned int *cache_slots;
+static const struct pe_cache_record *cache_records;
+static const char *cache_strings;
+
+/* names resolved by libpfm4 in this process */
+static struct pe_cache_record *new_records=NULL;
+static char **new_names=NULL;
+static unsigned int num_new=0, allocated_new=0;
+static unsigned int *new_slots=NULL;
+static unsigned int new_mask=0;
+
+/* FNV-1a over a name */
+static unsigned int
+name_hash( const char *str )
+{
+	unsigned int h=2166136261U;
+
+	while ( *str ) {
+		h^=(unsigned char)*str++;
+		h*=16777619U;
+	}
+	return h;
+}
+
+/* 64-bit FNV-1a, continued from h */
+static unsigned long long
+key_hash( unsigned long long h, const char *str )
+{
+	while ( *str ) {
+		h^=(unsigned char)*str++;
+		h*=1099511628211ULL;
+	}
+	return h;
+}
+
+/* Fingerprint of everything that decides how libpfm4 encodes a name */
+static unsigned long long
+system_key( void )
+{
+	static const char *env[]={ "LIBPFM_FORCE_PMU",
+				   "LIBPFM_ENCODE_INACTIVE",
+				   "LIBPFM_DISABLED_PMUS", NULL };
+	PAPI_hw_info_t *hw=&_papi_hwi_system_info.hw_info;
+	unsigned long long h=14695981039346656037ULL;
+	struct dirent **pmus;
+	char buf[PATH_MAX], type[64];
+	const char *value;
+	int i, n, fd, len;
+
+	sprintf( buf, "cpu=%s/%d/%d/%d;pfm=%#x;",
+		 hw->vendor_string, hw->cpuid_family, hw->cpuid_model,
+		 hw->cpuid_stepping, pfm_get_version(  ) );
+	h=key_hash( h, buf );
+
+	for ( i=0; env[i]!=NULL; i++ ) {
+		value=getenv( env[i] );
+		h=key_hash( h, env[i] );
+		h=key_hash( h, ( value==NULL ) ? ";" : value );
+	}
+
+	/* PMU types are handed out at boot, so uncore encodings */
+	/* depend on them as well                               */
+	n=scandir( PE_CACHE_SYSFS, &pmus, NULL, alphasort );
+	for ( i=0; i<n; i++ ) {
+		if ( pmus[i]->d_name[0]!='.' ) {
+			snprintf( buf, sizeof(buf), PE_CACHE_SYSFS "/%s/type",
+				  pmus[i]->d_name );
+			len=0;
+			fd=open( buf, O_RDONLY );
+			if ( fd>=0 ) {
+				len=read( fd, type, sizeof(type)-1 );
+				close( fd );
+			}
+			type[( len>0 ) ? len : 0]=0;
+			h=key_hash( h, pmus[i]->d_name );
+			h=key_hash( h, "=" );
+			h=key_hash( h, type );
+		}
+		free( pmus[i] );
+	}
+	if ( n>=0 ) {
+		free( pmus );
+	}
+
+	return h;
+}
+
+/* Is this a header we wrote, for this system? */
+static int
+header_ok( const struct pe_cache_header *header )
+{
+	return ( !memcmp( header->magic, PE_CACHE_MAGIC, sizeof(header->magic) ) &&
+		 ( header->version==PE_CACHE_VERSION ) &&
+		 ( header->attr_size==sizeof(perf_event_attr_t) ) &&
+		 ( header->key==cache_key ) );
+}
+
+static void
+fill_header( struct pe_cache_header *header )
+{
+	memcpy( header->magic, PE_CACHE_MAGIC, sizeof(header->magic) );
+	header->version=PE_CACHE_VERSION;
+	header->attr_size=sizeof(perf_event_attr_t);
+	header->key=cache_key;
+}
+
+/* Map the cache file, keeping it only if it is sane and ours */
+static void
+cache_map_file( void )
+{
+	const struct pe_cache_header *header;
+	unsigned long long expected;
+	struct stat st;
+	void *map;
+	int fd;
+
+	fd=open( cache_path, O_RDONLY );
+	if ( fd<0 ) {
+		SUBDBG( "no encoding cache at %s\n", cache_path );
+		return;
+	}
+
+	if ( ( fstat( fd, &st )<0 ) ||
+	     ( st.st_size<(off_t)sizeof(struct pe_cache_header) ) ) {
+		close( fd );
+		return;
+	}
+
+	map=mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+	close( fd );
+	if ( map==MAP_FAILED ) {
+		return;
+	}
+
+	header=map;
+	expected=sizeof(struct pe_cache_header)+
+		 (unsigned long long)header->num_slots*sizeof(unsigned int)+
+		 (unsigned long long)header->num_records*
+		 sizeof(struct pe_cache_record)+header->strings_size;
+
+	if ( !header_ok( header ) ||
+	     ( header->num_slots==0 ) ||
+	     ( header->num_slots&( header->num_slots-1 ) ) ||
+	     ( header->num_records>=header->num_slots ) ||
+	     ( expected!=(unsigned long long)st.st_size ) ||
+	     ( ( header->strings_size>0 ) &&
+	       ( ((char *)map)[st.st_size-1]!=0 ) ) ) {
+		SUBDBG( "ignoring stale encoding cache %s\n", cache_path );
+		munmap( map, st.st_size );
+		return;
+	}
+
+	cache_map=map;
+	cache_map_size=st.st_size;
+	cache_header=header;
+	cache_slots=(const unsigned int *)( header+1 );
+	cache_records=(const struct pe_cache_record *)
+		( cache_slots+header->num_slots );
+	cache_strings=(const char *)( cache_records+header->num_records );
+
+	SUBDBG( "using %u cached encodings from %s\n",
+		header->num_records, cache_path );
+}
+
+static void
+cache_unmap_file( void )
+{
+	if ( cache_map!=NULL ) {
+		munmap( cache_map, cache_map_size );
+		cache_map=NULL;
+	}
+}
+
+static const struct pe_cache_record *
+find_mapped( const char *name, unsigned int hash )
+{
+	const struct pe_cache_record *rec;
+	unsigned int i, n, slot;
+
+	if ( cache_map==NULL ) {
+		return NULL;
+	}
+
+	for ( n=0, i=hash; n<cache_header->num_slots; n++, i++ ) {
+		slot=cache_slots[i&( cache_header->num_slots-1 )];
+		if ( ( slot==0 ) || ( slot>cache_header->num_records ) ) {
+			break;
+		}
+		rec=&cache_records[slot-1];
+		if ( ( rec->hash==hash ) &&
+		     ( rec->name_offset<cache_header->strings_size ) &&
+		     !strcmp( cache_strings+rec->name_offset, name ) ) {
+			return rec;
+		}
+	}
+	return NULL;
+}
+
+static const struct pe_cache_record *
+find_new( const char *name, unsigned int hash )
+{
+	unsigned int i, slot;
+
+	if ( new_slots==NULL ) {
+		return NULL;
+	}
+
+	for ( i=hash;; i++ ) {
+		slot=new_slots[i&new_mask];
+		if ( slot==0 ) {
+			break;
+		}
+		if ( ( new_records[slot-1].hash==hash ) &&
+		     !strcmp( new_names[slot-1], name ) ) {
+			return &new_records[slot-1];
+		}
+	}
+	return NULL;
+}
+
+/* Make room for one more new record, keeping its index half empty */
+static int
+grow_new( void )
+{
+	struct pe_cache_record *records;
+	unsigned int *slots, size, i, j;
+	char **names;
+
+	if ( num_new==allocated_new ) {
+		size=( allocated_new==0 ) ? PE_CACHE_MIN_SLOTS : 2*allocated_new;
+		records=realloc( new_records, size*sizeof(struct pe_cache_record) );
+		if ( records==NULL ) {
+			return PAPI_ENOMEM;
+		}
+		new_records=records;
+		names=realloc( new_names, size*sizeof(char *) );
+		if ( names==NULL ) {
+			return PAPI_ENOMEM;
+		}
+		new_names=names;
+		allocated_new=size;
+	}
+
+	if ( ( new_slots==NULL ) || ( ( num_new+1 )*2>new_mask+1 ) ) {
+		size=( new_slots==NULL ) ? 2*PE_CACHE_MIN_SLOTS : 2*( new_mask+1 );
+		slots=calloc( size, sizeof(unsigned int) );
+		if ( slots==NULL ) {
+			return PAPI_ENOMEM;
+		}
+		for ( i=0; i<num_new; i++ ) {
+			for ( j=new_records[i].hash; slots[j&( size-1 )]; j++ );
+			slots[j&( size-1 )]=i+1;
+		}
+		free( new_slots );
+		new_slots=slots;
+		new_mask=size-1;
+	}
+
+	return PAPI_OK;
+}
+
+/* Remember an encoding in this process, unless it is known already */
+static int
+add_record( const char *name, const perf_event_attr_t *attr,
+	    int cpu, int libpfm4_idx )
+{
+	struct pe_cache_record *rec;
+	unsigned int hash, i;
+
+	hash=name_hash( name );
+	if ( ( find_mapped( name, hash )!=NULL ) ||
+	     ( find_new( name, hash )!=NULL ) ) {
+		return PAPI_EINVAL;
+	}
+
+	if ( grow_new(  )!=PAPI_OK ) {
+		return PAPI_ENOMEM;
+	}
+
+	new_names[num_new]=strdup( name );
+	if ( new_names[num_new]==NULL ) {
+		return PAPI_ENOMEM;
+	}
+
+	rec=&new_records[num_new];
+	memset( rec, 0, sizeof(struct pe_cache_record) );
+	rec->hash=hash;
+	rec->libpfm4_idx=libpfm4_idx;
+	rec->cpu=cpu;
+	memcpy( &rec->attr, attr, sizeof(perf_event_attr_t) );
+
+	for ( i=hash; new_slots[i&new_mask]; i++ );
+	new_slots[i&new_mask]=++num_new;
+
+	return PAPI_OK;
+}
+
+/* Pick up the names other processes appended to the journal.  The */
+/* caller holds a lock on it.  Returns the size of the journal.     */
+static off_t
+log_read( void )
+{
+	const struct pe_cache_log_record *rec;
+	struct stat st;
+	char *buf, *name;
+	size_t done;
+	ssize_t got;
+	off_t off;
+
+	if ( ( fstat( log_fd, &st )<0 ) ||
+	     ( st.st_size<=(off_t)sizeof(struct pe_cache_header) ) ) {
+		return 0;
+	}
+
+	buf=malloc( st.st_size );
+	if ( buf==NULL ) {
+		return st.st_size;
+	}
+	for ( done=0; done<(size_t)st.st_size; done+=got ) {
+		got=pread( log_fd, buf+done, st.st_size-done, done );
+		if ( got<=0 ) {
+			break;
+		}
+	}
+
+	if ( header_ok( (struct pe_cache_header *)buf ) ) {
+		off=sizeof(struct pe_cache_header);
+		while ( off+(off_t)sizeof(struct pe_cache_log_record)<=(off_t)done ) {
+			rec=(const struct pe_cache_log_record *)( buf+off );
+			name=(char *)( rec+1 );
+			off+=sizeof(struct pe_cache_log_record)+rec->name_size;
+			/* a record cut short, or not ours */
+			if ( ( rec->name_size==0 ) || ( off>(off_t)done ) ||
+			     ( name[rec->name_size-1]!=0 ) ) {
+				break;
+			}
+			add_record( name, &rec->attr, rec->cpu, rec->libpfm4_idx );
+		}
+	}
+
+	free( buf );
+	return st.st_size;
+}
+
+/* Append one name to the journal, starting it over if it was made */
+/* for another system or version                                   */
+static void
+log_append( const char *name, const perf_event_attr_t *attr,
+	    int cpu, int libpfm4_idx )
+{
+	struct pe_cache_header header;
+	struct pe_cache_log_record *rec;
+	size_t size, name_size;
+	struct stat st;
+	ssize_t written;
+
+	if ( log_fd<0 ) {
+		return;
+	}
+
+	name_size=strlen( name )+1;
+	size=sizeof(struct pe_cache_log_record)+name_size;
+	rec=calloc( 1, size );
+	if ( rec==NULL ) {
+		return;
+	}
+	rec->name_size=name_size;
+	rec->libpfm4_idx=libpfm4_idx;
+	rec->cpu=cpu;
+	memcpy( &rec->attr, attr, sizeof(perf_event_attr_t) );
+	memcpy( rec+1, name, name_size );
+
+	flock( log_fd, LOCK_EX );
+
+	if ( ( fstat( log_fd, &st )<0 ) ||
+	     ( st.st_size<(off_t)sizeof(struct pe_cache_header) ) ||
+	     ( pread( log_fd, &header, sizeof(header), 0 )!=sizeof(header) ) ||
+	     !header_ok( &header ) ) {
+		memset( &header, 0, sizeof(header) );
+		fill_header( &header );
+		if ( ( ftruncate( log_fd, 0 )<0 ) ||
+		     ( write( log_fd, &header, sizeof(header) )!=sizeof(header) ) ) {
+			SUBDBG( "could not start journal %s\n", log_path );
+			flock( log_fd, LOCK_UN );
+			free( rec );
+			return;
+		}
+	}
+
+	/* O_APPEND puts it at the end, in one piece */
+	written=write( log_fd, rec, size );
+	if ( written!=(ssize_t)size ) {
+		SUBDBG( "could not append %s to %s\n", name, log_path );
+	}
+
+	flock( log_fd, LOCK_UN );
+	free( rec );
+}
+
+/* Write the mapped and new records to a fresh file and rename it */
+/* over the old one                                               */
+static void
+cache_write( void )
+{
+	struct pe_cache_header *header;
+	struct pe_cache_record *records;
+	unsigned int *slots;
+	unsigned int num_mapped, num_records, num_slots, strings_size;
+	unsigned int i, j;
+	const char *name;
+	char *strings, *buf, tmp[PATH_MAX];
+	size_t size, done;
+	ssize_t written;
+	int fd;
+
+	num_mapped=( cache_map!=NULL ) ? cache_header->num_records : 0;
+
+	/* names another process got into the file meanwhile are there */
+	num_records=num_mapped;
+	for ( i=0; i<num_new; i++ ) {
+		if ( find_mapped( new_names[i], new_records[i].hash )==NULL ) {
+			num_records++;
+		}
+	}
+
+	num_slots=PE_CACHE_MIN_SLOTS;
+	while ( num_slots<2*num_records ) {
+		num_slots*=2;
+	}
+
+	strings_size=( cache_map!=NULL ) ? cache_header->strings_size : 0;
+	for ( i=0; i<num_new; i++ ) {
+		if ( find_mapped( new_names[i], new_records[i].hash )==NULL ) {
+			strings_size+=strlen( new_names[i] )+1;
+		}
+	}
+
+	size=sizeof(struct pe_cache_header)+num_slots*sizeof(unsigned int)+
+	     num_records*sizeof(struct pe_cache_record)+strings_size;
+	buf=calloc( 1, size );
+	if ( buf==NULL ) {
+		return;
+	}
+
+	header=(struct pe_cache_header *)buf;
+	slots=(unsigned int *)( header+1 );
+	records=(struct pe_cache_record *)( slots+num_slots );
+	strings=(char *)( records+num_records );
+
+	fill_header( header );
+	header->num_slots=num_slots;
+	header->num_records=num_records;
+	header->strings_size=strings_size;
+
+	/* old names keep their offsets */
+	if ( num_mapped ) {
+		memcpy( records, cache_records,
+			num_mapped*sizeof(struct pe_cache_record) );
+		memcpy( strings, cache_strings, cache_header->strings_size );
+		strings_size=cache_header->strings_size;
+	} else {
+		strings_size=0;
+	}
+
+	for ( i=0, j=num_mapped; i<num_new; i++ ) {
+		name=new_names[i];
+		if ( find_mapped( name, new_records[i].hash )!=NULL ) {
+			continue;
+		}
+		records[j]=new_records[i];
+		records[j].name_offset=strings_size;
+		strcpy( strings+strings_size, name );
+		strings_size+=strlen( name )+1;
+		j++;
+	}
+
+	for ( i=0; i<num_records; i++ ) {
+		for ( j=records[i].hash; slots[j&( num_slots-1 )]; j++ );
+		slots[j&( num_slots-1 )]=i+1;
+	}
+
+	snprintf( tmp, sizeof(tmp), "%s.%d", cache_path, (int)getpid(  ) );
+	fd=open( tmp, O_WRONLY|O_CREAT|O_TRUNC, 0644 );
+	if ( fd<0 ) {
+		SUBDBG( "could not create %s\n", tmp );
+		free( buf );
+		return;
+	}
+
+	for ( done=0; done<size; done+=written ) {
+		written=write( fd, buf+done, size-done );
+		if ( written<=0 ) {
+			break;
+		}
+	}
+	close( fd );
+	free( buf );
+
+	if ( ( done<size ) || rename( tmp, cache_path ) ) {
+		SUBDBG( "could not write encoding cache %s\n", cache_path );
+		unlink( tmp );
+		return;
+	}
+
+	SUBDBG( "wrote %u encodings to %s\n", num_records, cache_path );
+}
+
+/** @class  _pe_encoding_cache_open
+ *  @brief  Map the encoding cache named by PAPI_PERF_EVENT_CACHE
+ *
+ *  Called by each libpfm4 event table at init.  Without the
+ *  environment variable the cache does nothing.
+ *
+ *  @retval PAPI_OK     We always return PAPI_OK
+ */
+
+int
+_pe_encoding_cache_open( void )
+{
+	const char *path;
+
+	_papi_hwi_lock( NAMELIB_LOCK );
+
+	if ( cache_users++ ) {
+		_papi_hwi_unlock( NAMELIB_LOCK );
+		return PAPI_OK;
+	}
+
+	path=getenv( "PAPI_PERF_EVENT_CACHE" );
+	if ( ( path!=NULL ) && ( path[0]!=0 ) ) {
+		cache_path=strdup( path );
+		log_path=malloc( strlen( path )+sizeof(".log") );
+		if ( ( cache_path!=NULL ) && ( log_path!=NULL ) ) {
+			sprintf( log_path, "%s.log", path );
+			cache_key=system_key(  );
+			cache_map_file(  );
+			log_fd=open( log_path, O_RDWR|O_CREAT|O_APPEND, 0644 );
+			if ( log_fd>=0 ) {
+				flock( log_fd, LOCK_SH );
+				log_read(  );
+				flock( log_fd, LOCK_UN );
+			}
+			else {
+				SUBDBG( "no journal at %s, new names are kept "
+					"until shutdown\n", log_path );
+			}
+		}
+		else {
+			free( cache_path );
+			free( log_path );
+			cache_path=NULL;
+			log_path=NULL;
+		}
+	}
+
+	_papi_hwi_unlock( NAMELIB_LOCK );
+
+	return PAPI_OK;
+}
+
+/** @class  _pe_encoding_cache_lookup
+ *  @brief  Find the encoding libpfm4 gave a name earlier
+ *
+ *  @param[in] name
+ *        -- event name as passed to allocate_native_event
+ *  @param[out] attr
+ *        -- perf_event attributes of the event
+ *  @param[out] cpu
+ *        -- cpu given with the cpu= mask, or -1
+ *  @param[out] libpfm4_idx
+ *        -- libpfm4 index of the event
+ *
+ *  @retval PAPI_OK      The name was in the cache
+ *  @retval PAPI_ENOEVNT The name has to be resolved by libpfm4
+ */
+
+int
+_pe_encoding_cache_lookup( const char *name, perf_event_attr_t *attr,
+			   int *cpu, int *libpfm4_idx )
+{
+	const struct pe_cache_record *rec;
+	unsigned int hash;
+
+	if ( cache_path==NULL ) {
+		return PAPI_ENOEVNT;
+	}
+
+	hash=name_hash( name );
+	rec=find_mapped( name, hash );
+	if ( rec==NULL ) {
+		rec=find_new( name, hash );
+	}
+	if ( rec==NULL ) {
+		return PAPI_ENOEVNT;
+	}
+
+	memcpy( attr, &rec->attr, sizeof(perf_event_attr_t) );
+	*cpu=rec->cpu;
+	*libpfm4_idx=rec->libpfm4_idx;
+
+	return PAPI_OK;
+}
+
+/** @class  _pe_encoding_cache_add
+ *  @brief  Remember how libpfm4 encoded a name
+ *
+ *  @param[in] name
+ *        -- event name as passed to allocate_native_event
+ *  @param[in] attr
+ *        -- perf_event attributes libpfm4 produced
+ *  @param[in] cpu
+ *        -- cpu given with the cpu= mask, or -1
+ *  @param[in] libpfm4_idx
+ *        -- libpfm4 index of the event
+ */
+
+void
+_pe_encoding_cache_add( const char *name, const perf_event_attr_t *attr,
+			int cpu, int libpfm4_idx )
+{
+	if ( cache_path==NULL ) {
+		return;
+	}
+
+	if ( add_record( name, attr, cpu, libpfm4_idx )==PAPI_OK ) {
+		log_append( name, attr, cpu, libpfm4_idx );
+	}
+}
+
+/** @class  _pe_encoding_cache_close
+ *  @brief  For the last user, fold the journal into the cache file
+ *          and unmap it
+ *
+ *  Called by each libpfm4 event table at shutdown.
+ */
+
+void
+_pe_encoding_cache_close( void )
+{
+	unsigned int i;
+
+	if ( cache_users==0 ) {
+		return;
+	}
+
+	if ( --cache_users ) {
+		return;
+	}
+
+	if ( log_fd>=0 ) {
+		flock( log_fd, LOCK_EX );
+		/* start from what is on disk now, another process may */
+		/* have rewritten the file since we mapped it          */
+		cache_unmap_file(  );
+		cache_map_file(  );
+		if ( log_read(  )>0 ) {
+			cache_write(  );
+			if ( ftruncate( log_fd, 0 )<0 ) {
+				SUBDBG( "could not empty journal %s\n", log_path );
+			}
+		}
+		flock( log_fd, LOCK_UN );
+		close( log_fd );
+		log_fd=-1;
+	}
+	else if ( num_new ) {
+		cache_write(  );
+	}
+
+	cache_unmap_file(  );
+
+	for ( i=0; i<num_new; i++ ) {
+		free( new_names[i] );
+	}
+	free( new_names );
+	free( new_records );
+	free( new_slots );
+	new_names=NULL;
+	new_records=NULL;
+	new_slots=NULL;
+	num_new=allocated_new=0;
+	new_mask=0;
+
+	free( cache_path );
+	free( log_path );
+	cache_path=NULL;
+	log_path=NULL;
+}
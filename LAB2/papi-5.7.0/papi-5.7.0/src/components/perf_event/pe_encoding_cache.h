@@ -0,0 +1,18 @@
+/*
+* File:    pe_encoding_cache.h
+*/
+
+#ifndef _PE_ENCODING_CACHE_H
+#define _PE_ENCODING_CACHE_H
+
+/* Prototypes for the on-disk event encoding cache.  All but */
+/* open take NAMELIB_LOCK held by the caller.                 */
+
+int _pe_encoding_cache_open( void );
+int _pe_encoding_cache_lookup( const char *name, perf_event_attr_t *attr,
+		int *cpu, int *libpfm4_idx );
+void _pe_encoding_cache_add( const char *name, const perf_event_attr_t *attr,
+		int cpu, int libpfm4_idx );
+void _pe_encoding_cache_close( void );
+
+#endif
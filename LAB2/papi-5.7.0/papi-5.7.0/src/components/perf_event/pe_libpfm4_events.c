@@ -14,6 +14,7 @@
 */
 
 #include <string.h>
+#include <ctype.h>
 
 #include "papi.h"
 #include "papi_internal.h"
@@ -21,7 +22,9 @@
 
 #include "papi_libpfm4_events.h"
 #include "pe_libpfm4_events.h"
+#include "pe_encoding_cache.h"
 #include "perf_event_lib.h"
+#include "mb.h"
 
 #include "perfmon/pfmlib.h"
 #include "perfmon/pfmlib_perf_event.h"
@@ -31,9 +34,180 @@
 // used to step through the attributes when enumerating events
 static int attr_idx;
 
+// Open addressing index over event_table->native_events, so resolving
+// a name does not walk every event allocated so far.  Each event is
+// hashed on its allocated_name and, when it belongs to the default pmu,
+// on base_name:mask_string for callers that leave the pmu name off.
+//
+// Readers probe it without NAMELIB_LOCK.  Writers hold NAMELIB_LOCK,
+// fill a slot before publishing its name pointer, and replace a full
+// index with a bigger one by a single pointer store.  Replaced indexes
+// are kept on the retired list until shutdown, since a reader may
+// still be walking one.
+
+#define NAME_INDEX_SIZE 2048
+
+struct pe_name_slot {
+  unsigned int hash;
+  int event;              // offset in native_events
+  const char *mask;       // NULL when name is an allocated_name
+  const char * volatile name;   // NULL if the slot is empty
+};
+
+struct pe_name_index {
+  unsigned int mask;
+  unsigned int used;
+  struct pe_name_index *retired;
+  struct pe_name_slot *slots;
+};
+
+/* FNV-1a, continued from h */
+static unsigned int
+name_hash(unsigned int h, const char *str) {
+  while (*str) {
+     h^=(unsigned char)*str++;
+     h*=16777619U;
+  }
+  return h;
+}
+
+#define NAME_HASH_INIT 2166136261U
+
+static struct pe_name_index *
+name_index_alloc(unsigned int size, struct pe_name_index *retired) {
+  struct pe_name_index *index;
+
+  index=calloc(1,sizeof(struct pe_name_index));
+  if (index==NULL) return NULL;
+
+  index->slots=calloc(size,sizeof(struct pe_name_slot));
+  if (index->slots==NULL) {
+     free(index);
+     return NULL;
+  }
+  index->mask=size-1;
+  index->retired=retired;
+
+  return index;
+}
+
+/* Caller holds NAMELIB_LOCK and made room for the key */
+static void
+name_index_put(struct pe_name_index *index, unsigned int hash,
+               int event, const char *name, const char *mask) {
+  struct pe_name_slot *slot;
+  unsigned int i=hash;
+
+  while (index->slots[i&index->mask].name!=NULL) i++;
+  slot=&index->slots[i&index->mask];
+
+  slot->hash=hash;
+  slot->event=event;
+  slot->mask=mask;
+  __sync_synchronize();
+  slot->name=name;
+
+  index->used++;
+}
+
+/* Does name match base_name:mask_string (or base_name with no masks) */
+static int
+name_is_base_and_mask(const char *name, const char *base, const char *mask) {
+  size_t len=strlen(base);
+
+  if (strncmp(name,base,len)) return 0;
+  if (mask[0]==0) return (name[len]==0);
+  return ((name[len]==':') && !strcmp(name+len+1,mask));
+}
+
+/** @class  name_index_insert
+ *  @brief  Adds native_events[event] to the name index
+ *
+ *  Caller holds NAMELIB_LOCK.  If the index cannot grow the event is
+ *  still in the table, it just will not be found by name.
+ *
+ *  @param[in] event
+ *             -- offset in native_events
+ *  @param[in] event_table
+ *             -- native_event_table structure
+ *
+ */
+
+static void
+name_index_insert(int event, struct native_event_table_t *event_table) {
+  struct native_event_t *ntv_evt=&event_table->native_events[event];
+  struct pe_name_index *index=event_table->name_index;
+  struct pe_name_index *bigger;
+  unsigned int i, size, hash;
+  int keys=1;
+
+  // pmu-less names are already covered by their allocated_name
+  if ((ntv_evt->pmu!=NULL) && (ntv_evt->pmu[0]!=0) &&
+      (event_table->default_pmu.name!=NULL) &&
+      !strcmp(ntv_evt->pmu,event_table->default_pmu.name)) {
+     keys=2;
+  }
+
+  // keep the index at most half full
+  if ((index==NULL) || ((index->used+keys)*2 > index->mask+1)) {
+     size=(index==NULL)?NAME_INDEX_SIZE:2*(index->mask+1);
+
+     bigger=name_index_alloc(size,index);
+     if (bigger==NULL) {
+        SUBDBG("EXIT: could not grow name index to %u\n",size);
+        return;
+     }
+
+     if (index!=NULL) {
+        for(i=0;i<=index->mask;i++) {
+           if (index->slots[i].name!=NULL) {
+              name_index_put(bigger,index->slots[i].hash,
+                             index->slots[i].event,index->slots[i].name,
+                             index->slots[i].mask);
+           }
+        }
+     }
+
+     __sync_synchronize();
+     event_table->name_index=bigger;
+     index=bigger;
+  }
+
+  name_index_put(index,name_hash(NAME_HASH_INIT,ntv_evt->allocated_name),
+                 event,ntv_evt->allocated_name,NULL);
+
+  if (keys==2) {
+     hash=name_hash(NAME_HASH_INIT,ntv_evt->base_name);
+     if (ntv_evt->mask_string[0]!=0) {
+        hash=name_hash(hash,":");
+        hash=name_hash(hash,ntv_evt->mask_string);
+     }
+     name_index_put(index,hash,event,ntv_evt->base_name,
+                    ntv_evt->mask_string);
+  }
+}
+
+/* Free the name index and every index it replaced */
+static void
+name_index_free(struct native_event_table_t *event_table) {
+  struct pe_name_index *index=event_table->name_index;
+  struct pe_name_index *retired;
+
+  event_table->name_index=NULL;
+
+  while (index!=NULL) {
+     retired=index->retired;
+     free(index->slots);
+     free(index);
+     index=retired;
+  }
+}
+
 /** @class  find_existing_event
  *  @brief  looks up an event, returns it if it exists
  *
+ *  Does not take NAMELIB_LOCK, see the name index above.
+ *
  *  @param[in] name
  *             -- name of the event
  *  @param[in] event_table
@@ -47,34 +221,44 @@ static int find_existing_event(const char *name,
                                struct native_event_table_t *event_table) {
   SUBDBG("Entry: name: %s, event_table: %p, num_native_events: %d\n", name, event_table, event_table->num_native_events);
 
-  int i,event=PAPI_ENOEVNT;
+  struct pe_name_index *index=event_table->name_index;
+  struct pe_name_slot *slot;
+  const char *slot_name;
+  unsigned int i, hash;
+  int event=PAPI_ENOEVNT;
 
-  _papi_hwi_lock( NAMELIB_LOCK );
-
-  for(i=0;i<event_table->num_native_events;i++) {
-    // Most names passed in will contain the pmu name, so first we compare to the allocated name (it has pmu name on front)
-    if (!strcmp(name,event_table->native_events[i].allocated_name)) {
-      SUBDBG("Found allocated_name: %s, libpfm4_idx: %#x, papi_event_code: %#x\n", 
-         event_table->native_events[i].allocated_name, event_table->native_events[i].libpfm4_idx, event_table->native_events[i].papi_event_code);
-      event=i;
-      break;
-    }
-    // some callers have an event name without the pmu name on the front, so we also compare to the base name (just the event name part)
-    if (!strcmp(name,event_table->native_events[i].base_name)) {
-      int nameLen = strlen(event_table->native_events[i].base_name);
-      // the name we are looking for must be the same length as this event table entry name for them to match
-      if (strlen(name) != nameLen + strlen(event_table->native_events[i].mask_string) + 1) {
-        continue;
-      }
-      if(!strcmp(name+nameLen+1, event_table->native_events[i].mask_string)) {
-          SUBDBG("Found base_name: %s, mask_string: %s, libpfm4_idx: %#x, papi_event_code: %#x\n",
-            event_table->native_events[i].base_name, event_table->native_events[i].mask_string , event_table->native_events[i].libpfm4_idx, event_table->native_events[i].papi_event_code);
-          event=i;
-          break;
-      }
-    }
+  if (index==NULL) {
+     SUBDBG("EXIT: no events yet\n");
+     return PAPI_ENOEVNT;
+  }
+  rmb();
+
+  hash=name_hash(NAME_HASH_INIT,name);
+
+  for(i=hash;;i++) {
+     slot=&index->slots[i&index->mask];
+     slot_name=slot->name;
+     if (slot_name==NULL) break;
+     rmb();
+
+     if (slot->hash!=hash) continue;
+
+     // Most names passed in will contain the pmu name, so an allocated
+     // name match wins over a base_name:mask_string one
+     if (slot->mask==NULL) {
+        if (!strcmp(name,slot_name)) {
+           event=slot->event;
+           SUBDBG("Found allocated_name: %s, event: %d\n", slot_name, event);
+           break;
+        }
+     }
+     else if (((event<0) || (slot->event<event)) &&
+              name_is_base_and_mask(name,slot_name,slot->mask)) {
+        event=slot->event;
+        SUBDBG("Found base_name: %s, mask_string: %s, event: %d\n",
+               slot_name, slot->mask, event);
+     }
   }
-  _papi_hwi_unlock( NAMELIB_LOCK );
 
   SUBDBG("EXIT: returned: %#x\n", event);
   return event;
@@ -136,6 +320,8 @@ static struct native_event_t *allocate_native_event(
 	int nevt_idx;
 	int event_num;
 	int encode_failed=0;
+	int from_cache;
+	int cached_idx=-1;
 
 	pfm_err_t ret;
 	char *event_string=NULL;
@@ -162,6 +348,26 @@ static struct native_event_t *allocate_native_event(
 	/* add the event to our event table */
 	_papi_hwi_lock( NAMELIB_LOCK );
 
+	// another thread may have added it since we looked, its entry
+	// is already set up and being read without the lock, so leave
+	// it alone and hand it back
+	if (event_num < 0) {
+		event_num=find_existing_event(name, event_table);
+		if (event_num >= 0) {
+			ntv_evt = &(event_table->native_events[event_num]);
+			_papi_hwi_set_papi_event_code(ntv_evt->papi_event_code, 1);
+			// its encode failing is marked in attr.config
+			encode_failed = (ntv_evt->attr.config == 0xFFFFFF);
+			_papi_hwi_unlock( NAMELIB_LOCK );
+			if (encode_failed) {
+				SUBDBG("EXIT: added meanwhile, encoding failed\n");
+				return NULL;
+			}
+			SUBDBG("EXIT: added meanwhile by another thread: %p\n", ntv_evt);
+			return ntv_evt;
+		}
+	}
+
 	// if we already know this event name,
 	// it was created as part of setting up the preset tables
 	// we need to use the event table which is already created
@@ -188,15 +394,21 @@ static struct native_event_t *allocate_native_event(
 	perf_arg.attr=&ntv_evt->attr;
 	perf_arg.fstr=&event_string;
 
+	/* a name resolved by an earlier run may be in the encoding cache */
+	from_cache = (_pe_encoding_cache_lookup(name, &ntv_evt->attr,
+				&perf_arg.cpu, &cached_idx) == PAPI_OK);
+
 	/* use user provided name of the event to get the */
 	/* perf_event encoding and a fully qualified event string */
-	ret = pfm_get_os_event_encoding(name,
+	if (!from_cache) {
+		ret = pfm_get_os_event_encoding(name,
 					PFM_PLM0 | PFM_PLM3,
 					PFM_OS_PERF_EVENT_EXT,
 					&perf_arg);
+	}
 
 	// If the encode function failed, skip processing of the event_string
-	if ((ret != PFM_SUCCESS) || (event_string == NULL)) {
+	if (!from_cache && ((ret != PFM_SUCCESS) || (event_string == NULL))) {
 		SUBDBG("encode failed for event: %s, returned: %d\n",
 			name, ret);
 
@@ -262,6 +474,9 @@ static struct native_event_t *allocate_native_event(
 	// try to get one based on the event name passed in.
 
 	/* This may return a value for a disabled PMU */
+	if ((libpfm4_index == -1) && from_cache) {
+		libpfm4_index = cached_idx;
+	}
 	if (libpfm4_index == -1) {
 		libpfm4_index = pfm_find_event(fullname);
 		if (libpfm4_index < 0) {
@@ -300,6 +515,12 @@ static struct native_event_t *allocate_native_event(
 		return NULL;
 	}
 
+	// save what libpfm4 worked out for later runs
+	if (!from_cache && !encode_failed) {
+		_pe_encoding_cache_add(name, &ntv_evt->attr,
+				perf_arg.cpu, libpfm4_index);
+	}
+
 	ntv_evt->allocated_name=strdup(name);
 	ntv_evt->mask_string=strdup(masks);
 	ntv_evt->component=cidx;
@@ -458,7 +679,9 @@ static struct native_event_t *allocate_native_event(
 	}
 
 	// if we created a new event, bump the number used
+	// and make it findable by name
 	if (event_num < 0) {
+		name_index_insert(nevt_idx, event_table);
 		event_table->num_native_events++;
 	}
 
@@ -1099,6 +1322,10 @@ _pe_libpfm4_shutdown(papi_vector_t *my_vector,
 
   free(event_table->native_events);
 
+  name_index_free(event_table);
+
+  _pe_encoding_cache_close();
+
   _papi_hwi_unlock( NAMELIB_LOCK );
 
   SUBDBG("EXIT: PAPI_OK\n");
@@ -1132,6 +1359,8 @@ _pe_libpfm4_init(papi_vector_t *component, int cidx,
 	pfm_err_t retval = PFM_SUCCESS;
 	pfm_pmu_info_t pinfo;
 
+	_pe_encoding_cache_open();
+
 	/* allocate the native event structure */
 	event_table->num_native_events=0;
 	event_table->pmu_type=pmu_type;
@@ -1261,14 +1490,17 @@ _peu_libpfm4_init(papi_vector_t *my_vector, int cidx,
 		   int pmu_type) {
 
    int detected_pmus=0;
-   int i;
+   int i,k;
    int j=0;
+   size_t len;
    pfm_err_t retval = PFM_SUCCESS;
    unsigned int ncnt;
    pfm_pmu_info_t pinfo;
 
 	(void)cidx;
 
+   _pe_encoding_cache_open();
+
    /* allocate the native event structure */
 
    event_table->num_native_events=0;
@@ -1287,6 +1519,38 @@ _peu_libpfm4_init(papi_vector_t *my_vector, int cidx,
 
    my_vector->cmp_info.num_cntrs=0;
 
+   /* Numbered boxes (skx_unc_imc0..5) are also known by their family   */
+   /* name, which ALL_BOXES aggregate events are under.  The families go */
+   /* first, so when there are more than PAPI_PMU_MAX names only boxes   */
+   /* are left out, and those are still routed here by their family.    */
+   for(i=0;;i++) {
+      memset(&pinfo,0,sizeof(pfm_pmu_info_t));
+      pinfo.size = sizeof(pfm_pmu_info_t);
+      retval=pfm_get_pmu_info(i, &pinfo);
+      if (retval==PFM_ERR_INVAL) {
+	 break;
+      }
+      if ((retval!=PFM_SUCCESS) || (pinfo.name == NULL) ||
+	  (!pmu_is_present_and_right_type(&pinfo,pmu_type))) {
+	 continue;
+      }
+
+      len=strlen(pinfo.name);
+      while ((len>0) && isdigit((unsigned char)pinfo.name[len-1])) len--;
+      if ((len==0) || (pinfo.name[len]=='\0')) {
+	 continue;
+      }
+      for(k=0;k<j;k++) {
+	 if ((strlen(my_vector->cmp_info.pmu_names[k])==len) &&
+	     (!strncmp(my_vector->cmp_info.pmu_names[k],pinfo.name,len))) {
+	    break;
+	 }
+      }
+      if ((k==j) && (j < PAPI_PMU_MAX)) {
+	 my_vector->cmp_info.pmu_names[j++] = strndup(pinfo.name,len);
+      }
+   }
+
    SUBDBG("Detected pmus:\n");
 	i=0;
 	while(1) {
@@ -1313,6 +1577,7 @@ _peu_libpfm4_init(papi_vector_t *my_vector, int cidx,
 	 if ((j < PAPI_PMU_MAX) && (pinfo.name != NULL)) {
 	     my_vector->cmp_info.pmu_names[j++] = strdup(pinfo.name);
 	 }
+
          my_vector->cmp_info.num_cntrs += pinfo.num_cntrs+
                                    pinfo.num_fixed_cntrs;
       }
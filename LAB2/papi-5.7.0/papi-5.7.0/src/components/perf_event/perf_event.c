@@ -84,6 +84,7 @@ static int exclude_guest_unsupported;
 #endif
 
 static int _pe_set_domain( hwd_control_state_t *ctl, int domain);
+static int _pe_virtual_snapshot( pe_control_t *pe_ctl );
 
 #if (OBSOLETE_WORKAROUNDS==1)
 
@@ -464,6 +465,10 @@ check_permissions( unsigned long tid,
 
    if (granularity==PAPI_GRN_SYS) {
       pid = -1;
+   } else if (granularity==PAPI_GRN_SYS_CPU) {
+      /* opened on every cpu, trying the one we are on will do */
+      pid = -1;
+      cpu_num = _papi_getcpu();
    } else {
       pid = tid;
    }
@@ -676,86 +681,305 @@ set_up_mmap( pe_control_t *ctl, int evt_idx)
 
 
 
-/* Open all events in the control state */
-static int
-open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
+/* The pid events of this control state are opened for */
+static long
+pe_event_pid( pe_control_t *ctl )
 {
-
-	int i, ret = PAPI_OK;
-	long pid;
-
-
-	/* Set the pid setting */
 	/* If attached, this is the pid of process we are attached to. */
 	/* If GRN_THRD then it is 0 meaning current process only */
 	/* If GRN_SYS then it is -1 meaning all procs on this CPU */
 	/* Note if GRN_SYS then CPU must be specified, not -1 */
 
 	if (ctl->attached) {
-		pid = ctl->tid;
+		return ctl->tid;
 	}
-	else {
-		if (ctl->granularity==PAPI_GRN_SYS) {
-			pid = -1;
+	if ((ctl->granularity==PAPI_GRN_SYS) ||
+	    (ctl->granularity==PAPI_GRN_SYS_CPU)) {
+		return -1;
+	}
+	return 0;
+}
+
+/* Set up the attr fields that depend on where event idx sits in   */
+/* the group.  The rest of the attr structure was set up previously. */
+static void
+pe_set_group_attr( pe_control_t *ctl, int idx, struct perf_event_attr *attr )
+{
+	/* Handle the broken exclude_guest problem */
+	/* libpfm4 sets this by default (PEBS events depend on it) */
+	/* but on older kernels that dont know about exclude_guest */
+	/* perf_event_open() will error out as a "reserved"        */
+	/* unknown bit is set to 1.                                */
+	/* Do we need to also watch for exclude_host, exclude_idle */
+	/* exclude_callchain*?					   */
+	if ((attr->exclude_guest) && (exclude_guest_unsupported)) {
+		SUBDBG("Disabling exclude_guest in event %d\n",idx);
+		attr->exclude_guest=0;
+	}
+
+	/* group leader (event 0) is special                */
+	/* If we're multiplexed, everyone is a group leader */
+	if (( idx == 0 ) || (ctl->multiplexed)) {
+		attr->pinned = !ctl->multiplexed;
+		attr->disabled = 1;
+		attr->read_format = get_read_format( ctl->multiplexed,
+						     ctl->inherit,
+						     !ctl->multiplexed );
+	} else {
+		attr->pinned=0;
+		attr->disabled = 0;
+		attr->read_format = get_read_format( ctl->multiplexed,
+						     ctl->inherit,
+						     0 );
+	}
+}
+
+/* A PAPI_GRN_SYS_CPU ("per node") EventSet opens its group on every */
+/* online cpu.  events[] is the group on the first of them and is     */
+/* handled like any other EventSet; the fds on the other cpus are     */
+/* kept in node_fds and are only ever touched a whole group at a time. */
+/* As these are never read with rdpmc, reads are one read() of each    */
+/* cpu's group leader back to back, see _pe_read_node().              */
+
+/* Find the online cpus a per node EventSet is opened on */
+static int
+pe_find_node_cpus( pe_control_t *ctl )
+{
+	FILE *fff;
+	int first, last, cpu, num = 0, max;
+	int sep = EOF;
+	int *cpus;
+
+	max = sysconf( _SC_NPROCESSORS_CONF );
+	if ( max < 1 ) max = 1;
+
+	cpus = papi_malloc( max * sizeof ( int ) );
+	if ( cpus == NULL ) return PAPI_ENOMEM;
+
+	/* The list looks like 0-3,8-11 */
+	fff = fopen( "/sys/devices/system/cpu/online", "r" );
+	if ( fff ) {
+		while ( fscanf( fff, "%d", &first ) == 1 ) {
+			last = first;
+			sep = fgetc( fff );
+			if ( sep == '-' ) {
+				if ( fscanf( fff, "%d", &last ) != 1 ) break;
+				sep = fgetc( fff );
+			}
+			for( cpu = first; ( cpu <= last ) && ( num < max ); cpu++ ) {
+				cpus[num++] = cpu;
+			}
+			if ( sep != ',' ) break;
 		}
-		else {
-			pid = 0;
+		fclose( fff );
+	}
+
+	/* No sysfs, assume they are all online */
+	if ( num == 0 ) {
+		num = sysconf( _SC_NPROCESSORS_ONLN );
+		if ( ( num < 1 ) || ( num > max ) ) num = max;
+		for( cpu = 0; cpu < num; cpu++ ) {
+			cpus[cpu] = cpu;
 		}
 	}
 
-	for( i = 0; i < ctl->num_events; i++ ) {
+	SUBDBG( "Per node EventSet spans %d cpus\n", num );
+
+	papi_free( ctl->node_cpus );
+	ctl->node_cpus = cpus;
+	ctl->num_node_cpus = num;
+
+	return PAPI_OK;
+}
+
+/* Drop the per node state, the fds are closed already */
+static void
+pe_free_node( pe_control_t *ctl )
+{
+	papi_free( ctl->node_cpus );
+	papi_free( ctl->node_fds );
+	papi_free( ctl->node_counts );
+	ctl->node_cpus = NULL;
+	ctl->node_fds = NULL;
+	ctl->node_counts = NULL;
+	ctl->num_node_cpus = 0;
+}
+
+/* Close the events from event first on on the cpus after the first */
+/* one and before cpu last, an event is open on all of them if it is  */
+/* open in events[]                                                   */
+static void
+close_node_events( pe_control_t *ctl, int first, int last )
+{
+	int c, i, n = ctl->num_node_cpus;
+
+	for( c = 1; c < last; c++ ) {
+		/* children first */
+		for( i = ctl->num_events - 1; i >= first; i-- ) {
+			if ( !ctl->events[i].event_opened ) continue;
+			if ( close( ctl->node_fds[i * n + c] ) ) {
+				PAPIERROR( "close of fd = %d returned error: %s",
+					   ctl->node_fds[i * n + c],
+					   strerror( errno ) );
+			}
+		}
+	}
+}
+
+/* Open the events from event first on on all but the first cpu, */
+/* events[] has just been opened on the first one                */
+static int
+open_node_events( pe_control_t *ctl, long pid, int first )
+{
+	int c, i, fd, ret, n = ctl->num_node_cpus;
+	int *fds;
+	long long *counts;
+
+	fds = papi_realloc( ctl->node_fds,
+			    ctl->num_events * n * sizeof ( int ) );
+	if ( fds == NULL ) return PAPI_ENOMEM;
+	ctl->node_fds = fds;
+
+	counts = papi_realloc( ctl->node_counts,
+			       ctl->num_events * n * sizeof ( long long ) );
+	if ( counts == NULL ) return PAPI_ENOMEM;
+	ctl->node_counts = counts;
+
+	for( i = first; i < ctl->num_events; i++ ) {
+		ctl->node_fds[i * n] = ctl->events[i].event_fd;
+	}
+
+	/* The first cpu went through check_scheduability(), the same */
+	/* group is assumed to fit on the others                      */
+	for( c = 1; c < n; c++ ) {
+		for( i = first; i < ctl->num_events; i++ ) {
+			fd = sys_perf_event_open( &ctl->events[i].attr, pid,
+						  ctl->node_cpus[c],
+						  i ? ctl->node_fds[c] : -1,
+						  0 /* flags */ );
+			if ( fd == -1 ) {
+				SUBDBG( "sys_perf_event_open returned error "
+					"on event #%d, cpu %d.  Error: %s\n",
+					i, ctl->node_cpus[c], strerror( errno ) );
+				ret = map_perf_event_errors_to_papi( errno );
+				goto open_node_cleanup;
+			}
+			ctl->node_fds[i * n + c] = fd;
+		}
+	}
+
+	return PAPI_OK;
+
+open_node_cleanup:
+	/* the cpus before c are complete, c has events first..i-1 */
+	while ( i > first ) {
+		i--;
+		close( ctl->node_fds[i * n + c] );
+	}
+	close_node_events( ctl, first, c );
+
+	return ret;
+}
+
+/* Apply a group ioctl to the groups on all but the first cpu, the  */
+/* caller takes care of events[].  An enable that fails partway      */
+/* disables the groups it already enabled, a disable carries on past */
+/* a failure so no group is left counting.                           */
+static int
+pe_node_ioctl( pe_control_t *ctl, unsigned long request )
+{
+	int c, ret = PAPI_OK;
+
+	for( c = 1; c < ctl->num_node_cpus; c++ ) {
+		if ( ioctl( ctl->node_fds[c], request, PERF_IOC_FLAG_GROUP ) == -1 ) {
+			PAPIERROR( "ioctl(%d, %#lx, PERF_IOC_FLAG_GROUP) on "
+				   "cpu %d returned error, Linux says: %s",
+				   ctl->node_fds[c], request,
+				   ctl->node_cpus[c], strerror( errno ) );
+			ret = PAPI_ESYS;
+			if ( request != PERF_EVENT_IOC_DISABLE ) break;
+		}
+	}
+
+	if ( ( ret != PAPI_OK ) && ( request == PERF_EVENT_IOC_ENABLE ) ) {
+		while ( --c >= 1 ) {
+			ioctl( ctl->node_fds[c], PERF_EVENT_IOC_DISABLE,
+			       PERF_IOC_FLAG_GROUP );
+		}
+	}
+
+	return ret;
+}
+
+/* Disable the group leaders in events[] before event last, */
+/* to undo a start that failed partway                      */
+static void
+pe_disable_leaders( pe_control_t *ctl, int last )
+{
+	int i;
+
+	for( i = 0; i < last; i++ ) {
+		if ( ctl->events[i].group_leader_fd == -1 ) {
+			ioctl( ctl->events[i].event_fd, PERF_EVENT_IOC_DISABLE, NULL );
+		}
+	}
+}
+
+/* Open the events in the control state from event first on, */
+/* events before it are already open and stay as they are     */
+static int
+open_pe_events( pe_context_t *ctx, pe_control_t *ctl, int first )
+{
+
+	int i, cpu, ret = PAPI_OK;
+	long pid;
+
+
+	/* Set the pid setting */
+	pid = pe_event_pid( ctl );
+	ctl->pid = pid;
+
+	/* A per node EventSet finds its cpus when it is opened from scratch */
+	if ( first == 0 ) {
+		if ( ctl->granularity == PAPI_GRN_SYS_CPU ) {
+			ret = pe_find_node_cpus( ctl );
+			if ( ret != PAPI_OK ) return ret;
+		}
+		else if ( ctl->num_node_cpus ) {
+			pe_free_node( ctl );
+		}
+	}
+
+	for( i = first; i < ctl->num_events; i++ ) {
 
 		ctl->events[i].event_opened=0;
 
 		/* set up the attr structure.			*/
 		/* We don't set up all fields here		*/
 		/* as some have already been set up previously.	*/
+		pe_set_group_attr( ctl, i, &ctl->events[i].attr );
 
-		/* Handle the broken exclude_guest problem */
-		/* libpfm4 sets this by default (PEBS events depend on it) */
-		/* but on older kernels that dont know about exclude_guest */
-		/* perf_event_open() will error out as a "reserved"        */
-		/* unknown bit is set to 1.                                */
-		/* Do we need to also watch for exclude_host, exclude_idle */
-		/* exclude_callchain*?					   */
-		if ((ctl->events[i].attr.exclude_guest) &&
-			(exclude_guest_unsupported)) {
-			SUBDBG("Disabling exclude_guest in event %d\n",i);
-			ctl->events[i].attr.exclude_guest=0;
-		}
-
-		/* group leader (event 0) is special                */
-		/* If we're multiplexed, everyone is a group leader */
 		if (( i == 0 ) || (ctl->multiplexed)) {
-			ctl->events[i].attr.pinned = !ctl->multiplexed;
-			ctl->events[i].attr.disabled = 1;
 			ctl->events[i].group_leader_fd=-1;
-			ctl->events[i].attr.read_format = get_read_format(
-							ctl->multiplexed,
-							ctl->inherit,
-							!ctl->multiplexed );
 		} else {
-			ctl->events[i].attr.pinned=0;
-			ctl->events[i].attr.disabled = 0;
 			ctl->events[i].group_leader_fd=ctl->events[0].event_fd;
-			ctl->events[i].attr.read_format = get_read_format(
-							ctl->multiplexed,
-							ctl->inherit,
-							0 );
 		}
 
+		/* a per node EventSet has events[] on its first cpu */
+		cpu = ctl->num_node_cpus ? ctl->node_cpus[0] : ctl->events[i].cpu;
+
 		/* try to open */
 		perf_event_dump_attr(
 				&ctl->events[i].attr,
 				pid,
-				ctl->events[i].cpu,
+				cpu,
 				ctl->events[i].group_leader_fd,
 				0 /* flags */ );
 
 		ctl->events[i].event_fd = sys_perf_event_open(
 				&ctl->events[i].attr,
 				pid,
-				ctl->events[i].cpu,
+				cpu,
 				ctl->events[i].group_leader_fd,
 				0 /* flags */ );
 
@@ -772,7 +996,7 @@ open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 		SUBDBG ("sys_perf_event_open: tid: %ld, cpu_num: %d,"
 			" group_leader/fd: %d, event_fd: %d,"
 			" read_format: %"PRIu64"\n",
-			pid, ctl->events[i].cpu,
+			pid, cpu,
 			ctl->events[i].group_leader_fd,
 			ctl->events[i].event_fd,
 			ctl->events[i].attr.read_format);
@@ -798,6 +1022,14 @@ open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 		ctl->events[i].event_opened=1;
 	}
 
+	/* then the same group on the other cpus of a per node EventSet */
+	if ( ctl->num_node_cpus ) {
+		ret = open_node_events( ctl, pid, first );
+		if ( ret != PAPI_OK ) {
+			goto open_pe_cleanup;
+		}
+	}
+
 	/* Now that we've successfully opened all of the events, do whatever  */
 	/* "tune-up" is needed to attach the mmap'd buffers, signal handlers, */
 	/* and so on.                                                         */
@@ -808,10 +1040,11 @@ open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 	/* Would be a pain.  Also perf always gives every event a */
 	/* mmap buffer.						  */
 
-	for ( i = 0; i < ctl->num_events; i++ ) {
+	for ( i = first; i < ctl->num_events; i++ ) {
 
-		/* Can't mmap() inherited events :( */
-		if (ctl->inherit) {
+		/* Can't mmap() inherited events :(           */
+		/* nor use rdpmc on the cpus of a per node set */
+		if ((ctl->inherit) || (ctl->num_node_cpus)) {
 			ctl->events[i].nr_mmap_pages = 0;
 			ctl->events[i].mmap_buf = NULL;
 		}
@@ -842,7 +1075,17 @@ open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 		}
 	}
 
-	for ( i = 0; i < ctl->num_events; i++ ) {
+	/* Note which events can be read from userspace.  An event   */
+	/* can still fail an individual rdpmc read (for example if   */
+	/* it is not currently scheduled) and is then read with the  */
+	/* read() syscall instead, see _pe_read().                   */
+	for ( i = first; i < ctl->num_events; i++ ) {
+		ctl->events[i].rdpmc_ok =
+			( _perf_event_vector.cmp_info.fast_counter_read ) &&
+			( ctl->events[i].mmap_buf != NULL );
+	}
+
+	for ( i = first; i < ctl->num_events; i++ ) {
 
 		/* If sampling is enabled, hook up signal handler */
 		if (ctl->events[i].attr.sample_period) {
@@ -851,12 +1094,19 @@ open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 			if ( ret != PAPI_OK ) {
 				/* We failed, and all of the fds are open */
 				/* so we need to clean up all of them */
+				if ( ctl->num_node_cpus ) {
+					close_node_events( ctl, first,
+							   ctl->num_node_cpus );
+				}
 				i = ctl->num_events;
 				goto open_pe_cleanup;
 			}
 		}
 	}
 
+	/* Fresh events start out disabled */
+	ctl->virtual_armed = 0;
+
 	/* Set num_evts only if completely successful */
 	ctx->state |= PERF_EVENTS_OPENED;
 
@@ -866,7 +1116,7 @@ open_pe_cleanup:
 	/* We encountered an error, close up the fds we successfully opened.  */
 	/* We go backward in an attempt to close group leaders last, although */
 	/* That's probably not strictly necessary.                            */
-	while ( i > 0 ) {
+	while ( i > first ) {
 		i--;
 		if (ctl->events[i].event_fd>=0) {
 			close( ctl->events[i].event_fd );
@@ -911,9 +1161,10 @@ close_event( pe_event_info_t *event )
 	return 0;
 }
 
-/* Close all of the opened events */
+/* Close the opened events from event first on, events before it */
+/* stay open and become the whole control state                    */
 static int
-close_pe_events( pe_context_t *ctx, pe_control_t *ctl )
+close_pe_events_from( pe_context_t *ctx, pe_control_t *ctl, int first )
 {
 	int i,result;
 	int num_closed=0;
@@ -924,9 +1175,14 @@ close_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 		SUBDBG("Closing without stopping first\n");
 	}
 
+	/* The other cpus of a per node EventSet go first */
+	if ( ctl->num_node_cpus ) {
+		close_node_events( ctl, first, ctl->num_node_cpus );
+	}
+
 	/* Close child events first */
 	/* Is that necessary? -- vmw */
-	for( i=0; i<ctl->num_events; i++ ) {
+	for( i=first; i<ctl->num_events; i++ ) {
 		if (ctl->events[i].event_opened) {
 			if (ctl->events[i].group_leader_fd!=-1) {
 				result=close_event(&ctl->events[i]);
@@ -940,7 +1196,7 @@ close_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 	}
 
 	/* Close the group leaders last */
-	for( i=0; i<ctl->num_events; i++ ) {
+	for( i=first; i<ctl->num_events; i++ ) {
 		if (ctl->events[i].event_opened) {
 			if (ctl->events[i].group_leader_fd==-1) {
 				result=close_event(&ctl->events[i]);
@@ -950,22 +1206,130 @@ close_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 		}
 	}
 
-	if (ctl->num_events!=num_closed) {
-		if (ctl->num_events!=(num_closed+events_not_opened)) {
+	if (ctl->num_events-first!=num_closed) {
+		if (ctl->num_events-first!=(num_closed+events_not_opened)) {
 			PAPIERROR("Didn't close all events: "
 				"Closed %d Not Opened: %d Expected %d",
-				num_closed,events_not_opened,ctl->num_events);
+				num_closed,events_not_opened,
+				ctl->num_events-first);
 			return PAPI_EBUG;
 		}
 	}
 
-	ctl->num_events=0;
+	ctl->num_events=first;
 
-	ctx->state &= ~PERF_EVENTS_OPENED;
+	if (first==0) {
+		ctx->state &= ~PERF_EVENTS_OPENED;
+	}
 
 	return PAPI_OK;
 }
 
+/* Close all of the opened events */
+static int
+close_pe_events( pe_context_t *ctx, pe_control_t *ctl )
+{
+	return close_pe_events_from( ctx, ctl, 0 );
+}
+
+/* Close the group a cleanup left open in this thread */
+static void
+close_parked_events( pe_context_t *ctx )
+{
+	int i;
+
+	/* children first, as in close_pe_events() */
+	for( i=ctx->num_parked-1; i>=0; i-- ) {
+		close_event( &ctx->parked[i] );
+	}
+
+	papi_free( ctx->parked );
+	ctx->parked=NULL;
+	ctx->num_parked=0;
+}
+
+/* PAPI_cleanup_eventset() followed by PAPI_add_event() is how many   */
+/* tools reuse an EventSet, so instead of closing its events the     */
+/* group is parked in the thread's context, still open and disabled.  */
+/* The next EventSet of this thread that starts with the same events  */
+/* takes it over, see _pe_update_control_state().  Only one group is  */
+/* parked per thread, anything else is simply closed.                 */
+static int
+park_pe_events( pe_context_t *ctx, pe_control_t *ctl )
+{
+	int i, ret;
+
+	/* A per node EventSet is not worth keeping around */
+	if ( ctl->num_node_cpus ) {
+		ret = close_pe_events( ctx, ctl );
+		pe_free_node( ctl );
+		return ret;
+	}
+
+	if ( ctl->num_events==0 ) {
+		return PAPI_OK;
+	}
+
+	/* Sampling fds have signals set up and virtual start leaves */
+	/* counters enabled, neither can be handed to someone else.  */
+	if ( ( ctx->state & PERF_EVENTS_RUNNING ) || ( ctl->virtual_armed ) ) {
+		return close_pe_events( ctx, ctl );
+	}
+	for( i=0; i<ctl->num_events; i++ ) {
+		if ( ( !ctl->events[i].event_opened ) ||
+		     ( ctl->events[i].attr.sample_period ) ) {
+			return close_pe_events( ctx, ctl );
+		}
+	}
+
+	if ( ctx->parked ) {
+		close_parked_events( ctx );
+	}
+
+	ctx->parked=papi_malloc( ctl->num_events*sizeof(pe_event_info_t) );
+	if ( ctx->parked==NULL ) {
+		return close_pe_events( ctx, ctl );
+	}
+
+	memcpy( ctx->parked, ctl->events,
+		ctl->num_events*sizeof(pe_event_info_t) );
+	ctx->num_parked=ctl->num_events;
+	ctx->parked_pid=ctl->pid;
+
+	SUBDBG("Parked %d events, leader fd %d\n",
+	       ctx->num_parked, ctx->parked[0].event_fd);
+
+	ctl->num_events=0;
+
+	return PAPI_OK;
+}
+
+/* Give the parked group of this thread to an empty control state */
+static void
+adopt_parked_events( pe_context_t *ctx, pe_control_t *ctl )
+{
+	if ( ( ctx->parked==NULL ) || ( ctl->num_events ) ) {
+		return;
+	}
+
+	if ( ctx->parked_pid!=pe_event_pid( ctl ) ) {
+		close_parked_events( ctx );
+		return;
+	}
+
+	memcpy( ctl->events, ctx->parked,
+		ctx->num_parked*sizeof(pe_event_info_t) );
+	ctl->num_events=ctx->num_parked;
+	ctl->pid=ctx->parked_pid;
+	ctl->virtual_armed=0;
+
+	papi_free( ctx->parked );
+	ctx->parked=NULL;
+	ctx->num_parked=0;
+
+	ctx->state |= PERF_EVENTS_OPENED;
+}
+
 
 /********************************************************************/
 /********************************************************************/
@@ -1004,6 +1368,10 @@ _pe_shutdown_thread( hwd_context_t *ctx )
 
 	pe_ctx->initialized=0;
 
+	if ( pe_ctx->parked ) {
+		close_parked_events( pe_ctx );
+	}
+
 	return PAPI_OK;
 }
 
@@ -1039,6 +1407,12 @@ _pe_reset( hwd_context_t *ctx, hwd_control_state_t *ctl )
 
 	( void ) ctx;			 /*unused */
 
+	/* Counters left running by virtual start/stop are never reset, */
+	/* we move the baseline instead                                 */
+	if (pe_ctl->virtual_armed) {
+		return _pe_virtual_snapshot( pe_ctl );
+	}
+
 	/* We need to reset all of the events, not just the group leaders */
 	for( i = 0; i < pe_ctl->num_events; i++ ) {
 		ret = ioctl( pe_ctl->events[i].event_fd,
@@ -1052,7 +1426,8 @@ _pe_reset( hwd_context_t *ctx, hwd_control_state_t *ctl )
 		}
 	}
 
-	return PAPI_OK;
+	/* the other cpus of a per node set, one group at a time */
+	return pe_node_ioctl( pe_ctl, PERF_EVENT_IOC_RESET );
 }
 
 
@@ -1092,33 +1467,38 @@ _pe_write( hwd_context_t *ctx, hwd_control_state_t *ctl,
 /* When we read with rdpmc, we must read each counter individually */
 /* Because of this we don't need separate multiplexing support */
 /* This is all handled by mmap_read_self() */
+
+/* Events that cannot be read this way (rdpmc not usable for the */
+/* event, or the event is not currently scheduled on a counter)  */
+/* are flagged in pending[] so the caller can read them with the */
+/* read() syscall.  Returns the number of pending events.        */
 static int
-_pe_rdpmc_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
-		long long **events, int flags )
+_pe_rdpmc_read( pe_control_t *pe_ctl, char *pending )
 {
-	long long papi_pe_buffer[READ_BUFFER_SIZE];
-
-	SUBDBG("ENTER: ctx: %p, ctl: %p, events: %p, flags: %#x\n",
-		ctx, ctl, events, flags);
-
-	( void ) flags;			/*unused */
-	( void ) ctx;			/*unused */
-	( void ) papi_pe_buffer;	/*unused */
 	int i;
-	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
 	unsigned long long count, enabled = 0, running = 0, adjusted;
-	int errors=0;
+	int slow=0;
 
 	/* we must read each counter individually */
 	for ( i = 0; i < pe_ctl->num_events; i++ ) {
 
+		if (!pe_ctl->events[i].rdpmc_ok) {
+			pending[i]=1;
+			slow++;
+			continue;
+		}
+
 		count = mmap_read_self(pe_ctl->events[i].mmap_buf,
 						&enabled,&running);
 
 		if (count==0xffffffffffffffffULL) {
-			errors++;
+			pending[i]=1;
+			slow++;
+			continue;
 		}
 
+		pending[i]=0;
+
 		/* Handle multiplexing case */
 		if (enabled == running) {
 			/* no adjustment needed */
@@ -1131,26 +1511,26 @@ _pe_rdpmc_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
 		} else {
 			/* This should not happen, but we have had it reported */
 			SUBDBG("perf_event kernel bug(?) count, enabled, "
-				"running: %lld, %lld, %lld\n",
-				papi_pe_buffer[0],enabled,running);
+				"running: %llu, %llu, %llu\n",
+				count,enabled,running);
 
 		}
 
 		pe_ctl->counts[i] = count;
 	}
-	/* point PAPI to the values we read */
-	*events = pe_ctl->counts;
 
-	SUBDBG("EXIT: *events: %p\n", *events);
+	SUBDBG("rdpmc read %d of %d events\n",
+		pe_ctl->num_events-slow, pe_ctl->num_events);
 
-	if (errors) return PAPI_ESYS;
-
-	return PAPI_OK;
+	return slow;
 }
 
 
+/* In the per-event read() helpers below, pending may be NULL, */
+/* in which case every event in the control state is read.     */
+
 static int
-_pe_read_multiplexed( pe_control_t *pe_ctl )
+_pe_read_multiplexed( pe_control_t *pe_ctl, const char *pending )
 {
 	int i,ret=-1;
 	long long papi_pe_buffer[READ_BUFFER_SIZE];
@@ -1161,6 +1541,8 @@ _pe_read_multiplexed( pe_control_t *pe_ctl )
 
 	for ( i = 0; i < pe_ctl->num_events; i++ ) {
 
+		if ((pending) && (!pending[i])) continue;
+
 		ret = read( pe_ctl->events[i].event_fd,
 				papi_pe_buffer,
 				sizeof ( papi_pe_buffer ) );
@@ -1222,13 +1604,16 @@ _pe_read_multiplexed( pe_control_t *pe_ctl )
 /* This includes when INHERIT is set, as well as various bugs */
 
 static int
-_pe_read_nogroup( pe_control_t *pe_ctl ) {
+_pe_read_nogroup( pe_control_t *pe_ctl, const char *pending ) {
 
 	int i,ret=-1;
 	long long papi_pe_buffer[READ_BUFFER_SIZE];
 
 	/* we must read each counter individually */
 	for ( i = 0; i < pe_ctl->num_events; i++ ) {
+
+		if ((pending) && (!pending[i])) continue;
+
 		ret = read( pe_ctl->events[i].event_fd,
 				papi_pe_buffer,
 				sizeof ( papi_pe_buffer ) );
@@ -1259,89 +1644,274 @@ _pe_read_nogroup( pe_control_t *pe_ctl ) {
 
 }
 
+/* Handle common case where we are using FORMAT_GROUP	*/
+/* We assume only one group leader, in position 0	*/
+
+/* By reading the leader file descriptor, we get a series */
+/* of 64-bit values.  The first is the total number of    */
+/* events, followed by the counts for them.               */
+
+/* A single read() returns the whole group, so even if    */
+/* only some events are pending we pay for one syscall.   */
+
 static int
-_pe_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
-	       long long **events, int flags )
-{
-	SUBDBG("ENTER: ctx: %p, ctl: %p, events: %p, flags: %#x\n",
-		ctx, ctl, events, flags);
+_pe_read_group( pe_control_t *pe_ctl, const char *pending ) {
 
-	( void ) flags;			 /*unused */
-	( void ) ctx;			 /*unused */
-	int i, j, ret = -1;
-	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
+	int i,j,ret=-1;
 	long long papi_pe_buffer[READ_BUFFER_SIZE];
-	int result;
 
-	/* Handle fast case */
-	/* FIXME: we fallback to slow reads if *any* event in eventset fails */
-	/*        in theory we could only fall back for the one event        */
-	/*        but that makes the code more complicated.                  */
-	if ((_perf_event_vector.cmp_info.fast_counter_read) && (!pe_ctl->inherit)) {
-		result=_pe_rdpmc_read( ctx, ctl, events, flags);
-		/* if successful we are done, otherwise fall back to read */
-		if (result==PAPI_OK) return PAPI_OK;
+	if (pe_ctl->events[0].group_leader_fd!=-1) {
+		PAPIERROR("Was expecting group leader");
 	}
 
-	/* Handle case where we are multiplexing */
-	if (pe_ctl->multiplexed) {
-		_pe_read_multiplexed(pe_ctl);
+	ret = read( pe_ctl->events[0].event_fd,
+		papi_pe_buffer,
+		sizeof ( papi_pe_buffer ) );
+
+	if ( ret == -1 ) {
+		PAPIERROR("read returned an error: ",
+			strerror( errno ));
+		return PAPI_ESYS;
 	}
 
-	/* Handle cases where we cannot use FORMAT GROUP */
-	else if (bug_format_group() || pe_ctl->inherit) {
-		_pe_read_nogroup(pe_ctl);
+	/* we read 1 64-bit value (number of events) then     */
+	/* num_events more 64-bit values that hold the counts */
+	if (ret<(signed)((1+pe_ctl->num_events)*sizeof(long long))) {
+		PAPIERROR("Error! short read");
+		return PAPI_ESYS;
 	}
 
-	/* Handle common case where we are using FORMAT_GROUP	*/
-	/* We assume only one group leader, in position 0	*/
+	SUBDBG("read: fd: %2d, tid: %ld, cpu: %d, ret: %d\n",
+		pe_ctl->events[0].event_fd,
+		(long)pe_ctl->tid, pe_ctl->events[0].cpu, ret);
 
-	/* By reading the leader file descriptor, we get a series */
-	/* of 64-bit values.  The first is the total number of    */
-	/* events, followed by the counts for them.               */
+	for(j=0;j<ret/8;j++) {
+		SUBDBG("read %d: %lld\n",j,papi_pe_buffer[j]);
+	}
 
-	else {
-		if (pe_ctl->events[0].group_leader_fd!=-1) {
-			PAPIERROR("Was expecting group leader");
-		}
+	/* Make sure the kernel agrees with how many events we have */
+	if (papi_pe_buffer[0]!=pe_ctl->num_events) {
+		PAPIERROR("Error!  Wrong number of events");
+		return PAPI_ESYS;
+	}
+
+	/* put the count values in their proper location */
+	for(i=0;i<pe_ctl->num_events;i++) {
+		if ((pending) && (!pending[i])) continue;
+		pe_ctl->counts[i] = papi_pe_buffer[1+i];
+	}
+
+	return PAPI_OK;
+}
+
+/* A per node set reads the group leader of every cpu back to back, */
+/* the counts are kept per cpu and summed into counts[]               */
+static int
+_pe_read_node( pe_control_t *pe_ctl )
+{
+	int c, i, ret;
+	int n = pe_ctl->num_node_cpus;
+	long long papi_pe_buffer[READ_BUFFER_SIZE];
+	long long *counts;
 
-		ret = read( pe_ctl->events[0].event_fd,
-			papi_pe_buffer,
-			sizeof ( papi_pe_buffer ) );
+	for( i = 0; i < pe_ctl->num_events; i++ ) {
+		pe_ctl->counts[i] = 0;
+	}
 
+	for( c = 0; c < n; c++ ) {
+		ret = read( pe_ctl->node_fds[c], papi_pe_buffer,
+			    sizeof ( papi_pe_buffer ) );
 		if ( ret == -1 ) {
 			PAPIERROR("read returned an error: ",
 				strerror( errno ));
 			return PAPI_ESYS;
 		}
 
-		/* we read 1 64-bit value (number of events) then     */
-		/* num_events more 64-bit values that hold the counts */
-		if (ret<(signed)((1+pe_ctl->num_events)*sizeof(long long))) {
-			PAPIERROR("Error! short read");
+		/* the number of events, then their counts */
+		if ( ( ret < (signed)((1+pe_ctl->num_events)*sizeof(long long)) ) ||
+		     ( papi_pe_buffer[0] != pe_ctl->num_events ) ) {
+			PAPIERROR("Error! short read on cpu %d",
+				  pe_ctl->node_cpus[c]);
 			return PAPI_ESYS;
 		}
 
-		SUBDBG("read: fd: %2d, tid: %ld, cpu: %d, ret: %d\n",
-			pe_ctl->events[0].event_fd,
-			(long)pe_ctl->tid, pe_ctl->events[0].cpu, ret);
-
-		for(j=0;j<ret/8;j++) {
-			SUBDBG("read %d: %lld\n",j,papi_pe_buffer[j]);
+		counts = pe_ctl->node_counts + c * pe_ctl->num_events;
+		for( i = 0; i < pe_ctl->num_events; i++ ) {
+			counts[i] = papi_pe_buffer[1+i];
+			pe_ctl->counts[i] += counts[i];
 		}
+	}
 
-		/* Make sure the kernel agrees with how many events we have */
-		if (papi_pe_buffer[0]!=pe_ctl->num_events) {
-			PAPIERROR("Error!  Wrong number of events");
-			return PAPI_ESYS;
+	return PAPI_OK;
+}
+
+/* First half of a read: read whatever we can from userspace.   */
+/* Returns the number of events left for _pe_read_syscall(),     */
+/* which are flagged in pe_ctl->pending.                         */
+static int
+_pe_read_userspace( pe_control_t *pe_ctl )
+{
+	/* Handle fast case */
+	/* Events that rdpmc could not read are left pending and    */
+	/* are picked up by _pe_read_syscall(), so one failing event */
+	/* does not force the whole eventset onto the slow path.     */
+	if ((_perf_event_vector.cmp_info.fast_counter_read) && (!pe_ctl->inherit)) {
+		return _pe_rdpmc_read( pe_ctl, pe_ctl->pending );
+	}
+
+	return pe_ctl->num_events;
+}
+
+/* read() the slow events rdpmc could not handle */
+static int
+_pe_read_pending( pe_control_t *pe_ctl, int slow )
+{
+	const char *to_read = NULL;
+
+	if (slow==0) {
+		return PAPI_OK;
+	}
+
+	if (slow<pe_ctl->num_events) {
+		to_read = pe_ctl->pending;
+	}
+
+	/* Handle case where we span a node */
+	if (pe_ctl->num_node_cpus) {
+		return _pe_read_node(pe_ctl);
+	}
+
+	/* Handle case where we are multiplexing */
+	if (pe_ctl->multiplexed) {
+		return _pe_read_multiplexed(pe_ctl, to_read);
+	}
+
+	/* Handle cases where we cannot use FORMAT GROUP */
+	if (bug_format_group() || pe_ctl->inherit) {
+		return _pe_read_nogroup(pe_ctl, to_read);
+	}
+
+	/* Handle common case where we are using FORMAT_GROUP */
+	return _pe_read_group(pe_ctl, to_read);
+}
+
+/* Second half of a read: read() the events rdpmc could not handle, */
+/* counting which way the read went for PAPI_READ_STATS             */
+static int
+_pe_read_syscall( pe_control_t *pe_ctl, int slow )
+{
+	if (slow==0) {
+		pe_ctl->reads_fast++;
+	}
+	else if (slow<pe_ctl->num_events) {
+		pe_ctl->reads_mixed++;
+	}
+	else {
+		pe_ctl->reads_slow++;
+	}
+
+	return _pe_read_pending( pe_ctl, slow );
+}
+
+/* Virtual start/stop (PAPI_VIRTUAL_START) leaves the counters enabled */
+/* after the first start.  Start and reset then only record a baseline */
+/* with rdpmc, reads subtract it and stop does nothing, so no ioctl is */
+/* needed.  This only works for self-monitoring, non-multiplexed,      */
+/* non-sampling eventsets whose events can all be read with rdpmc;     */
+/* anything else keeps using the enable/disable ioctls.  A virtually   */
+/* stopped eventset still holds its counters, other eventsets and      */
+/* processes have to share the PMU with it until it is cleaned up or   */
+/* the option is turned off.                                           */
+static int
+_pe_virtual_usable( pe_control_t *pe_ctl )
+{
+	int i;
+
+	if ((!pe_ctl->virtual_start) || (pe_ctl->multiplexed) ||
+		(pe_ctl->inherit) || (pe_ctl->attached) || (pe_ctl->overflow) ||
+		(pe_ctl->granularity==PAPI_GRN_SYS) ||
+		(pe_ctl->granularity==PAPI_GRN_SYS_CPU) || (pe_ctl->cpu!=-1)) {
+		return 0;
+	}
+
+	for ( i = 0; i < pe_ctl->num_events; i++ ) {
+		if ((!pe_ctl->events[i].rdpmc_ok) || (pe_ctl->events[i].sampling)) {
+			return 0;
 		}
+	}
+
+	return pe_ctl->num_events > 0;
+}
+
+/* Enable the group leaders once, without a reset */
+static int
+_pe_virtual_arm( pe_control_t *pe_ctl )
+{
+	int i, ret;
 
-		/* put the count values in their proper location */
-		for(i=0;i<pe_ctl->num_events;i++) {
-			pe_ctl->counts[i] = papi_pe_buffer[1+i];
+	for( i = 0; i < pe_ctl->num_events; i++ ) {
+		if (pe_ctl->events[i].group_leader_fd == -1) {
+			ret=ioctl( pe_ctl->events[i].event_fd,
+				PERF_EVENT_IOC_ENABLE, NULL) ;
+			if (ret == -1) {
+				PAPIERROR("ioctl(PERF_EVENT_IOC_ENABLE) failed");
+				return PAPI_ESYS;
+			}
 		}
 	}
 
+	pe_ctl->virtual_armed = 1;
+
+	return PAPI_OK;
+}
+
+/* Take the current counts as the new zero.  This is not a read */
+/* the user asked for, so it stays out of the read statistics.  */
+static int
+_pe_virtual_snapshot( pe_control_t *pe_ctl )
+{
+	int i, ret;
+
+	ret = _pe_read_pending( pe_ctl, _pe_read_userspace( pe_ctl ) );
+	if (ret!=PAPI_OK) return ret;
+
+	for ( i = 0; i < pe_ctl->num_events; i++ ) {
+		pe_ctl->baseline[i] = pe_ctl->counts[i];
+	}
+
+	return PAPI_OK;
+}
+
+/* Turn raw counts into counts since the last start or reset */
+static void
+_pe_virtual_adjust( pe_control_t *pe_ctl )
+{
+	int i;
+
+	for ( i = 0; i < pe_ctl->num_events; i++ ) {
+		pe_ctl->counts[i] -= pe_ctl->baseline[i];
+	}
+}
+
+static int
+_pe_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
+	       long long **events, int flags )
+{
+	SUBDBG("ENTER: ctx: %p, ctl: %p, events: %p, flags: %#x\n",
+		ctx, ctl, events, flags);
+
+	( void ) flags;			 /*unused */
+	( void ) ctx;			 /*unused */
+	int ret;
+	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
+
+	ret = _pe_read_syscall( pe_ctl, _pe_read_userspace( pe_ctl ) );
+	if (ret!=PAPI_OK) return ret;
+
+	if (pe_ctl->virtual_armed) {
+		_pe_virtual_adjust( pe_ctl );
+	}
+
 	/* point PAPI to the values we read */
 	*events = pe_ctl->counts;
 
@@ -1350,6 +1920,73 @@ _pe_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
 	return PAPI_OK;
 }
 
+/* Read several eventsets in one pass.  All of the rdpmc reads  */
+/* are done first, back to back, and then the group leaders of  */
+/* every eventset are read() one after the other, so the values */
+/* of the different eventsets are as close together as we can   */
+/* get them.                                                    */
+static int
+_pe_read_many( hwd_context_t **ctx, hwd_control_state_t **ctl,
+		int num, long long **events )
+{
+	SUBDBG("ENTER: ctx: %p, ctl: %p, num: %d, events: %p\n",
+		ctx, ctl, num, events);
+
+	( void ) ctx;			 /*unused */
+	int i, ret;
+	pe_control_t *pe_ctl;
+
+	for ( i = 0; i < num; i++ ) {
+		pe_ctl = ( pe_control_t *) ctl[i];
+		pe_ctl->num_pending = _pe_read_userspace( pe_ctl );
+	}
+
+	for ( i = 0; i < num; i++ ) {
+		pe_ctl = ( pe_control_t *) ctl[i];
+		ret = _pe_read_syscall( pe_ctl, pe_ctl->num_pending );
+		if (ret!=PAPI_OK) return ret;
+
+		if (pe_ctl->virtual_armed) {
+			_pe_virtual_adjust( pe_ctl );
+		}
+
+		/* point PAPI to the values we read */
+		events[i] = pe_ctl->counts;
+	}
+
+	SUBDBG("EXIT: PAPI_OK\n");
+
+	return PAPI_OK;
+}
+
+/* The counts of every cpu a per node set spans.  Any other set is */
+/* one row, for the cpu it is bound to (-1 if it is not).          */
+static int
+_pe_read_cpus( hwd_context_t *ctx, hwd_control_state_t *ctl,
+	       long long **events, int **cpus, int *num_cpus )
+{
+	int ret;
+	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
+
+	if (!pe_ctl->num_node_cpus) {
+		ret = _pe_read( ctx, ctl, events, 0 );
+		if (ret!=PAPI_OK) return ret;
+
+		*cpus = &pe_ctl->cpu;
+		*num_cpus = 1;
+		return PAPI_OK;
+	}
+
+	ret = _pe_read_syscall( pe_ctl, pe_ctl->num_events );
+	if (ret!=PAPI_OK) return ret;
+
+	*events = pe_ctl->node_counts;
+	*cpus = pe_ctl->node_cpus;
+	*num_cpus = pe_ctl->num_node_cpus;
+
+	return PAPI_OK;
+}
+
 #if (OBSOLETE_WORKAROUNDS==1)
 /* On kernels before 2.6.33 the TOTAL_TIME_ENABLED and TOTAL_TIME_RUNNING */
 /* fields are always 0 unless the counter is disabled.  So if we are on   */
@@ -1418,6 +2055,26 @@ _pe_start( hwd_context_t *ctx, hwd_control_state_t *ctl )
 	pe_context_t *pe_ctx = ( pe_context_t *) ctx;
 	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
 
+	/* Virtual start: enable once, then only take a snapshot */
+	if (_pe_virtual_usable( pe_ctl )) {
+		if (!pe_ctl->virtual_armed) {
+			ret = _pe_virtual_arm( pe_ctl );
+			if ( ret ) {
+				return ret;
+			}
+		}
+		ret = _pe_virtual_snapshot( pe_ctl );
+		if ( ret ) {
+			return ret;
+		}
+		pe_ctx->state |= PERF_EVENTS_RUNNING;
+		return PAPI_OK;
+	}
+
+	/* Anything left enabled by virtual start is reset and */
+	/* re-enabled below, and from now on stopped for real  */
+	pe_ctl->virtual_armed = 0;
+
 	/* Reset the counters first.  Is this necessary? */
 	ret = _pe_reset( pe_ctx, pe_ctl );
 	if ( ret ) {
@@ -1436,6 +2093,7 @@ _pe_start( hwd_context_t *ctx, hwd_control_state_t *ctl )
 			/* ioctls always return -1 on failure */
 			if (ret == -1) {
 				PAPIERROR("ioctl(PERF_EVENT_IOC_ENABLE) failed");
+				pe_disable_leaders( pe_ctl, i );
 				return PAPI_ESYS;
 			}
 
@@ -1448,6 +2106,13 @@ _pe_start( hwd_context_t *ctx, hwd_control_state_t *ctl )
 		return PAPI_EBUG;
 	}
 
+	/* the other cpus of a per node set, none counts if one fails */
+	ret = pe_node_ioctl( pe_ctl, PERF_EVENT_IOC_ENABLE );
+	if ( ret ) {
+		pe_disable_leaders( pe_ctl, pe_ctl->num_events );
+		return ret;
+	}
+
 	pe_ctx->state |= PERF_EVENTS_RUNNING;
 
 	return PAPI_OK;
@@ -1460,12 +2125,20 @@ _pe_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
 {
 	SUBDBG( "ENTER: ctx: %p, ctl: %p\n", ctx, ctl);
 
-	int ret;
+	int ret, failed = PAPI_OK;
 	int i;
 	pe_context_t *pe_ctx = ( pe_context_t *) ctx;
 	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
 
-	/* Just disable the group leaders */
+	/* Virtual stop: PAPI_stop() has already read the values and */
+	/* the next start takes a new baseline, so leave them running */
+	if (pe_ctl->virtual_armed) {
+		pe_ctx->state &= ~PERF_EVENTS_RUNNING;
+		SUBDBG( "EXIT: virtual\n");
+		return PAPI_OK;
+	}
+
+	/* Just disable the group leaders, all of them even if one fails */
 	for ( i = 0; i < pe_ctl->num_events; i++ ) {
 		if ( pe_ctl->events[i].group_leader_fd == -1 ) {
 			ret=ioctl( pe_ctl->events[i].event_fd,
@@ -1474,11 +2147,19 @@ _pe_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
 				PAPIERROR( "ioctl(%d, PERF_EVENT_IOC_DISABLE, NULL) "
 					"returned error, Linux says: %s",
 					pe_ctl->events[i].event_fd, strerror( errno ) );
-				return PAPI_EBUG;
+				failed = PAPI_EBUG;
 			}
 		}
 	}
 
+	ret = pe_node_ioctl( pe_ctl, PERF_EVENT_IOC_DISABLE );
+	if ( failed ) {
+		return failed;
+	}
+	if ( ret ) {
+		return ret;
+	}
+
 	pe_ctx->state &= ~PERF_EVENTS_RUNNING;
 
 	SUBDBG( "EXIT:\n");
@@ -1495,7 +2176,11 @@ _pe_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
 
 /* This function clears the current contents of the control structure and
    updates it with whatever resources are allocated for all the native events
-   in the native info structure array. */
+   in the native info structure array.
+
+   Events that are already open and stay the same, position by position, are
+   kept open, so adding an event to an EventSet only opens the new event.
+   Anything after the first event that changed is closed and opened again. */
 
 static int
 _pe_update_control_state( hwd_control_state_t *ctl,
@@ -1508,20 +2193,34 @@ _pe_update_control_state( hwd_control_state_t *ctl,
 	int j;
 	int ret;
 	int skipped_events=0;
+	int reuse=0,kept=0;
 	struct native_event_t *ntv_evt;
+	perf_event_attr_t attr;
+	int cpu;
 	pe_context_t *pe_ctx = ( pe_context_t *) ctx;
 	pe_control_t *pe_ctl = ( pe_control_t *) ctl;
 
-	/* close all of the existing fds and start over again */
-	/* In theory we could have finer-grained control and know if             */
-	/* things were changed, but it's easier to tear things down and rebuild. */
-	close_pe_events( pe_ctx, pe_ctl );
-
 	/* Calling with count==0 should be OK, it's how things are deallocated */
-	/* when an eventset is destroyed.                                      */
+	/* when an eventset is destroyed.  The group is parked for the next    */
+	/* EventSet of this thread rather than closed.                         */
 	if ( count == 0 ) {
 		SUBDBG( "EXIT: Called with count == 0\n" );
-		return PAPI_OK;
+		return park_pe_events( pe_ctx, pe_ctl );
+	}
+
+	/* Only a new list of native events can be compared with the open  */
+	/* ones, the other callers changed settings of the open events, so */
+	/* they are closed and opened again.                               */
+	if ( native ) {
+		adopt_parked_events( pe_ctx, pe_ctl );
+		if ( ( pe_ctl->pid == pe_event_pid( pe_ctl ) ) &&
+		     !( pe_ctx->state & PERF_EVENTS_RUNNING ) &&
+		     !pe_ctl->virtual_armed ) {
+			reuse = pe_ctl->num_events;
+		}
+	}
+	if ( !reuse ) {
+		close_pe_events( pe_ctx, pe_ctl );
 	}
 
 	/* set up all the events */
@@ -1556,7 +2255,8 @@ _pe_update_control_state( hwd_control_state_t *ctl,
 			SUBDBG("i: %d, pe_ctx->event_table->num_native_events: %d\n", i, pe_ctx->event_table->num_native_events);
 
 			/* Move this events hardware config values and other attributes to the perf_events attribute structure */
-			memcpy (&pe_ctl->events[i].attr, &ntv_evt->attr, sizeof(perf_event_attr_t));
+			/* it is built on the side first, to compare it with the event already open at this position */
+			memcpy (&attr, &ntv_evt->attr, sizeof(perf_event_attr_t));
 
 			/* may need to update the attribute structure with information from event set level domain settings (values set by PAPI_set_domain) */
 			/* only done if the event mask which controls each counting domain was not provided */
@@ -1564,12 +2264,12 @@ _pe_update_control_state( hwd_control_state_t *ctl,
 			/* get pointer to allocated name, will be NULL when adding preset events to event set */
 			char *aName = ntv_evt->allocated_name;
 			if ((aName == NULL)  ||  (strstr(aName, ":u=") == NULL)) {
-				SUBDBG("set exclude_user attribute from eventset level domain flags, encode: %d, eventset: %d\n", pe_ctl->events[i].attr.exclude_user, !(pe_ctl->domain & PAPI_DOM_USER));
-				pe_ctl->events[i].attr.exclude_user = !(pe_ctl->domain & PAPI_DOM_USER);
+				SUBDBG("set exclude_user attribute from eventset level domain flags, encode: %d, eventset: %d\n", attr.exclude_user, !(pe_ctl->domain & PAPI_DOM_USER));
+				attr.exclude_user = !(pe_ctl->domain & PAPI_DOM_USER);
 			}
 			if ((aName == NULL)  ||  (strstr(aName, ":k=") == NULL)) {
-				SUBDBG("set exclude_kernel attribute from eventset level domain flags, encode: %d, eventset: %d\n", pe_ctl->events[i].attr.exclude_kernel, !(pe_ctl->domain & PAPI_DOM_KERNEL));
-				pe_ctl->events[i].attr.exclude_kernel = !(pe_ctl->domain & PAPI_DOM_KERNEL);
+				SUBDBG("set exclude_kernel attribute from eventset level domain flags, encode: %d, eventset: %d\n", attr.exclude_kernel, !(pe_ctl->domain & PAPI_DOM_KERNEL));
+				attr.exclude_kernel = !(pe_ctl->domain & PAPI_DOM_KERNEL);
 			}
 
 			// libpfm4 supports mh (monitor host) and mg (monitor guest) event masks
@@ -1579,17 +2279,32 @@ _pe_update_control_state( hwd_control_state_t *ctl,
 			// if that can be figured out then there should probably be code here to set some perf_events attributes based on what was set in a PAPI_set_domain call
 			// the code sample below is one possibility
 //			if (strstr(ntv_evt->allocated_name, ":mg=") == NULL) {
-//				SUBDBG("set exclude_hv attribute from eventset level domain flags, encode: %d, eventset: %d\n", pe_ctl->events[i].attr.exclude_hv, !(pe_ctl->domain & PAPI_DOM_SUPERVISOR));
-//				pe_ctl->events[i].attr.exclude_hv = !(pe_ctl->domain & PAPI_DOM_SUPERVISOR);
+//				SUBDBG("set exclude_hv attribute from eventset level domain flags, encode: %d, eventset: %d\n", attr.exclude_hv, !(pe_ctl->domain & PAPI_DOM_SUPERVISOR));
+//				attr.exclude_hv = !(pe_ctl->domain & PAPI_DOM_SUPERVISOR);
 //			}
 
 
 			// set the cpu number provided with an event mask if there was one (will be -1 if mask not provided)
-			pe_ctl->events[i].cpu = ntv_evt->cpu;
+			cpu = ntv_evt->cpu;
 			// if cpu event mask not provided, then set the cpu to use to what may have been set on call to PAPI_set_opt (will still be -1 if not called)
-			if (pe_ctl->events[i].cpu == -1) {
-				pe_ctl->events[i].cpu = pe_ctl->cpu;
+			if (cpu == -1) {
+				cpu = pe_ctl->cpu;
+			}
+
+			attr.inherit = pe_ctl->inherit;
+			pe_set_group_attr( pe_ctl, i, &attr );
+
+			/* keep the open event if it and all before it are unchanged */
+			if ( ( kept == i ) && ( i < reuse ) &&
+			     ( pe_ctl->events[i].event_opened ) &&
+			     ( pe_ctl->events[i].cpu == cpu ) &&
+			     ( !memcmp( &pe_ctl->events[i].attr, &attr,
+					sizeof(perf_event_attr_t) ) ) ) {
+				kept++;
 			}
+
+			memcpy (&pe_ctl->events[i].attr, &attr, sizeof(perf_event_attr_t));
+			pe_ctl->events[i].cpu = cpu;
       } else {
     	  /* This case happens when called from _pe_set_overflow and _pe_ctl */
           /* Those callers put things directly into the pe_ctl structure so it is already set for the open call */
@@ -1612,12 +2327,26 @@ _pe_update_control_state( hwd_control_state_t *ctl,
 		return PAPI_ENOEVNT;
 	}
 
+	/* close what is open past the events we keep */
+	if ( reuse ) {
+		ret = close_pe_events_from( pe_ctx, pe_ctl, kept );
+		if ( ret != PAPI_OK ) {
+			SUBDBG("EXIT: close_pe_events_from returned: %d\n", ret);
+			return ret;
+		}
+		SUBDBG("Keeping %d of %d open events\n", kept, reuse);
+	}
+
 	pe_ctl->num_events = count - skipped_events;
 
 	/* actually open the events */
-	ret = open_pe_events( pe_ctx, pe_ctl );
+	ret = open_pe_events( pe_ctx, pe_ctl, kept );
 	if ( ret != PAPI_OK ) {
 		SUBDBG("EXIT: open_pe_events returned: %d\n", ret);
+		/* the new events did not fit next to the ones we kept */
+		if ( kept ) {
+			close_pe_events( pe_ctx, pe_ctl );
+		}
       		/* Restore values ? */
 		return ret;
 	}
@@ -1626,6 +2355,47 @@ _pe_update_control_state( hwd_control_state_t *ctl,
 	return PAPI_OK;
 }
 
+/* What the kernel records for each overflow of a sampling event */
+static void
+pe_set_sample_type( pe_control_t *ctl, pe_event_info_t *pe )
+{
+	/* We need the IP to pass to the overflow handler */
+	pe->attr.sample_type = PERF_SAMPLE_IP;
+	pe->attr.exclude_callchain_kernel = 0;
+
+	if ( ctl->hotspots ) {
+		pe->attr.sample_type |= PERF_SAMPLE_TID;
+		if ( ctl->callchain_depth ) {
+			pe->attr.sample_type |= PERF_SAMPLE_CALLCHAIN;
+			/* there are no symbols to look kernel addresses up with */
+			pe->attr.exclude_callchain_kernel = 1;
+		}
+	}
+}
+
+/* Switch the sampling events of ctl to or from callchain samples */
+static int
+pe_set_hotspots( pe_context_t *ctx, pe_control_t *ctl, int enable, int depth )
+{
+	int i, sampling = 0;
+
+	ctl->hotspots = enable;
+	ctl->callchain_depth = enable ? depth : 0;
+
+	for ( i = 0; i < ctl->num_events; i++ ) {
+		if ( ctl->events[i].sampling ) {
+			pe_set_sample_type( ctl, &ctl->events[i] );
+			sampling = 1;
+		}
+	}
+
+	/* events already open have to be opened again */
+	if ( !sampling ) {
+		return PAPI_OK;
+	}
+	return _pe_update_control_state( ctl, NULL, ctl->num_events, ctx );
+}
+
 /* Set various options on a control state */
 static int
 _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
@@ -1637,6 +2407,10 @@ _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
    switch ( code ) {
       case PAPI_MULTIPLEX:
 	   pe_ctl = ( pe_control_t * ) ( option->multiplex.ESI->ctl_state );
+	   /* a per node set is read one whole group per cpu */
+	   if (pe_ctl->granularity==PAPI_GRN_SYS_CPU) {
+	      return PAPI_ECNFLCT;
+	   }
 	   ret = check_permissions( pe_ctl->tid, pe_ctl->cpu, pe_ctl->domain,
 				    pe_ctl->granularity,
 				    1, pe_ctl->inherit );
@@ -1655,6 +2429,10 @@ _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
 
       case PAPI_ATTACH:
 	   pe_ctl = ( pe_control_t * ) ( option->attach.ESI->ctl_state );
+	   /* a per node set counts every task on its cpus */
+	   if (pe_ctl->granularity==PAPI_GRN_SYS_CPU) {
+	      return PAPI_ECNFLCT;
+	   }
 	   ret = check_permissions( option->attach.tid, pe_ctl->cpu,
 				  pe_ctl->domain, pe_ctl->granularity,
 				  pe_ctl->multiplexed,
@@ -1683,6 +2461,10 @@ _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
 
       case PAPI_CPU_ATTACH:
 	   pe_ctl = ( pe_control_t *) ( option->cpu.ESI->ctl_state );
+	   /* a per node set already picks its own cpus */
+	   if (pe_ctl->granularity==PAPI_GRN_SYS_CPU) {
+	      return PAPI_ECNFLCT;
+	   }
 	   ret = check_permissions( pe_ctl->tid, option->cpu.cpu_num,
 				    pe_ctl->domain, pe_ctl->granularity,
 				    pe_ctl->multiplexed,
@@ -1717,7 +2499,6 @@ _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
 
            switch ( option->granularity.granularity  ) {
               case PAPI_GRN_PROCG:
-              case PAPI_GRN_SYS_CPU:
               case PAPI_GRN_PROC:
 		   return PAPI_ECMP;
 
@@ -1727,6 +2508,26 @@ _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
 		   pe_ctl->cpu=_papi_getcpu();
 		   break;
 
+	      /* and counting the whole node, one group per cpu, which */
+	      /* needs FORMAT_GROUP reads and nothing per-thread       */
+              case PAPI_GRN_SYS_CPU:
+		   if ( bug_format_group() ) {
+		      return PAPI_ECMP;
+		   }
+		   if ( pe_ctl->multiplexed || pe_ctl->inherit ||
+			pe_ctl->overflow || pe_ctl->attached ) {
+		      return PAPI_ECNFLCT;
+		   }
+		   ret = check_permissions( pe_ctl->tid, pe_ctl->cpu,
+					    pe_ctl->domain, PAPI_GRN_SYS_CPU,
+					    0, 0 );
+		   if (ret != PAPI_OK) {
+		      return ret;
+		   }
+	 	   pe_ctl->granularity=PAPI_GRN_SYS_CPU;
+		   pe_ctl->cpu=-1;
+		   break;
+
               case PAPI_GRN_THR:
 	 	   pe_ctl->granularity=PAPI_GRN_THR;
 		   break;
@@ -1735,10 +2536,24 @@ _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
               default:
 		   return PAPI_EINVAL;
 	   }
+
+	   /* Events already open have to move to or from every cpu */
+	   if ( ( pe_ctl->num_events ) &&
+		( ( pe_ctl->num_node_cpus ) ||
+		  ( pe_ctl->granularity==PAPI_GRN_SYS_CPU ) ) ) {
+	      pe_ctx = ( pe_context_t *) ( option->granularity.ESI->master->
+					  context[pe_ctl->cidx] );
+	      return _pe_update_control_state( pe_ctl, NULL,
+					       pe_ctl->num_events, pe_ctx );
+	   }
            return PAPI_OK;
 
       case PAPI_INHERIT:
 	   pe_ctl = (pe_control_t *) ( option->inherit.ESI->ctl_state );
+	   if ((option->inherit.inherit) &&
+	       (pe_ctl->granularity==PAPI_GRN_SYS_CPU)) {
+	      return PAPI_ECNFLCT;
+	   }
 	   ret = check_permissions( pe_ctl->tid, pe_ctl->cpu, pe_ctl->domain,
 				  pe_ctl->granularity, pe_ctl->multiplexed,
 				    option->inherit.inherit );
@@ -1793,6 +2608,41 @@ _pe_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
 	   /* We don't support this... */
 	   return PAPI_OK;
 
+      case PAPI_READ_STATS:
+	   pe_ctl = (pe_control_t *) ( option->read_stats.ESI->ctl_state );
+	   option->read_stats.fast = pe_ctl->reads_fast;
+	   option->read_stats.mixed = pe_ctl->reads_mixed;
+	   option->read_stats.slow = pe_ctl->reads_slow;
+	   return PAPI_OK;
+
+      case PAPI_SAMPLE_RING:
+	   pe_ctl = (pe_control_t *) ( option->sample_ring.ESI->ctl_state );
+	   pe_ctl->sample_ring = option->sample_ring.ring;
+	   if (pe_ctl->hotspots) {
+	      return pe_set_hotspots( pe_ctx, pe_ctl, 0, 0 );
+	   }
+	   return PAPI_OK;
+
+      case PAPI_HOTSPOTS:
+	   pe_ctl = (pe_control_t *) ( option->hotspots.ESI->ctl_state );
+	   pe_ctl->sample_ring = option->hotspots.ring;
+	   return pe_set_hotspots( pe_ctx, pe_ctl,
+				   option->hotspots.ring != NULL,
+				   option->hotspots.depth );
+
+      case PAPI_VIRTUAL_START:
+	   pe_ctl = (pe_control_t *) ( option->virtual_start.ESI->ctl_state );
+	   if (!_perf_event_vector.cmp_info.fast_counter_read) {
+	      return PAPI_ENOSUPP;
+	   }
+	   pe_ctl->virtual_start = ( option->virtual_start.enable != 0 );
+	   /* Turn off counters a virtual stop left running */
+	   if ((!pe_ctl->virtual_start) && (pe_ctl->virtual_armed)) {
+	      pe_ctl->virtual_armed = 0;
+	      return _pe_stop( ctx, pe_ctl );
+	   }
+	   return PAPI_OK;
+
       default:
 	   return PAPI_ENOSUPP;
    }
@@ -1900,6 +2750,22 @@ find_profile_index( EventSetInfo_t *ESI, int evt_idx, int *flags,
 }
 
 
+/* Map a native event back to the EventSet index it overflows for */
+static int
+find_overflow_index( EventSetInfo_t *ESI, int evt_idx )
+{
+	int count, esi_index;
+
+	for ( count = 0; count < ESI->overflow.event_counter; count++ ) {
+		esi_index = ESI->overflow.EventIndex[count];
+		if ( ESI->EventInfoArray[esi_index].pos[0] == evt_idx ) {
+			return esi_index;
+		}
+	}
+	return -1;
+}
+
+
 /* What exactly does this do? */
 static int
 process_smpl_buf( int evt_idx, ThreadInfo_t **thr, int cidx )
@@ -1998,7 +2864,22 @@ _pe_dispatch_timer( int n, hwd_siginfo_t *info, void *uc)
 		PAPIERROR("ioctl(PERF_EVENT_IOC_DISABLE) failed");
 	}
 
-	if ( ( thread->running_eventset[cidx]->state & PAPI_PROFILING ) &&
+	if ( ctl->hotspots ) {
+		/* PAPI_stop() turns these into a symbol table */
+		mmap_read_to_callchains( &(ctl->events[found_evt_idx]),
+			ctl->sample_ring,
+			find_overflow_index( thread->running_eventset[cidx],
+				found_evt_idx ),
+			ctl->callchain_depth );
+	}
+	else if ( ctl->sample_ring ) {
+		/* The user drains the samples with PAPI_read_samples() */
+		mmap_read_to_ring( &(ctl->events[found_evt_idx]),
+			ctl->sample_ring,
+			find_overflow_index( thread->running_eventset[cidx],
+				found_evt_idx ) );
+	}
+	else if ( ( thread->running_eventset[cidx]->state & PAPI_PROFILING ) &&
 		!( thread->running_eventset[cidx]->profile.flags &
 		PAPI_PROFIL_FORCE_SW ) ) {
 		process_smpl_buf( found_evt_idx, &thread, cidx );
@@ -2091,6 +2972,20 @@ _pe_stop_profiling( ThreadInfo_t *thread, EventSetInfo_t *ESI )
 	/* Loop through all of the events and process those which have mmap */
 	/* buffers attached.                                                */
 	for ( i = 0; i < ctl->num_events; i++ ) {
+		/* Samples still in the kernel buffer go to the sample ring */
+		if ( ( ctl->sample_ring ) && ( ctl->events[i].sampling ) &&
+			( ctl->events[i].mmap_buf ) ) {
+			if ( ctl->hotspots ) {
+				mmap_read_to_callchains( &(ctl->events[i]),
+					ctl->sample_ring, find_overflow_index( ESI, i ),
+					ctl->callchain_depth );
+			} else {
+				mmap_read_to_ring( &(ctl->events[i]),
+					ctl->sample_ring, find_overflow_index( ESI, i ) );
+			}
+			ctl->events[i].profiling=0;
+			continue;
+		}
 		/* Use the mmap_buf field as an indicator */
 		/* of this fd being used for profiling.   */
 		if ( ctl->events[i].profiling ) {
@@ -2135,6 +3030,12 @@ _pe_set_overflow( EventSetInfo_t *ESI, int EventIndex, int threshold )
 		return PAPI_EINVAL;
 	}
 
+	/* Overflows on every cpu of a per node set are not handled */
+	if (( threshold ) && ( ctl->granularity == PAPI_GRN_SYS_CPU )) {
+		SUBDBG("EXIT: PAPI_ECNFLCT, per node EventSet\n");
+		return PAPI_ECNFLCT;
+	}
+
 	/* It's an error to disable overflow if it wasn't set in the	*/
 	/* first place.							*/
 	if (( threshold == 0 ) &&
@@ -2156,8 +3057,7 @@ _pe_set_overflow( EventSetInfo_t *ESI, int EventIndex, int threshold )
 		/* Setting wakeup_events to one means issue a wakeup on every */
 		/* counter overflow (not mmap page overflow).                 */
 		ctl->events[evt_idx].attr.wakeup_events = 1;
-		/* We need the IP to pass to the overflow handler */
-		ctl->events[evt_idx].attr.sample_type = PERF_SAMPLE_IP;
+		pe_set_sample_type( ctl, &ctl->events[evt_idx] );
 	}
 
 
@@ -2501,6 +3401,12 @@ _pe_init_component( int cidx )
 	_papi_hwd[cidx]->cmp_info.fast_counter_read = 0;
 #endif
 
+	/* Allow turning rdpmc off at run time, for example to compare */
+	/* the read paths with papi_cost_suite                         */
+	if ( getenv( "PAPI_PERF_EVENT_NO_RDPMC" ) ) {
+		_papi_hwd[cidx]->cmp_info.fast_counter_read = 0;
+	}
+
 	/* Run the libpfm4-specific setup */
 	retval = _papi_libpfm4_init(_papi_hwd[cidx]);
 	if (retval) {
@@ -2585,7 +3491,8 @@ papi_vector_t _perf_event_vector = {
       .default_domain = PAPI_DOM_USER,
       .available_domains = PAPI_DOM_USER | PAPI_DOM_KERNEL | PAPI_DOM_SUPERVISOR,
       .default_granularity = PAPI_GRN_THR,
-      .available_granularities = PAPI_GRN_THR | PAPI_GRN_SYS,
+      .available_granularities = PAPI_GRN_THR | PAPI_GRN_SYS |
+				 PAPI_GRN_SYS_CPU,
 
       .hardware_intr = 1,
       .kernel_profile = 1,
@@ -2623,6 +3530,8 @@ papi_vector_t _perf_event_vector = {
   .start =                 _pe_start,
   .stop =                  _pe_stop,
   .read =                  _pe_read,
+  .read_many =             _pe_read_many,
+  .read_cpus =             _pe_read_cpus,
   .shutdown_thread =       _pe_shutdown_thread,
   .ctl =                   _pe_ctl,
   .update_control_state =  _pe_update_control_state,
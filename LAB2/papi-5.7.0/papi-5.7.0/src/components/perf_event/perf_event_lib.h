@@ -18,6 +18,7 @@ typedef struct
   uint64_t tail;                  /* current read location in mmap buffer */
   uint64_t mask;                  /* mask used for wrapping the pages     */
   int cpu;                        /* cpu associated with this event       */
+  int rdpmc_ok;                   /* event can be read with rdpmc         */
   struct perf_event_attr attr;    /* perf_event config structure          */
 } pe_event_info_t;
 
@@ -34,8 +35,27 @@ typedef struct {
   int cidx;                       /* current component                 */
   int cpu;                        /* which cpu to measure              */
   pid_t tid;                      /* thread we are monitoring          */
+  long pid;                       /* pid the open events were opened for */
+  long long reads_fast;           /* reads done entirely with rdpmc    */
+  long long reads_mixed;          /* reads using rdpmc and read()      */
+  long long reads_slow;           /* reads done entirely with read()   */
   pe_event_info_t events[PERF_EVENT_MAX_MPX_COUNTERS];
   long long counts[PERF_EVENT_MAX_MPX_COUNTERS];
+  int num_pending;                /* events left for read() this read  */
+  char pending[PERF_EVENT_MAX_MPX_COUNTERS]; /* events rdpmc missed    */
+  struct _papi_sample_ring *sample_ring; /* raw overflow samples go here */
+  unsigned int hotspots;          /* samples go to the ring as callchains */
+  int callchain_depth;            /* callers kept per callchain sample  */
+  unsigned int virtual_start;     /* start/stop with rdpmc snapshots   */
+  unsigned int virtual_armed;     /* counters left enabled for that    */
+  long long baseline[PERF_EVENT_MAX_MPX_COUNTERS]; /* counts at start/reset */
+  int num_node_cpus;              /* cpus a PAPI_GRN_SYS_CPU set spans */
+  int *node_cpus;                 /* those cpus, events[] is the first */
+  int *node_fds;                  /* fds by event, then by cpu         */
+  long long *node_counts;         /* counts by cpu, then by event      */
+  int num_boxes;                  /* extra uncore boxes being summed   */
+  pe_event_info_t *boxes;         /* those boxes, opened after events[] */
+  int *box_event;                 /* event each box is summed into     */
 } pe_control_t;
 
 
@@ -44,6 +64,9 @@ typedef struct {
   int state;                      /* are we opened and/or running? */
   int cidx;                       /* our component id              */
   struct native_event_table_t *event_table; /* our event table     */
+  pe_event_info_t *parked;        /* group kept open by a cleanup  */
+  int num_parked;                 /* events in the parked group    */
+  long parked_pid;                /* pid the parked group counts   */
 } pe_context_t;
 
 
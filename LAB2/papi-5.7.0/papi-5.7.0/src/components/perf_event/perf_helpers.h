@@ -287,4 +287,128 @@ mmap_read( int cidx, ThreadInfo_t **thr, pe_event_info_t *pe,
 	mmap_write_tail( pe, old );
 }
 
+/* Copy every record between tail and head into a sample ring, as is. */
+/* Used instead of mmap_read() when the user asked for raw samples,   */
+/* so nothing here allocates or takes a lock.                         */
+static void
+mmap_read_to_ring( pe_event_info_t *pe, PapiSampleRing_t *ring,
+		   int event_index )
+{
+	uint64_t head = mmap_read_head( pe );
+	uint64_t old = pe->tail;
+	unsigned char *data = ((unsigned char*)pe->mmap_buf) + getpagesize();
+	int diff;
+
+	diff = head - old;
+	if ( diff < 0 ) {
+		SUBDBG( "WARNING: failed to keep up with mmap data. head = %" PRIu64
+			",  tail = %" PRIu64 ". Discarding samples.\n", head, old );
+		old = head;
+	}
+
+	for( ; old != head; ) {
+		struct perf_event_header *header =
+			( struct perf_event_header * ) &data[old & pe->mask];
+		uint64_t offset = old & pe->mask;
+		size_t size = header->size;
+		size_t first;
+
+		if ( size == 0 ) {
+			/* should not happen, but don't spin on it */
+			old = head;
+			break;
+		}
+
+		/* Records straddling the mmap boundary go in two pieces */
+		first = min( pe->mask + 1 - offset, size );
+		_papi_hwi_sample_ring_put( ring, event_index,
+			&data[offset], first, data, size - first );
+
+		old += size;
+	}
+
+	pe->tail = old;
+	mmap_write_tail( pe, old );
+}
+
+/* The 8 byte aligned word at offset pos of the mmap data; records are */
+/* multiples of 8 bytes, so such a word never wraps around the end.   */
+static inline uint64_t
+mmap_read_u64( pe_event_info_t *pe, unsigned char *data, uint64_t pos )
+{
+	return *( uint64_t * ) &data[pos & pe->mask];
+}
 
+/* Turn the PERF_SAMPLE_IP | PERF_SAMPLE_TID [| PERF_SAMPLE_CALLCHAIN] */
+/* records between tail and head into PAPI_callchain_sample_t records */
+/* in a sample ring, keeping at most depth user space callers.  Runs  */
+/* in the overflow handler, so the record is built on the stack.      */
+static void
+mmap_read_to_callchains( pe_event_info_t *pe, PapiSampleRing_t *ring,
+			 int event_index, int depth )
+{
+	uint64_t head = mmap_read_head( pe );
+	uint64_t old = pe->tail;
+	unsigned char *data = ((unsigned char*)pe->mmap_buf) + getpagesize();
+	struct {
+		PAPI_callchain_sample_t s;
+		unsigned long long callers[PAPI_HOTSPOT_MAX_DEPTH];
+	} rec;
+	uint64_t nr, i, ip;
+	int diff;
+
+	diff = head - old;
+	if ( diff < 0 ) {
+		SUBDBG( "WARNING: failed to keep up with mmap data. head = %" PRIu64
+			",  tail = %" PRIu64 ". Discarding samples.\n", head, old );
+		old = head;
+	}
+
+	for( ; old != head; ) {
+		struct perf_event_header *header =
+			( struct perf_event_header * ) &data[old & pe->mask];
+		size_t size = header->size;
+
+		if ( size == 0 ) {
+			/* should not happen, but don't spin on it */
+			old = head;
+			break;
+		}
+
+		if ( header->type == PERF_RECORD_LOST ) {
+			/* u64 id, u64 lost */
+			ring->dropped += mmap_read_u64( pe, data, old + 16 );
+		}
+		else if ( header->type == PERF_RECORD_SAMPLE ) {
+			/* u64 ip, u32 pid, u32 tid, u64 nr, u64 ips[nr] */
+			rec.s.ip = mmap_read_u64( pe, data, old + 8 );
+			rec.s.tid = ( int ) ( mmap_read_u64( pe, data, old + 16 ) >> 32 );
+			rec.s.nr = 0;
+
+			nr = 0;
+			if ( ( pe->attr.sample_type & PERF_SAMPLE_CALLCHAIN ) &&
+				( size >= 32 ) ) {
+				nr = mmap_read_u64( pe, data, old + 24 );
+				if ( nr > ( size - 32 ) / 8 ) nr = 0;
+			}
+
+			for ( i = 0; ( i < nr ) && ( rec.s.nr < depth ); i++ ) {
+				ip = mmap_read_u64( pe, data, old + 32 + 8 * i );
+				/* skip the PERF_CONTEXT_* markers, and the */
+				/* sampled address the chain starts with    */
+				if ( ip >= PERF_CONTEXT_MAX ) continue;
+				if ( ( rec.s.nr == 0 ) && ( ip == rec.s.ip ) ) continue;
+				rec.callers[rec.s.nr++] = ip;
+			}
+
+			_papi_hwi_sample_ring_put( ring, event_index, &rec,
+				sizeof ( rec.s ) + rec.s.nr * sizeof ( rec.callers[0] ),
+				NULL, 0 );
+		}
+
+		old += size;
+	}
+
+	pe->tail = old;
+	mmap_write_tail( pe, old );
+}
@@ -0,0 +1,160 @@
+/*
+ * This tests the PAPI_PERF_EVENT_CACHE encoding cache: the names a run
+ * resolves are saved even if it never calls PAPI_shutdown(), and a
+ * second run finds all of them, before and after they are folded into
+ * the cache file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "event_name_lib.h"
+
+#define CHILD_OK	0
+#define CHILD_SKIP	1
+#define CHILD_FAIL	2
+
+/* One run of a tool: resolve a name, and maybe shut down */
+static int
+run( int shutdown )
+{
+	char event_name[BUFSIZ];
+	char *instructions_event;
+	const PAPI_component_info_t *cmpinfo;
+	int retval, cidx, code;
+	pid_t pid;
+
+	pid = fork(  );
+	if ( pid < 0 ) {
+		return CHILD_FAIL;
+	}
+
+	if ( pid == 0 ) {
+		retval = PAPI_library_init( PAPI_VER_CURRENT );
+		if ( retval != PAPI_VER_CURRENT ) {
+			_exit( CHILD_FAIL );
+		}
+
+		cidx = PAPI_get_component_index( "perf_event" );
+		cmpinfo = PAPI_get_component_info( cidx );
+		if ( ( cidx < 0 ) || ( cmpinfo == NULL ) || cmpinfo->disabled ) {
+			_exit( CHILD_SKIP );
+		}
+
+		instructions_event=get_instructions_event(event_name, BUFSIZ);
+		if ( instructions_event == NULL ) {
+			_exit( CHILD_SKIP );
+		}
+
+		retval = PAPI_event_name_to_code( instructions_event, &code );
+		if ( retval != PAPI_OK ) {
+			_exit( CHILD_SKIP );
+		}
+
+		if ( shutdown ) {
+			PAPI_shutdown(  );
+		}
+		_exit( CHILD_OK );
+	}
+
+	if ( ( waitpid( pid, &retval, 0 ) != pid ) || !WIFEXITED( retval ) ) {
+		return CHILD_FAIL;
+	}
+	return WEXITSTATUS( retval );
+}
+
+static off_t
+file_size( const char *path )
+{
+	struct stat st;
+
+	if ( stat( path, &st ) < 0 ) {
+		return -1;
+	}
+	return st.st_size;
+}
+
+int main( int argc, char **argv ) {
+
+	char cache[BUFSIZ], journal[BUFSIZ + 8];
+	off_t first, second;
+	int retval;
+	int quiet=0;
+
+	/* Set TESTS_QUIET variable */
+	quiet=tests_quiet( argc, argv );
+
+	snprintf( cache, sizeof(cache), "/tmp/papi_pe_cache.%d", (int)getpid(  ) );
+	snprintf( journal, sizeof(journal), "%s.log", cache );
+	unlink( cache );
+	unlink( journal );
+	setenv( "PAPI_PERF_EVENT_CACHE", cache, 1 );
+
+	/* The first run saves what it resolved without shutting down */
+	retval = run( 0 );
+	if ( retval == CHILD_SKIP ) {
+		unlink( journal );
+		test_skip( __FILE__, __LINE__, "perf_event not usable", PAPI_ENOSUPP );
+	}
+	if ( retval != CHILD_OK ) {
+		test_fail( __FILE__, __LINE__, "first run", retval );
+	}
+
+	first = file_size( journal );
+	if ( first <= 0 ) {
+		test_fail( __FILE__, __LINE__, "nothing saved by the first run",
+			( int ) first );
+	}
+
+	/* The second run finds every name, so it adds nothing */
+	retval = run( 0 );
+	if ( retval != CHILD_OK ) {
+		test_fail( __FILE__, __LINE__, "second run", retval );
+	}
+	second = file_size( journal );
+	if ( second != first ) {
+		test_fail( __FILE__, __LINE__, "second run missed the cache",
+			( int ) second );
+	}
+
+	/* Shutting down folds the journal into the cache file */
+	retval = run( 1 );
+	if ( retval != CHILD_OK ) {
+		test_fail( __FILE__, __LINE__, "run with shutdown", retval );
+	}
+	second = file_size( journal );
+	if ( ( second != 0 ) || ( file_size( cache ) <= 0 ) ) {
+		test_fail( __FILE__, __LINE__, "journal not folded into the cache",
+			( int ) second );
+	}
+
+	/* And a third run finds every name in the cache file */
+	retval = run( 0 );
+	if ( retval != CHILD_OK ) {
+		test_fail( __FILE__, __LINE__, "third run", retval );
+	}
+	if ( file_size( journal ) != 0 ) {
+		test_fail( __FILE__, __LINE__, "third run missed the cache",
+			( int ) file_size( journal ) );
+	}
+
+	if ( !quiet ) {
+		printf( "Later runs found the %lld bytes of "
+			"encodings the first one saved\n", ( long long ) first );
+	}
+
+	unlink( cache );
+	unlink( journal );
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
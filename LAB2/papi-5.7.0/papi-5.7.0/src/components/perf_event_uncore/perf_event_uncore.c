@@ -14,6 +14,8 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
 #include <fcntl.h>
 #include <string.h>
 #include <errno.h>
@@ -60,6 +62,23 @@ static int our_cidx;
 #define PERF_EVENTS_OPENED  0x01
 #define PERF_EVENTS_RUNNING 0x02
 
+/* Aggregate events count one event summed over several uncore boxes,  */
+/* for example skx_unc_imc::UNC_M_CAS_COUNT:RD:ALL_BOXES:SOCKET=0.      */
+/* papi keeps PEU_AGGREGATE_IDX plus their slot here as native index.  */
+#define PEU_AGGREGATE_IDX 0x40000000
+
+struct peu_aggregate {
+   char *name;                    /* name it was asked for by          */
+   int papi_event_code;           /* papi event code handed out for it */
+   unsigned int ntv_code;         /* libpfm4 code of the first box     */
+   int num_boxes;
+   int *box_codes;                /* papi event codes of the boxes     */
+};
+
+/* Slots are never freed before shutdown, only the array is realloced */
+static struct peu_aggregate **peu_aggregates;
+static int num_peu_aggregates;
+
 static int _peu_set_domain( hwd_control_state_t *ctl, int domain);
 static int _peu_shutdown_component( void );
 
@@ -218,6 +237,79 @@ static int map_perf_event_errors_to_papi(int perf_event_error) {
 
 
 
+/* Apply an ioctl to the extra boxes of aggregate events */
+static int
+box_ioctl( pe_control_t *ctl, unsigned long request )
+{
+   int k;
+
+   for( k = 0; k < ctl->num_boxes; k++ ) {
+      if (ioctl( ctl->boxes[k].event_fd, request, NULL ) == -1) {
+	 PAPIERROR("ioctl(%d, %#lx, NULL) on uncore box returned error, "
+		   "Linux says: %s",
+		   ctl->boxes[k].event_fd, request, strerror( errno ) );
+	 return PAPI_ESYS;
+      }
+   }
+   return PAPI_OK;
+}
+
+/* Close the extra boxes of aggregate events */
+static int
+close_boxes( pe_control_t *ctl )
+{
+   int k, ret = PAPI_OK;
+
+   for( k = 0; k < ctl->num_boxes; k++ ) {
+      if (!ctl->boxes[k].event_opened) continue;
+      if ( close( ctl->boxes[k].event_fd ) ) {
+	 PAPIERROR( "close of fd = %d returned error: %s",
+		    ctl->boxes[k].event_fd, strerror( errno ) );
+	 ret = PAPI_ESYS;
+      }
+      ctl->boxes[k].event_opened=0;
+   }
+   return ret;
+}
+
+/* Add the extra boxes of aggregate events into the count of their */
+/* event.  They are read back to back, right after events[].        */
+static int
+read_boxes( pe_control_t *ctl )
+{
+   long long papi_pe_buffer[3];
+   long long count;
+   int k, ret;
+
+   for( k = 0; k < ctl->num_boxes; k++ ) {
+      ret = read( ctl->boxes[k].event_fd, papi_pe_buffer,
+		  sizeof ( papi_pe_buffer ) );
+      if ( ret == -1 ) {
+	 PAPIERROR("read returned an error: ", strerror( errno ));
+	 return PAPI_ESYS;
+      }
+
+      /* one value, plus enabled and running times if multiplexed */
+      if (ret != (signed)((ctl->multiplexed ? 3 : 1)*sizeof(long long))) {
+	 PAPIERROR("Error!  short read!\n");
+	 return PAPI_ESYS;
+      }
+
+      count = papi_pe_buffer[0];
+      if ((ctl->multiplexed) && (papi_pe_buffer[2]) &&
+	  (papi_pe_buffer[1] != papi_pe_buffer[2])) {
+	 count = ((papi_pe_buffer[1] * 100LL) / papi_pe_buffer[2]) * count / 100LL;
+      }
+
+      SUBDBG("read: box fd: %2d, cpu: %d, event: %d, count: %lld\n",
+	     ctl->boxes[k].event_fd, ctl->boxes[k].cpu,
+	     ctl->box_event[k], count);
+
+      ctl->counts[ctl->box_event[k]] += count;
+   }
+   return PAPI_OK;
+}
+
 /* KERNEL_CHECKS_SCHEDUABILITY_UPON_OPEN is a work-around for kernel arch */
 /* implementations (e.g. x86 before 2.6.33) which don't do a static event */
 /* scheduability check in sys_perf_event_open.  It is also needed if the  */
@@ -244,6 +336,9 @@ check_scheduability( pe_context_t *ctx, pe_control_t *ctl)
 	 return PAPI_ESYS;
       }
    }
+   if (box_ioctl( ctl, PERF_EVENT_IOC_ENABLE ) != PAPI_OK) {
+      return PAPI_ESYS;
+   }
 
    /* stop all events */
    for( i = 0; i < ctl->num_events; i++) {
@@ -253,6 +348,9 @@ check_scheduability( pe_context_t *ctx, pe_control_t *ctl)
 	 return PAPI_ESYS;
       }
    }
+   if (box_ioctl( ctl, PERF_EVENT_IOC_DISABLE ) != PAPI_OK) {
+      return PAPI_ESYS;
+   }
 
    /* See if a read of each event returns results */
    for( i = 0; i < ctl->num_events; i++) {
@@ -272,6 +370,13 @@ check_scheduability( pe_context_t *ctx, pe_control_t *ctl)
 	 return PAPI_ECNFLCT;
       }
    }
+   for( i = 0; i < ctl->num_boxes; i++) {
+      cnt = read( ctl->boxes[i].event_fd, papi_pe_buffer, sizeof(papi_pe_buffer));
+      if ( cnt <= 0 ) {
+	 SUBDBG( "EXIT: read of box %d returned %d, return PAPI_ECNFLCT.\n", i, cnt);
+	 return PAPI_ECNFLCT;
+      }
+   }
 
    /* Reset all of the counters (opened so far) back to zero      */
    /* from the above brief enable/disable call pair.              */
@@ -292,6 +397,9 @@ check_scheduability( pe_context_t *ctx, pe_control_t *ctl)
 	 return PAPI_ESYS;
       }
    }
+   if (box_ioctl( ctl, PERF_EVENT_IOC_RESET ) != PAPI_OK) {
+      return PAPI_ESYS;
+   }
    SUBDBG("EXIT: return PAPI_OK\n");
    return PAPI_OK;
 }
@@ -302,8 +410,9 @@ static int
 open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
 {
 
-   int i, ret = PAPI_OK;
+   int i, k, ret = PAPI_OK;
    long pid;
+   pe_event_info_t *box;
 
    if (ctl->granularity==PAPI_GRN_SYS) {
       pid = -1;
@@ -396,6 +505,30 @@ open_pe_events( pe_context_t *ctx, pe_control_t *ctl )
       ctl->events[i].event_opened=1;
    }
 
+   /* The extra boxes of aggregate events are never grouped, the   */
+   /* kernel wants every event of a group on the same uncore PMU.  */
+   for( k = 0; k < ctl->num_boxes; k++ ) {
+      box = &ctl->boxes[k];
+
+      box->event_opened=0;
+      box->attr.pinned = !ctl->multiplexed;
+      box->attr.disabled = 1;
+      box->attr.inherit = ctl->events[ctl->box_event[k]].attr.inherit;
+      box->group_leader_fd=-1;
+      box->attr.read_format = get_read_format(ctl->multiplexed, 0, 0 );
+
+      box->event_fd = sys_perf_event_open( &box->attr, pid, box->cpu,
+					   box->group_leader_fd, 0 );
+      if ( box->event_fd == -1 ) {
+	 SUBDBG("sys_perf_event_open returned error on box #%d of event #%d."
+		"  Error: %s\n",
+		k, ctl->box_event[k], strerror( errno ) );
+	 ret=map_perf_event_errors_to_papi(errno);
+	 goto open_peu_cleanup;
+      }
+      box->event_opened=1;
+   }
+
 
    /* in many situations the kernel will indicate we opened fine */
    /* yet things will fail later.  So we need to double check    */
@@ -433,6 +566,7 @@ open_peu_cleanup:
    /* We encountered an error, close up the fds we successfully opened.  */
    /* We go backward in an attempt to close group leaders last, although */
    /* That's probably not strictly necessary.                            */
+   close_boxes( ctl );
    while ( i > 0 ) {
       i--;
       if (ctl->events[i].event_fd>=0) {
@@ -457,6 +591,10 @@ close_pe_events( pe_context_t *ctx, pe_control_t *ctl )
       SUBDBG("Closing without stopping first\n");
    }
 
+   if ( close_boxes( ctl ) != PAPI_OK ) {
+      return PAPI_ESYS;
+   }
+
    /* Close child events first */
    for( i=0; i<ctl->num_events; i++ ) {
 
@@ -665,6 +803,18 @@ _peu_init_component( int cidx )
 static int
 _peu_shutdown_component( void ) {
 
+	int i;
+
+	/* deallocate our aggregate events */
+	for (i = 0; i < num_peu_aggregates; i++) {
+		free(peu_aggregates[i]->name);
+		free(peu_aggregates[i]->box_codes);
+		free(peu_aggregates[i]);
+	}
+	free(peu_aggregates);
+	peu_aggregates = NULL;
+	num_peu_aggregates = 0;
+
 	/* deallocate our event table */
 	_pe_libpfm4_shutdown(&_perf_event_uncore_vector,
 				&uncore_native_event_table);
@@ -675,6 +825,128 @@ _peu_shutdown_component( void ) {
 	return PAPI_OK;
 }
 
+/* Find the native event for a papi event code, NULL if the component */
+/* does not know it                                                     */
+static struct native_event_t *
+peu_native_event( pe_context_t *pe_ctx, int ntv_idx, int papi_event_code )
+{
+	int j;
+
+	if (ntv_idx < -1) {
+		SUBDBG("papi_event_code: %#x known by papi but not by the component\n", papi_event_code);
+		return NULL;
+	}
+	// if native index is -1, then we have an event without a mask and need to find the right native index to use
+	if (ntv_idx == -1) {
+		// find the native event index we want by matching for the right papi event code
+		for (j=0 ; j<pe_ctx->event_table->num_native_events ; j++) {
+			if (pe_ctx->event_table->native_events[j].papi_event_code == papi_event_code) {
+				ntv_idx = j;
+			}
+		}
+	}
+
+	// if native index is still negative, we did not find event we wanted so just return error
+	if (ntv_idx < 0) {
+		SUBDBG("papi_event_code: %#x not found in native event tables\n", papi_event_code);
+		return NULL;
+	}
+
+	// this native index is positive so there was a mask with the event, the ntv_idx identifies which native event to use
+	return &(pe_ctx->event_table->native_events[ntv_idx]);
+}
+
+/* Fill in an event (or an aggregate box) from its native event */
+static void
+peu_setup_event( pe_control_t *pe_ctl, pe_event_info_t *evt,
+		 struct native_event_t *ntv_evt )
+{
+	SUBDBG("ntv_evt: %p\n", ntv_evt);
+
+	// Move this events hardware config values and other attributes to the perf_events attribute structure
+	memcpy (&evt->attr, &ntv_evt->attr, sizeof(perf_event_attr_t));
+
+	// may need to update the attribute structure with information from event set level domain settings (values set by PAPI_set_domain)
+	// only done if the event mask which controls each counting domain was not provided
+
+	// get pointer to allocated name, will be NULL when adding preset events to event set
+	char *aName = ntv_evt->allocated_name;
+	if ((aName == NULL)  ||  (strstr(aName, ":u=") == NULL)) {
+		SUBDBG("set exclude_user attribute from eventset level domain flags, encode: %d, eventset: %d\n", evt->attr.exclude_user, !(pe_ctl->domain & PAPI_DOM_USER));
+		evt->attr.exclude_user = !(pe_ctl->domain & PAPI_DOM_USER);
+	}
+	if ((aName == NULL)  ||  (strstr(aName, ":k=") == NULL)) {
+		SUBDBG("set exclude_kernel attribute from eventset level domain flags, encode: %d, eventset: %d\n", evt->attr.exclude_kernel, !(pe_ctl->domain & PAPI_DOM_KERNEL));
+		evt->attr.exclude_kernel = !(pe_ctl->domain & PAPI_DOM_KERNEL);
+	}
+
+	// set the cpu number provided with an event mask if there was one (will be -1 if mask not provided)
+	evt->cpu = ntv_evt->cpu;
+	// if cpu event mask not provided, then set the cpu to use to what may have been set on call to PAPI_set_opt (will still be -1 if not called)
+	if (evt->cpu == -1) {
+		evt->cpu = pe_ctl->cpu;
+	}
+}
+
+/* Set up event i from an aggregate, its first box goes in events[i] */
+/* and the rest are appended to boxes[] to be summed into it         */
+static int
+peu_setup_aggregate( pe_context_t *pe_ctx, pe_control_t *pe_ctl,
+		     int i, int slot )
+{
+	struct peu_aggregate *agg = NULL;
+	struct native_event_t *ntv_evt;
+	pe_event_info_t *boxes;
+	int *box_event;
+	int b, num;
+
+	_papi_hwi_lock( NAMELIB_LOCK );
+	if (slot < num_peu_aggregates) {
+		agg = peu_aggregates[slot];
+	}
+	_papi_hwi_unlock( NAMELIB_LOCK );
+
+	if (agg == NULL) {
+		return PAPI_ENOEVNT;
+	}
+
+	if (agg->num_boxes > 1) {
+		num = pe_ctl->num_boxes + agg->num_boxes - 1;
+		boxes = papi_realloc( pe_ctl->boxes, num * sizeof ( pe_event_info_t ) );
+		if (boxes == NULL) {
+			return PAPI_ENOMEM;
+		}
+		pe_ctl->boxes = boxes;
+		box_event = papi_realloc( pe_ctl->box_event, num * sizeof ( int ) );
+		if (box_event == NULL) {
+			return PAPI_ENOMEM;
+		}
+		pe_ctl->box_event = box_event;
+	}
+
+	for (b = 0; b < agg->num_boxes; b++) {
+		ntv_evt = peu_native_event(pe_ctx,
+				_papi_hwi_get_ntv_idx((unsigned)agg->box_codes[b]),
+				agg->box_codes[b]);
+		if (ntv_evt == NULL) {
+			return PAPI_ENOEVNT;
+		}
+
+		if (b == 0) {
+			peu_setup_event(pe_ctl, &pe_ctl->events[i], ntv_evt);
+			continue;
+		}
+
+		memset( &pe_ctl->boxes[pe_ctl->num_boxes], 0, sizeof ( pe_event_info_t ) );
+		peu_setup_event(pe_ctl, &pe_ctl->boxes[pe_ctl->num_boxes], ntv_evt);
+		pe_ctl->box_event[pe_ctl->num_boxes] = i;
+		pe_ctl->num_boxes++;
+	}
+
+	SUBDBG("event %d: %s sums %d boxes\n", i, agg->name, agg->num_boxes);
+	return PAPI_OK;
+}
+
 /* This function clears the current contents of the control structure and
    updates it with whatever resources are allocated for all the native events
    in the native info structure array. */
@@ -685,7 +957,6 @@ _peu_update_control_state( hwd_control_state_t *ctl,
 			       int count, hwd_context_t *ctx )
 {
 	int i;
-	int j;
 	int ret;
 	int skipped_events=0;
 	struct native_event_t *ntv_evt;
@@ -701,63 +972,37 @@ _peu_update_control_state( hwd_control_state_t *ctl,
    /* when an eventset is destroyed.                                      */
    if ( count == 0 ) {
       SUBDBG( "Called with count == 0\n" );
+      papi_free( pe_ctl->boxes );
+      papi_free( pe_ctl->box_event );
+      pe_ctl->boxes = NULL;
+      pe_ctl->box_event = NULL;
+      pe_ctl->num_boxes = 0;
       return PAPI_OK;
    }
 
+   if ( native ) {
+      pe_ctl->num_boxes = 0;
+   }
+
    /* set up all the events */
    for( i = 0; i < count; i++ ) {
       if ( native ) {
 			// get the native event pointer used for this papi event
 			int ntv_idx = _papi_hwi_get_ntv_idx((unsigned)(native[i].ni_papi_code));
-			if (ntv_idx < -1) {
-				SUBDBG("papi_event_code: %#x known by papi but not by the component\n", native[i].ni_papi_code);
-				continue;
-			}
-			// if native index is -1, then we have an event without a mask and need to find the right native index to use
-			if (ntv_idx == -1) {
-				// find the native event index we want by matching for the right papi event code
-				for (j=0 ; j<pe_ctx->event_table->num_native_events ; j++) {
-					if (pe_ctx->event_table->native_events[j].papi_event_code == native[i].ni_papi_code) {
-						ntv_idx = j;
-					}
-				}
-			}
-
-			// if native index is still negative, we did not find event we wanted so just return error
-			if (ntv_idx < 0) {
-				SUBDBG("papi_event_code: %#x not found in native event tables\n", native[i].ni_papi_code);
-				continue;
-			}
-
-			// this native index is positive so there was a mask with the event, the ntv_idx identifies which native event to use
-			ntv_evt = (struct native_event_t *)(&(pe_ctx->event_table->native_events[ntv_idx]));
-
-			SUBDBG("ntv_evt: %p\n", ntv_evt);
 
-			SUBDBG("i: %d, pe_ctx->event_table->num_native_events: %d\n", i, pe_ctx->event_table->num_native_events);
-
-	    	// Move this events hardware config values and other attributes to the perf_events attribute structure
-			memcpy (&pe_ctl->events[i].attr, &ntv_evt->attr, sizeof(perf_event_attr_t));
-
-			// may need to update the attribute structure with information from event set level domain settings (values set by PAPI_set_domain)
-			// only done if the event mask which controls each counting domain was not provided
-
-			// get pointer to allocated name, will be NULL when adding preset events to event set
-			char *aName = ntv_evt->allocated_name;
-			if ((aName == NULL)  ||  (strstr(aName, ":u=") == NULL)) {
-				SUBDBG("set exclude_user attribute from eventset level domain flags, encode: %d, eventset: %d\n", pe_ctl->events[i].attr.exclude_user, !(pe_ctl->domain & PAPI_DOM_USER));
-				pe_ctl->events[i].attr.exclude_user = !(pe_ctl->domain & PAPI_DOM_USER);
-			}
-			if ((aName == NULL)  ||  (strstr(aName, ":k=") == NULL)) {
-				SUBDBG("set exclude_kernel attribute from eventset level domain flags, encode: %d, eventset: %d\n", pe_ctl->events[i].attr.exclude_kernel, !(pe_ctl->domain & PAPI_DOM_KERNEL));
-				pe_ctl->events[i].attr.exclude_kernel = !(pe_ctl->domain & PAPI_DOM_KERNEL);
-			}
-
-			// set the cpu number provided with an event mask if there was one (will be -1 if mask not provided)
-			pe_ctl->events[i].cpu = ntv_evt->cpu;
-			// if cpu event mask not provided, then set the cpu to use to what may have been set on call to PAPI_set_opt (will still be -1 if not called)
-			if (pe_ctl->events[i].cpu == -1) {
-				pe_ctl->events[i].cpu = pe_ctl->cpu;
+			// aggregates put their first box here, the others in boxes[]
+			if (ntv_idx >= PEU_AGGREGATE_IDX) {
+				ret = peu_setup_aggregate(pe_ctx, pe_ctl, i, ntv_idx - PEU_AGGREGATE_IDX);
+				if (ret != PAPI_OK) {
+					SUBDBG("EXIT: aggregate papi_event_code: %#x could not be set up\n", native[i].ni_papi_code);
+					return ret;
+				}
+			} else {
+				ntv_evt = peu_native_event(pe_ctx, ntv_idx, native[i].ni_papi_code);
+				if (ntv_evt == NULL) {
+					continue;
+				}
+				peu_setup_event(pe_ctl, &pe_ctl->events[i], ntv_evt);
 			}
       } else {
     	  // This case happens when called from _pe_set_overflow and _pe_ctl
@@ -851,7 +1096,7 @@ _peu_reset( hwd_context_t *ctx, hwd_control_state_t *ctl )
       }
    }
 
-   return PAPI_OK;
+   return box_ioctl( pe_ctl, PERF_EVENT_IOC_RESET );
 }
 
 
@@ -1043,6 +1288,13 @@ _peu_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
       }
    }
 
+   /* aggregate events add up the rest of their boxes */
+   ret = read_boxes( pe_ctl );
+   if ( ret != PAPI_OK ) {
+      SUBDBG("EXIT: %d\n", ret);
+      return ret;
+   }
+
    /* point PAPI to the values we read */
    *events = pe_ctl->counts;
 
@@ -1088,6 +1340,11 @@ _peu_start( hwd_context_t *ctx, hwd_control_state_t *ctl )
       return PAPI_EBUG;
    }
 
+   ret = box_ioctl( pe_ctl, PERF_EVENT_IOC_ENABLE );
+   if ( ret != PAPI_OK ) {
+      return ret;
+   }
+
    pe_ctx->state |= PERF_EVENTS_RUNNING;
 
    return PAPI_OK;
@@ -1117,6 +1374,10 @@ _peu_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
       }
    }
 
+   if ( box_ioctl( pe_ctl, PERF_EVENT_IOC_DISABLE ) != PAPI_OK ) {
+      return PAPI_EBUG;
+   }
+
    pe_ctx->state &= ~PERF_EVENTS_RUNNING;
 
    return PAPI_OK;
@@ -1238,6 +1499,308 @@ _peu_ctl( hwd_context_t *ctx, int code, _papi_int_option_t *option )
 }
 
 
+/********************************************************************/
+/* Aggregate events                                                 */
+/********************************************************************/
+
+/* Split pmu::event:masks into the pmu and the event with its masks, */
+/* taking out the ALL_BOXES and SOCKET=n masks libpfm4 does not know. */
+/* Returns 1 if either of them was there.                             */
+static int
+peu_parse_aggregate( const char *name, char *pmu, int pmu_len,
+		     char *event, int event_len, int *all_boxes, int *socket )
+{
+   char copy[PAPI_HUGE_STR_LEN];
+   const char *sep;
+   char *tok, *save, *end;
+   long n;
+
+   *all_boxes = 0;
+   *socket = -1;
+
+   sep = strstr(name, "::");
+   if ((sep == NULL) || (sep - name >= pmu_len) ||
+       (strlen(sep + 2) >= sizeof(copy))) {
+      return 0;
+   }
+   memcpy(pmu, name, sep - name);
+   pmu[sep - name] = '\0';
+   strcpy(copy, sep + 2);
+
+   event[0] = '\0';
+   for (tok = strtok_r(copy, ":", &save); tok != NULL;
+	tok = strtok_r(NULL, ":", &save)) {
+      if (!strcasecmp(tok, "ALL_BOXES")) {
+	 *all_boxes = 1;
+	 continue;
+      }
+      if (!strncasecmp(tok, "SOCKET=", 7)) {
+	 n = strtol(tok + 7, &end, 10);
+	 if ((end == tok + 7) || (*end != '\0') || (n < 0) || (n > 0xffff)) {
+	    return 0;
+	 }
+	 *socket = n;
+	 continue;
+      }
+      if (strlen(event) + strlen(tok) + 2 > (size_t)event_len) {
+	 return 0;
+      }
+      if (event[0] != '\0') strcat(event, ":");
+      strcat(event, tok);
+   }
+
+   return (*all_boxes || (*socket >= 0));
+}
+
+/* First online cpu of a socket, the one its uncore is counted from */
+static int
+peu_socket_cpu( int socket )
+{
+   char path[128];
+   FILE *fff;
+   int cpu, max, id, online, ret;
+
+   max = sysconf( _SC_NPROCESSORS_CONF );
+   for (cpu = 0; cpu < max; cpu++) {
+
+      /* cpu0 usually has no online file, it cannot go offline */
+      snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/online", cpu);
+      fff = fopen(path, "r");
+      if (fff != NULL) {
+	 ret = fscanf(fff, "%d", &online);
+	 fclose(fff);
+	 if ((ret == 1) && (online == 0)) continue;
+      }
+
+      snprintf(path, sizeof(path),
+	       "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+      fff = fopen(path, "r");
+      if (fff == NULL) continue;
+      ret = fscanf(fff, "%d", &id);
+      fclose(fff);
+
+      if ((ret == 1) && (id == socket)) {
+	 SUBDBG("socket %d is counted from cpu %d\n", socket, cpu);
+	 return cpu;
+      }
+   }
+
+   return -1;
+}
+
+/* Is this pmu one of the boxes asked for: the pmu itself, or with */
+/* ALL_BOXES any pmu named family (family_len chars) plus a number  */
+static int
+peu_is_box( const char *name, const char *pmu, size_t family_len,
+	    int all_boxes )
+{
+   const char *p;
+
+   if (!all_boxes) {
+      return !strcmp(name, pmu);
+   }
+   if (strncmp(name, pmu, family_len)) {
+      return 0;
+   }
+   for (p = name + family_len; *p != '\0'; p++) {
+      if (!isdigit((unsigned char)*p)) return 0;
+   }
+   return 1;
+}
+
+/* Look an aggregate up by name, or by papi event code if name is NULL. */
+/* The caller holds NAMELIB_LOCK.                                       */
+static struct peu_aggregate *
+find_aggregate( const char *name, int papi_event_code )
+{
+   int i;
+
+   for (i = 0; i < num_peu_aggregates; i++) {
+      if (name != NULL) {
+	 if (!strcmp(peu_aggregates[i]->name, name)) return peu_aggregates[i];
+      }
+      else if (peu_aggregates[i]->papi_event_code == papi_event_code) {
+	 return peu_aggregates[i];
+      }
+   }
+   return NULL;
+}
+
+static struct peu_aggregate *
+peu_find_aggregate( const char *name, int papi_event_code )
+{
+   struct peu_aggregate *agg;
+
+   _papi_hwi_lock( NAMELIB_LOCK );
+   agg = find_aggregate( name, papi_event_code );
+   _papi_hwi_unlock( NAMELIB_LOCK );
+
+   return agg;
+}
+
+/* Resolve every box of an aggregate, then hand out one papi event   */
+/* code for the lot.  Its native index tells update_control_state    */
+/* which aggregate it is.                                            */
+static int
+peu_aggregate_name_to_code( const char *name, const char *pmu,
+			    const char *event, int all_boxes, int socket,
+			    unsigned int *event_code )
+{
+   char box_name[PAPI_HUGE_STR_LEN];
+   struct peu_aggregate *agg, **aggs;
+   pfm_pmu_info_t pinfo;
+   unsigned int box_code, ntv_code = 0;
+   int *box_codes = NULL, *codes;
+   int num_boxes = 0, cpu = -1, i, ret;
+   size_t family_len;
+
+   SUBDBG("ENTER: name: %s, pmu: %s, event: %s, all_boxes: %d, socket: %d\n",
+	  name, pmu, event, all_boxes, socket);
+
+   /* asked for before, hand out the same code again */
+   agg = peu_find_aggregate( name, 0 );
+   if (agg != NULL) {
+      _papi_hwi_set_papi_event_code(agg->papi_event_code, 1);
+      *event_code = agg->ntv_code;
+      return PAPI_OK;
+   }
+
+   if (socket >= 0) {
+      /* a cpu= mask as well would say two different things */
+      if (strstr(event, ":cpu=") != NULL) {
+	 SUBDBG("EXIT: both SOCKET= and cpu= given\n");
+	 return PAPI_ENOEVNT;
+      }
+      cpu = peu_socket_cpu( socket );
+      if (cpu < 0) {
+	 SUBDBG("EXIT: no online cpu on socket %d\n", socket);
+	 return PAPI_ENOEVNT;
+      }
+   }
+
+   /* skx_unc_imc and skx_unc_imc0 both mean all the skx_unc_imc boxes */
+   family_len = strlen(pmu);
+   if (all_boxes) {
+      while ((family_len > 0) && isdigit((unsigned char)pmu[family_len-1])) {
+	 family_len--;
+      }
+      if (family_len == 0) return PAPI_ENOEVNT;
+   }
+
+   for (i = 0; ; i++) {
+      memset(&pinfo, 0, sizeof(pfm_pmu_info_t));
+      pinfo.size = sizeof(pfm_pmu_info_t);
+      ret = pfm_get_pmu_info(i, &pinfo);
+      if (ret == PFM_ERR_INVAL) break;
+
+      if ((ret != PFM_SUCCESS) || (!pinfo.is_present) ||
+	  (pinfo.type != PFM_PMU_TYPE_UNCORE) ||
+	  (!peu_is_box(pinfo.name, pmu, family_len, all_boxes))) {
+	 continue;
+      }
+
+      if (cpu >= 0) {
+	 ret = snprintf(box_name, sizeof(box_name), "%s::%s:cpu=%d",
+			pinfo.name, event, cpu);
+      } else {
+	 ret = snprintf(box_name, sizeof(box_name), "%s::%s",
+			pinfo.name, event);
+      }
+      if (ret >= (int)sizeof(box_name)) {
+	 free(box_codes);
+	 return PAPI_ENOEVNT;
+      }
+
+      /* each box gets a papi event code of its own */
+      _papi_hwi_set_papi_event_code(-1, -1);
+      ret = _pe_libpfm4_ntv_name_to_code(box_name, &box_code, our_cidx,
+					 &uncore_native_event_table);
+      if (ret != PAPI_OK) {
+	 SUBDBG("EXIT: box event %s not found\n", box_name);
+	 free(box_codes);
+	 return PAPI_ENOEVNT;
+      }
+
+      codes = realloc(box_codes, (num_boxes + 1) * sizeof(int));
+      if (codes == NULL) {
+	 free(box_codes);
+	 return PAPI_ENOMEM;
+      }
+      box_codes = codes;
+
+      /* resolving the box left its papi event code behind */
+      box_codes[num_boxes++] = _papi_hwi_get_papi_event_code();
+      if (num_boxes == 1) ntv_code = box_code;
+   }
+
+   if (num_boxes == 0) {
+      SUBDBG("EXIT: no present uncore pmu matches %s\n", pmu);
+      return PAPI_ENOEVNT;
+   }
+
+   /* the code we hand out is the aggregate's, not the last box's */
+   _papi_hwi_set_papi_event_code(-1, -1);
+
+   _papi_hwi_lock( NAMELIB_LOCK );
+
+   agg = find_aggregate( name, 0 );
+   if (agg == NULL) {
+      aggs = realloc(peu_aggregates,
+		     (num_peu_aggregates + 1) * sizeof(struct peu_aggregate *));
+      if (aggs != NULL) {
+	 peu_aggregates = aggs;
+	 agg = calloc(1, sizeof(struct peu_aggregate));
+      }
+      if ((agg == NULL) || ((agg->name = strdup(name)) == NULL)) {
+	 _papi_hwi_unlock( NAMELIB_LOCK );
+	 free(agg);
+	 free(box_codes);
+	 return PAPI_ENOMEM;
+      }
+
+      agg->ntv_code = ntv_code;
+      agg->num_boxes = num_boxes;
+      agg->box_codes = box_codes;
+      box_codes = NULL;
+      agg->papi_event_code = _papi_hwi_native_to_eventcode(our_cidx, ntv_code,
+					PEU_AGGREGATE_IDX + num_peu_aggregates, name);
+      peu_aggregates[num_peu_aggregates++] = agg;
+   }
+
+   _papi_hwi_unlock( NAMELIB_LOCK );
+   free(box_codes);
+
+   _papi_hwi_set_papi_event_code(agg->papi_event_code, 1);
+   *event_code = agg->ntv_code;
+
+   SUBDBG("EXIT: %s sums %d boxes, papi_event_code: %#x\n",
+	  name, agg->num_boxes, agg->papi_event_code);
+   return PAPI_OK;
+}
+
+/* An aggregate is described the way its first box is */
+static int
+peu_aggregate_descr( struct peu_aggregate *agg, char *ntv_descr, int len )
+{
+   char descr[PAPI_HUGE_STR_LEN];
+   int ret;
+
+   _papi_hwi_set_papi_event_code(agg->box_codes[0], 0);
+   ret = _pe_libpfm4_ntv_code_to_descr(agg->ntv_code, descr, sizeof(descr),
+				       &uncore_native_event_table);
+   _papi_hwi_set_papi_event_code(agg->papi_event_code, 0);
+   if (ret != PAPI_OK) {
+      return ret;
+   }
+
+   if (snprintf(ntv_descr, len, "Sum of %d boxes: %s",
+		agg->num_boxes, descr) >= len) {
+      return PAPI_EBUF;
+   }
+   return PAPI_OK;
+}
+
+
 static int
 _peu_ntv_enum_events( unsigned int *PapiEventCode, int modifier )
 {
@@ -1252,8 +1815,18 @@ _peu_ntv_enum_events( unsigned int *PapiEventCode, int modifier )
 static int
 _peu_ntv_name_to_code( const char *name, unsigned int *event_code) {
 
+  char pmu[PAPI_MIN_STR_LEN];
+  char event[PAPI_HUGE_STR_LEN];
+  int all_boxes, socket;
+
   if (_perf_event_uncore_vector.cmp_info.disabled) return PAPI_ENOEVNT;
 
+  if (peu_parse_aggregate(name, pmu, sizeof(pmu), event, sizeof(event),
+			  &all_boxes, &socket)) {
+     return peu_aggregate_name_to_code(name, pmu, event, all_boxes, socket,
+				       event_code);
+  }
+
   return _pe_libpfm4_ntv_name_to_code(name,event_code, our_cidx,
                                         &uncore_native_event_table);
 }
@@ -1262,8 +1835,17 @@ static int
 _peu_ntv_code_to_name(unsigned int EventCode,
                           char *ntv_name, int len) {
 
+   struct peu_aggregate *agg;
+
    if (_perf_event_uncore_vector.cmp_info.disabled) return PAPI_ENOEVNT;
 
+   agg = peu_find_aggregate(NULL, _papi_hwi_get_papi_event_code());
+   if (agg != NULL) {
+      if (strlen(agg->name) >= (unsigned)len) return PAPI_EBUF;
+      strcpy(ntv_name, agg->name);
+      return PAPI_OK;
+   }
+
    return _pe_libpfm4_ntv_code_to_name(EventCode,
                                          ntv_name, len, 
 					 &uncore_native_event_table);
@@ -1273,8 +1855,15 @@ static int
 _peu_ntv_code_to_descr( unsigned int EventCode,
                             char *ntv_descr, int len) {
 
+   struct peu_aggregate *agg;
+
    if (_perf_event_uncore_vector.cmp_info.disabled) return PAPI_ENOEVNT;
 
+   agg = peu_find_aggregate(NULL, _papi_hwi_get_papi_event_code());
+   if (agg != NULL) {
+      return peu_aggregate_descr(agg, ntv_descr, len);
+   }
+
    return _pe_libpfm4_ntv_code_to_descr(EventCode,ntv_descr,len,
                                           &uncore_native_event_table);
 }
@@ -1283,8 +1872,19 @@ static int
 _peu_ntv_code_to_info(unsigned int EventCode,
                           PAPI_event_info_t *info) {
 
+  struct peu_aggregate *agg;
+  int ret;
+
   if (_perf_event_uncore_vector.cmp_info.disabled) return PAPI_ENOEVNT;
 
+  agg = peu_find_aggregate(NULL, _papi_hwi_get_papi_event_code());
+  if (agg != NULL) {
+     if (strlen(agg->name) >= sizeof(info->symbol)) return PAPI_ENOEVNT;
+     strcpy(info->symbol, agg->name);
+     ret = peu_aggregate_descr(agg, info->long_descr, sizeof(info->long_descr));
+     return (ret == PAPI_OK) ? PAPI_OK : PAPI_ENOEVNT;
+  }
+
   return _pe_libpfm4_ntv_code_to_info(EventCode, info,
                                         &uncore_native_event_table);
 }
@@ -0,0 +1,209 @@
+/*
+ * This file tests ALL_BOXES aggregate uncore events on Intel Processors
+ *
+ * One event per socket sums the cbox event over every cbox of that
+ * socket, so the whole machine fits in a single EventSet.  The socket 0
+ * aggregate is checked against the boxes added one by one.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "do_loops.h"
+
+#include "perf_event_uncore_lib.h"
+
+#define MAX_PACKAGES  4
+#define MAX_BOXES     64
+
+/* The aggregate is read inside the window the boxes are read in, */
+/* so it may come out a little lower but never higher             */
+#define AGG_TOLERANCE 0.1
+
+int main( int argc, char **argv ) {
+
+	int retval,i,quiet;
+	int EventSet = PAPI_NULL;
+	int BoxSet = PAPI_NULL;
+	int boxes;
+	long long values[MAX_PACKAGES];
+	long long box_values[MAX_BOXES];
+	long long sum;
+	PAPI_cpu_option_t cpu_opt;
+	char event_name[BUFSIZ];
+	char uncore_base[BUFSIZ];
+	char uncore_event[MAX_PACKAGES][BUFSIZ];
+	char box_event[BUFSIZ];
+	int uncore_cidx=-1;
+	int sockets;
+	char *result;
+	PAPI_event_info_t info;
+
+	const PAPI_hw_info_t *hwinfo;
+
+	/* Set TESTS_QUIET variable */
+	quiet = tests_quiet( argc, argv );
+
+	/* Init the PAPI library */
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	/* Find the uncore PMU */
+	uncore_cidx=PAPI_get_component_index("perf_event_uncore");
+	if (uncore_cidx<0) {
+		if (!quiet) {
+			printf("perf_event_uncore component not found\n");
+		}
+		test_skip(__FILE__,__LINE__,"perf_event_uncore component not found",0);
+	}
+
+	/* Get hardware info */
+	hwinfo = PAPI_get_hardware_info();
+	if ( hwinfo == NULL ) {
+		test_fail(__FILE__,__LINE__,"PAPI_get_hardware_info()",retval);
+	}
+
+	/* Get event to use */
+	result=get_uncore_cbox_event(event_name,uncore_base,BUFSIZ);
+	if (result==NULL) {
+		if (!quiet) {
+			printf("No event available\n");
+		}
+		test_skip( __FILE__, __LINE__,
+			"No event available", PAPI_ENOSUPP );
+	}
+
+	/* Create an eventset */
+	retval = PAPI_create_eventset(&EventSet);
+	if (retval != PAPI_OK) {
+		test_fail(__FILE__, __LINE__, "PAPI_create_eventset",retval);
+	}
+
+	sockets=hwinfo->sockets;
+	if (sockets>MAX_PACKAGES) sockets=MAX_PACKAGES;
+	if (sockets<1) sockets=1;
+
+	/* One event per socket, each summing all of its boxes */
+	for(i=0;i<sockets;i++) {
+		retval = snprintf(uncore_event[i],sizeof(uncore_event[i]),
+			"%s::%s:ALL_BOXES:SOCKET=%d",
+			uncore_base,event_name,i);
+		if (retval >= (int)sizeof(uncore_event[i])) {
+			test_skip( __FILE__, __LINE__,
+				"event name too long", PAPI_EINVAL );
+		}
+		retval = PAPI_add_named_event(EventSet, uncore_event[i]);
+		if (retval != PAPI_OK) {
+			if (!quiet) {
+				printf("Could not add %s\n",uncore_event[i]);
+			}
+			test_skip( __FILE__, __LINE__,
+				"adding aggregate event; need to run as root",
+				retval);
+		}
+		if (!quiet) {
+			printf("Added %s\n",uncore_event[i]);
+		}
+	}
+
+	/* The aggregate should describe itself under the name we gave */
+	retval = PAPI_event_name_to_code(uncore_event[0], &i);
+	if (retval == PAPI_OK) retval = PAPI_get_event_info(i, &info);
+	if (retval != PAPI_OK) {
+		test_fail( __FILE__, __LINE__, "PAPI_get_event_info", retval );
+	}
+	if (strcmp(info.symbol,uncore_event[0])) {
+		test_fail( __FILE__, __LINE__, "aggregate event name", PAPI_EMISC );
+	}
+	if (!quiet) {
+		printf("%s\n\t%s\n",info.symbol,info.long_descr);
+	}
+
+	/* The boxes of socket 0 one by one, on the first cpu like the */
+	/* other uncore tests                                          */
+	retval = PAPI_create_eventset(&BoxSet);
+	if (retval != PAPI_OK) {
+		test_fail(__FILE__, __LINE__, "PAPI_create_eventset",retval);
+	}
+
+	retval = PAPI_assign_eventset_component(BoxSet, uncore_cidx);
+	if (retval!=PAPI_OK) {
+		test_fail(__FILE__, __LINE__, "PAPI_assign_eventset_component",retval);
+	}
+
+	cpu_opt.eventset=BoxSet;
+	cpu_opt.cpu_num=0;
+	retval = PAPI_set_opt(PAPI_CPU_ATTACH,(PAPI_option_t*)&cpu_opt);
+	if (retval != PAPI_OK) {
+		test_fail(__FILE__, __LINE__, "PAPI_CPU_ATTACH",retval);
+	}
+
+	for(boxes=0;boxes<MAX_BOXES;boxes++) {
+		retval = snprintf(box_event,sizeof(box_event),"%s%d::%s",
+			uncore_base,boxes,event_name);
+		if (retval >= (int)sizeof(box_event)) break;
+		retval = PAPI_add_named_event(BoxSet, box_event);
+		if (retval != PAPI_OK) break;
+	}
+	if (boxes==0) {
+		test_fail(__FILE__, __LINE__, "adding the first box",retval);
+	}
+	if (!quiet) {
+		printf("Added %d boxes for socket 0\n",boxes);
+	}
+
+	/* Start PAPI, the boxes are attached to a cpu so they go first */
+	retval = PAPI_start( BoxSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	/* our work code */
+	do_flops( NUM_FLOPS );
+
+	/* Stop PAPI */
+	retval = PAPI_stop( EventSet, values );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	retval = PAPI_stop( BoxSet, box_values );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	sum=0;
+	for(i=0;i<boxes;i++) {
+		sum+=box_values[i];
+	}
+
+	/* Print Results */
+	if ( !quiet ) {
+		for(i=0;i<sockets;i++) {
+			printf("\t%s %lld\n",uncore_event[i],values[i]);
+		}
+		printf("\tsum of %d boxes %lld\n",boxes,sum);
+	}
+
+	if ((values[0]>sum) || (values[0]<sum-(long long)(sum*AGG_TOLERANCE))) {
+		test_fail( __FILE__, __LINE__,
+			"aggregate does not match the sum of the boxes",
+			PAPI_EMISC );
+	}
+
+	PAPI_shutdown();
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
@@ -39,6 +39,8 @@ typedef struct _powercap_native_event_entry {
   int event_id;
   int type;
   int return_type;
+  int energy_event;        /* ENERGY_UJ event an AVG_POWER_UW event derives from */
+  long long max_range;     /* where an ENERGY_UJ event wraps around */
   _powercap_register_t resources;
 } _powercap_native_event_entry_t;
 
@@ -85,21 +87,34 @@ static char *component_event_names[COMPONENT_NUM_EVENTS] = {"ENERGY_UJ", "MAX_EN
 static char *component_sys_names[COMPONENT_NUM_EVENTS]         = {"energy_uj", "max_energy_range_uj", "constraint_0_max_power_uw", "constraint_0_power_limit_uw", "constraint_0_time_window_us", "enabled", "name"};
 static mode_t   component_sys_flags[COMPONENT_NUM_EVENTS]      = {O_RDONLY, O_RDONLY, O_RDONLY, O_RDWR, O_RDONLY, O_RDONLY, O_RDONLY};
 
-#define POWERCAP_MAX_COUNTERS (2 * (PKG_NUM_EVENTS + (3 * COMPONENT_NUM_EVENTS)))
+// derived events, the average power since start computed from ENERGY_UJ
+#define PKG_AVG_POWER               17
+#define COMPONENT_AVG_POWER         18
 
-static _powercap_native_event_entry_t powercap_ntv_events[(2 * (PKG_NUM_EVENTS + (3 * COMPONENT_NUM_EVENTS)))];
+/* energy_uj wrapped at 32 bits before max_energy_range_uj was exported */
+#define POWERCAP_DEFAULT_RANGE      0x100000000LL
+
+#define POWERCAP_MAX_COUNTERS (2 * (PKG_NUM_EVENTS + 1 + (3 * (COMPONENT_NUM_EVENTS + 1))))
+
+static _powercap_native_event_entry_t powercap_ntv_events[POWERCAP_MAX_COUNTERS];
 
 static int event_fds[POWERCAP_MAX_COUNTERS];
 
 typedef struct _powercap_control_state {
   long long count[POWERCAP_MAX_COUNTERS];
   long long which_counter[POWERCAP_MAX_COUNTERS];
-  long long need_difference[POWERCAP_MAX_COUNTERS];
+  int num_events;
+  /* the sysfs files read for the EventSet, each once per read */
+  int num_files;
+  int file_event[POWERCAP_MAX_COUNTERS];   /* native event owning the fd */
+  int file_of[POWERCAP_MAX_COUNTERS];      /* file slot of each position */
+  long long last[POWERCAP_MAX_COUNTERS];   /* last raw value of each file */
+  long long total[POWERCAP_MAX_COUNTERS];  /* energy accumulated since start */
+  long long start_usec;
   long long lastupdate;
 } _powercap_control_state_t;
 
 typedef struct _powercap_context {
-  long long start_value[POWERCAP_MAX_COUNTERS];
   _powercap_control_state_t state;
 } _powercap_context_t;
 
@@ -119,12 +134,89 @@ static char * _local_strlcpy( char *dst, const char *src, size_t size )
 
 static long long read_powercap_value( int index )
 {
-  int sz = pread(event_fds[index], read_buff, PAPI_MAX_STR_LEN, 0);
+  int sz = pread(event_fds[index], read_buff, PAPI_MAX_STR_LEN - 1, 0);
+  if (sz < 0) sz = 0;
   read_buff[sz] = '\0';
 
   return atoll(read_buff);
 }
 
+static int is_energy_event( int index )
+{
+  return (powercap_ntv_events[index].type == PKG_ENERGY) ||
+         (powercap_ntv_events[index].type == COMPONENT_ENERGY);
+}
+
+static int is_power_event( int index )
+{
+  return (powercap_ntv_events[index].type == PKG_AVG_POWER) ||
+         (powercap_ntv_events[index].type == COMPONENT_AVG_POWER);
+}
+
+/* add the event deriving the average power from ENERGY_UJ event energy */
+static void add_power_event( int energy, const char *zone )
+{
+  _powercap_native_event_entry_t *entry = &powercap_ntv_events[num_events];
+
+  snprintf(entry->name, sizeof(entry->name), "AVG_POWER_UW:%s", zone);
+  snprintf(entry->description, sizeof(entry->description),
+           "Average power since start, derived from ENERGY_UJ:%s", zone);
+  _local_strlcpy(entry->units, "uW", sizeof(entry->units));
+  entry->return_type = PAPI_DATATYPE_UINT64;
+  entry->type = (powercap_ntv_events[energy].type == PKG_ENERGY) ?
+                PKG_AVG_POWER : COMPONENT_AVG_POWER;
+  entry->energy_event = energy;
+  entry->resources.selector = num_events + 1;
+
+  event_fds[num_events] = -1;
+  num_events++;
+}
+
+/*
+ * Read every sysfs file of the EventSet once, with a plain decimal
+ * parse, folding energy into the 64-bit totals.  energy_uj wraps at
+ * max_energy_range_uj, so reading at least once per wrap period is
+ * enough to never lose any.
+ */
+static int read_powercap_files( _powercap_control_state_t *control, int starting )
+{
+  char buf[PAPI_MIN_STR_LEN], *p;
+  long long value, delta;
+  int f, index, sz;
+
+  for( f = 0; f < control->num_files; f++ ) {
+    index = control->file_event[f];
+
+    sz = pread(event_fds[index], buf, sizeof(buf) - 1, 0);
+    if (sz < 0) {
+      SUBDBG("Error reading %s\n", powercap_ntv_events[index].name);
+      return PAPI_ESYS;
+    }
+    buf[sz] = '\0';
+
+    value = 0;
+    for( p = buf; *p >= '0' && *p <= '9'; p++ ) {
+      value = value * 10 + (*p - '0');
+    }
+
+    if (!is_energy_event(index)) {
+      control->total[f] = value;
+    } else if (starting) {
+      control->total[f] = 0;
+    } else {
+      delta = value - control->last[f];
+      if (delta < 0) {
+        SUBDBG("Wraparound!\nlast value:\t%lld,\tcurrent value:%lld\n", control->last[f], value);
+        delta += powercap_ntv_events[index].max_range;
+      }
+      control->total[f] += delta;
+    }
+    control->last[f] = value;
+  }
+
+  return PAPI_OK;
+}
+
 static int write_powercap_value( int index, long long value )
 {
   snprintf(write_buff, sizeof(write_buff), "%lld", value);
@@ -154,9 +246,11 @@ static int _powercap_init_component( int cidx )
 
   int num_sockets = -1;
   int s = -1, e = -1, c = -1;
+  int energy, range;
 
   char events_dir[128];
   char event_path[128];
+  char zone[PAPI_MIN_STR_LEN];
 
   DIR *events;
 
@@ -174,7 +268,8 @@ static int _powercap_init_component( int cidx )
   num_sockets = hw_info->sockets;
 
   num_events = 0;
-  for(s = 0; s < num_sockets; s++) {
+  // every zone needs room for all its events, derived ones included
+  for(s = 0; s < num_sockets && num_events + PKG_NUM_EVENTS + 1 <= POWERCAP_MAX_COUNTERS; s++) {
 
     // compose string of a pkg directory path
     snprintf(events_dir, sizeof(events_dir), "/sys/class/powercap/intel-rapl:%d/", s);
@@ -186,6 +281,8 @@ static int _powercap_init_component( int cidx )
     if (events == NULL) { continue; }
     closedir(events);                                                // opendir has mallocs; so clean up.
 
+    energy = range = -1;
+
     // loop through pkg events and create powercap event entries
     for (e = 0; e < PKG_NUM_EVENTS; e++) {
 
@@ -194,6 +291,10 @@ static int _powercap_init_component( int cidx )
       // not a valid pkg event path so continue
       if (access(event_path, F_OK) == -1) { continue; }
 
+      // an event we can not open can not be read either
+      event_fds[num_events] = open(event_path, O_SYNC|pkg_sys_flags[e]);
+      if (event_fds[num_events] < 0) { continue; }
+
       snprintf(powercap_ntv_events[num_events].name, sizeof(powercap_ntv_events[num_events].name), "%s:ZONE%d", pkg_event_names[e], s);
       //snprintf(powercap_ntv_events[num_events].description, sizeof(powercap_ntv_events[num_events].name), "%s:ZONE%d", pkg_event_names[e], s);
       //snprintf(powercap_ntv_events[num_events].units, sizeof(powercap_ntv_events[num_events].name), "%s:ZONE%d", pkg_event_names[e], s);
@@ -202,23 +303,33 @@ static int _powercap_init_component( int cidx )
 
       powercap_ntv_events[num_events].resources.selector = num_events + 1;
 
-      event_fds[num_events] = open(event_path, O_SYNC|pkg_sys_flags[e]);
-
       if(powercap_ntv_events[num_events].type == PKG_NAME) {
-        int sz = pread(event_fds[num_events], read_buff, PAPI_MAX_STR_LEN, 0);
+        int sz = pread(event_fds[num_events], read_buff, PAPI_MAX_STR_LEN - 1, 0);
+        if (sz < 0) sz = 0;
         read_buff[sz] = '\0';
         snprintf(powercap_ntv_events[num_events].description, sizeof(powercap_ntv_events[num_events].description), "%s", read_buff);
       }
+      if(powercap_ntv_events[num_events].type == PKG_ENERGY) energy = num_events;
+      if(powercap_ntv_events[num_events].type == PKG_MAX_ENERGY_RANGE) range = num_events;
 
       num_events++;
     }
 
+    if (energy >= 0) {
+      powercap_ntv_events[energy].max_range = (range >= 0) ? read_powercap_value(range) : POWERCAP_DEFAULT_RANGE;
+      snprintf(zone, sizeof(zone), "ZONE%d", s);
+      add_power_event(energy, zone);
+    }
+
     // reset component count for each socket
     c = 0;
     snprintf(events_dir, sizeof(events_dir), "/sys/class/powercap/intel-rapl:%d:%d/", s, c);
-    while((events = opendir(events_dir)) != NULL) {
+    while(num_events + COMPONENT_NUM_EVENTS + 1 <= POWERCAP_MAX_COUNTERS &&
+          (events = opendir(events_dir)) != NULL) {
       closedir(events);                                                // opendir has mallocs; so clean up.
 
+      energy = range = -1;
+
       // loop through pkg events and create powercap event entries
       for (e = 0; e < COMPONENT_NUM_EVENTS; e++) {
 
@@ -228,6 +339,10 @@ static int _powercap_init_component( int cidx )
         // not a valid pkg event path so continue
         if (access(event_path, F_OK) == -1) { continue; }
 
+        // an event we can not open can not be read either
+        event_fds[num_events] = open(event_path, O_SYNC|component_sys_flags[e]);
+        if (event_fds[num_events] < 0) { continue; }
+
         snprintf(powercap_ntv_events[num_events].name, sizeof(powercap_ntv_events[num_events].name), "%s:ZONE%d_SUBZONE%d", component_event_names[e], s, c);
         //snprintf(powercap_ntv_events[num_events].description, sizeof(powercap_ntv_events[num_events].name), "%s:ZONE%d_SUBZONE%d", component_event_names[e], s, c);
         //snprintf(powercap_ntv_events[num_events].units, sizeof(powercap_ntv_events[num_events].name), "%s:ZONE%d_SUBZONE%d", component_event_names[e], s, c);
@@ -236,17 +351,24 @@ static int _powercap_init_component( int cidx )
 
         powercap_ntv_events[num_events].resources.selector = num_events + 1;
 
-        event_fds[num_events] = open(event_path, O_SYNC|component_sys_flags[e]);
-
         if(powercap_ntv_events[num_events].type == COMPONENT_NAME) {
-          int sz = pread(event_fds[num_events], read_buff, PAPI_MAX_STR_LEN, 0);
+          int sz = pread(event_fds[num_events], read_buff, PAPI_MAX_STR_LEN - 1, 0);
+          if (sz < 0) sz = 0;
           read_buff[sz] = '\0';
           snprintf(powercap_ntv_events[num_events].description, sizeof(powercap_ntv_events[num_events].description), "%s", read_buff);
         }
+        if(powercap_ntv_events[num_events].type == COMPONENT_ENERGY) energy = num_events;
+        if(powercap_ntv_events[num_events].type == COMPONENT_MAX_ENERGY_RANGE) range = num_events;
 
         num_events++;
       }
 
+      if (energy >= 0) {
+        powercap_ntv_events[energy].max_range = (range >= 0) ? read_powercap_value(range) : POWERCAP_DEFAULT_RANGE;
+        snprintf(zone, sizeof(zone), "ZONE%d_SUBZONE%d", s, c);
+        add_power_event(energy, zone);
+      }
+
       // test for next component
       c++;
 
@@ -276,29 +398,17 @@ static int _powercap_init_control_state( hwd_control_state_t *ctl )
     _powercap_control_state_t* control = ( _powercap_control_state_t* ) ctl;
     memset( control, 0, sizeof ( _powercap_control_state_t ) );
 
-
-    /* if an event is a counter, set its corresponding flag to 1  */
-    int i;
-    for (i = 0; i < num_events; i++) {
-        if ((powercap_ntv_events[i].type == PKG_ENERGY) || (powercap_ntv_events[i].type == COMPONENT_ENERGY)) {
-  	    control->need_difference[i] = 1;
-        }
-    }
-
     return PAPI_OK;
 }
 
 static int _powercap_start( hwd_context_t *ctx, hwd_control_state_t *ctl )
 {
-    _powercap_context_t* context = ( _powercap_context_t* ) ctx;
-    (void) ctl;
+    _powercap_control_state_t* control = ( _powercap_control_state_t* ) ctl;
+    (void) ctx;
 
-    int b;
-    for( b = 0; b < num_events; b++ ) {
-      context->start_value[b]=read_powercap_value(b);
-    }
+    control->start_usec = PAPI_get_real_usec();
 
-    return PAPI_OK;
+    return read_powercap_files( control, 1 );
 }
 
 static int _powercap_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
@@ -325,42 +435,31 @@ _powercap_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
   SUBDBG("Enter _powercap_read\n");
 
   (void) flags;
+  (void) ctx;
   _powercap_control_state_t* control = ( _powercap_control_state_t* ) ctl;
-  _powercap_context_t* context = ( _powercap_context_t* ) ctx;
-
-  long long start_val = 0;
-  long long curr_val = 0;
-  int c;
 
-  for( c = 0; c < num_events; c++ ) {
-    start_val = context->start_value[c];
-    curr_val = read_powercap_value(c);
+  long long now, elapsed;
+  int i, retval;
 
-    SUBDBG("%d, start value: %lld, current value %lld\n", c, start_val, curr_val);
+  retval = read_powercap_files( control, 0 );
+  if (retval != PAPI_OK) return retval;
 
-    if(start_val) {
+  now = PAPI_get_real_usec();
+  elapsed = now - control->start_usec;
+  control->lastupdate = now;
 
-      /* Make sure an event is a counter. */
-      if (control->need_difference[c] == 1) {
+  for( i = 0; i < control->num_events; i++ ) {
+    long long value = control->total[control->file_of[i]];
 
-	/* Wraparound. */
-	if(start_val > curr_val) {
-	  SUBDBG("Wraparound!\nstart value:\t%lld,\tcurrent value:%lld\n", start_val, curr_val);
-	  curr_val += (0x100000000 - start_val);
-	}
-	/* Normal subtraction. */
-	else if (start_val < curr_val) {
-	  SUBDBG("Normal subtraction!\nstart value:\t%lld,\tcurrent value:%lld\n", start_val, curr_val);
-	  curr_val -= start_val;
-	}
-	SUBDBG("Final value: %lld\n", curr_val);
-
-      }
+    /* uJ over us is W, so scale up to uW */
+    if (is_power_event(control->which_counter[i])) {
+      value = (elapsed > 0) ? (long long)((double)value * 1000000.0 / elapsed) : 0;
     }
-    control->count[c]=curr_val;
+    SUBDBG("%d, value %lld\n", i, value);
+    control->count[i] = value;
   }
 
-  *events = ( ( _powercap_control_state_t* ) ctl )->count;
+  *events = control->count;
 
   return PAPI_OK;
 }
@@ -373,7 +472,7 @@ static int _powercap_write( hwd_context_t * ctx, hwd_control_state_t * ctl, long
 
     int i;
 
-    for(i=0;i<num_events;i++) {
+    for(i=0;i<control->num_events;i++) {
       if( (powercap_ntv_events[control->which_counter[i]].type == PKG_POWER_LIMIT_A) || (powercap_ntv_events[control->which_counter[i]].type == PKG_POWER_LIMIT_B) ) {
         write_powercap_value(control->which_counter[i], values[i]);
       }
@@ -390,7 +489,7 @@ static int _powercap_shutdown_component( void )
 
   /* Read counters into expected slot */
   for(i=0;i<num_events;i++) {
-    close(event_fds[i]);
+    if (event_fds[i] >= 0) close(event_fds[i]);
   }
     return PAPI_OK;
 }
@@ -416,15 +515,27 @@ static int _powercap_update_control_state( hwd_control_state_t *ctl,
                                 hwd_context_t *ctx )
 {
   (void) ctx;
-  int i, index;
+  int i, f, index, file;
 
   _powercap_control_state_t* control = ( _powercap_control_state_t* ) ctl;
-  if (count==0) return PAPI_OK;
+
+  control->num_events = count;
+  control->num_files = 0;
 
   for( i = 0; i < count; i++ ) {
     index = native[i].ni_event;
     control->which_counter[i]=index;
     native[i].ni_position = i;
+
+    /* the energy file is shared with the power derived from it */
+    file = is_power_event(index) ? powercap_ntv_events[index].energy_event : index;
+    for( f = 0; f < control->num_files; f++ ) {
+      if (control->file_event[f] == file) break;
+    }
+    if (f == control->num_files) {
+      control->file_event[control->num_files++] = file;
+    }
+    control->file_of[i] = f;
   }
 
   return PAPI_OK;
@@ -441,11 +552,10 @@ static int _powercap_set_domain( hwd_control_state_t *ctl, int domain )
 }
 
 
+/* restart the energy totals and the interval average power is over */
 static int _powercap_reset( hwd_context_t *ctx, hwd_control_state_t *ctl )
 {
-    ( void ) ctx;
-    ( void ) ctl;
-    return PAPI_OK;
+    return _powercap_start( ctx, ctl );
 }
 
 /*
@@ -0,0 +1,172 @@
+/**
+ * @author PAPI team UTK/ICL
+ * Test case for powercap component
+ * @brief
+ *   Tests the AVG_POWER_UW events against the ENERGY_UJ events
+ *   they are derived from
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define MAX_powercap_EVENTS 128
+
+/* AVG_POWER_UW is read a little after the energy, allow for the skew */
+#define POWER_TOLERANCE 0.2
+
+int main ( int argc, char **argv )
+{
+  (void) argv;
+  (void) argc;
+  int retval,cid,powercap_cid=-1,numcmp;
+  int EventSet = PAPI_NULL;
+  long long values[MAX_powercap_EVENTS];
+  int energy_map[MAX_powercap_EVENTS];
+  int num_events=0, num_power=0;
+  int code;
+  char event_names[MAX_powercap_EVENTS][PAPI_MAX_STR_LEN];
+  char energy_name[PAPI_MAX_STR_LEN];
+  long long before_time,after_time;
+  double elapsed_time,expected;
+  int r,i,j;
+
+  const PAPI_component_info_t *cmpinfo = NULL;
+
+  /* PAPI Initialization */
+  retval = PAPI_library_init( PAPI_VER_CURRENT );
+  if ( retval != PAPI_VER_CURRENT )
+    test_fail( __FILE__, __LINE__,"PAPI_library_init()\n",retval );
+
+  if ( !TESTS_QUIET ) printf( "Trying powercap average power events\n" );
+
+  numcmp = PAPI_num_components();
+
+  for( cid=0; cid<numcmp; cid++ ) {
+
+    if ( ( cmpinfo = PAPI_get_component_info( cid ) ) == NULL )
+      test_fail( __FILE__, __LINE__,"PAPI_get_component_info()\n", 0 );
+
+    if ( strstr( cmpinfo->name,"powercap" ) ) {
+      powercap_cid=cid;
+      if ( !TESTS_QUIET ) printf( "Found powercap component at cid %d\n",powercap_cid );
+      if ( cmpinfo->disabled ) {
+        if ( !TESTS_QUIET ) {
+          printf( "powercap component disabled: %s\n",
+                  cmpinfo->disabled_reason );
+        }
+        test_skip( __FILE__,__LINE__,"powercap component disabled",0 );
+      }
+      break;
+    }
+  }
+
+  /* Component not found */
+  if ( cid==numcmp )
+    test_skip( __FILE__,__LINE__,"No powercap component found\n",0 );
+
+  /* Skip if component has no counters */
+  if ( cmpinfo->num_cntrs==0 )
+    test_skip( __FILE__,__LINE__,"No counters in the powercap component\n",0 );
+
+  /* Create EventSet */
+  retval = PAPI_create_eventset( &EventSet );
+  if ( retval != PAPI_OK )
+    test_fail( __FILE__, __LINE__, "PAPI_create_eventset()",retval );
+
+  /* find all energy and average power events */
+  code = PAPI_NATIVE_MASK;
+  r = PAPI_enum_cmp_event( &code, PAPI_ENUM_FIRST, powercap_cid );
+
+  while ( r == PAPI_OK ) {
+    if ( num_events == MAX_powercap_EVENTS )
+      break; /* No room for more */
+
+    retval = PAPI_event_code_to_name( code, event_names[num_events] );
+    if ( retval != PAPI_OK )
+      test_fail( __FILE__, __LINE__,"PAPI_event_code_to_name()", retval );
+
+    if ( strstr( event_names[num_events],"ENERGY_UJ" ) ||
+         strstr( event_names[num_events],"AVG_POWER_UW" ) ) {
+      retval = PAPI_add_event( EventSet, code );
+      if ( retval != PAPI_OK )
+        break; /* We've hit an event limit */
+      num_events++;
+    }
+
+    r = PAPI_enum_cmp_event( &code, PAPI_ENUM_EVENTS, powercap_cid );
+  }
+
+  /* pair every AVG_POWER_UW:<zone> with its ENERGY_UJ:<zone> */
+  for( i=0; i<num_events; i++ ) {
+    if ( !strstr( event_names[i],"AVG_POWER_UW" ) ) continue;
+
+    snprintf( energy_name, sizeof( energy_name ), "%.*sENERGY_UJ%s",
+              ( int )( strstr( event_names[i],"AVG_POWER_UW" ) - event_names[i] ),
+              event_names[i],
+              strstr( event_names[i],"AVG_POWER_UW" ) + strlen( "AVG_POWER_UW" ) );
+
+    for( j=0; j<num_events; j++ ) {
+      if ( !strcmp( event_names[j],energy_name ) ) break;
+    }
+    if ( j==num_events )
+      test_fail( __FILE__, __LINE__,"No ENERGY_UJ event for AVG_POWER_UW", i );
+
+    energy_map[i] = j;
+    num_power++;
+  }
+
+  if ( num_power==0 )
+    test_skip( __FILE__,__LINE__,"No AVG_POWER_UW events\n",0 );
+
+  /* start collecting power data */
+  before_time=PAPI_get_real_nsec();
+  retval = PAPI_start( EventSet );
+  if ( retval != PAPI_OK )
+    test_fail( __FILE__, __LINE__, "PAPI_start()",retval );
+
+  sleep( 2 );
+
+  retval = PAPI_stop( EventSet, values );
+  after_time=PAPI_get_real_nsec();
+  if ( retval != PAPI_OK )
+    test_fail( __FILE__, __LINE__, "PAPI_stop()",retval );
+
+  elapsed_time=( ( double )( after_time-before_time ) )/1.0e9;
+
+  for( i=0; i<num_events; i++ ) {
+    if ( !strstr( event_names[i],"AVG_POWER_UW" ) ) continue;
+
+    expected = ( ( double )values[energy_map[i]] )/elapsed_time;
+
+    if ( !TESTS_QUIET ) {
+      printf( "%-45s%12.3f W (from energy %.3f W)\n", event_names[i],
+              ( double )values[i]/1.0e6, expected/1.0e6 );
+    }
+
+    if ( values[i] < 0 )
+      test_fail( __FILE__, __LINE__,"Negative average power", i );
+
+    if ( ( values[energy_map[i]] > 0 ) &&
+         ( ( values[i] < expected*( 1.0-POWER_TOLERANCE ) ) ||
+           ( values[i] > expected*( 1.0+POWER_TOLERANCE ) ) ) )
+      test_fail( __FILE__, __LINE__,"Average power does not match energy", i );
+  }
+
+  /* Done, clean up */
+  retval = PAPI_cleanup_eventset( EventSet );
+  if ( retval != PAPI_OK )
+    test_fail( __FILE__, __LINE__,"PAPI_cleanup_eventset()",retval );
+
+  retval = PAPI_destroy_eventset( &EventSet );
+  if ( retval != PAPI_OK )
+    test_fail( __FILE__, __LINE__, "PAPI_destroy_eventset()",retval );
+
+  test_pass( __FILE__ );
+
+  return 0;
+}
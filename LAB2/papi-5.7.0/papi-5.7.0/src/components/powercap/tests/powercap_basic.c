@@ -13,7 +13,7 @@
 #include "papi.h"
 #include "papi_test.h"
 
-#define MAX_powercap_EVENTS 64
+#define MAX_powercap_EVENTS 128
 
 #ifdef BASIC_TEST
 
@@ -147,6 +147,9 @@ int main ( int argc, char **argv )
     code = PAPI_NATIVE_MASK;
     r = PAPI_enum_cmp_event( &code, PAPI_ENUM_FIRST, powercap_cid );
     while ( r == PAPI_OK ) {
+        if ( num_events == MAX_powercap_EVENTS )
+            break; /* No room for more */
+
         retval = PAPI_event_code_to_name( code, event_names[num_events] );
         if ( retval != PAPI_OK )
             test_fail( __FILE__, __LINE__,"Error from PAPI_event_code_to_name", retval );
@@ -21,7 +21,12 @@
 #include <fcntl.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
 
 /* Headers required by PAPI */
 #include "papi.h"
@@ -29,6 +34,8 @@
 #include "papi_vector.h"
 #include "papi_memory.h"
 
+#include PEINCLUDE
+
 
 /***************/
 /* AMD Support */
@@ -110,6 +117,7 @@ typedef struct _rapl_native_event_entry
   int msr;
   int type;
   int return_type;
+  int source;
   _rapl_register_t resources;
 } _rapl_native_event_entry_t;
 
@@ -126,6 +134,8 @@ typedef struct _rapl_control_state
   int being_measured[RAPL_MAX_COUNTERS];
   long long count[RAPL_MAX_COUNTERS];
   int need_difference[RAPL_MAX_COUNTERS];
+  int num_sources;
+  int sources[RAPL_MAX_COUNTERS];	/* sorted by cpu */
   long long lastupdate;
 } _rapl_control_state_t;
 
@@ -153,6 +163,52 @@ int power_divisor,time_divisor;
 int cpu_energy_divisor,dram_energy_divisor;
 unsigned int msr_rapl_power_unit;
 
+/* Every event reads one of these sources, a (cpu, msr) pair or a power */
+/* PMU event, so a source is only read once per read however many       */
+/* events use it.  The energy status MSRs are only 32 bits wide, their  */
+/* sources accumulate them into 64 bits so wraps are not lost.          */
+typedef struct _rapl_source
+{
+  int fd_offset;
+  int msr;              /* the power PMU event config for perf */
+  int accumulate;
+  int package;
+  int perf_fd;
+  int perf_index;       /* position in the package's perf group */
+  double perf_scale;    /* joules per count of the power PMU event */
+  long long last;
+  long long total;
+  int seeded;
+  int tracked;          /* kept up to date by the poller */
+} _rapl_source_t;
+
+static _rapl_source_t *rapl_sources=NULL;
+static int num_sources=0;
+
+#define RAPL_BACKEND_MSR	0
+#define RAPL_BACKEND_PERF	1
+
+static int rapl_backend=RAPL_BACKEND_MSR;
+
+/* perf backend: the group leader of each package's power PMU events */
+#define RAPL_PERF_PMU		"/sys/bus/event_source/devices/power"
+#define RAPL_PERF_DOMAINS	5
+
+static int *perf_leaders=NULL;
+static int *perf_group_size=NULL;
+
+/* The poller reads the tracked sources often enough that no wrap goes */
+/* unseen, 2^32 energy units last about a minute on a busy package.    */
+/* PAPI_RAPL_POLL_INTERVAL sets the period in seconds, 0 disables it.  */
+#define RAPL_POLL_INTERVAL	10
+
+static int poll_interval=RAPL_POLL_INTERVAL;
+static int poll_running=0;
+static pid_t poll_pid;
+static pthread_t poll_thread;
+static pthread_cond_t poll_cond=PTHREAD_COND_INITIALIZER;
+static pthread_mutex_t rapl_lock=PTHREAD_MUTEX_INITIALIZER;
+
 #define PACKAGE_ENERGY      	0
 #define PACKAGE_THERMAL     	1
 #define PACKAGE_MINIMUM     	2
@@ -208,15 +264,6 @@ static int open_fd(int offset) {
   return fd;
 }
 
-static long long read_rapl_value(int index) {
-
-   int fd;
-
-   fd=open_fd(rapl_native_events[index].fd_offset);
-   return read_msr(fd,rapl_native_events[index].msr);
-
-}
-
 static long long convert_rapl_energy(int index, long long value) {
 
    union {
@@ -226,6 +273,14 @@ static long long convert_rapl_energy(int index, long long value) {
 
    return_val.ll = value; /* default case: return raw input value */
 
+   if (rapl_backend==RAPL_BACKEND_PERF) {
+      if (rapl_native_events[index].type!=PACKAGE_ENERGY_CNT) {
+	 return_val.ll = (long long)((double)value*
+		 rapl_sources[rapl_native_events[index].source].perf_scale*1e9);
+      }
+      return return_val.ll;
+   }
+
    if (rapl_native_events[index].type==PACKAGE_ENERGY) {
       return_val.ll = (long long)(((double)value/cpu_energy_divisor)*1e9);
    }
@@ -298,6 +353,346 @@ get_kernel_nr_cpus(void)
   return nr_cpus;
 }
 
+/* In case headers aren't new enough to have __NR_perf_event_open */
+#ifndef __NR_perf_event_open
+
+#ifdef __powerpc__
+#define __NR_perf_event_open	319
+#elif defined(__x86_64__)
+#define __NR_perf_event_open	298
+#elif defined(__i386__)
+#define __NR_perf_event_open	336
+#elif defined(__arm__)
+#define __NR_perf_event_open	364
+#endif
+
+#endif
+
+static long
+sys_perf_event_open( struct perf_event_attr *hw_event, pid_t pid, int cpu,
+		     int group_fd, unsigned long flags )
+{
+   return syscall( __NR_perf_event_open, hw_event, pid, cpu,
+		   group_fd, flags );
+}
+
+static int is_energy_type(int type) {
+
+   return (type==PACKAGE_ENERGY ||
+	   type==DRAM_ENERGY ||
+	   type==PLATFORM_ENERGY ||
+	   type==PACKAGE_ENERGY_CNT);
+}
+
+static int add_source(int fd_offset, int msr, int accumulate) {
+
+   int i;
+
+   for(i=0;i<num_sources;i++) {
+      if ((rapl_sources[i].fd_offset==fd_offset) &&
+	  (rapl_sources[i].msr==msr)) {
+	 return i;
+      }
+   }
+
+   rapl_sources[num_sources].fd_offset=fd_offset;
+   rapl_sources[num_sources].msr=msr;
+   rapl_sources[num_sources].accumulate=accumulate;
+   rapl_sources[num_sources].perf_fd=-1;
+
+   return num_sources++;
+}
+
+/* Called with rapl_lock held */
+static void update_msr_source(_rapl_source_t *source) {
+
+   long long raw;
+
+   raw=read_msr(open_fd(source->fd_offset),source->msr);
+
+   if (!source->accumulate) {
+      source->total=raw;
+      return;
+   }
+
+   raw&=0xffffffff;
+   if (source->seeded) {
+      /* unsigned 32-bit difference, right across a wrap */
+      source->total+=(raw-source->last)&0xffffffff;
+   }
+   else {
+      source->total=raw;
+      source->seeded=1;
+   }
+   source->last=raw;
+}
+
+/* Bring a list of sources sorted by cpu up to date, a package at a  */
+/* time; perf reads a whole package group at once.  rapl_lock held.  */
+static void refresh_sources(int *list, int count) {
+
+   uint64_t group[1+RAPL_PERF_DOMAINS];
+   _rapl_source_t *source;
+   int i, package=-1;
+
+   for(i=0;i<count;i++) {
+      source=&rapl_sources[list[i]];
+
+      if (rapl_backend==RAPL_BACKEND_MSR) {
+	 update_msr_source(source);
+	 continue;
+      }
+
+      if (source->package!=package) {
+	 package=source->package;
+	 if (read(perf_leaders[package],group,sizeof(group)) <
+	     (ssize_t)sizeof(group[0])) {
+	    SUBDBG("Error reading power PMU group of package %d\n",package);
+	    group[0]=0;
+	 }
+      }
+      if ((uint64_t)source->perf_index<group[0]) {
+	 source->total=group[1+source->perf_index];
+      }
+   }
+}
+
+static void *rapl_poll(void *arg) {
+
+   struct timespec deadline;
+   int i;
+
+   (void)arg;
+
+   pthread_mutex_lock(&rapl_lock);
+   while(poll_running) {
+      clock_gettime(CLOCK_REALTIME,&deadline);
+      deadline.tv_sec+=poll_interval;
+      while(poll_running &&
+	    pthread_cond_timedwait(&poll_cond,&rapl_lock,&deadline)!=ETIMEDOUT);
+      if (!poll_running) break;
+
+      for(i=0;i<num_sources;i++) {
+	 if (rapl_sources[i].tracked) update_msr_source(&rapl_sources[i]);
+      }
+   }
+   pthread_mutex_unlock(&rapl_lock);
+
+   return NULL;
+}
+
+/* Called with rapl_lock held */
+static void start_poller(void) {
+
+   sigset_t all,old;
+
+   /* The poller should never take the application's signals */
+   sigfillset(&all);
+   pthread_sigmask(SIG_SETMASK,&all,&old);
+
+   poll_running=1;
+   poll_pid=getpid();
+   if (pthread_create(&poll_thread,NULL,rapl_poll,NULL)) {
+      SUBDBG("Could not start the wraparound poller\n");
+      poll_running=0;
+   }
+
+   pthread_sigmask(SIG_SETMASK,&old,NULL);
+}
+
+static void stop_poller(void) {
+
+   pthread_mutex_lock(&rapl_lock);
+   if (!poll_running) {
+      pthread_mutex_unlock(&rapl_lock);
+      return;
+   }
+   poll_running=0;
+   pthread_cond_signal(&poll_cond);
+   pthread_mutex_unlock(&rapl_lock);
+
+   /* a forked child has no poller to wait for */
+   if (getpid()==poll_pid) pthread_join(poll_thread,NULL);
+}
+
+static void close_perf_backend(void) {
+
+   int i;
+
+   for(i=0;i<num_sources;i++) {
+      if (rapl_sources[i].perf_fd>=0) close(rapl_sources[i].perf_fd);
+   }
+   if (perf_leaders) papi_free(perf_leaders);
+   if (perf_group_size) papi_free(perf_group_size);
+   perf_leaders=NULL;
+   perf_group_size=NULL;
+}
+
+static const struct {
+   char *event;
+   char *name;
+   char *what;
+   int type;
+} perf_domains[RAPL_PERF_DOMAINS] = {
+   /* the same order the MSR events are listed in */
+   { "energy-pkg",   "PACKAGE", "chip package",                         PACKAGE_ENERGY },
+   { "energy-gpu",   "PP1",     "Power Plane 1 (Often GPU) on package", PACKAGE_ENERGY },
+   { "energy-ram",   "DRAM",    "DRAM on package",                      DRAM_ENERGY },
+   { "energy-psys",  "PSYS",    "SoC on package",                       PLATFORM_ENERGY },
+   { "energy-cores", "PP0",     "all cores in package",                 PACKAGE_ENERGY },
+};
+
+/*
+ * Set up the energy events on the kernel's power PMU, which needs no
+ * MSR access and accumulates the counters to 64 bits itself
+ */
+static int init_perf_backend(int cidx, int *cpu_to_use) {
+
+   char filename[BUFSIZ];
+   FILE *fff;
+   struct perf_event_attr attr;
+   unsigned int config[RAPL_PERF_DOMAINS];
+   double scale[RAPL_PERF_DOMAINS];
+   int type,avail=0;
+   int i,j,k,d,fd,source;
+
+   fff=fopen(RAPL_PERF_PMU "/type","r");
+   if (fff==NULL) return PAPI_ENOSUPP;
+   if (fscanf(fff,"%d",&type)!=1) type=-1;
+   fclose(fff);
+   if (type<0) return PAPI_ENOSUPP;
+
+   for(d=0;d<RAPL_PERF_DOMAINS;d++) {
+      scale[d]=0.0;
+
+      sprintf(filename,RAPL_PERF_PMU "/events/%s",perf_domains[d].event);
+      fff=fopen(filename,"r");
+      if (fff==NULL) continue;
+      if (fscanf(fff,"event=%x",&config[d])!=1) {
+	 fclose(fff);
+	 continue;
+      }
+      fclose(fff);
+
+      sprintf(filename,RAPL_PERF_PMU "/events/%s.scale",perf_domains[d].event);
+      fff=fopen(filename,"r");
+      if (fff==NULL) continue;
+      if (fscanf(fff,"%lf",&scale[d])!=1) scale[d]=0.0;
+      fclose(fff);
+
+      if (scale[d]>0.0) avail++;
+   }
+
+   if (avail==0) return PAPI_ENOSUPP;
+
+   num_events=avail*num_packages*2;
+
+   perf_leaders=papi_calloc(num_packages,sizeof(int));
+   perf_group_size=papi_calloc(num_packages,sizeof(int));
+   rapl_sources=papi_calloc(avail*num_packages,sizeof(_rapl_source_t));
+   rapl_native_events=papi_calloc(num_events,
+				  sizeof(_rapl_native_event_entry_t));
+   if ((perf_leaders==NULL) || (perf_group_size==NULL) ||
+       (rapl_sources==NULL) || (rapl_native_events==NULL)) {
+      return PAPI_ENOMEM;
+   }
+
+   for(j=0;j<num_packages;j++) perf_leaders[j]=-1;
+
+   i=0;
+   k=num_events/2;
+
+   for(d=0;d<RAPL_PERF_DOMAINS;d++) {
+      if (scale[d]<=0.0) continue;
+
+      for(j=0;j<num_packages;j++) {
+
+	 /* All of a package's domains are read as one group */
+	 memset(&attr,0,sizeof(attr));
+	 attr.type=type;
+	 attr.size=sizeof(attr);
+	 attr.config=config[d];
+	 attr.read_format=PERF_FORMAT_GROUP;
+
+	 fd=sys_perf_event_open(&attr,-1,cpu_to_use[j],perf_leaders[j],0);
+	 if (fd<0) {
+	    SUBDBG("Can't open %s on cpu %d: %s\n",
+		   perf_domains[d].event,cpu_to_use[j],strerror(errno));
+	    return PAPI_EPERM;
+	 }
+	 if (perf_leaders[j]<0) perf_leaders[j]=fd;
+
+	 source=add_source(cpu_to_use[j],config[d],1);
+	 rapl_sources[source].package=j;
+	 rapl_sources[source].perf_fd=fd;
+	 rapl_sources[source].perf_index=perf_group_size[j]++;
+	 rapl_sources[source].perf_scale=scale[d];
+
+	 sprintf(rapl_native_events[i].name,
+		 "%s_ENERGY_CNT:PACKAGE%d",perf_domains[d].name,j);
+	 sprintf(rapl_native_events[i].description,
+		 "Energy used in counts by %s %d",perf_domains[d].what,j);
+	 rapl_native_events[i].fd_offset=cpu_to_use[j];
+	 rapl_native_events[i].msr=config[d];
+	 rapl_native_events[i].source=source;
+	 rapl_native_events[i].resources.selector = i + 1;
+	 rapl_native_events[i].type=PACKAGE_ENERGY_CNT;
+	 rapl_native_events[i].return_type=PAPI_DATATYPE_UINT64;
+
+	 sprintf(rapl_native_events[k].name,
+		 "%s_ENERGY:PACKAGE%d",perf_domains[d].name,j);
+	 strncpy(rapl_native_events[k].units,"nJ",PAPI_MIN_STR_LEN);
+	 sprintf(rapl_native_events[k].description,
+		 "Energy used by %s %d",perf_domains[d].what,j);
+	 rapl_native_events[k].fd_offset=cpu_to_use[j];
+	 rapl_native_events[k].msr=config[d];
+	 rapl_native_events[k].source=source;
+	 rapl_native_events[k].resources.selector = k + 1;
+	 rapl_native_events[k].type=perf_domains[d].type;
+	 rapl_native_events[k].return_type=PAPI_DATATYPE_UINT64;
+
+	 i++;
+	 k++;
+      }
+   }
+
+   rapl_backend=RAPL_BACKEND_PERF;
+
+   SUBDBG("Using the power PMU for %d domains on %d packages\n",
+	  avail,num_packages);
+
+   /* Export the total number of events available */
+   _rapl_vector.cmp_info.num_native_events = num_events;
+
+   _rapl_vector.cmp_info.num_cntrs = num_events;
+   _rapl_vector.cmp_info.num_mpx_cntrs = num_events;
+
+   /* Export the component id */
+   _rapl_vector.cmp_info.CmpIdx = cidx;
+
+   return PAPI_OK;
+}
+
+/* The MSRs can not be used: fall back to the power PMU, or fail with */
+/* retval and the reason the MSRs could not be used                   */
+static int try_perf_backend(int cidx, int *cpu_to_use, int retval) {
+
+   if (init_perf_backend(cidx,cpu_to_use)==PAPI_OK) {
+      _rapl_vector.cmp_info.disabled_reason[0]='\0';
+      return PAPI_OK;
+   }
+
+   close_perf_backend();
+   if (rapl_native_events) papi_free(rapl_native_events);
+   if (rapl_sources) papi_free(rapl_sources);
+   rapl_native_events=NULL;
+   rapl_sources=NULL;
+   num_sources=0;
+   num_events=0;
+
+   return retval;
+}
+
 /************************* PAPI Functions **********************************/
 
 
@@ -324,8 +719,8 @@ _rapl_init_component( int cidx )
      FILE *fff;
      char filename[BUFSIZ];
 
-	int package_avail, dram_avail, pp0_avail, pp1_avail, psys_avail;
-	int different_units;
+	int package_avail=0, dram_avail=0, pp0_avail=0, pp1_avail=0, psys_avail=0;
+	int different_units=0;
 
      long long result;
      int package;
@@ -337,7 +732,11 @@ _rapl_init_component( int cidx )
      int cpu_to_use[nr_cpus];
 
 	unsigned int msr_pkg_energy_status,msr_pp0_energy_status;
+	char *env;
+
 
+     env=getenv("PAPI_RAPL_POLL_INTERVAL");
+     if (env!=NULL) poll_interval=atoi(env);
 
      /* Fill with sentinel values */
      for (i=0; i<nr_cpus; ++i) {
@@ -363,6 +762,61 @@ _rapl_init_component( int cidx )
 	}
 
 
+     /* Detect how many packages */
+     j=0;
+     while(1) {
+       int num_read;
+
+       sprintf(filename,
+	       "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",j);
+       fff=fopen(filename,"r");
+       if (fff==NULL) break;
+       num_read=fscanf(fff,"%d",&package);
+       fclose(fff);
+       if (num_read!=1) {
+    		 strcpy(_rapl_vector.cmp_info.disabled_reason, "Error reading file: ");
+    		 strncat(_rapl_vector.cmp_info.disabled_reason, filename, PAPI_MAX_STR_LEN - strlen(_rapl_vector.cmp_info.disabled_reason) - 1);
+    		 _rapl_vector.cmp_info.disabled_reason[PAPI_MAX_STR_LEN-1] = '\0';
+    		 return PAPI_ESYS;
+       }
+
+       /* Check if a new package */
+       if ((package >= 0) && (package < nr_cpus)) {
+         if (packages[package] == -1) {
+           SUBDBG("Found package %d out of total %d\n",package,num_packages);
+	   packages[package]=package;
+	   cpu_to_use[package]=j;
+	   num_packages++;
+         }
+       } else {
+	 SUBDBG("Package outside of allowed range\n");
+	 strncpy(_rapl_vector.cmp_info.disabled_reason,
+		"Package outside of allowed range",PAPI_MAX_STR_LEN);
+	 return PAPI_ESYS;
+       }
+
+       j++;
+     }
+     num_cpus=j;
+
+     if (num_packages==0) {
+        SUBDBG("Can't access /dev/cpu/*/<msr_safe | msr>\n");
+	strncpy(_rapl_vector.cmp_info.disabled_reason,
+		"Can't access /dev/cpu/*/<msr_safe | msr>",PAPI_MAX_STR_LEN);
+	return PAPI_ESYS;
+     }
+
+     SUBDBG("Found %d packages with %d cpus\n",num_packages,num_cpus);
+
+     /* Some kernels expose RAPL as the power PMU, which needs no MSR  */
+     /* access; PAPI_RAPL_PERF uses it even where the MSRs are usable  */
+     env=getenv("PAPI_RAPL_PERF");
+     if ((env!=NULL) && (atoi(env)!=0)) {
+	strncpy(_rapl_vector.cmp_info.disabled_reason,
+		"No usable power PMU",PAPI_MAX_STR_LEN);
+	return try_perf_backend(cidx,cpu_to_use,PAPI_ENOSUPP);
+     }
+
 	/* Make sure it is a family 6 Intel Chip */
 
 	if (hw_info->vendor==PAPI_VENDOR_INTEL) {
@@ -375,7 +829,7 @@ _rapl_init_component( int cidx )
 			/* Not a family 6 machine */
 			strncpy(_rapl_vector.cmp_info.disabled_reason,
 				"CPU family not supported",PAPI_MAX_STR_LEN);
-			return PAPI_ENOIMPL;
+			return try_perf_backend(cidx,cpu_to_use,PAPI_ENOIMPL);
 		}
 
 		/* Detect RAPL support */
@@ -468,7 +922,7 @@ _rapl_init_component( int cidx )
 			strncpy(_rapl_vector.cmp_info.disabled_reason,
 				"CPU model not supported",
 				PAPI_MAX_STR_LEN);
-			return PAPI_ENOIMPL;
+			return try_perf_backend(cidx,cpu_to_use,PAPI_ENOIMPL);
 		}
 	}
 
@@ -482,7 +936,7 @@ _rapl_init_component( int cidx )
 			/* Not a family 17h machine */
 			strncpy(_rapl_vector.cmp_info.disabled_reason,
 				"CPU family not supported",PAPI_MAX_STR_LEN);
-			return PAPI_ENOIMPL;
+			return try_perf_backend(cidx,cpu_to_use,PAPI_ENOIMPL);
 		}
 
 		package_avail=1;
@@ -494,51 +948,6 @@ _rapl_init_component( int cidx )
 	}
 
 
-     /* Detect how many packages */
-     j=0;
-     while(1) {
-       int num_read;
-
-       sprintf(filename,
-	       "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",j);
-       fff=fopen(filename,"r");
-       if (fff==NULL) break;
-       num_read=fscanf(fff,"%d",&package);
-       fclose(fff);
-       if (num_read!=1) {
-    		 strcpy(_rapl_vector.cmp_info.disabled_reason, "Error reading file: ");
-    		 strncat(_rapl_vector.cmp_info.disabled_reason, filename, PAPI_MAX_STR_LEN - strlen(_rapl_vector.cmp_info.disabled_reason) - 1);
-    		 _rapl_vector.cmp_info.disabled_reason[PAPI_MAX_STR_LEN-1] = '\0';
-    		 return PAPI_ESYS;
-       }
-
-       /* Check if a new package */
-       if ((package >= 0) && (package < nr_cpus)) {
-         if (packages[package] == -1) {
-           SUBDBG("Found package %d out of total %d\n",package,num_packages);
-	   packages[package]=package;
-	   cpu_to_use[package]=j;
-	   num_packages++;
-         }
-       } else {
-	 SUBDBG("Package outside of allowed range\n");
-	 strncpy(_rapl_vector.cmp_info.disabled_reason,
-		"Package outside of allowed range",PAPI_MAX_STR_LEN);
-	 return PAPI_ESYS;
-       }
-
-       j++;
-     }
-     num_cpus=j;
-
-     if (num_packages==0) {
-        SUBDBG("Can't access /dev/cpu/*/<msr_safe | msr>\n");
-	strncpy(_rapl_vector.cmp_info.disabled_reason,
-		"Can't access /dev/cpu/*/<msr_safe | msr>",PAPI_MAX_STR_LEN);
-	return PAPI_ESYS;
-     }
-
-     SUBDBG("Found %d packages with %d cpus\n",num_packages,num_cpus);
 
      /* Init fd_array */
 
@@ -549,14 +958,14 @@ _rapl_init_component( int cidx )
      if (fd<0) {
         sprintf(_rapl_vector.cmp_info.disabled_reason,
 		"Can't open fd for cpu0: %s",strerror(errno));
-        return PAPI_ESYS;
+        return try_perf_backend(cidx,cpu_to_use,PAPI_ESYS);
      }
 
      /* Verify needed MSR is readable. In a guest VM it may not be readable*/
      if (pread(fd, &result, sizeof result, msr_rapl_power_unit) != sizeof result ) {
         strncpy(_rapl_vector.cmp_info.disabled_reason,
                "Unable to access RAPL registers",PAPI_MAX_STR_LEN);
-        return PAPI_ESYS;
+        return try_perf_backend(cidx,cpu_to_use,PAPI_ESYS);
      }
 
      /* Calculate the units used */
@@ -858,6 +1267,17 @@ _rapl_init_component( int cidx )
 		}
      }
 
+     /* Events that read the same MSR share a source */
+     rapl_sources=papi_calloc(num_events,sizeof(_rapl_source_t));
+     if (rapl_sources==NULL) return PAPI_ENOMEM;
+
+     for(i=0;i<num_events;i++) {
+	rapl_native_events[i].source=add_source(
+		rapl_native_events[i].fd_offset,
+		rapl_native_events[i].msr,
+		is_energy_type(rapl_native_events[i].type));
+     }
+
      /* Export the total number of events available */
      _rapl_vector.cmp_info.num_native_events = num_events;
 
@@ -896,14 +1316,36 @@ _rapl_start( hwd_context_t *ctx, hwd_control_state_t *ctl)
   _rapl_context_t* context = (_rapl_context_t*) ctx;
   _rapl_control_state_t* control = (_rapl_control_state_t*) ctl;
   long long now = PAPI_get_real_usec();
-  int i;
+  _rapl_source_t *source;
+  int i, track=0;
+
+  pthread_mutex_lock(&rapl_lock);
+
+  refresh_sources(control->sources,control->num_sources);
+
+  /* From now on keep the energy MSRs from wrapping unseen */
+  if (rapl_backend==RAPL_BACKEND_MSR) {
+     for( i = 0; i < control->num_sources; i++ ) {
+	source=&rapl_sources[control->sources[i]];
+	if ((source->accumulate) && (!source->tracked)) {
+	   source->tracked=1;
+	   track=1;
+	}
+     }
+     if ((track) && (poll_interval>0) && (!poll_running)) {
+	start_poller();
+     }
+  }
 
   for( i = 0; i < RAPL_MAX_COUNTERS; i++ ) {
      if ((control->being_measured[i]) && (control->need_difference[i])) {
-        context->start_value[i]=read_rapl_value(i);
+        context->start_value[i]=
+		rapl_sources[rapl_native_events[i].source].total;
      }
   }
 
+  pthread_mutex_unlock(&rapl_lock);
+
   control->lastupdate = now;
 
   return PAPI_OK;
@@ -920,24 +1362,24 @@ _rapl_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
     int i;
     long long temp;
 
+    pthread_mutex_lock(&rapl_lock);
+
+    /* Each MSR or package group is read once for all its events */
+    refresh_sources(control->sources,control->num_sources);
+
     for ( i = 0; i < RAPL_MAX_COUNTERS; i++ ) {
 		if (control->being_measured[i]) {
-			temp = read_rapl_value(i);
-			if (context->start_value[i])
+			temp = rapl_sources[rapl_native_events[i].source].total;
+			/* the sources are 64 bits wide, so never wrap */
 			if (control->need_difference[i]) {
-				/* test for wrap around */
-				if (temp < context->start_value[i] ) {
-	        		SUBDBG("Wraparound!\nstart:\t%#016x\ttemp:\t%#016x",
-	        			(unsigned)context->start_value[i], (unsigned)temp);
-	           		temp += (0x100000000 - context->start_value[i]);
-	           		SUBDBG("\tresult:\t%#016x\n", (unsigned)temp);
-		  		} else {
-					temp -= context->start_value[i];
-		  		}
+				temp -= context->start_value[i];
 			}
 			control->count[i] = convert_rapl_energy( i, temp );
 		}
     }
+
+    pthread_mutex_unlock(&rapl_lock);
+
     control->lastupdate = now;
     return PAPI_OK;
 }
@@ -973,6 +1415,8 @@ _rapl_shutdown_component( void )
 {
     int i;
 
+    stop_poller();
+
     if (rapl_native_events) papi_free(rapl_native_events);
     if (fd_array) {
        for(i=0;i<num_cpus;i++) {
@@ -980,6 +1424,18 @@ _rapl_shutdown_component( void )
        }
        papi_free(fd_array);
     }
+    if (rapl_sources) {
+       close_perf_backend();
+       papi_free(rapl_sources);
+    }
+    rapl_native_events=NULL;
+    fd_array=NULL;
+    rapl_sources=NULL;
+    num_sources=0;
+    num_events=0;
+    num_packages=0;
+    num_cpus=0;
+    rapl_backend=RAPL_BACKEND_MSR;
 
     return PAPI_OK;
 }
@@ -1005,7 +1461,7 @@ _rapl_update_control_state( hwd_control_state_t *ctl,
 			    NativeInfo_t *native, int count,
 			    hwd_context_t *ctx )
 {
-  int i, index;
+  int i, j, index, source;
     ( void ) ctx;
 
     _rapl_control_state_t* control = (_rapl_control_state_t*) ctl;
@@ -1017,6 +1473,8 @@ _rapl_update_control_state( hwd_control_state_t *ctl,
        control->being_measured[i]=0;
     }
 
+    control->num_sources=0;
+
     for( i = 0; i < count; i++ ) {
        index=native[i].ni_event&PAPI_NATIVE_AND_MASK;
        native[i].ni_position=rapl_native_events[index].resources.selector - 1;
@@ -1024,10 +1482,22 @@ _rapl_update_control_state( hwd_control_state_t *ctl,
 
        /* Only need to subtract if it's a PACKAGE_ENERGY or ENERGY_CNT type */
        control->need_difference[index]=
-	 	(rapl_native_events[index].type==PACKAGE_ENERGY ||
-		rapl_native_events[index].type==DRAM_ENERGY ||
-		rapl_native_events[index].type==PLATFORM_ENERGY ||
-	 	rapl_native_events[index].type==PACKAGE_ENERGY_CNT);
+		is_energy_type(rapl_native_events[index].type);
+
+       /* Keep the sources sorted by cpu, so reads go package by package */
+       source=rapl_native_events[index].source;
+       for( j = 0; j < control->num_sources; j++ ) {
+	  if (control->sources[j]==source) break;
+       }
+       if (j<control->num_sources) continue;
+
+       for( j = control->num_sources; j > 0; j-- ) {
+	  if (rapl_sources[control->sources[j-1]].fd_offset<=
+	      rapl_sources[source].fd_offset) break;
+	  control->sources[j]=control->sources[j-1];
+       }
+       control->sources[j]=source;
+       control->num_sources++;
     }
 
     return PAPI_OK;
@@ -12,6 +12,8 @@
 #include <dirent.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 #include "papi.h"
 #include "papi_internal.h"
@@ -36,6 +38,8 @@ struct STEALTIME_control_state
   long long *values;
   int *which_counter;
   int num_events;
+  int cpu_lines;       /* /proc/stat cpu lines the events need */
+  int thread;          /* the THREAD event is in the EventSet */
 };
 
 
@@ -44,11 +48,27 @@ struct STEALTIME_context
   long long *start_count;
   long long *current_count;
   long long *value;
+  char *buffer;        /* last /proc/stat contents */
+  size_t buffer_size;
+  int schedstat_fd;    /* this thread's schedstat, -1 until started */
 };
 
 
 static int num_events = 0;
 
+/* the cpu lines of /proc/stat come first, followed by the */
+/* optional THREAD event when schedstat is available       */
+static int num_cpu_lines = 0;
+static int thread_event = -1;
+
+/* /proc/stat stays open, reads are preads from offset 0 */
+static int stat_fd = -1;
+
+/* bytes up to the end of the last cpu line at init time */
+static size_t cpu_lines_size = 0;
+
+static int hz = 100;
+
 static struct counter_info *event_info=NULL;
 
 /* Advance declaration of buffer */
@@ -58,65 +78,140 @@ papi_vector_t _stealtime_vector;
  ********  BEGIN FUNCTIONS  USED INTERNALLY SPECIFIC TO THIS COMPONENT ********
  *****************************************************************************/
 
-struct statinfo {
-  long long user;
-  long long nice;
-  long long system;
-  long long idle;
-  long long iowait;
-  long long irq;
-  long long softirq;
-  long long steal;
-  long long guest;
-};
+/* parse the next unsigned decimal number at *p, leaving *p after it */
+static inline int
+scan_value( char **p, long long *value ) {
+
+  char *s=*p;
+  long long v=0;
 
+  while(*s==' ') s++;
+  if (*s<'0' || *s>'9') return 0;
+
+  while(*s>='0' && *s<='9') {
+    v=v*10+(*s-'0');
+    s++;
+  }
+
+  *p=s;
+  *value=v;
+
+  return 1;
+}
+
+/* parse the steal time of the /proc/stat cpu line at *line,  */
+/* returns 0 if it is not a complete cpu line                 */
 static int
-read_stealtime( struct STEALTIME_context *context, int starting) {
+parse_cpu_line( char **line, long long *steal ) {
+
+  char *p=*line;
+  long long value=0;
+  int i;
+
+  /* /proc/stat line with cpu stats always starts with "cpu" */
+  if (strncmp(p,"cpu",3)) return 0;
+
+  p+=3;
+  while(isdigit(*p)) p++;
+
+  /* user nice system idle iowait irq softirq steal */
+  for(i=0;i<8;i++) {
+    if (!scan_value(&p,&value)) return 0;
+  }
+
+  p=strchr(p,'\n');
+  if (p==NULL) return 0;
+
+  *steal=value;
+  *line=p+1;
+
+  return 1;
+}
+
+/* time in ns the schedstat at fd says its task has waited on a run queue */
+static int
+read_schedstat( int fd, long long *wait ) {
+
+  char buffer[PAPI_MIN_STR_LEN],*p=buffer;
+  long long runtime;
+  ssize_t bytes;
+
+  bytes=pread(fd,buffer,sizeof(buffer)-1,0);
+  if (bytes<=0) return PAPI_ESYS;
+  buffer[bytes]='\0';
+
+  if (!scan_value(&p,&runtime) || !scan_value(&p,wait)) return PAPI_ESYS;
+
+  return PAPI_OK;
+}
+
+static int
+read_stealtime( struct STEALTIME_context *context,
+		struct STEALTIME_control_state *control, int starting ) {
+
+  char path[PATH_MAX],*p,*bigger;
+  ssize_t bytes;
+  long long steal;
+  int i;
+
+  /* Only the cpu lines the EventSet needs are parsed, they come */
+  /* first in /proc/stat, so the rest of the file is never read  */
+  while(control->cpu_lines>0) {
+
+    bytes=pread(stat_fd,context->buffer,context->buffer_size-1,0);
+    if (bytes<0) return PAPI_ESYS;
+    context->buffer[bytes]='\0';
 
-  FILE *fff;
-  char buffer[BUFSIZ],*result;
-  int i,count;
-  struct statinfo our_stat;
+    p=context->buffer;
+    for(i=0;i<control->cpu_lines;i++) {
+      if (!parse_cpu_line(&p,&steal)) break;
 
-  int hz=sysconf(_SC_CLK_TCK);
+      if (starting) {
+	context->start_count[i]=steal;
+      }
+      context->current_count[i]=steal;
+
+      /* convert to us */
+      context->value[i]=(context->current_count[i]-context->start_count[i])*
+	(1000000/hz);
+    }
 
+    if (i==control->cpu_lines) break;
 
-  fff=fopen("/proc/stat","r");
-  if (fff==NULL) {
-     return PAPI_ESYS; 
+    /* A short read means the lines are not there at all, */
+    /* otherwise they did not fit, so try a bigger buffer  */
+    if ((size_t)bytes<context->buffer_size-1) return PAPI_ESYS;
+
+    bigger=realloc(context->buffer,context->buffer_size*2);
+    if (bigger==NULL) return PAPI_ENOMEM;
+    context->buffer=bigger;
+    context->buffer_size*=2;
   }
 
-  for(i=0;i<num_events;i++) {
-    result=fgets(buffer,BUFSIZ,fff);
-    if (result==NULL) break;
-
-    count=sscanf(buffer,"%*s %lld %lld %lld %lld %lld %lld %lld %lld %lld",
-		 &our_stat.user,
-		 &our_stat.nice,
-		 &our_stat.system,
-		 &our_stat.idle,
-		 &our_stat.iowait,
-		 &our_stat.irq,
-		 &our_stat.softirq,
-		 &our_stat.steal,
-		 &our_stat.guest);
-    if (count<=7) {
-       fclose(fff);
-       return PAPI_ESYS;
+  if (control->thread) {
+
+    /* opened by the thread itself, which is the one that starts */
+    if (context->schedstat_fd<0) {
+      snprintf(path,PATH_MAX,"/proc/self/task/%ld/schedstat",
+	       (long)syscall(SYS_gettid));
+      context->schedstat_fd=open(path,O_RDONLY);
+      if (context->schedstat_fd<0) return PAPI_ESYS;
+    }
+
+    if (read_schedstat(context->schedstat_fd,&steal)!=PAPI_OK) {
+      return PAPI_ESYS;
     }
 
+    i=thread_event;
     if (starting) {
-       context->start_count[i]=our_stat.steal;
+      context->start_count[i]=steal;
     }
-    context->current_count[i]=our_stat.steal;
+    context->current_count[i]=steal;
 
     /* convert to us */
-    context->value[i]=(context->current_count[i]-context->start_count[i])*
-      (1000000/hz);
+    context->value[i]=(context->current_count[i]-context->start_count[i])/
+      1000;
   }
-  
-
-  fclose(fff);
 
   return PAPI_OK;
 
@@ -139,36 +234,47 @@ _stealtime_init_component( int cidx )
 
   (void)cidx;
 
-	FILE *fff;
-	char buffer[BUFSIZ],*result,string[BUFSIZ];
-	int i;
+	char *buffer,*p,string[BUFSIZ];
+	size_t size=BUFSIZ;
+	ssize_t bytes;
+	long long steal;
+	int i,fd;
 
-	/* Make sure /proc/stat exists */
-	fff=fopen("/proc/stat","r");
-	if (fff==NULL) {
+	/* Make sure /proc/stat exists, it is kept open for reads */
+	stat_fd=open("/proc/stat",O_RDONLY);
+	if (stat_fd<0) {
 	   strncpy(_stealtime_vector.cmp_info.disabled_reason,
 		   "Cannot open /proc/stat",PAPI_MAX_STR_LEN);
        _stealtime_shutdown_component();
 	   return PAPI_ESYS;
 	}
 
-	num_events=0;
+	/* Read all of it once to find the cpu lines */
 	while(1) {
-	  result=fgets(buffer,BUFSIZ,fff);
-	  if (result==NULL) break;
-
-	  /* /proc/stat line with cpu stats always starts with "cpu" */
-
-	  if (!strncmp(buffer,"cpu",3)) {
-	     num_events++;
-	  }
-	  else {
-	    break;
+	  buffer=malloc(size);
+	  if (buffer==NULL) {
+	     _stealtime_shutdown_component();
+	     return PAPI_ENOMEM;
 	  }
 
+	  bytes=pread(stat_fd,buffer,size-1,0);
+	  if (bytes<0 || (size_t)bytes<size-1) break;
+	  free(buffer);
+	  size*=2;
 	}
+	if (bytes<0) bytes=0;
+	buffer[bytes]='\0';
 
-	fclose(fff);
+	p=buffer;
+	num_cpu_lines=0;
+	while(parse_cpu_line(&p,&steal)) {
+	   num_cpu_lines++;
+	}
+	cpu_lines_size=p-buffer;
+
+	free(buffer);
+
+	num_events=num_cpu_lines;
 
 	if (num_events<1) {
 	   strncpy(_stealtime_vector.cmp_info.disabled_reason,
@@ -178,6 +284,16 @@ _stealtime_init_component( int cidx )
 	   return PAPI_ESYS;
 	}
 
+	/* Per-thread run queue wait time, if the kernel keeps schedstats */
+	fd=open("/proc/self/schedstat",O_RDONLY);
+	if (fd>=0) {
+	   if (read_schedstat(fd,&steal)==PAPI_OK) {
+	      thread_event=num_events;
+	      num_events++;
+	   }
+	   close(fd);
+	}
+
 	event_info=calloc(num_events,sizeof(struct counter_info));
 	if (event_info==NULL) {
         _stealtime_shutdown_component();
@@ -185,12 +301,12 @@ _stealtime_init_component( int cidx )
 	}
 
 	
-	sysconf(_SC_CLK_TCK);
+	hz=sysconf(_SC_CLK_TCK);
 	event_info[0].name=strdup("TOTAL");
 	event_info[0].description=strdup("Total amount of steal time");
 	event_info[0].units=strdup("us");
 
-	for(i=1;i<num_events;i++) {
+	for(i=1;i<num_cpu_lines;i++) {
 	   sprintf(string,"CPU%d",i);
 	   event_info[i].name=strdup(string);
 	   sprintf(string,"Steal time for CPU %d",i);
@@ -198,6 +314,13 @@ _stealtime_init_component( int cidx )
 	   event_info[i].units=strdup("us");
         }
 
+	if (thread_event>=0) {
+	   event_info[thread_event].name=strdup("THREAD");
+	   event_info[thread_event].description=
+	     strdup("Time the thread spent waiting on a run queue");
+	   event_info[thread_event].units=strdup("us");
+	}
+
 	//	printf("Found %d CPUs\n",num_events-1);
 
 	_stealtime_vector.cmp_info.num_native_events=num_events;
@@ -228,6 +351,13 @@ _stealtime_init_thread( hwd_context_t * ctx )
   context->value=calloc(num_events,sizeof(long long));
   if (context->value==NULL) return PAPI_ENOMEM;
 
+  /* room for the cpu lines to grow before the buffer has to */
+  context->buffer_size=2*cpu_lines_size+1;
+  context->buffer=malloc(context->buffer_size);
+  if (context->buffer==NULL) return PAPI_ENOMEM;
+
+  context->schedstat_fd=-1;
+
   return PAPI_OK;
 }
 
@@ -247,7 +377,13 @@ _stealtime_shutdown_component( void )
                        free(event_info[i].units);
                }
                free(event_info);
+               event_info=NULL;
+       }
+       if (stat_fd>=0) {
+               close(stat_fd);
+               stat_fd=-1;
        }
+       thread_event=-1;
 
    return PAPI_OK;
 }
@@ -264,6 +400,8 @@ _stealtime_shutdown_thread( hwd_context_t * ctx )
   if (context->start_count!=NULL) free(context->start_count);
   if (context->current_count!=NULL) free(context->current_count);
   if (context->value!=NULL) free(context->value);
+  if (context->buffer!=NULL) free(context->buffer);
+  if (context->schedstat_fd>=0) close(context->schedstat_fd);
 
   return PAPI_OK;
 }
@@ -283,6 +421,8 @@ _stealtime_init_control_state( hwd_control_state_t *ctl )
     control->values=NULL;
     control->which_counter=NULL;
     control->num_events=0;
+    control->cpu_lines=0;
+    control->thread=0;
 
     return PAPI_OK;
 }
@@ -315,10 +455,20 @@ _stealtime_update_control_state( hwd_control_state_t *ctl,
     }
 
 
+    control->cpu_lines=0;
+    control->thread=0;
+
     for ( i = 0; i < count; i++ ) {
        index = native[i].ni_event;
        control->which_counter[i]=index;
        native[i].ni_position = i;
+
+       if (index==thread_event) {
+	  control->thread=1;
+       }
+       else if (index>=control->cpu_lines) {
+	  control->cpu_lines=index+1;
+       }
     }
 
     control->num_events=count;
@@ -334,15 +484,13 @@ static int
 _stealtime_start( hwd_context_t *ctx, hwd_control_state_t *ctl )
 {
 
-  (void)ctl;
-
-  //    struct STEALTIME_control_state *control;
+    struct STEALTIME_control_state *control;
     struct STEALTIME_context *context;
     
-    //control = (struct STEALTIME_control_state *)ctl;
+    control = (struct STEALTIME_control_state *)ctl;
     context = (struct STEALTIME_context *)ctx;
 
-    read_stealtime( context, 1 );
+    read_stealtime( context, control, 1 );
 
     /* no need to update control, as we assume only one EventSet  */
     /* is active at once, so starting things at the context level */
@@ -359,15 +507,13 @@ static int
 _stealtime_stop( hwd_context_t *ctx, hwd_control_state_t *ctl )
 {
 
-  (void) ctl;
-
-  //    struct STEALTIME_control_state *control;
+    struct STEALTIME_control_state *control;
     struct STEALTIME_context *context;
     
-    //control = (struct STEALTIME_control_state *)ctl;
+    control = (struct STEALTIME_control_state *)ctl;
     context = (struct STEALTIME_context *)ctx;
 
-    read_stealtime( context, 0 );
+    read_stealtime( context, control, 0 );
 
     return PAPI_OK;
 
@@ -392,7 +538,7 @@ _stealtime_read( hwd_context_t *ctx, hwd_control_state_t *ctl,
     control = (struct STEALTIME_control_state *)ctl;
     context = (struct STEALTIME_context *)ctx;
 
-    read_stealtime( context, 0 );
+    read_stealtime( context, control, 0 );
 
     for(i=0;i<control->num_events;i++) {
        control->values[i]=
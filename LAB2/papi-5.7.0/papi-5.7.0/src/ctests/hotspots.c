@@ -0,0 +1,143 @@
+/* hotspots.c */
+
+/* Test PAPI_HOTSPOTS and PAPI_get_hotspots(): callchain samples are */
+/* queued by the signal handler and turned into a table of symbols  */
+/* when the event set stops                                          */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "do_loops.h"
+
+#define RING_SIZE	( 1 << 20 )
+#define MAX_ROWS	16
+
+int
+main( int argc, char **argv )
+{
+	int EventSet = PAPI_NULL;
+	int retval, count, rows, i;
+	long long self = 0;
+	PAPI_option_t opt;
+	PAPI_hotspot_t table[MAX_ROWS];
+	int quiet;
+
+	/* Set TESTS_QUIET variable */
+	quiet=tests_quiet( argc, argv );
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	retval = PAPI_create_eventset( &EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+	}
+
+	retval = PAPI_add_named_event( EventSet, "PAPI_TOT_CYC" );
+	if ( retval != PAPI_OK ) {
+		if ( !quiet ) {
+			printf( "Trouble adding PAPI_TOT_CYC: %s\n",
+				PAPI_strerror( retval ) );
+		}
+		test_skip( __FILE__, __LINE__, "adding PAPI_TOT_CYC", retval );
+	}
+
+	/* Not enabled yet */
+	count = MAX_ROWS;
+	retval = PAPI_get_hotspots( EventSet, table, &count );
+	if ( retval != PAPI_EINVAL ) {
+		test_fail( __FILE__, __LINE__, "PAPI_get_hotspots without ring",
+			retval );
+	}
+
+	opt.hotspots.eventset = EventSet;
+	opt.hotspots.size = RING_SIZE;
+	opt.hotspots.depth = 16;
+	retval = PAPI_set_opt( PAPI_HOTSPOTS, &opt );
+	if ( retval == PAPI_ENOSUPP || retval == PAPI_ECMP ) {
+		test_skip( __FILE__, __LINE__, "PAPI_HOTSPOTS", retval );
+	}
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_set_opt", retval );
+	}
+
+	retval = PAPI_overflow( EventSet, PAPI_TOT_CYC, THRESHOLD, 0, NULL );
+	if ( retval != PAPI_OK ) {
+		test_skip( __FILE__, __LINE__, "PAPI_overflow", retval );
+	}
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	do_flops( NUM_FLOPS * 10 );
+
+	retval = PAPI_stop( EventSet, NULL );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	retval = PAPI_get_hotspots( EventSet, NULL, &rows );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_get_hotspots", retval );
+	}
+
+	count = MAX_ROWS;
+	retval = PAPI_get_hotspots( EventSet, table, &count );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_get_hotspots", retval );
+	}
+
+	if ( !quiet ) {
+		printf( "Test case: callchain samples aggregated by symbol\n" );
+		printf( "-------------------------------------------------\n" );
+		printf( "Symbols            : %d\n", rows );
+		printf( "%12s %12s  %-24s %s\n", "self", "total", "symbol", "dso" );
+		for ( i = 0; i < count; i++ ) {
+			printf( "%12lld %12lld  %-24s %s\n", table[i].self,
+				table[i].total, table[i].symbol, table[i].dso );
+		}
+	}
+
+	if ( ( rows == 0 ) || ( count != ( rows < MAX_ROWS ? rows : MAX_ROWS ) ) ) {
+		test_fail( __FILE__, __LINE__, "no hot spots", 1 );
+	}
+
+	for ( i = 0; i < count; i++ ) {
+		if ( ( table[i].total < table[i].self ) ||
+		     ( table[i].event_index != 0 ) ||
+		     ( ( i > 0 ) && ( table[i].self > table[i-1].self ) ) ) {
+			test_fail( __FILE__, __LINE__, "bad hot spot", 1 );
+		}
+		self += table[i].self;
+	}
+
+	if ( self == 0 ) {
+		test_fail( __FILE__, __LINE__, "no samples", 1 );
+	}
+
+	retval = PAPI_overflow( EventSet, PAPI_TOT_CYC, 0, 0, NULL );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_overflow", retval );
+	}
+
+	retval = PAPI_cleanup_eventset( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_cleanup_eventset", retval );
+	}
+
+	retval = PAPI_destroy_eventset( &EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_destroy_eventset", retval );
+	}
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
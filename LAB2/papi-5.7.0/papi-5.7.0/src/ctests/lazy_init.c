@@ -0,0 +1,82 @@
+/* lazy_init.c */
+
+/* Test that under PAPI_LAZY_INIT looking a component up by name with  */
+/* PAPI_get_component_index() does not initialize the other components */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+/* Asking for component info initializes the component, so peek at the */
+/* table in libpapi instead.  The component info comes first in each   */
+/* entry.  A shared libpapi does not export it, then there is no test.  */
+extern PAPI_component_info_t *_papi_hwd[] __attribute__ ( ( weak ) );
+
+int main( int argc, char **argv ) {
+
+	int retval, i, cidx, last = -1, pending = 0;
+	int num_components;
+	int quiet=0;
+
+	/* Set TESTS_QUIET variable */
+	quiet=tests_quiet( argc, argv );
+
+	if ( _papi_hwd == NULL ) {
+		test_skip( __FILE__, __LINE__, "component table not visible",
+			PAPI_ENOSUPP );
+	}
+
+	setenv( "PAPI_LAZY_INIT", "1", 1 );
+
+	/* Init the PAPI library */
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	num_components = PAPI_num_components(  );
+	for ( i = 1; i < num_components; i++ ) {
+		if ( _papi_hwd[i]->disabled == PAPI_EDELAY_INIT ) {
+			last = i;
+			pending++;
+		}
+	}
+
+	if ( pending < 2 ) {
+		if (!quiet) {
+			printf("Need two components left for lazy init, have %d\n",
+				pending);
+		}
+		test_skip( __FILE__, __LINE__, "not enough components",
+			PAPI_ENOSUPP );
+	}
+
+	cidx = PAPI_get_component_index( _papi_hwd[last]->name );
+	if ( cidx != last ) {
+		test_fail( __FILE__, __LINE__, "PAPI_get_component_index", cidx );
+	}
+
+	/* the components in front of it are still waiting */
+	for ( i = 1; i < last; i++ ) {
+		if ( _papi_hwd[i]->disabled != PAPI_EDELAY_INIT ) {
+			if (!quiet) {
+				printf("Component %s was initialized\n",
+					_papi_hwd[i]->name);
+			}
+			test_fail( __FILE__, __LINE__, "name lookup initialized",
+				i );
+		}
+	}
+
+	if (!quiet) {
+		printf("Found %s at %d, %d components left alone\n",
+			_papi_hwd[last]->name, cidx, pending - 1);
+	}
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
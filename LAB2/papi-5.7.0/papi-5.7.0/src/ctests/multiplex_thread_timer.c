@@ -0,0 +1,161 @@
+/* multiplex_thread_timer.c */
+
+/* Test PAPI_MULTIPLEX_THREAD_TIMER: every thread multiplexes its own */
+/* event set from its own timer.  The timer has to keep running for   */
+/* the whole measurement, so each event gets its turn and counts.     */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "do_loops.h"
+
+#define MAX_TO_ADD	6
+#define RUN_USEC	1000000
+
+static const int events[MAX_TO_ADD] = { PAPI_TOT_CYC, PAPI_TOT_INS, PAPI_BR_INS,
+	PAPI_LD_INS, PAPI_SR_INS, PAPI_FP_OPS };
+
+static volatile int failures = 0;
+static volatile int skipped = 0;
+
+static void *
+Thread( void *arg )
+{
+	int EventSet = PAPI_NULL;
+	int retval, i, added = 0;
+	long long values[MAX_TO_ADD];
+	long long start;
+	PAPI_option_t opt;
+
+	( void ) arg;
+
+	retval = PAPI_register_thread(  );
+	if ( retval != PAPI_OK ) {
+		__sync_fetch_and_add( &failures, 1 );
+		return NULL;
+	}
+
+	retval = PAPI_create_eventset( &EventSet );
+	if ( retval != PAPI_OK ) {
+		__sync_fetch_and_add( &failures, 1 );
+		return NULL;
+	}
+
+	/* 0 is always the cpu component */
+	retval = PAPI_assign_eventset_component( EventSet, 0 );
+	if ( retval != PAPI_OK ) {
+		__sync_fetch_and_add( &skipped, 1 );
+		return NULL;
+	}
+
+	memset( &opt, 0, sizeof ( opt ) );
+	opt.multiplex.eventset = EventSet;
+	opt.multiplex.ns = 0;
+	opt.multiplex.flags = PAPI_MULTIPLEX_THREAD_TIMER;
+	retval = PAPI_set_opt( PAPI_MULTIPLEX, &opt );
+	if ( retval != PAPI_OK ) {
+		__sync_fetch_and_add( &skipped, 1 );
+		return NULL;
+	}
+
+	for ( i = 0; i < MAX_TO_ADD; i++ ) {
+		if ( PAPI_add_event( EventSet, events[i] ) == PAPI_OK ) {
+			added++;
+		}
+	}
+
+	/* Nothing to rotate with only one event */
+	if ( added < 2 ) {
+		__sync_fetch_and_add( &skipped, 1 );
+		return NULL;
+	}
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK ) {
+		__sync_fetch_and_add( &failures, 1 );
+		return NULL;
+	}
+
+	start = PAPI_get_real_usec(  );
+	while ( PAPI_get_real_usec(  ) - start < RUN_USEC ) {
+		do_stuff(  );
+	}
+
+	retval = PAPI_stop( EventSet, values );
+	if ( retval != PAPI_OK ) {
+		__sync_fetch_and_add( &failures, 1 );
+		return NULL;
+	}
+
+	/* A timer that fired only once leaves the later events at 0 */
+	for ( i = 0; i < added; i++ ) {
+		if ( values[i] <= 0 ) {
+			__sync_fetch_and_add( &failures, 1 );
+		}
+	}
+
+	PAPI_cleanup_eventset( EventSet );
+	PAPI_destroy_eventset( &EventSet );
+	PAPI_unregister_thread(  );
+
+	return NULL;
+}
+
+int
+main( int argc, char **argv )
+{
+	pthread_t threads[NUM_THREADS];
+	int i, retval;
+	int quiet;
+
+	/* Set TESTS_QUIET variable */
+	quiet = tests_quiet( argc, argv );
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	retval = PAPI_thread_init( ( unsigned long ( * )( void ) )
+							   ( pthread_self ) );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_thread_init", retval );
+	}
+
+	retval = PAPI_multiplex_init(  );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_multiplex_init", retval );
+	}
+
+	for ( i = 0; i < NUM_THREADS; i++ ) {
+		if ( pthread_create( &threads[i], NULL, Thread, NULL ) ) {
+			test_fail( __FILE__, __LINE__, "pthread_create", PAPI_ESYS );
+		}
+	}
+
+	for ( i = 0; i < NUM_THREADS; i++ ) {
+		pthread_join( threads[i], NULL );
+	}
+
+	if ( failures ) {
+		test_fail( __FILE__, __LINE__, "events not rotated", failures );
+	}
+
+	if ( skipped ) {
+		test_skip( __FILE__, __LINE__, "thread timer multiplexing", 1 );
+	}
+
+	if ( !quiet ) {
+		printf( "%d threads multiplexed from their own timers\n",
+				NUM_THREADS );
+	}
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
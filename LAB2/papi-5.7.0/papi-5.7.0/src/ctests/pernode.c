@@ -1,48 +1,63 @@
-/* This file performs the following test: 
+/* This file performs the following test:
 
    - make an event set with PAPI_TOT_INS and PAPI_TOT_CYC.
    - enable per node counting
    - enable full domain counting
-   - sleeps for 5 seconds
-   - print the results
+   - sleeps for 1 second
+   - reads the counts of every cpu with PAPI_read_cpus()
+   - checks that they add up to what PAPI_stop() returns
 */
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <unistd.h>
-#include <errno.h>
-#include <sys/types.h>
-#include <memory.h>
-#include <malloc.h>
+
+#include "papi.h"
 #include "papi_test.h"
 
+#define NUM_EVENTS 2
+
 int
-main(  )
+main( int argc, char **argv )
 {
-	int ncpu, nctr, i, actual_domain;
-	int retval;
+	int ncpu, nrows, i, j, actual_domain;
+	int retval, quiet;
 	int EventSet = PAPI_NULL;
-	long long *values;
+	int *cpus;
+	long long *values, sum[NUM_EVENTS], total[NUM_EVENTS];
 	long long elapsed_us, elapsed_cyc;
 	PAPI_option_t options;
 
+	/* Set TESTS_QUIET variable */
+	quiet = tests_quiet( argc, argv );
+
 	retval = PAPI_library_init( PAPI_VER_CURRENT );
 	if ( retval != PAPI_VER_CURRENT ) {
-		fprintf( stderr, "Library mismatch: code %d, library %d\n", retval,
-				 PAPI_VER_CURRENT );
-		exit( 1 );
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
 	}
 
-	if ( PAPI_create_eventset( &EventSet ) != PAPI_OK )
-		exit( 1 );
+	retval = PAPI_create_eventset( &EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+	}
+
+	/* Force event set to be associated with component 0 */
+	/* (perf_events component provides all core events)  */
+	retval = PAPI_assign_eventset_component( EventSet, 0 );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_assign_eventset_component", retval );
+	}
 
 	/* Set the domain as high as it will go. */
 
 	options.domain.eventset = EventSet;
 	options.domain.domain = PAPI_DOM_ALL;
 	retval = PAPI_set_opt( PAPI_DOMAIN, &options );
-	if ( retval != PAPI_OK )
-		exit( 1 );
+	if ( retval != PAPI_OK ) {
+		if (!quiet) printf("Can't set PAPI_DOM_ALL: %s\n",
+				PAPI_strerror(retval));
+		test_skip( __FILE__, __LINE__, "PAPI_set_opt", retval );
+	}
 	actual_domain = options.domain.domain;
 
 	/* This should only happen to an empty eventset */
@@ -50,74 +65,120 @@ main(  )
 	options.granularity.eventset = EventSet;
 	options.granularity.granularity = PAPI_GRN_SYS_CPU;
 	retval = PAPI_set_opt( PAPI_GRANUL, &options );
-	if ( retval != PAPI_OK )
-		exit( 1 );
+	if ( retval != PAPI_OK ) {
+		if (!quiet) printf("Can't set PAPI_GRN_SYS_CPU: %s\n",
+				PAPI_strerror(retval));
+		test_skip( __FILE__, __LINE__, "PAPI_set_opt", retval );
+	}
 
-	/* Malloc the output array */
+	/* Add the counters */
 
-	ncpu = PAPI_get_opt( PAPI_MAX_CPUS, NULL );
-	nctr = PAPI_get_opt( PAPI_MAX_HWCTRS, NULL );
-	values = ( long long * ) malloc( ncpu * nctr * sizeof ( long long ) );
-	memset( values, 0x0, ( ncpu * nctr * sizeof ( long long ) ) );
+	retval = PAPI_add_event( EventSet, PAPI_TOT_CYC );
+	if ( retval != PAPI_OK ) {
+		test_skip( __FILE__, __LINE__, "PAPI_add_event PAPI_TOT_CYC", retval );
+	}
 
-	/* Add the counters */
+	retval = PAPI_add_event( EventSet, PAPI_TOT_INS );
+	if ( retval != PAPI_OK ) {
+		test_skip( __FILE__, __LINE__, "PAPI_add_event PAPI_TOT_INS", retval );
+	}
 
-	if ( PAPI_add_event( EventSet, PAPI_TOT_CYC ) != PAPI_OK )
-		exit( 1 );
+	/* Malloc the output arrays */
 
-	if ( PAPI_add_event( EventSet, PAPI_TOT_INS ) != PAPI_OK )
-		exit( 1 );
+	ncpu = PAPI_get_opt( PAPI_MAX_CPUS, NULL );
+	if ( ncpu < 1 ) {
+		test_fail( __FILE__, __LINE__, "PAPI_get_opt PAPI_MAX_CPUS", ncpu );
+	}
+	values = ( long long * ) calloc( ncpu * NUM_EVENTS, sizeof ( long long ) );
+	cpus = ( int * ) calloc( ncpu, sizeof ( int ) );
+	if ( ( values == NULL ) || ( cpus == NULL ) ) {
+		test_fail( __FILE__, __LINE__, "calloc", PAPI_ENOMEM );
+	}
 
 	elapsed_us = PAPI_get_real_usec(  );
 
 	elapsed_cyc = PAPI_get_real_cyc(  );
 
 	retval = PAPI_start( EventSet );
-	if ( retval != PAPI_OK )
-		exit( 1 );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
 
-	sleep( 5 );
+	sleep( 1 );
 
-	retval = PAPI_stop( EventSet, values );
-	if ( retval != PAPI_OK )
-		exit( 1 );
+	retval = PAPI_stop( EventSet, total );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
 
 	elapsed_us = PAPI_get_real_usec(  ) - elapsed_us;
 
 	elapsed_cyc = PAPI_get_real_cyc(  ) - elapsed_cyc;
 
-	printf( "Test case: per node\n" );
-	printf( "-------------------\n\n" );
+	nrows = ncpu;
+	retval = PAPI_read_cpus( EventSet, values, cpus, &nrows );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_read_cpus", retval );
+	}
 
-	printf( "This machine has %d cpus, each with %d counters.\n", ncpu, nctr );
-	printf( "Test case asked for: PAPI_DOM_ALL\n" );
-	printf( "Test case got: " );
-	if ( actual_domain & PAPI_DOM_USER )
-		printf( "PAPI_DOM_USER " );
-	if ( actual_domain & PAPI_DOM_KERNEL )
-		printf( "PAPI_DOM_KERNEL " );
-	if ( actual_domain & PAPI_DOM_OTHER )
-		printf( "PAPI_DOM_OTHER " );
-	printf( "\n" );
+	if (!quiet) {
+		printf( "Test case: per node\n" );
+		printf( "-------------------\n\n" );
+
+		printf( "This machine has %d cpus, %d of them counted.\n",
+			ncpu, nrows );
+		printf( "Test case asked for: PAPI_DOM_ALL\n" );
+		printf( "Test case got: " );
+		if ( actual_domain & PAPI_DOM_USER )
+			printf( "PAPI_DOM_USER " );
+		if ( actual_domain & PAPI_DOM_KERNEL )
+			printf( "PAPI_DOM_KERNEL " );
+		if ( actual_domain & PAPI_DOM_OTHER )
+			printf( "PAPI_DOM_OTHER " );
+		printf( "\n" );
+	}
 
-	for ( i = 0; i < ncpu; i++ ) {
-		printf( "CPU %d\n", i );
-		printf( "PAPI_TOT_CYC: \t%lld\n", values[0 + i * nctr] );
-		printf( "PAPI_TOT_INS: \t%lld\n", values[1 + i * nctr] );
+	for ( j = 0; j < NUM_EVENTS; j++ ) {
+		sum[j] = 0;
 	}
 
-	printf
-		( "\n-------------------------------------------------------------------------\n" );
+	for ( i = 0; i < nrows; i++ ) {
+		if (!quiet) {
+			printf( "CPU %d\n", cpus[i] );
+			printf( "PAPI_TOT_CYC: \t%lld\n", values[0 + i * NUM_EVENTS] );
+			printf( "PAPI_TOT_INS: \t%lld\n", values[1 + i * NUM_EVENTS] );
+		}
+		for ( j = 0; j < NUM_EVENTS; j++ ) {
+			sum[j] += values[j + i * NUM_EVENTS];
+		}
+	}
+
+	if (!quiet) {
+		printf
+			( "\n-------------------------------------------------------------------------\n" );
+
+		printf( "All cpus    : \t%lld cycles, %lld instructions\n",
+			total[0], total[1] );
+		printf( "Real usec   : \t%lld\n", elapsed_us );
+		printf( "Real cycles : \t%lld\n", elapsed_cyc );
 
-	printf( "Real usec   : \t%lld\n", elapsed_us );
-	printf( "Real cycles : \t%lld\n", elapsed_cyc );
+		printf
+			( "-------------------------------------------------------------------------\n" );
+	}
 
-	printf
-		( "-------------------------------------------------------------------------\n" );
+	for ( j = 0; j < NUM_EVENTS; j++ ) {
+		if ( sum[j] != total[j] ) {
+			test_fail( __FILE__, __LINE__,
+				"per cpu counts do not add up", PAPI_EMISC );
+		}
+	}
 
 	free( values );
+	free( cpus );
 
 	PAPI_shutdown(  );
 
-	exit( 0 );
+	test_pass( __FILE__ );
+
+	return 0;
 }
@@ -0,0 +1,163 @@
+/* read_many.c */
+
+/* Test PAPI_read_many(): one running and one stopped event set are  */
+/* read in a single call and must agree with PAPI_read()/PAPI_stop() */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "testcode.h"
+
+#define NUM_LOOPS	50
+
+int main( int argc, char **argv ) {
+
+	int retval, i;
+	int EventSet1 = PAPI_NULL, EventSet2 = PAPI_NULL;
+	int sets[2];
+	long long stopped[1], before[1], after[1];
+	long long many1[1], many2[1];
+	long long *values[2];
+	int quiet=0;
+
+	/* Set TESTS_QUIET variable */
+	quiet=tests_quiet( argc, argv );
+
+	/* Init the PAPI library */
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	retval=PAPI_create_eventset(&EventSet1);
+	if (retval!=PAPI_OK) {
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+	}
+
+	retval=PAPI_create_eventset(&EventSet2);
+	if (retval!=PAPI_OK) {
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+	}
+
+	retval=PAPI_add_named_event(EventSet1,"PAPI_TOT_INS");
+	if (retval!=PAPI_OK) {
+		if (!quiet) {
+			printf("Trouble adding PAPI_TOT_INS: %s\n",
+				PAPI_strerror(retval));
+		}
+		test_skip( __FILE__, __LINE__, "adding PAPI_TOT_INS", retval );
+	}
+
+	retval=PAPI_add_named_event(EventSet2,"PAPI_TOT_INS");
+	if (retval!=PAPI_OK) {
+		test_fail( __FILE__, __LINE__, "adding PAPI_TOT_INS", retval );
+	}
+
+	/* Run and stop the second event set so it has stored values */
+	retval = PAPI_start( EventSet2 );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	for(i=0;i<NUM_LOOPS;i++) {
+		instructions_million();
+	}
+
+	retval = PAPI_stop( EventSet2, stopped );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	retval = PAPI_start( EventSet1 );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	for(i=0;i<NUM_LOOPS;i++) {
+		instructions_million();
+	}
+
+	sets[0]=EventSet1;
+	sets[1]=EventSet2;
+	values[0]=many1;
+	values[1]=many2;
+
+	retval = PAPI_read( EventSet1, before );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_read", retval );
+	}
+
+	retval = PAPI_read_many( sets, 2, values );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_read_many", retval );
+	}
+
+	retval = PAPI_read( EventSet1, after );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_read", retval );
+	}
+
+	retval = PAPI_stop( EventSet1, NULL );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	if ( !quiet ) {
+		printf( "Test case: PAPI_read_many of a running and a stopped event set\n" );
+		printf( "-------------------------------------------------------------------------\n" );
+		printf( "%-24s %12lld\n", "PAPI_read (before) : ", before[0] );
+		printf( "%-24s %12lld\n", "PAPI_read_many     : ", many1[0] );
+		printf( "%-24s %12lld\n", "PAPI_read (after)  : ", after[0] );
+		printf( "%-24s %12lld\n", "PAPI_stop          : ", stopped[0] );
+		printf( "%-24s %12lld\n", "PAPI_read_many     : ", many2[0] );
+		printf( "-------------------------------------------------------------------------\n" );
+		printf( "Verification: running values are monotonic, stopped values match\n" );
+	}
+
+	if ( ( many1[0] < before[0] ) || ( many1[0] > after[0] ) ) {
+		test_fail( __FILE__, __LINE__, "running event set value", 1 );
+	}
+
+	if ( many2[0] != stopped[0] ) {
+		test_fail( __FILE__, __LINE__, "stopped event set value", 1 );
+	}
+
+	/* Bad arguments */
+	retval = PAPI_read_many( sets, 0, values );
+	if ( retval != PAPI_EINVAL ) {
+		test_fail( __FILE__, __LINE__, "PAPI_read_many with n=0", retval );
+	}
+
+	sets[1]=PAPI_NULL;
+	retval = PAPI_read_many( sets, 2, values );
+	if ( retval != PAPI_ENOEVST ) {
+		test_fail( __FILE__, __LINE__, "PAPI_read_many with bad eventset", retval );
+	}
+
+	retval = PAPI_cleanup_eventset( EventSet1 );
+	if (retval!=PAPI_OK) {
+		test_fail( __FILE__, __LINE__, "PAPI_cleanup_eventset", retval );
+	}
+
+	retval = PAPI_cleanup_eventset( EventSet2 );
+	if (retval!=PAPI_OK) {
+		test_fail( __FILE__, __LINE__, "PAPI_cleanup_eventset", retval );
+	}
+
+	retval=PAPI_destroy_eventset( &EventSet1 );
+	if (retval!=PAPI_OK) {
+		test_fail( __FILE__, __LINE__, "PAPI_destroy_eventset", retval );
+	}
+
+	retval=PAPI_destroy_eventset( &EventSet2 );
+	if (retval!=PAPI_OK) {
+		test_fail( __FILE__, __LINE__, "PAPI_destroy_eventset", retval );
+	}
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
@@ -0,0 +1,215 @@
+/* recycle.c */
+
+/* Test PAPI_recycle_eventset()/PAPI_reuse_eventset(): a parked event */
+/* set is invisible until it is reused, comes back only for the same  */
+/* events, and still counts when it does.  An event set that was      */
+/* multiplexed or attached never comes back as such.                  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "testcode.h"
+
+#define NUM_LOOPS	16
+
+int main( int argc, char **argv ) {
+
+	int retval, i, parked;
+	int EventSet1 = PAPI_NULL, EventSet2 = PAPI_NULL;
+	int events[2] = { PAPI_TOT_INS, PAPI_TOT_CYC };
+	long long values[2];
+	PAPI_option_t opt;
+	int quiet=0;
+
+	/* Set TESTS_QUIET variable */
+	quiet=tests_quiet( argc, argv );
+
+	/* Init the PAPI library */
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	/* Nothing parked yet, so this creates a new event set */
+	retval = PAPI_reuse_eventset( &EventSet1, events, 1 );
+	if ( retval != PAPI_OK ) {
+		if (!quiet) {
+			printf("Trouble adding PAPI_TOT_INS: %s\n",
+				PAPI_strerror(retval));
+		}
+		test_skip( __FILE__, __LINE__, "PAPI_reuse_eventset", retval );
+	}
+
+	retval = PAPI_start( EventSet1 );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	/* A running event set can not be parked */
+	i = EventSet1;
+	retval = PAPI_recycle_eventset( &i );
+	if ( retval != PAPI_EISRUN ) {
+		test_fail( __FILE__, __LINE__, "PAPI_recycle_eventset running",
+			retval );
+	}
+
+	retval = PAPI_stop( EventSet1, values );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	parked = EventSet1;
+	retval = PAPI_recycle_eventset( &EventSet1 );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_recycle_eventset", retval );
+	}
+	if ( EventSet1 != PAPI_NULL ) {
+		test_fail( __FILE__, __LINE__, "EventSet not set to PAPI_NULL",
+			EventSet1 );
+	}
+
+	/* Parked event sets can not be used */
+	retval = PAPI_start( parked );
+	if ( retval != PAPI_ENOEVST ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start of parked set", retval );
+	}
+
+	/* Other events do not get the parked event set */
+	retval = PAPI_reuse_eventset( &EventSet2, events, 2 );
+	if ( retval == PAPI_OK ) {
+		if ( EventSet2 == parked ) {
+			test_fail( __FILE__, __LINE__,
+				"parked set reused for other events", EventSet2 );
+		}
+		retval = PAPI_cleanup_eventset( EventSet2 );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_cleanup_eventset",
+				retval );
+		}
+		retval = PAPI_destroy_eventset( &EventSet2 );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_destroy_eventset",
+				retval );
+		}
+	}
+	else if (!quiet) {
+		printf("Not checking other events: %s\n", PAPI_strerror(retval));
+	}
+
+	/* The same events get it back, and it still counts */
+	for(i=0;i<NUM_LOOPS;i++) {
+
+		retval = PAPI_reuse_eventset( &EventSet1, events, 1 );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_reuse_eventset",
+				retval );
+		}
+		if ( EventSet1 != parked ) {
+			test_fail( __FILE__, __LINE__, "parked set not reused",
+				EventSet1 );
+		}
+
+		retval = PAPI_start( EventSet1 );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+		}
+
+		instructions_million();
+
+		retval = PAPI_stop( EventSet1, values );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+		}
+
+		if ( values[0] <= 0 ) {
+			test_fail( __FILE__, __LINE__, "PAPI_TOT_INS not counting",
+				( int ) values[0] );
+		}
+
+		retval = PAPI_recycle_eventset( &EventSet1 );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_recycle_eventset",
+				retval );
+		}
+	}
+
+	if (!quiet) {
+		printf("Reused event set %d %d times\n", parked, NUM_LOOPS);
+	}
+
+	/* A multiplexed event set is not handed out for plain events */
+	retval = PAPI_multiplex_init(  );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_multiplex_init", retval );
+	}
+
+	retval = PAPI_reuse_eventset( &EventSet1, events, 1 );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_reuse_eventset", retval );
+	}
+
+	retval = PAPI_set_multiplex( EventSet1 );
+	if ( retval == PAPI_OK ) {
+		retval = PAPI_recycle_eventset( &EventSet1 );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_recycle_eventset",
+				retval );
+		}
+		retval = PAPI_reuse_eventset( &EventSet1, events, 1 );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_reuse_eventset",
+				retval );
+		}
+		retval = PAPI_get_multiplex( EventSet1 );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__,
+				"reused event set is multiplexed", retval );
+		}
+	}
+	else if (!quiet) {
+		printf("Not checking multiplexing: %s\n", PAPI_strerror(retval));
+	}
+
+	/* Neither is one attached to a process */
+	retval = PAPI_attach( EventSet1, ( unsigned long ) getpid(  ) );
+	if ( retval == PAPI_OK ) {
+		retval = PAPI_recycle_eventset( &EventSet1 );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_recycle_eventset",
+				retval );
+		}
+		retval = PAPI_reuse_eventset( &EventSet1, events, 1 );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_reuse_eventset",
+				retval );
+		}
+		memset( &opt, 0, sizeof ( opt ) );
+		opt.attach.eventset = EventSet1;
+		retval = PAPI_get_opt( PAPI_ATTACH, &opt );
+		if ( retval != 0 ) {
+			test_fail( __FILE__, __LINE__,
+				"reused event set is attached", retval );
+		}
+	}
+	else if (!quiet) {
+		printf("Not checking attach: %s\n", PAPI_strerror(retval));
+	}
+
+	retval = PAPI_cleanup_eventset( EventSet1 );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_cleanup_eventset", retval );
+	}
+	retval = PAPI_destroy_eventset( &EventSet1 );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_destroy_eventset", retval );
+	}
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
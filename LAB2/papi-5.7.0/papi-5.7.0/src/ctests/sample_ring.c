@@ -0,0 +1,158 @@
+/* sample_ring.c */
+
+/* Test PAPI_SAMPLE_RING and PAPI_read_samples(): overflow samples are */
+/* queued by the signal handler and drained after the event set stops  */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "do_loops.h"
+
+#define RING_SIZE	( 1 << 16 )
+
+static int handler_called = 0;
+
+static void
+handler( int EventSet, void *address, long long overflow_vector, void *context )
+{
+	( void ) EventSet;
+	( void ) address;
+	( void ) overflow_vector;
+	( void ) context;
+
+	handler_called++;
+}
+
+int
+main( int argc, char **argv )
+{
+	int EventSet = PAPI_NULL;
+	int retval, count, total = 0, i;
+	long long dropped = 0;
+	PAPI_option_t opt;
+	PAPI_sample_record_t *rec;
+	char *buf, *p;
+	int quiet;
+
+	/* Set TESTS_QUIET variable */
+	quiet=tests_quiet( argc, argv );
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	retval = PAPI_create_eventset( &EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+	}
+
+	retval = PAPI_add_named_event( EventSet, "PAPI_TOT_CYC" );
+	if ( retval != PAPI_OK ) {
+		if ( !quiet ) {
+			printf( "Trouble adding PAPI_TOT_CYC: %s\n",
+				PAPI_strerror( retval ) );
+		}
+		test_skip( __FILE__, __LINE__, "adding PAPI_TOT_CYC", retval );
+	}
+
+	/* No ring yet */
+	buf = malloc( RING_SIZE );
+	if ( buf == NULL ) {
+		test_fail( __FILE__, __LINE__, "malloc", PAPI_ENOMEM );
+	}
+	retval = PAPI_read_samples( EventSet, buf, RING_SIZE, &count, NULL );
+	if ( retval != PAPI_EINVAL ) {
+		test_fail( __FILE__, __LINE__, "PAPI_read_samples without ring",
+			retval );
+	}
+
+	opt.sample_ring.eventset = EventSet;
+	opt.sample_ring.size = RING_SIZE;
+	retval = PAPI_set_opt( PAPI_SAMPLE_RING, &opt );
+	if ( retval == PAPI_ENOSUPP || retval == PAPI_ECMP ) {
+		test_skip( __FILE__, __LINE__, "PAPI_SAMPLE_RING", retval );
+	}
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_set_opt", retval );
+	}
+
+	retval = PAPI_overflow( EventSet, PAPI_TOT_CYC, THRESHOLD, 0, handler );
+	if ( retval != PAPI_OK ) {
+		test_skip( __FILE__, __LINE__, "PAPI_overflow", retval );
+	}
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	do_flops( NUM_FLOPS * 10 );
+
+	retval = PAPI_stop( EventSet, NULL );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	do {
+		retval = PAPI_read_samples( EventSet, buf, RING_SIZE,
+					&count, &dropped );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_read_samples",
+				retval );
+		}
+
+		/* Walk the records, each header gives the padded size */
+		p = buf;
+		for ( i = 0; i < count; i++ ) {
+			rec = ( PAPI_sample_record_t * ) p;
+			if ( ( rec->size < sizeof ( *rec ) ) ||
+			     ( rec->event_index != 0 ) ) {
+				test_fail( __FILE__, __LINE__, "bad record", 1 );
+			}
+			p += rec->size;
+		}
+		total += count;
+	} while ( count );
+
+	if ( !quiet ) {
+		printf( "Test case: overflow samples through a sample ring\n" );
+		printf( "-------------------------------------------------\n" );
+		printf( "Samples read       : %d\n", total );
+		printf( "Samples dropped    : %lld\n", dropped );
+		printf( "Handler calls      : %d\n", handler_called );
+	}
+
+	if ( handler_called ) {
+		test_fail( __FILE__, __LINE__,
+			"overflow handler called with a sample ring", 1 );
+	}
+
+	if ( total + dropped == 0 ) {
+		test_fail( __FILE__, __LINE__, "no samples", 1 );
+	}
+
+	retval = PAPI_overflow( EventSet, PAPI_TOT_CYC, 0, 0, handler );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_overflow", retval );
+	}
+
+	free( buf );
+
+	retval = PAPI_cleanup_eventset( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_cleanup_eventset", retval );
+	}
+
+	retval = PAPI_destroy_eventset( &EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_destroy_eventset", retval );
+	}
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+/* unregister_pthreads.c */
+
+/* Threads keep looking themselves up while other threads register and */
+/* unregister as fast as they can.  Every lookup must find the thread  */
+/* it is made for, however the hash buckets change underneath it.      */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#define NUM_STABLE	4
+#define NUM_CHURN	4
+#define NUM_LOOPS	2000
+
+static volatile int stop = 0;
+static volatile int failures = 0;
+static int markers[NUM_STABLE];
+
+static void *
+Stable( void *arg )
+{
+	int *marker = ( int * ) arg;
+	void *found;
+	long lookups = 0;
+
+	if ( PAPI_register_thread(  ) != PAPI_OK ) {
+		__sync_fetch_and_add( &failures, 1 );
+		return NULL;
+	}
+
+	if ( PAPI_set_thr_specific( PAPI_USR1_TLS, marker ) != PAPI_OK ) {
+		__sync_fetch_and_add( &failures, 1 );
+	}
+
+	while ( !stop || lookups == 0 ) {
+		found = NULL;
+		if ( ( PAPI_get_thr_specific( PAPI_USR1_TLS, &found ) != PAPI_OK ) ||
+			 ( found != marker ) ) {
+			__sync_fetch_and_add( &failures, 1 );
+			break;
+		}
+		lookups++;
+	}
+
+	if ( PAPI_unregister_thread(  ) != PAPI_OK ) {
+		__sync_fetch_and_add( &failures, 1 );
+	}
+
+	return NULL;
+}
+
+static void *
+Churn( void *arg )
+{
+	int i;
+
+	( void ) arg;
+
+	for ( i = 0; i < NUM_LOOPS; i++ ) {
+		if ( PAPI_register_thread(  ) != PAPI_OK ) {
+			__sync_fetch_and_add( &failures, 1 );
+			break;
+		}
+		if ( PAPI_unregister_thread(  ) != PAPI_OK ) {
+			__sync_fetch_and_add( &failures, 1 );
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+int
+main( int argc, char **argv )
+{
+	pthread_t stable[NUM_STABLE], churn[NUM_CHURN];
+	PAPI_thread_id_t tids[NUM_STABLE + NUM_CHURN + 1];
+	int i, retval, number;
+	int quiet;
+
+	/* Set TESTS_QUIET variable */
+	quiet = tests_quiet( argc, argv );
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	retval = PAPI_thread_init( ( unsigned long ( * )( void ) )
+							   ( pthread_self ) );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_thread_init", retval );
+	}
+
+	for ( i = 0; i < NUM_STABLE; i++ ) {
+		if ( pthread_create( &stable[i], NULL, Stable, &markers[i] ) ) {
+			test_fail( __FILE__, __LINE__, "pthread_create", PAPI_ESYS );
+		}
+	}
+
+	for ( i = 0; i < NUM_CHURN; i++ ) {
+		if ( pthread_create( &churn[i], NULL, Churn, NULL ) ) {
+			test_fail( __FILE__, __LINE__, "pthread_create", PAPI_ESYS );
+		}
+	}
+
+	for ( i = 0; i < NUM_CHURN; i++ ) {
+		pthread_join( churn[i], NULL );
+	}
+
+	stop = 1;
+
+	for ( i = 0; i < NUM_STABLE; i++ ) {
+		pthread_join( stable[i], NULL );
+	}
+
+	if ( failures ) {
+		test_fail( __FILE__, __LINE__, "thread lookup failed", failures );
+	}
+
+	/* Only the main thread is left */
+	number = NUM_STABLE + NUM_CHURN + 1;
+	retval = PAPI_list_threads( tids, &number );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_list_threads", retval );
+	}
+	if ( number != 1 ) {
+		test_fail( __FILE__, __LINE__, "threads left behind", number );
+	}
+
+	if ( !quiet ) {
+		printf( "%d threads registered and unregistered %d times each\n",
+				NUM_CHURN, NUM_LOOPS );
+	}
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
@@ -0,0 +1,167 @@
+/* virtual_start.c */
+
+/* Test PAPI_VIRTUAL_START: with the counters left enabled, start/stop   */
+/* and reset must still only count what happens between start and stop */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "papi.h"
+#include "papi_test.h"
+
+#include "testcode.h"
+
+#define NUM_LOOPS	10
+
+static int
+outside( long long value, long long reference )
+{
+	return ( value < reference * 9 / 10 ) || ( value > reference * 11 / 10 );
+}
+
+int main( int argc, char **argv ) {
+
+	int retval, i;
+	int EventSet = PAPI_NULL;
+	long long windows[NUM_LOOPS], empty[1], reset[1], reference[1];
+	PAPI_option_t opt;
+	int quiet=0;
+
+	/* Set TESTS_QUIET variable */
+	quiet=tests_quiet( argc, argv );
+
+	/* Init the PAPI library */
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		test_fail( __FILE__, __LINE__, "PAPI_library_init", retval );
+	}
+
+	retval=PAPI_create_eventset(&EventSet);
+	if (retval!=PAPI_OK) {
+		test_fail( __FILE__, __LINE__, "PAPI_create_eventset", retval );
+	}
+
+	retval=PAPI_add_named_event(EventSet,"PAPI_TOT_INS");
+	if (retval!=PAPI_OK) {
+		if (!quiet) {
+			printf("Trouble adding PAPI_TOT_INS: %s\n",
+				PAPI_strerror(retval));
+		}
+		test_skip( __FILE__, __LINE__, "adding PAPI_TOT_INS", retval );
+	}
+
+	opt.virtual_start.eventset = EventSet;
+	opt.virtual_start.enable = 1;
+	retval = PAPI_set_opt( PAPI_VIRTUAL_START, &opt );
+	if ( retval == PAPI_ENOSUPP ) {
+		test_skip( __FILE__, __LINE__, "PAPI_VIRTUAL_START", retval );
+	}
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_set_opt", retval );
+	}
+
+	/* Count one million instructions per window, and do */
+	/* the same work while stopped, which must not count */
+	for(i=0;i<NUM_LOOPS;i++) {
+		retval = PAPI_start( EventSet );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+		}
+
+		instructions_million();
+
+		retval = PAPI_stop( EventSet, &windows[i] );
+		if ( retval != PAPI_OK ) {
+			test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+		}
+
+		instructions_million();
+	}
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	retval = PAPI_stop( EventSet, empty );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	instructions_million();
+
+	retval = PAPI_reset( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_reset", retval );
+	}
+
+	retval = PAPI_stop( EventSet, reset );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	/* The same window with the usual enable/disable ioctls */
+	opt.virtual_start.enable = 0;
+	retval = PAPI_set_opt( PAPI_VIRTUAL_START, &opt );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_set_opt", retval );
+	}
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_start", retval );
+	}
+
+	instructions_million();
+
+	retval = PAPI_stop( EventSet, reference );
+	if ( retval != PAPI_OK ) {
+		test_fail( __FILE__, __LINE__, "PAPI_stop", retval );
+	}
+
+	if ( !quiet ) {
+		printf( "Test case: PAPI_VIRTUAL_START start/stop/reset windows\n" );
+		printf( "-------------------------------------------------------------------------\n" );
+		for(i=0;i<NUM_LOOPS;i++) {
+			printf( "Window %-17d : %12lld\n", i, windows[i] );
+		}
+		printf( "%-24s : %12lld\n", "Empty window", empty[0] );
+		printf( "%-24s : %12lld\n", "After PAPI_reset", reset[0] );
+		printf( "%-24s : %12lld\n", "Without virtual start", reference[0] );
+		printf( "-------------------------------------------------------------------------\n" );
+		printf( "Verification: windows within 10%% of the ioctl count, empty windows near 0\n" );
+	}
+
+	for(i=0;i<NUM_LOOPS;i++) {
+		if ( outside( windows[i], reference[0] ) ) {
+			test_fail( __FILE__, __LINE__, "virtual window count", 1 );
+		}
+	}
+
+	if ( empty[0] > reference[0] / 10 ) {
+		test_fail( __FILE__, __LINE__, "empty window count", 1 );
+	}
+
+	if ( reset[0] > reference[0] / 10 ) {
+		test_fail( __FILE__, __LINE__, "count after reset", 1 );
+	}
+
+	retval = PAPI_cleanup_eventset( EventSet );
+	if (retval!=PAPI_OK) {
+		test_fail( __FILE__, __LINE__, "PAPI_cleanup_eventset", retval );
+	}
+
+	retval=PAPI_destroy_eventset( &EventSet );
+	if (retval!=PAPI_OK) {
+		test_fail( __FILE__, __LINE__, "PAPI_destroy_eventset", retval );
+	}
+
+	test_pass( __FILE__ );
+
+	return 0;
+}
@@ -26,6 +26,8 @@ vendors did in the kernel extensions or performance libraries. */
 #include "extras.h"
 #include "threads.h"
 
+#include <dlfcn.h>
+
 #if (!defined(HAVE_FFSLL) || defined(__bgp__))
 int ffsll( long long lli );
 #else
@@ -36,26 +38,29 @@ int ffsll( long long lli );
 /* BEGIN LOCALS */
 /****************/
 
-static unsigned int _rnum = DEADBEEF;
+static unsigned long long _rnum = DEADBEEF;
 
 /**************/
 /* END LOCALS */
 /**************/
 
-inline_static unsigned short
-random_ushort( void )
+/* the top bits of a 64-bit LCG; its low bits have short periods,
+   the low 16 of them repeat every 65536 draws */
+inline_static unsigned long long
+random_bits( int bits )
 {
-	return ( unsigned short ) ( _rnum = 1664525 * _rnum + 1013904223 );
+	_rnum = 6364136223846793005ULL * _rnum + 1442695040888963407ULL;
+	return ( _rnum >> ( 64 - bits ) );
 }
 
 
 /* compute the amount by which to increment the bucket.
-   value is the current value of the bucket
+   value is the current value of the bucket, bits its width
    this routine is used by all three profiling cases
    it is inlined for speed
 */
 inline_static int
-profil_increment( long long value,
+profil_increment( unsigned long long value, int bits,
 				  int flags, long long excess, long long threshold )
 {
 	int increment = 1;
@@ -65,13 +70,16 @@ profil_increment( long long value,
 	}
 
 	if ( flags & PAPI_PROFIL_RANDOM ) {
-		if ( random_ushort(  ) <= ( USHRT_MAX / 4 ) )
+		if ( random_bits( 16 ) <= ( USHRT_MAX / 4 ) )
 			return ( 0 );
 	}
 
 	if ( flags & PAPI_PROFIL_COMPRESS ) {
-		/* We're likely to ignore the sample if buf[address] gets big. */
-		if ( random_ushort(  ) < value ) {
+		/* We're likely to ignore the sample if buf[address] gets big
+		   compared to what the bucket holds; the random number is as
+		   wide as the bucket, so 32 and 64-bit buckets do not stop
+		   counting at 65536. */
+		if ( random_bits( bits ) < value ) {
 			return ( 0 );
 		}
 	}
@@ -127,7 +135,7 @@ posix_profil( caddr_t address, PAPI_sprofil_t * prof,
 				buf16 = (unsigned short *) prof->pr_base;
 				buf16[indx] =
 					( unsigned short ) ( ( unsigned short ) buf16[indx] +
-										 profil_increment( buf16[indx], flags,
+										 profil_increment( buf16[indx], 16, flags,
 														   excess,
 														   threshold ) );
 				PRFDBG( "posix_profil_16() bucket %lu = %u\n", indx,
@@ -139,7 +147,7 @@ posix_profil( caddr_t address, PAPI_sprofil_t * prof,
 			if ( ( indx * sizeof ( int ) ) < prof->pr_size ) {
 				buf32 = (unsigned int *) prof->pr_base;
 				buf32[indx] = ( unsigned int ) buf32[indx] +
-					( unsigned int ) profil_increment( buf32[indx], flags,
+					( unsigned int ) profil_increment( buf32[indx], 32, flags,
 													   excess, threshold );
 				PRFDBG( "posix_profil_32() bucket %lu = %u\n", indx,
 						buf32[indx] );
@@ -150,9 +158,8 @@ posix_profil( caddr_t address, PAPI_sprofil_t * prof,
 			if ( ( indx * sizeof ( long long ) ) < prof->pr_size ) {
 				buf64 = (unsigned long long *) prof->pr_base;
 				buf64[indx] = ( unsigned long long ) buf64[indx] +
-					( unsigned long long ) profil_increment( ( long long )
-															 buf64[indx], flags,
-															 excess,
+					( unsigned long long ) profil_increment( buf64[indx], 64,
+															 flags, excess,
 															 threshold );
 				PRFDBG( "posix_profil_64() bucket %lu = %lld\n", indx,
 						buf64[indx] );
@@ -161,33 +168,84 @@ posix_profil( caddr_t address, PAPI_sprofil_t * prof,
 	}
 }
 
+static int
+compare_regions( const void *a, const void *b )
+{
+	const ProfileRegion_t *ra = ( const ProfileRegion_t * ) a;
+	const ProfileRegion_t *rb = ( const ProfileRegion_t * ) b;
+
+	if ( ra->pr_off != rb->pr_off )
+		return ( ra->pr_off < rb->pr_off ) ? -1 : 1;
+	return ra->index - rb->index;
+}
+
+/* Build the table _papi_hwi_dispatch_profile() searches for the region
+   of a sample: the count regions of prof by increasing pr_off, keeping
+   only the first of those starting at the same address, and none that
+   start at 0 as those are only ever used as the fallback region 0.
+   *regions is NULL when there is nothing to search. */
+int
+_papi_hwi_sort_profile_regions( PAPI_sprofil_t * prof, int count,
+								ProfileRegion_t ** regions, int *num )
+{
+	ProfileRegion_t *r;
+	int i, n;
+
+	*regions = NULL;
+	*num = 0;
+	if ( count <= 0 )
+		return PAPI_OK;
+
+	r = papi_malloc( sizeof ( ProfileRegion_t ) * ( size_t ) count );
+	if ( r == NULL )
+		return PAPI_ENOMEM;
+
+	for ( i = 0, n = 0; i < count; i++ ) {
+		if ( prof[i].pr_off == 0 )
+			continue;
+		r[n].pr_off = prof[i].pr_off;
+		r[n].index = i;
+		n++;
+	}
+	qsort( r, ( size_t ) n, sizeof ( ProfileRegion_t ), compare_regions );
+
+	for ( i = 0; i < n; i++ ) {
+		if ( *num && r[*num - 1].pr_off == r[i].pr_off )
+			continue;
+		r[( *num )++] = r[i];
+	}
+
+	*regions = r;
+	return PAPI_OK;
+}
+
 void
 _papi_hwi_dispatch_profile( EventSetInfo_t * ESI, caddr_t pc,
 							long long over, int profile_index )
 {
 	EventSetProfileInfo_t *profile = &ESI->profile;
+	ProfileRegion_t *regions;
 	PAPI_sprofil_t *sprof;
-	caddr_t offset = 0;
-	caddr_t best_offset = 0;
-	int count;
-	int best_index = -1;
-	int i;
+	int lo, hi, mid;
+	int best_index = 0;
 
 	PRFDBG( "handled IP %p\n", pc );
 
 	sprof = profile->prof[profile_index];
-	count = profile->count[profile_index];
-
-	for ( i = 0; i < count; i++ ) {
-		offset = sprof[i].pr_off;
-		if ( ( offset < pc ) && ( offset > best_offset ) ) {
-			best_index = i;
-			best_offset = offset;
-		}
+	regions = profile->regions[profile_index];
+
+	/* the region starting the closest below pc, else region 0 */
+	lo = 0;
+	hi = profile->num_regions[profile_index];
+	while ( lo < hi ) {
+		mid = ( lo + hi ) / 2;
+		if ( regions[mid].pr_off < pc )
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-
-	if ( best_index == -1 )
-		best_index = 0;
+	if ( lo > 0 )
+		best_index = regions[lo - 1].index;
 
 	posix_profil( pc, &sprof[best_index], profile->flags, over,
 				  profile->threshold[profile_index] );
@@ -492,6 +550,497 @@ _papi_hwi_stop_timer( int timer, int signal )
 
 
 
+/* Overflow sample ring, see extras.h.  The producer side runs in */
+/* signal context, so it must not allocate, lock or block.        */
+
+PapiSampleRing_t *
+_papi_hwi_sample_ring_create( int size )
+{
+	PapiSampleRing_t *ring;
+	unsigned long long bytes = 4096;
+
+	/* round up to a power of two */
+	while ( bytes < ( unsigned long long ) size )
+		bytes <<= 1;
+
+	ring = papi_calloc( 1, sizeof ( PapiSampleRing_t ) );
+	if ( ring == NULL )
+		return NULL;
+
+	ring->data = papi_malloc( ( size_t ) bytes );
+	if ( ring->data == NULL ) {
+		papi_free( ring );
+		return NULL;
+	}
+	ring->mask = bytes - 1;
+
+	return ring;
+}
+
+void
+_papi_hwi_sample_ring_destroy( PapiSampleRing_t * ring )
+{
+	if ( ring == NULL )
+		return;
+	papi_free( ring->data );
+	papi_free( ring );
+}
+
+static void
+ring_copy_in( PapiSampleRing_t * ring, unsigned long long pos,
+			  const void *src, unsigned int len )
+{
+	unsigned long long off = pos & ring->mask;
+	unsigned long long first = ring->mask + 1 - off;
+
+	if ( len <= first ) {
+		memcpy( ring->data + off, src, len );
+	} else {
+		memcpy( ring->data + off, src, first );
+		memcpy( ring->data, ( const char * ) src + first, len - first );
+	}
+}
+
+static void
+ring_copy_out( PapiSampleRing_t * ring, unsigned long long pos,
+			   void *dst, unsigned int len )
+{
+	unsigned long long off = pos & ring->mask;
+	unsigned long long first = ring->mask + 1 - off;
+
+	if ( len <= first ) {
+		memcpy( dst, ring->data + off, len );
+	} else {
+		memcpy( dst, ring->data + off, first );
+		memcpy( ( char * ) dst + first, ring->data, len - first );
+	}
+}
+
+/* Append one record, made of up to two pieces (a component record */
+/* may itself be wrapped around the end of a kernel buffer).       */
+/* Called from the overflow handler of the thread owning the ring. */
+int
+_papi_hwi_sample_ring_put( PapiSampleRing_t * ring, int event_index,
+			   const void *rec, unsigned int len,
+			   const void *rec2, unsigned int len2 )
+{
+	PAPI_sample_record_t hdr;
+	unsigned long long head = ring->head;
+	unsigned long long tail;
+	unsigned int total;
+
+	total = ( unsigned int ) sizeof ( hdr ) + len + len2;
+	total = ( total + 7 ) & ~7U;
+
+	tail = ring->tail;
+	/* don't overwrite anything before the consumer is done with it */
+	__sync_synchronize(  );
+
+	if ( total > ring->mask + 1 - ( head - tail ) ) {
+		ring->dropped++;
+		return PAPI_ENOMEM;
+	}
+
+	hdr.size = total;
+	hdr.event_index = event_index;
+
+	ring_copy_in( ring, head, &hdr, sizeof ( hdr ) );
+	ring_copy_in( ring, head + sizeof ( hdr ), rec, len );
+	if ( len2 )
+		ring_copy_in( ring, head + sizeof ( hdr ) + len, rec2, len2 );
+
+	/* the record must be visible before the new head is */
+	__sync_synchronize(  );
+	ring->head = head + total;
+
+	return PAPI_OK;
+}
+
+/* Copy as many whole records as fit in buf.  Returns the number of */
+/* bytes copied, the number of records is returned in *count.      */
+int
+_papi_hwi_sample_ring_get( PapiSampleRing_t * ring, void *buf,
+			   int bufsiz, int *count )
+{
+	PAPI_sample_record_t *hdr;
+	unsigned long long head, tail = ring->tail;
+	int used = 0, n = 0;
+
+	head = ring->head;
+	/* don't read records before we have seen the head covering them */
+	__sync_synchronize(  );
+
+	while ( tail != head ) {
+		hdr = ( PAPI_sample_record_t * ) ( ring->data + ( tail & ring->mask ) );
+		if ( ( int ) hdr->size > bufsiz - used )
+			break;
+		ring_copy_out( ring, tail, ( char * ) buf + used, hdr->size );
+		used += ( int ) hdr->size;
+		tail += hdr->size;
+		n++;
+	}
+
+	/* we are done reading before the producer may reuse the space */
+	__sync_synchronize(  );
+	ring->tail = tail;
+
+	*count = n;
+	return used;
+}
+
+
+/* Hot spot tables, see extras.h.  Each table is an array indexed */
+/* through open addressing hashes of 64-bit keys.                 */
+
+#define HOTSPOT_BUFSIZ 65536
+
+static unsigned int
+hotspot_hashval( unsigned long long key )
+{
+	return ( unsigned int ) ( ( key * 0x9E3779B97F4A7C15ULL ) >> 32 );
+}
+
+/* value stored for key, -1 if there is none */
+static int
+hotspot_hash_find( PapiHotspotHash_t * h, unsigned long long key )
+{
+	struct _papi_hotspot_slot *s;
+	unsigned int slot;
+
+	if ( h->slots == NULL )
+		return -1;
+
+	for ( slot = hotspot_hashval( key );; slot++ ) {
+		s = &h->slots[slot & h->mask];
+		if ( s->value == 0 )
+			return -1;
+		if ( s->key == key )
+			return s->value - 1;
+	}
+}
+
+/* store value for a key that is not in the table yet */
+static int
+hotspot_hash_add( PapiHotspotHash_t * h, unsigned long long key, int value )
+{
+	struct _papi_hotspot_slot *old = h->slots, *s;
+	unsigned int i, size = h->mask + 1, slot;
+
+	/* keep the table at most half full */
+	if ( ( old == NULL ) || ( 2 * ( unsigned int ) ( h->used + 1 ) > size ) ) {
+		size = ( old == NULL ) ? 256 : 2 * size;
+		s = papi_calloc( size, sizeof ( *s ) );
+		if ( s == NULL )
+			return PAPI_ENOMEM;
+		h->slots = s;
+		h->mask = size - 1;
+		h->used = 0;
+		if ( old ) {
+			for ( i = 0; i < size / 2; i++ ) {
+				if ( old[i].value )
+					hotspot_hash_add( h, old[i].key, old[i].value - 1 );
+			}
+			papi_free( old );
+		}
+	}
+
+	for ( slot = hotspot_hashval( key );; slot++ ) {
+		s = &h->slots[slot & h->mask];
+		if ( s->value == 0 )
+			break;
+	}
+	s->key = key;
+	s->value = value + 1;
+	h->used++;
+
+	return PAPI_OK;
+}
+
+static void
+hotspot_hash_free( PapiHotspotHash_t * h )
+{
+	if ( h->slots )
+		papi_free( h->slots );
+	h->slots = NULL;
+}
+
+/* make room for one more element in an array of max elements */
+static int
+hotspot_grow( void **array, int num, int *max, size_t size )
+{
+	void *bigger;
+	int n;
+
+	if ( num < *max )
+		return PAPI_OK;
+
+	n = ( *max == 0 ) ? 64 : 2 * *max;
+	bigger = papi_realloc( *array, ( size_t ) n * size );
+	if ( bigger == NULL )
+		return PAPI_ENOMEM;
+	*array = bigger;
+	*max = n;
+
+	return PAPI_OK;
+}
+
+/* index of the symbol address ip is in, adding the symbol if needed.  */
+/* Addresses without a symbol are lumped together by library, so that */
+/* stripped code still shows up as one hot spot per DSO.              */
+static int
+hotspot_symbol( PapiHotspots_t * hs, caddr_t ip )
+{
+	PAPI_address_map_t *map = _papi_hwi_system_info.shlib_info.map;
+	struct _papi_hotspot_sym *sym;
+	const char *symbol = "", *dso = "";
+	unsigned long long key;
+	caddr_t address = NULL, base;
+	Dl_info info;
+	int i, m = -1, s;
+
+	s = hotspot_hash_find( &hs->ips, ( unsigned long long ) ( unsigned long ) ip );
+	if ( s >= 0 )
+		return s;
+
+	for ( i = 0; i < _papi_hwi_system_info.shlib_info.count; i++ ) {
+		if ( ( ip >= map[i].text_start ) && ( ip < map[i].text_end ) ) {
+			m = i;
+			dso = map[i].name;
+			address = map[i].text_start;
+			break;
+		}
+	}
+
+	if ( dladdr( ip, &info ) == 0 )
+		memset( &info, 0, sizeof ( info ) );
+	if ( ( m < 0 ) && ( info.dli_fname ) )
+		dso = info.dli_fname;
+
+	if ( ( info.dli_sname ) && ( info.dli_saddr ) ) {
+		symbol = info.dli_sname;
+		address = info.dli_saddr;
+		key = ( unsigned long long ) ( unsigned long ) address;
+	} else {
+		/* keyed on where the library is loaded, map indexes change */
+		/* whenever the shlib info is refreshed                     */
+		base = ( m >= 0 ) ? map[m].text_start : ( caddr_t ) info.dli_fbase;
+		key = ~( unsigned long long ) ( unsigned long ) base;
+	}
+
+	s = hotspot_hash_find( &hs->sym_index, key );
+	if ( s < 0 ) {
+		if ( hotspot_grow( ( void ** ) &hs->syms, hs->num_syms, &hs->max_syms,
+						   sizeof ( *sym ) ) != PAPI_OK )
+			return PAPI_ENOMEM;
+		sym = &hs->syms[hs->num_syms];
+		sym->address = address;
+		sym->symbol = papi_strdup( symbol );
+		sym->dso = papi_strdup( dso );
+		if ( ( sym->symbol == NULL ) || ( sym->dso == NULL ) ||
+			 ( hotspot_hash_add( &hs->sym_index, key, hs->num_syms ) != PAPI_OK ) ) {
+			if ( sym->symbol )
+				papi_free( sym->symbol );
+			if ( sym->dso )
+				papi_free( sym->dso );
+			return PAPI_ENOMEM;
+		}
+		s = hs->num_syms++;
+	}
+
+	if ( hotspot_hash_add( &hs->ips, ( unsigned long long ) ( unsigned long ) ip,
+						   s ) != PAPI_OK )
+		return PAPI_ENOMEM;
+
+	return s;
+}
+
+/* count the current sample against symbol sym of event event_index */
+static int
+hotspot_count( PapiHotspots_t * hs, int sym, int event_index, int self )
+{
+	struct _papi_hotspot_entry *entry;
+	unsigned long long key;
+	int e;
+
+	key = ( ( unsigned long long ) sym << 32 ) | ( unsigned int ) event_index;
+
+	e = hotspot_hash_find( &hs->entry_index, key );
+	if ( e < 0 ) {
+		if ( hotspot_grow( ( void ** ) &hs->entries, hs->num_entries,
+						   &hs->max_entries, sizeof ( *entry ) ) != PAPI_OK )
+			return PAPI_ENOMEM;
+		if ( hotspot_hash_add( &hs->entry_index, key, hs->num_entries ) != PAPI_OK )
+			return PAPI_ENOMEM;
+		e = hs->num_entries++;
+		memset( &hs->entries[e], 0, sizeof ( *entry ) );
+		hs->entries[e].sym = sym;
+		hs->entries[e].event_index = event_index;
+	}
+
+	entry = &hs->entries[e];
+	if ( self )
+		entry->self++;
+	/* recursion puts a symbol on the callchain more than once */
+	if ( entry->last != hs->serial ) {
+		entry->last = hs->serial;
+		entry->total++;
+	}
+
+	return PAPI_OK;
+}
+
+PapiHotspots_t *
+_papi_hwi_hotspots_create( int depth )
+{
+	PapiHotspots_t *hs;
+
+	hs = papi_calloc( 1, sizeof ( PapiHotspots_t ) );
+	if ( hs == NULL )
+		return NULL;
+
+	hs->buf = papi_malloc( HOTSPOT_BUFSIZ );
+	if ( hs->buf == NULL ) {
+		papi_free( hs );
+		return NULL;
+	}
+	hs->bufsiz = HOTSPOT_BUFSIZ;
+	hs->depth = depth;
+
+	return hs;
+}
+
+void
+_papi_hwi_hotspots_destroy( PapiHotspots_t * hs )
+{
+	int i;
+
+	if ( hs == NULL )
+		return;
+
+	for ( i = 0; i < hs->num_syms; i++ ) {
+		papi_free( hs->syms[i].symbol );
+		papi_free( hs->syms[i].dso );
+	}
+	if ( hs->syms )
+		papi_free( hs->syms );
+	if ( hs->entries )
+		papi_free( hs->entries );
+	hotspot_hash_free( &hs->ips );
+	hotspot_hash_free( &hs->sym_index );
+	hotspot_hash_free( &hs->entry_index );
+	papi_free( hs->buf );
+	papi_free( hs );
+}
+
+/* Drain the PAPI_callchain_sample_t records in ring into hs.  The */
+/* address of a sample counts as self for its symbol, the sample   */
+/* counts once in total for every symbol on its callchain.         */
+int
+_papi_hwi_hotspots_update( PapiHotspots_t * hs, PapiSampleRing_t * ring )
+{
+	PAPI_sample_record_t *hdr;
+	PAPI_callchain_sample_t *sample;
+	unsigned long long *callers;
+	int count, off, i, sym, retval;
+
+	if ( ring->head == ring->tail )
+		return PAPI_OK;
+
+	/* libraries may have been loaded since the last update */
+	retval = _papi_os_vector.update_shlib_info( &_papi_hwi_system_info );
+	if ( retval != PAPI_OK )
+		return retval;
+
+	while ( _papi_hwi_sample_ring_get( ring, hs->buf, hs->bufsiz, &count ) ) {
+		for ( off = 0; count > 0; count--, off += ( int ) hdr->size ) {
+			hdr = ( PAPI_sample_record_t * ) ( hs->buf + off );
+			sample = ( PAPI_callchain_sample_t * ) ( hdr + 1 );
+			callers = ( unsigned long long * ) ( sample + 1 );
+
+			hs->serial++;
+
+			sym = hotspot_symbol( hs, ( caddr_t ) ( unsigned long ) sample->ip );
+			if ( sym < 0 )
+				return sym;
+			retval = hotspot_count( hs, sym, hdr->event_index, 1 );
+			if ( retval != PAPI_OK )
+				return retval;
+
+			for ( i = 0; i < sample->nr; i++ ) {
+				sym = hotspot_symbol( hs, ( caddr_t ) ( unsigned long ) callers[i] );
+				if ( sym < 0 )
+					return sym;
+				retval = hotspot_count( hs, sym, hdr->event_index, 0 );
+				if ( retval != PAPI_OK )
+					return retval;
+			}
+		}
+	}
+
+	return PAPI_OK;
+}
+
+static int
+hotspot_compare( const void *a, const void *b )
+{
+	const struct _papi_hotspot_entry *x =
+		*( const struct _papi_hotspot_entry * const * ) a;
+	const struct _papi_hotspot_entry *y =
+		*( const struct _papi_hotspot_entry * const * ) b;
+
+	if ( x->self != y->self )
+		return ( x->self < y->self ) ? 1 : -1;
+	if ( x->total != y->total )
+		return ( x->total < y->total ) ? 1 : -1;
+	return 0;
+}
+
+/* Copy the *count hottest entries to table, by self samples.  With */
+/* a NULL table, just return the number of entries in *count.      */
+int
+_papi_hwi_hotspots_get( PapiHotspots_t * hs, PAPI_hotspot_t * table,
+			int *count )
+{
+	struct _papi_hotspot_entry **sorted;
+	struct _papi_hotspot_sym *sym;
+	int i;
+
+	if ( table == NULL ) {
+		*count = hs->num_entries;
+		return PAPI_OK;
+	}
+
+	if ( *count > hs->num_entries )
+		*count = hs->num_entries;
+	if ( *count <= 0 ) {
+		*count = 0;
+		return PAPI_OK;
+	}
+
+	sorted = papi_malloc( ( size_t ) hs->num_entries * sizeof ( *sorted ) );
+	if ( sorted == NULL )
+		return PAPI_ENOMEM;
+	for ( i = 0; i < hs->num_entries; i++ )
+		sorted[i] = &hs->entries[i];
+	qsort( sorted, ( size_t ) hs->num_entries, sizeof ( *sorted ),
+		   hotspot_compare );
+
+	for ( i = 0; i < *count; i++ ) {
+		sym = &hs->syms[sorted[i]->sym];
+		table[i].address = sym->address;
+		table[i].self = sorted[i]->self;
+		table[i].total = sorted[i]->total;
+		table[i].event_index = sorted[i]->event_index;
+		snprintf( table[i].symbol, PAPI_MAX_STR_LEN, "%s", sym->symbol );
+		snprintf( table[i].dso, PAPI_HUGE_STR_LEN, "%s", sym->dso );
+	}
+
+	papi_free( sorted );
+
+	return PAPI_OK;
+}
+
+
 #if (!defined(HAVE_FFSLL) || defined(__bgp__))
 /* find the first set bit in long long */
 
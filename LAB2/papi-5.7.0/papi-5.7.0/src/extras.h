@@ -11,6 +11,71 @@ int _papi_hwi_dispatch_overflow_signal( void *papiContext, caddr_t address,
 					ThreadInfo_t ** master, int cidx );
 void _papi_hwi_dispatch_profile( EventSetInfo_t * ESI, caddr_t address,
 				 long long over, int profile_index );
+int _papi_hwi_sort_profile_regions( PAPI_sprofil_t * prof, int count,
+				    ProfileRegion_t ** regions, int *num );
 
+/* Single producer, single consumer ring of raw overflow samples.     */
+/* The producer is the overflow signal handler of the thread running */
+/* the EventSet, the consumer is whoever calls PAPI_read_samples().  */
+/* head and tail are free running byte counts; records are multiples */
+/* of 8 bytes so a record header never wraps around the buffer end.  */
+typedef struct _papi_sample_ring {
+	unsigned char *data;
+	unsigned long long mask;		/* size in bytes - 1 */
+	volatile unsigned long long head;	/* written by the producer only */
+	volatile unsigned long long tail;	/* written by the consumer only */
+	volatile long long dropped;		/* records dropped, ring full   */
+} PapiSampleRing_t;
+
+PapiSampleRing_t *_papi_hwi_sample_ring_create( int size );
+void _papi_hwi_sample_ring_destroy( PapiSampleRing_t * ring );
+int _papi_hwi_sample_ring_put( PapiSampleRing_t * ring, int event_index,
+			       const void *rec, unsigned int len,
+			       const void *rec2, unsigned int len2 );
+int _papi_hwi_sample_ring_get( PapiSampleRing_t * ring, void *buf,
+			       int bufsiz, int *count );
+
+/* Symbol table built from the PAPI_callchain_sample_t records a  */
+/* component puts in the sample ring when PAPI_HOTSPOTS is on.   */
+/* It is only updated outside of signal context, by PAPI_stop()  */
+/* and PAPI_get_hotspots(), so it may allocate and call dladdr.  */
+typedef struct _papi_hotspot_hash {
+	struct _papi_hotspot_slot {
+		unsigned long long key;
+		int value;		/* index + 1, 0 if the slot is free */
+	} *slots;
+	unsigned int mask;
+	int used;
+} PapiHotspotHash_t;
+
+typedef struct _papi_hotspots {
+	int depth;			/* callers recorded per sample   */
+	char *buf;			/* samples drained from the ring */
+	int bufsiz;
+	unsigned long long serial;	/* samples aggregated so far     */
+	struct _papi_hotspot_sym {
+		caddr_t address;
+		char *symbol;
+		char *dso;
+	} *syms;
+	int num_syms, max_syms;
+	struct _papi_hotspot_entry {
+		int sym;
+		int event_index;
+		long long self;
+		long long total;
+		unsigned long long last;	/* serial of the last sample counted */
+	} *entries;
+	int num_entries, max_entries;
+	PapiHotspotHash_t ips;		/* address -> sym            */
+	PapiHotspotHash_t sym_index;	/* symbol start -> sym       */
+	PapiHotspotHash_t entry_index;	/* (sym, event) -> entries   */
+} PapiHotspots_t;
+
+PapiHotspots_t *_papi_hwi_hotspots_create( int depth );
+void _papi_hwi_hotspots_destroy( PapiHotspots_t * hs );
+int _papi_hwi_hotspots_update( PapiHotspots_t * hs, PapiSampleRing_t * ring );
+int _papi_hwi_hotspots_get( PapiHotspots_t * hs, PAPI_hotspot_t * table,
+			    int *count );
 
 #endif /* EXTRAS_H */
@@ -88,6 +88,7 @@ const hwi_describe_t _papi_def[] = {
 
 	{PAPI_MULTIPLEX_DEFAULT, "PAPI_MULTIPLEX_DEFAULT", NULL},
 	{PAPI_MULTIPLEX_FORCE_SW, "PAPI_MULTIPLEX_FORCE_SW", NULL},
+	{PAPI_MULTIPLEX_THREAD_TIMER, "PAPI_MULTIPLEX_THREAD_TIMER", NULL},
 
 	{PAPI_DEBUG, "PAPI_DEBUG", NULL},
 	{PAPI_MULTIPLEX, "PAPI_MULTIPLEX", NULL},
@@ -184,7 +185,8 @@ const hwi_describe_t _papi_def[] = {
     /*22 */ {PAPI_EATTR, "PAPI_EATTR", "Invalid or missing event attributes"},
     /*23 */ {PAPI_ECOUNT, "PAPI_ECOUNT", "Too many events or attributes"},
     /*24 */ {PAPI_ECOMBO, "PAPI_ECOMBO", "Bad combination of features"},
-    /*25 */ {PAPI_ECMP_DISABLED, "PAPI_ECMP_DISABLED", "Component containing event is disabled"}
+    /*25 */ {PAPI_ECMP_DISABLED, "PAPI_ECMP_DISABLED", "Component containing event is disabled"},
+    /*26 */ {PAPI_EDELAY_INIT, "PAPI_EDELAY_INIT", "Component initialization delayed until first use"}
 };
 
 
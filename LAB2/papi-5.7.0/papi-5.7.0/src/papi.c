@@ -87,6 +87,8 @@ valid_component( int cidx )
 {
 	if ( _papi_hwi_invalid_cmp( cidx ) )
 		return ( PAPI_ENOCMP );
+	/* a component left for PAPI_LAZY_INIT comes up on first use */
+	_papi_hwi_init_pending_component( cidx );
 	return ( cidx );
 }
 
@@ -96,6 +98,25 @@ valid_ESI_component( EventSetInfo_t * ESI )
 	return ( valid_component( ESI->CmpIdx ) );
 }
 
+/* PAPI_reuse_eventset() hands out parked event sets as if they were new, */
+/* so only those still on the defaults of a new event set are parked      */
+inline_static int
+recyclable_ESI( EventSetInfo_t * ESI )
+{
+	int cidx = ESI->CmpIdx;
+
+	if ( ESI->state & ( PAPI_MULTIPLEXING | PAPI_ATTACHED | PAPI_CPU_ATTACHED ) )
+		return ( 0 );
+	if ( ESI->overflow.event_counter || ESI->profile.event_counter ||
+		 ESI->sample_ring || ESI->hotspots || ESI->inherit.inherit )
+		return ( 0 );
+	if ( cidx < 0 )
+		return ( 1 );
+	return ( ( ESI->domain.domain == _papi_hwd[cidx]->cmp_info.default_domain ) &&
+			 ( ESI->granularity.granularity ==
+			   _papi_hwd[cidx]->cmp_info.default_granularity ) );
+}
+
 /** @class	PAPI_thread_init
  *  @brief Initialize thread support in the PAPI library.
  *
@@ -244,9 +265,14 @@ int
 PAPI_unregister_thread( void )
 {
 	ThreadInfo_t *thread = _papi_hwi_lookup_thread( 0 );
+	int retval;
 
-	if ( thread )
-		papi_return( _papi_hwi_shutdown_thread( thread, 0 ) );
+	if ( thread ) {
+		retval = _papi_hwi_shutdown_thread( thread, 0 );
+		/* Let a new thread reuse our memory pool */
+		papi_mem_thread_exit(  );
+		papi_return( retval );
+	}
 
 	papi_return( PAPI_EMISC );
 }
@@ -480,6 +506,13 @@ PAPI_set_thr_specific( int tag, void *ptr )
  *	It must be called before any low level PAPI functions can be used. 
  *	If your application is making use of threads PAPI_thread_init must also be 
  *	called prior to making any calls to the library other than PAPI_library_init() . 
+ *
+ *	If the environment variable PAPI_LAZY_INIT is set (to anything but 0),
+ *	only the cpu component is initialized here.  Every other component 
+ *	reports PAPI_EDELAY_INIT as its disabled value until it is first used: 
+ *	an event name that may belong to it is resolved, its events are 
+ *	enumerated, its component info or options are asked for, or an 
+ *	event set is assigned to it. 
  *	@par Examples:
  *	@code
  *		int retval;
@@ -798,8 +831,9 @@ PAPI_get_component_info( int cidx )
 	APIDBG( "Entry: Component Index %d\n", cidx);
 	if ( _papi_hwi_invalid_cmp( cidx ) )
 		return ( NULL );
-	else
-		return ( &( _papi_hwd[cidx]->cmp_info ) );
+
+	_papi_hwi_init_pending_component( cidx );
+	return ( &( _papi_hwd[cidx]->cmp_info ) );
 }
 
 /* PAPI_get_event_info:
@@ -1366,7 +1400,7 @@ PAPI_enum_cmp_event( int *EventCode, int modifier, int cidx )
 		return PAPI_ENOCMP;
 	}
 
-	if (_papi_hwd[cidx]->cmp_info.disabled) {
+	if (_papi_hwi_init_pending_component(cidx)) {
 	  return PAPI_ENOCMP;
 	}
 
@@ -1443,7 +1477,8 @@ PAPI_enum_cmp_event( int *EventCode, int modifier, int cidx )
  *		The argument handle has not been initialized to PAPI_NULL or the argument is a NULL pointer.
  *
  *	@exception PAPI_ENOMEM 
- *		Insufficient memory to complete the operation. 
+ *		Insufficient memory to complete the operation, or 262144 EventSets
+ *		(parked ones included) already exist. 
  *
  *	@par Examples:
  *	@code
@@ -2038,6 +2073,190 @@ PAPI_destroy_eventset( int *EventSet )
 	return PAPI_OK;
 }
 
+/** @class PAPI_recycle_eventset
+ *	@brief Park an event set for reuse instead of destroying it.
+ *
+ *	@par C Interface:
+ *	\#include <papi.h> @n
+ *	int PAPI_recycle_eventset( int * EventSet );
+ *
+ *	PAPI_recycle_eventset() is what a code that creates an event set for
+ *	every request it measures calls instead of PAPI_cleanup_eventset() and
+ *	PAPI_destroy_eventset().  The event set keeps its events and the
+ *	counters the component set up for it (for perf_event, its open file
+ *	descriptors), and is parked with the calling thread, which gets it back
+ *	from PAPI_reuse_eventset() without setting anything up again.  Until
+ *	then the event set can not be used.  Each thread parks at most 16 event
+ *	sets, past that they are destroyed.  Empty event sets are destroyed too,
+ *	and so are event sets that do not have the default options (multiplexed,
+ *	attached, bound to a CPU, inheriting, with their own domain, granularity,
+ *	overflow, profiling or sampling), as a reused event set must be the same
+ *	as a new one.
+ *
+ *	@param *EventSet
+ *		A pointer to the integer handle of a stopped event set created by
+ *		the calling thread.  Set to PAPI_NULL.
+ *
+ *	@retval PAPI_EINVAL
+ *		The event set belongs to another thread, or is overflowing or
+ *		profiling.
+ *	@retval PAPI_ENOEVST
+ *		The EventSet specified does not exist.
+ *	@retval PAPI_EISRUN
+ *		The EventSet is currently counting events.
+ *
+ *	@par Examples:
+ *	@code
+ *	int Events[2] = { PAPI_TOT_INS, PAPI_TOT_CYC };
+ *	int EventSet = PAPI_NULL;
+ *	// per request
+ *	if ( PAPI_reuse_eventset( &EventSet, Events, 2 ) != PAPI_OK )
+ *	handle_error( 1 );
+ *	PAPI_start( EventSet );
+ *	...
+ *	PAPI_stop( EventSet, values );
+ *	PAPI_recycle_eventset( &EventSet );
+ *	@endcode
+ *
+ *	@see PAPI_reuse_eventset @n
+ *	PAPI_destroy_eventset
+ */
+int
+PAPI_recycle_eventset( int *EventSet )
+{
+	APIDBG("Entry: EventSet: %p, *EventSet: %d\n", EventSet, *EventSet);
+
+	EventSetInfo_t *ESI;
+	ThreadInfo_t *thread;
+	int retval;
+
+	if ( EventSet == NULL )
+		papi_return( PAPI_EINVAL );
+
+	ESI = _papi_hwi_lookup_EventSet( *EventSet );
+	if ( ESI == NULL )
+		papi_return( PAPI_ENOEVST );
+
+	if ( !( ESI->state & PAPI_STOPPED ) )
+		papi_return( PAPI_EISRUN );
+
+	if ( ESI->state & ( PAPI_OVERFLOWING | PAPI_PROFILING ) )
+		papi_return( PAPI_EINVAL );
+
+	/* the counters were set up for the thread that created it */
+	thread = _papi_hwi_lookup_thread( 0 );
+	if ( ( thread == NULL ) || ( ESI->master != thread ) )
+		papi_return( PAPI_EINVAL );
+
+	if ( ( ESI->NumberOfEvents == 0 ) || !recyclable_ESI( ESI ) ||
+		 ( thread->num_recycled_eventsets == PAPI_RECYCLE_MAX ) ) {
+		retval = PAPI_cleanup_eventset( *EventSet );
+		if ( retval != PAPI_OK )
+			papi_return( retval );
+		return PAPI_destroy_eventset( EventSet );
+	}
+
+	ESI->recycled = 1;
+	ESI->next_recycled = thread->recycled_eventsets;
+	thread->recycled_eventsets = ESI;
+	thread->num_recycled_eventsets++;
+
+	*EventSet = PAPI_NULL;
+
+	return PAPI_OK;
+}
+
+/** @class PAPI_reuse_eventset
+ *	@brief Get an event set with the given events, reusing a parked one if possible.
+ *
+ *	@par C Interface:
+ *	\#include <papi.h> @n
+ *	int PAPI_reuse_eventset( int * EventSet, int * Events, int number );
+ *
+ *	PAPI_reuse_eventset() looks for an event set the calling thread parked
+ *	with PAPI_recycle_eventset() that has exactly the given events, in the
+ *	same order, and hands it back ready to start.  If there is none, it
+ *	creates a new event set and adds the events to it, like
+ *	PAPI_create_eventset() followed by PAPI_add_events().
+ *
+ *	@param *EventSet
+ *		Address of an integer set to PAPI_NULL, receives the event set.
+ *	@param *Events
+ *		An array of preset or native event codes.
+ *	@param number
+ *		The number of events in Events.
+ *
+ *	@retval PAPI_EINVAL
+ *		One or more of the arguments is invalid.
+ *	@retval PAPI_ENOINIT
+ *		The library has not been initialized.
+ *	@retval PAPI_ENOMEM
+ *		Insufficient memory to complete the operation.
+ *	@retval PAPI_ENOEVNT
+ *		One of the events is not available.
+ *	@retval PAPI_ECNFLCT
+ *		The events can not be counted together.
+ *
+ *	@see PAPI_recycle_eventset @n
+ *	PAPI_create_eventset @n
+ *	PAPI_add_events
+ */
+int
+PAPI_reuse_eventset( int *EventSet, int *Events, int number )
+{
+	APIDBG("Entry: EventSet: %p, Events: %p, number: %d\n",
+		EventSet, Events, number);
+
+	EventSetInfo_t *ESI, **prev;
+	ThreadInfo_t *thread;
+	int i, retval;
+
+	if ( init_level == PAPI_NOT_INITED )
+		papi_return( PAPI_ENOINIT );
+
+	if ( ( EventSet == NULL ) || ( *EventSet != PAPI_NULL ) ||
+		 ( Events == NULL ) || ( number <= 0 ) )
+		papi_return( PAPI_EINVAL );
+
+	retval = _papi_hwi_lookup_or_create_thread( &thread, 0 );
+	if ( retval )
+		papi_return( retval );
+
+	for ( prev = &thread->recycled_eventsets; ( ESI = *prev ) != NULL;
+		  prev = &ESI->next_recycled ) {
+		if ( ESI->NumberOfEvents != number )
+			continue;
+		for ( i = 0; i < number; i++ ) {
+			if ( ESI->EventInfoArray[i].event_code !=
+				 ( unsigned int ) Events[i] )
+				break;
+		}
+		if ( i < number )
+			continue;
+
+		*prev = ESI->next_recycled;
+		thread->num_recycled_eventsets--;
+		ESI->next_recycled = NULL;
+		ESI->recycled = 0;
+		*EventSet = ESI->EventSetIndex;
+		return PAPI_OK;
+	}
+
+	retval = _papi_hwi_create_eventset( EventSet, thread );
+	if ( retval != PAPI_OK )
+		papi_return( retval );
+
+	retval = PAPI_add_events( *EventSet, Events, number );
+	if ( retval != PAPI_OK ) {
+		PAPI_cleanup_eventset( *EventSet );
+		PAPI_destroy_eventset( EventSet );
+		/* a positive value is the number of events that were added */
+		papi_return( ( retval < PAPI_OK ) ? retval : PAPI_ECNFLCT );
+	}
+
+	return PAPI_OK;
+}
+
 /* simply checks for valid EventSet, calls component start() call */
 /** @class PAPI_start
  *	@brief Start counting hardware events in an event set.
@@ -2141,7 +2360,7 @@ PAPI_start( int EventSet )
 	   call John May's code. */
 
 	if ( _papi_hwi_is_sw_multiplex( ESI ) ) {
-	   retval = MPX_start( ESI->multiplex.mpx_evset );
+	   retval = MPX_start( ESI->multiplex.mpx_evset, ESI->multiplex.flags );
 	   if ( retval != PAPI_OK ) {
 	      papi_return( retval );
 	   }
@@ -2359,9 +2578,11 @@ PAPI_stop( int EventSet, long long *values )
 		memcpy( values, ESI->sw_stop,
 				( size_t ) ESI->NumberOfEvents * sizeof ( long long ) );
 
-	/* If kernel profiling is in use, flush and process the kernel buffer */
+	/* If kernel profiling is in use, flush and process the kernel buffer. */
+	/* Same for samples still on their way to a sample ring.              */
 
-	if ( ESI->state & PAPI_PROFILING ) {
+	if ( ( ESI->state & PAPI_PROFILING ) ||
+		 ( ( ESI->sample_ring ) && ( ESI->state & PAPI_OVERFLOWING ) ) ) {
 		if ( _papi_hwd[cidx]->cmp_info.kernel_profile &&
 			 !( ESI->profile.flags & PAPI_PROFIL_FORCE_SW ) ) {
 			retval = _papi_hwd[cidx]->stop_profiling( ESI->master, ESI );
@@ -2394,6 +2615,15 @@ PAPI_stop( int EventSet, long long *values )
 	} else {
 		ESI->CpuInfo->running_eventset[cidx] = NULL;
 	}
+
+	/* Turn the samples of this run into symbols while the libraries */
+	/* they were taken in are still loaded.  The set is stopped      */
+	/* either way, a failure here only loses this run's hot spots.   */
+	if ( ESI->hotspots ) {
+		retval = _papi_hwi_hotspots_update( ESI->hotspots, ESI->sample_ring );
+		if ( retval != PAPI_OK )
+			papi_return( retval );
+	}
 	
 #if defined(DEBUG)
 	if ( _papi_hwi_debug & DEBUG_API ) {
@@ -2602,6 +2832,403 @@ PAPI_read( int EventSet, long long *values )
 	return ( PAPI_OK );
 }
 
+/** @class PAPI_read_many
+ *  @brief Read hardware counters from several event sets at once.
+ *	
+ *  @par C Interface:
+ *  \#include <papi.h> @n
+ *  int PAPI_read_many(int *EventSets, int n, long_long **values );
+ *
+ *  PAPI_read_many() copies the counters of each of the n indicated event
+ *  sets into the array provided for it, values[i] receiving the counts of
+ *  EventSets[i].  The result is the same as calling PAPI_read() on every
+ *  event set, but all of the event sets are validated up front and the
+ *  running ones are handed to their component together, so a component
+ *  that can read several event sets in one pass (such as perf_event) does
+ *  so and the values are taken closer together in time.
+ *
+ *  The counters continue counting after the read. 
+ *
+ *  @param[in] *EventSets
+ *     -- an array of n integer handles for PAPI Event Sets as created 
+ *        by PAPI_create_eventset()
+ *  @param[in] n
+ *     -- the number of event sets in EventSets
+ *  @param[out] **values 
+ *     -- an array of n arrays to hold the counter values of each event set
+ *
+ *  @retval PAPI_EINVAL 
+ *	    One or more of the arguments is invalid.
+ *  @retval PAPI_ENOMEM
+ *	    Insufficient memory to complete the operation.
+ *  @retval PAPI_ESYS 
+ *	    A system or C library call failed inside PAPI, see the 
+ *          errno variable.
+ *  @retval PAPI_ENOEVST 
+ *	    One of the event sets specified does not exist. 
+ *	
+ * @par Examples
+ * @code
+ * int sets[2] = { EventSet1, EventSet2 };
+ * long long *values[2] = { values1, values2 };
+ * if (PAPI_read_many(sets, 2, values) != PAPI_OK)
+ *    handle_error(1);
+ * @endcode
+ *
+ * @see PAPI_read 
+ * @see PAPI_start 
+ * @see PAPI_stop 
+ */
+int
+PAPI_read_many( int *EventSets, int n, long long **values )
+{
+	APIDBG( "Entry: EventSets: %p, n: %d, values: %p\n", EventSets, n, values);
+	EventSetInfo_t *ESI_stack[PAPI_READ_MANY_STACK];
+	EventSetInfo_t *group_stack[PAPI_READ_MANY_STACK];
+	hwd_context_t *context_stack[PAPI_READ_MANY_STACK];
+	long long *group_values_stack[PAPI_READ_MANY_STACK];
+	EventSetInfo_t **ESI = ESI_stack, **group = group_stack;
+	hwd_context_t **context = context_stack;
+	long long **group_values = group_values_stack;
+	int i, cidx, num, retval = PAPI_OK;
+
+	if ( ( EventSets == NULL ) || ( values == NULL ) || ( n <= 0 ) )
+		papi_return( PAPI_EINVAL );
+
+	/* this is called once per sample, so only big calls allocate */
+	if ( n > PAPI_READ_MANY_STACK ) {
+		ESI = papi_calloc( ( size_t ) n, sizeof ( EventSetInfo_t * ) );
+		group = papi_calloc( ( size_t ) n, sizeof ( EventSetInfo_t * ) );
+		context = papi_calloc( ( size_t ) n, sizeof ( hwd_context_t * ) );
+		group_values = papi_calloc( ( size_t ) n, sizeof ( long long * ) );
+		if ( ( ESI == NULL ) || ( group == NULL ) || ( context == NULL ) ||
+			 ( group_values == NULL ) ) {
+			retval = PAPI_ENOMEM;
+			goto read_many_done;
+		}
+	}
+
+	/* validate everything before we read anything */
+	for ( i = 0; i < n; i++ ) {
+		ESI[i] = _papi_hwi_lookup_EventSet( EventSets[i] );
+		if ( ESI[i] == NULL ) {
+			retval = PAPI_ENOEVST;
+			goto read_many_done;
+		}
+
+		cidx = valid_ESI_component( ESI[i] );
+		if ( cidx < 0 ) {
+			retval = cidx;
+			goto read_many_done;
+		}
+
+		if ( values[i] == NULL ) {
+			retval = PAPI_EINVAL;
+			goto read_many_done;
+		}
+	}
+
+	/* stopped and software multiplexed event sets are read directly */
+	for ( i = 0; i < n; i++ ) {
+		if ( !( ESI[i]->state & PAPI_RUNNING ) ) {
+			memcpy( values[i], ESI[i]->sw_stop,
+					( size_t ) ESI[i]->NumberOfEvents * sizeof ( long long ) );
+			ESI[i] = NULL;
+		} else if ( _papi_hwi_is_sw_multiplex( ESI[i] ) ) {
+			retval = MPX_read( ESI[i]->multiplex.mpx_evset, values[i], 0 );
+			if ( retval != PAPI_OK )
+				goto read_many_done;
+			ESI[i] = NULL;
+		}
+	}
+
+	/* hand the rest to their components, one component at a time */
+	for ( cidx = 0; cidx < papi_num_components; cidx++ ) {
+		num = 0;
+		for ( i = 0; i < n; i++ ) {
+			if ( ( ESI[i] == NULL ) || ( ESI[i]->CmpIdx != cidx ) )
+				continue;
+			group[num] = ESI[i];
+			group_values[num] = values[i];
+			/* get the context we should use for this event set */
+			context[num] = _papi_hwi_get_context( ESI[i], NULL );
+			num++;
+		}
+		if ( num == 0 )
+			continue;
+
+		retval = _papi_hwi_read_many( context, group, num, group_values );
+		if ( retval != PAPI_OK )
+			goto read_many_done;
+	}
+
+read_many_done:
+	if ( ESI != ESI_stack ) {
+		papi_free( group_values );
+		papi_free( context );
+		papi_free( group );
+		papi_free( ESI );
+	}
+
+	APIDBG( "PAPI_read_many returns %d\n", retval );
+	papi_return( retval );
+}
+
+/** @class PAPI_read_cpus
+ *  @brief Read the counters of an event set separately for every cpu it counts on.
+ *	
+ *  @par C Interface:
+ *  \#include <papi.h> @n
+ *  int PAPI_read_cpus(int EventSet, long_long *values, int *cpus, int *num_cpus );
+ *
+ *  PAPI_read() of an event set with PAPI_GRN_SYS_CPU granularity returns
+ *  the counts summed over all of the cpus of the node.  PAPI_read_cpus()
+ *  returns them cpu by cpu instead: values is filled with one row per cpu,
+ *  each row holding the values of all of the events of the event set in
+ *  the order PAPI_read() returns them, and cpus[i] is the cpu of row i.
+ *  An event set counting on one cpu, or not bound to any (cpu -1), is
+ *  returned as a single row.
+ *
+ *  The counters continue counting after the read.  A stopped event set
+ *  returns the counts it had when it was stopped.
+ *
+ *  @param EventSet
+ *     -- an integer handle for a PAPI Event Set as created 
+ *        by PAPI_create_eventset()
+ *  @param[out] *values 
+ *     -- room for *num_cpus rows of counter values
+ *  @param[out] *cpus
+ *     -- room for the cpu of each of the *num_cpus rows, may be NULL
+ *  @param[in,out] *num_cpus
+ *     -- the number of rows there is room for; on return the number of 
+ *        cpus the event set counts on
+ *
+ *  @retval PAPI_EINVAL 
+ *	    One or more of the arguments is invalid, or the event set is 
+ *          software multiplexed.
+ *  @retval PAPI_EBUF
+ *	    There is room for fewer rows than the event set has cpus, 
+ *          *num_cpus is set to the number needed and nothing is copied.
+ *  @retval PAPI_ECMP
+ *	    The component of the event set cannot read it cpu by cpu.
+ *  @retval PAPI_ESYS 
+ *	    A system or C library call failed inside PAPI, see the 
+ *          errno variable.
+ *  @retval PAPI_ENOEVST 
+ *	    The event set specified does not exist. 
+ *	
+ * @par Examples
+ * @code
+ * int ncpus = PAPI_get_opt( PAPI_MAX_CPUS, NULL );
+ * long long *values = malloc( ncpus * num_events * sizeof ( long long ) );
+ * int *cpus = malloc( ncpus * sizeof ( int ) );
+ * if (PAPI_read_cpus(EventSet, values, cpus, &ncpus) != PAPI_OK)
+ *    handle_error(1);
+ * for ( i = 0; i < ncpus; i++ )
+ *    printf( "cpu %d: %lld\n", cpus[i], values[i * num_events] );
+ * @endcode
+ *
+ * @see PAPI_read 
+ * @see PAPI_set_opt 
+ */
+int
+PAPI_read_cpus( int EventSet, long long *values, int *cpus, int *num_cpus )
+{
+	APIDBG( "Entry: EventSet: %d, values: %p, cpus: %p, num_cpus: %p\n",
+			EventSet, values, cpus, num_cpus);
+	EventSetInfo_t *ESI;
+	hwd_context_t *context;
+	int cidx, retval;
+
+	ESI = _papi_hwi_lookup_EventSet( EventSet );
+	if ( ESI == NULL )
+		papi_return( PAPI_ENOEVST );
+
+	cidx = valid_ESI_component( ESI );
+	if ( cidx < 0 )
+		papi_return( cidx );
+
+	if ( ( values == NULL ) || ( num_cpus == NULL ) || ( *num_cpus <= 0 ) )
+		papi_return( PAPI_EINVAL );
+
+	if ( _papi_hwi_is_sw_multiplex( ESI ) )
+		papi_return( PAPI_EINVAL );
+
+	/* get the context we should use for this event set */
+	context = _papi_hwi_get_context( ESI, NULL );
+	retval = _papi_hwi_read_cpus( context, ESI, values, cpus, num_cpus );
+
+	APIDBG( "PAPI_read_cpus returns %d\n", retval );
+	papi_return( retval );
+}
+
+/** @class PAPI_read_samples
+ *  @brief Drain overflow samples queued for an event set.
+ *	
+ *  @par C Interface:
+ *  \#include <papi.h> @n
+ *  int PAPI_read_samples(int EventSet, void *buf, int bufsiz, int *count, long long *dropped );
+ *
+ *  When an event set has been given a sample ring with 
+ *  PAPI_set_opt(PAPI_SAMPLE_RING, ...), its overflow signal handler does
+ *  not call the overflow handler or update profiling buffers.  It only
+ *  copies each sample, as received from the component, into the ring.
+ *  PAPI_read_samples() moves as many whole samples as fit in buf out
+ *  of the ring.
+ *
+ *  Each sample starts with a PAPI_sample_record_t giving its size and the
+ *  index of the event that overflowed, followed by the component's record;
+ *  for perf_event this is the kernel's PERF_RECORD_SAMPLE or 
+ *  PERF_RECORD_LOST record, so samples the kernel had to drop are
+ *  reported too.
+ *  Event sets using PAPI_set_opt(PAPI_HOTSPOTS, ...) get a 
+ *  PAPI_callchain_sample_t and its callers instead, see PAPI_get_hotspots.
+ *
+ *  The ring has exactly one writer (the thread running the event set)
+ *  and one reader, so PAPI_read_samples() takes no locks and may be 
+ *  called from another thread while the event set is running, as long
+ *  as only one thread drains a given event set.
+ *
+ *  @param[in] EventSet
+ *     -- an integer handle for a PAPI Event Set with a sample ring
+ *  @param[out] *buf
+ *     -- buffer receiving the samples
+ *  @param[in] bufsiz
+ *     -- size of buf in bytes
+ *  @param[out] *count
+ *     -- number of samples copied to buf
+ *  @param[out] *dropped
+ *     -- if not NULL, the number of samples dropped so far because
+ *        the ring was full
+ *
+ *  @retval PAPI_EINVAL 
+ *	    One or more of the arguments is invalid, or the event set has
+ *	    no sample ring.
+ *  @retval PAPI_ENOEVST 
+ *	    The event set specified does not exist. 
+ *	
+ * @par Examples
+ * @code
+ * PAPI_option_t opt;
+ * char buf[65536];
+ * int count;
+ * opt.sample_ring.eventset = EventSet;
+ * opt.sample_ring.size = 1 << 20;
+ * if (PAPI_set_opt(PAPI_SAMPLE_RING, &opt) != PAPI_OK)
+ *    handle_error(1);
+ * ...
+ * if (PAPI_read_samples(EventSet, buf, sizeof(buf), &count, NULL) != PAPI_OK)
+ *    handle_error(1);
+ * @endcode
+ *
+ * @see PAPI_overflow 
+ * @see PAPI_set_opt 
+ */
+int
+PAPI_read_samples( int EventSet, void *buf, int bufsiz, int *count,
+				   long long *dropped )
+{
+	APIDBG( "Entry: EventSet: %d, buf: %p, bufsiz: %d, count: %p, dropped: %p\n",
+			EventSet, buf, bufsiz, count, dropped );
+	EventSetInfo_t *ESI;
+
+	ESI = _papi_hwi_lookup_EventSet( EventSet );
+	if ( ESI == NULL )
+		papi_return( PAPI_ENOEVST );
+
+	if ( ( ESI->sample_ring == NULL ) || ( buf == NULL ) ||
+		 ( bufsiz <= 0 ) || ( count == NULL ) )
+		papi_return( PAPI_EINVAL );
+
+	_papi_hwi_sample_ring_get( ESI->sample_ring, buf, bufsiz, count );
+
+	if ( dropped )
+		*dropped = ESI->sample_ring->dropped;
+
+	return ( PAPI_OK );
+}
+
+/** @class PAPI_get_hotspots
+ *  @brief Get the symbols the samples of an event set fell in.
+ *	
+ *  @par C Interface:
+ *  \#include <papi.h> @n
+ *  int PAPI_get_hotspots(int EventSet, PAPI_hotspot_t *table, int *count );
+ *
+ *  An event set sampling with PAPI_set_opt(PAPI_HOTSPOTS, ...) queues the
+ *  address, thread and callchain of every overflow in its sample ring,
+ *  as a PAPI_callchain_sample_t.  PAPI_stop() and PAPI_get_hotspots()
+ *  drain the ring and look each address up, with dladdr() and the map of 
+ *  the libraries loaded (see PAPI_get_shared_lib_info), adding the sample
+ *  to the symbol it was taken in (self) and to every symbol on its
+ *  callchain (total).  Addresses without a symbol are counted against the
+ *  library they are in, with an empty symbol name.  Symbols of the 
+ *  executable itself are only found if it was linked with -rdynamic.
+ *
+ *  The table has one row per symbol and overflowing event, hottest first,
+ *  and keeps growing until PAPI_HOTSPOTS is set again.  Samples drained 
+ *  with PAPI_read_samples(), for instance to write flame graph stacks,
+ *  are not counted.
+ *
+ *  @param[in] EventSet
+ *     -- an integer handle for a PAPI Event Set using PAPI_HOTSPOTS
+ *  @param[out] *table
+ *     -- array of *count rows receiving the hottest symbols, may be NULL
+ *  @param[in,out] *count
+ *     -- number of rows in table, on return the number of rows filled,
+ *        or the number of rows there are if table is NULL
+ *
+ *  @retval PAPI_EINVAL 
+ *	    One or more of the arguments is invalid, or the event set does 
+ *	    not use PAPI_HOTSPOTS.
+ *  @retval PAPI_ENOEVST 
+ *	    The event set specified does not exist. 
+ *  @retval PAPI_ENOMEM 
+ *	    There was not enough memory to add the new symbols.
+ *	
+ * @par Examples
+ * @code
+ * PAPI_option_t opt;
+ * PAPI_hotspot_t top[10];
+ * int i, count = 10;
+ * opt.hotspots.eventset = EventSet;
+ * opt.hotspots.size = 1 << 20;
+ * opt.hotspots.depth = 32;
+ * if (PAPI_set_opt(PAPI_HOTSPOTS, &opt) != PAPI_OK)
+ *    handle_error(1);
+ * ...
+ * if (PAPI_get_hotspots(EventSet, top, &count) != PAPI_OK)
+ *    handle_error(1);
+ * for (i = 0; i < count; i++)
+ *    printf("%lld %lld %s %s\n", top[i].self, top[i].total, top[i].symbol, top[i].dso);
+ * @endcode
+ *
+ * @see PAPI_overflow 
+ * @see PAPI_read_samples
+ * @see PAPI_set_opt 
+ */
+int
+PAPI_get_hotspots( int EventSet, PAPI_hotspot_t *table, int *count )
+{
+	APIDBG( "Entry: EventSet: %d, table: %p, count: %p\n",
+			EventSet, table, count );
+	EventSetInfo_t *ESI;
+	int retval;
+
+	ESI = _papi_hwi_lookup_EventSet( EventSet );
+	if ( ESI == NULL )
+		papi_return( PAPI_ENOEVST );
+
+	if ( ( ESI->hotspots == NULL ) || ( count == NULL ) )
+		papi_return( PAPI_EINVAL );
+
+	retval = _papi_hwi_hotspots_update( ESI->hotspots, ESI->sample_ring );
+	if ( retval != PAPI_OK )
+		papi_return( retval );
+
+	papi_return( _papi_hwi_hotspots_get( ESI->hotspots, table, count ) );
+}
+
 /** @class PAPI_read_ts
  *  @brief Read hardware counters with a timestamp.
  *	
@@ -3323,6 +3950,11 @@ PAPI_detach( int EventSet )
  *	else if (ret != PAPI_OK) handle_error(ret);
  *	@endcode
  *
+ *	PAPI_set_multiplex uses PAPI_MULTIPLEX_DEFAULT. To force software multiplexing
+ *	call PAPI_set_opt with PAPI_MULTIPLEX and ptr->multiplex.flags set to
+ *	PAPI_MULTIPLEX_FORCE_SW, or to PAPI_MULTIPLEX_THREAD_TIMER to have each thread
+ *	rotate its own events from a private POSIX timer instead of the process wide itimer.
+ *
  *	@see  PAPI_multiplex_init
  *	@see  PAPI_get_multiplex
  *	@see  PAPI_set_opt
@@ -3427,6 +4059,16 @@ PAPI_set_multiplex( int EventSet )
  * PAPI_GRANUL		Set granularity for EventSet specified in ptr->granularity.eventset. 
  *					Will error if eventset is not bound to a component.
  * PAPI_INHERIT		Enable or disable inheritance for specified EventSet.
+ * PAPI_SAMPLE_RING	Queue the overflow samples of the EventSet in ptr->sample_ring.eventset in a ring of
+ *					ptr->sample_ring.size bytes instead of dispatching them, see PAPI_read_samples.
+ * PAPI_HOTSPOTS	Like PAPI_SAMPLE_RING with ptr->hotspots.size and ptr->hotspots.eventset, but each sample
+ *					also records the thread and up to ptr->hotspots.depth callers, and PAPI_stop
+ *					aggregates the samples by symbol, see PAPI_get_hotspots.
+ * PAPI_VIRTUAL_START	If ptr->virtual_start.enable is set, the counters of EventSet ptr->virtual_start.eventset
+ *					stay enabled once started and PAPI_start, PAPI_stop and PAPI_reset only take
+ *					user space snapshots. Only used when every event can be read with rdpmc.
+ *					A stopped EventSet stays enabled and competes with other EventSets and processes
+ *					for the hardware counters until it is cleaned up or the option is turned off.
  * PAPI_DATA_ADDRESS	Set data address range to restrict event counting for EventSet specified
  *					in ptr->addr.eventset. Starting and ending addresses are specified in
  *					ptr->addr.start and ptr->addr.end, respectively. If exact addresses
@@ -3451,6 +4093,16 @@ PAPI_set_multiplex( int EventSet )
  * <tr><td>PAPI_DOMAIN</td><td>Set domain for EventSet specified in ptr->domain.eventset. Will error if eventset is not bound to a component.</td></tr>
  * <tr><td>PAPI_GRANUL</td><td>Set granularity for EventSet specified in ptr->granularity.eventset. Will error if eventset is not bound to a component.</td></tr>
  * <tr><td>PAPI_INHERIT</td><td>Enable or disable inheritance for specified EventSet.</td></tr>
+ * <tr><td>PAPI_SAMPLE_RING</td><td>Queue the overflow samples of the EventSet in ptr->sample_ring.eventset in a ring of
+ *		ptr->sample_ring.size bytes instead of dispatching them, see PAPI_read_samples.</td></tr>
+ * <tr><td>PAPI_HOTSPOTS</td><td>Like PAPI_SAMPLE_RING with ptr->hotspots.size and ptr->hotspots.eventset, but each sample
+ *		also records the thread and up to ptr->hotspots.depth callers, and PAPI_stop
+ *		aggregates the samples by symbol, see PAPI_get_hotspots.</td></tr>
+ * <tr><td>PAPI_VIRTUAL_START</td><td>If ptr->virtual_start.enable is set, the counters of EventSet ptr->virtual_start.eventset
+ *		stay enabled once started and PAPI_start, PAPI_stop and PAPI_reset only take
+ *		user space snapshots. Only used when every event can be read with rdpmc.
+ *		A stopped EventSet stays enabled and competes with other EventSets and processes
+ *		for the hardware counters until it is cleaned up or the option is turned off.</td></tr>
  * <tr><td>PAPI_DATA_ADDRESS</td><td>Set data address range to restrict event counting for EventSet specified in ptr->addr.eventset. Starting and ending addresses are specified in ptr->addr.start and ptr->addr.end, respectively. If exact addresses cannot be instantiated, offsets are returned in ptr->addr.start_off and ptr->addr.end_off. Currently implemented on Itanium only.</td></tr>
  * <tr><td>PAPI_INSTR_ADDRESS</td><td>Set instruction address range as described above. Itanium only.</td></tr>
  * </table>
@@ -3663,7 +4315,8 @@ PAPI_set_opt( int option, PAPI_option_t * ptr )
 		internal.multiplex.ns = ( unsigned long ) ptr->multiplex.ns;
 		internal.multiplex.flags = ptr->multiplex.flags;
 		if ( ( _papi_hwd[cidx]->cmp_info.kernel_multiplex ) &&
-			 ( ( ptr->multiplex.flags & PAPI_MULTIPLEX_FORCE_SW ) == 0 ) ) {
+			 ( ( ptr->multiplex.flags &
+				 ( PAPI_MULTIPLEX_FORCE_SW | PAPI_MULTIPLEX_THREAD_TIMER ) ) == 0 ) ) {
 			/* get the context we should use for this event set */
 			context = _papi_hwi_get_context( ESI, NULL );
 			retval = _papi_hwd[cidx]->ctl( context, PAPI_MULTIPLEX, &internal );
@@ -3849,6 +4502,122 @@ PAPI_set_opt( int option, PAPI_option_t * ptr )
 		ESI->inherit.inherit = ptr->inherit.inherit;
 		return ( retval );
 	}
+	case PAPI_SAMPLE_RING:
+	{
+		EventSetInfo_t *ESI;
+		PapiSampleRing_t *ring = NULL;
+
+		if ( ptr->sample_ring.size < 0 )
+			papi_return( PAPI_EINVAL );
+
+		ESI = _papi_hwi_lookup_EventSet( ptr->sample_ring.eventset );
+		if ( ESI == NULL )
+			papi_return( PAPI_ENOEVST );
+
+		cidx = valid_ESI_component( ESI );
+		if ( cidx < 0 )
+			papi_return( cidx );
+
+		if ( ( ESI->state & PAPI_STOPPED ) == 0 )
+			papi_return( PAPI_EISRUN );
+
+		if ( ptr->sample_ring.size > 0 ) {
+			ring = _papi_hwi_sample_ring_create( ptr->sample_ring.size );
+			if ( ring == NULL )
+				papi_return( PAPI_ENOMEM );
+		}
+
+		internal.sample_ring.ESI = ESI;
+		internal.sample_ring.ring = ring;
+
+		/* get the context we should use for this event set */
+		context = _papi_hwi_get_context( internal.sample_ring.ESI, NULL );
+		retval = _papi_hwd[cidx]->ctl( context, PAPI_SAMPLE_RING, &internal );
+		if ( retval < PAPI_OK ) {
+			_papi_hwi_sample_ring_destroy( ring );
+			papi_return( retval );
+		}
+
+		_papi_hwi_sample_ring_destroy( ESI->sample_ring );
+		ESI->sample_ring = ring;
+		/* the component now queues raw samples again */
+		_papi_hwi_hotspots_destroy( ESI->hotspots );
+		ESI->hotspots = NULL;
+		return ( retval );
+	}
+	case PAPI_HOTSPOTS:
+	{
+		EventSetInfo_t *ESI;
+		PapiSampleRing_t *ring = NULL;
+		PapiHotspots_t *hs = NULL;
+
+		if ( ( ptr->hotspots.size < 0 ) || ( ptr->hotspots.depth < 0 ) ||
+			 ( ptr->hotspots.depth > PAPI_HOTSPOT_MAX_DEPTH ) )
+			papi_return( PAPI_EINVAL );
+
+		ESI = _papi_hwi_lookup_EventSet( ptr->hotspots.eventset );
+		if ( ESI == NULL )
+			papi_return( PAPI_ENOEVST );
+
+		cidx = valid_ESI_component( ESI );
+		if ( cidx < 0 )
+			papi_return( cidx );
+
+		if ( ( ESI->state & PAPI_STOPPED ) == 0 )
+			papi_return( PAPI_EISRUN );
+
+		if ( ptr->hotspots.size > 0 ) {
+			ring = _papi_hwi_sample_ring_create( ptr->hotspots.size );
+			hs = _papi_hwi_hotspots_create( ptr->hotspots.depth );
+			if ( ( ring == NULL ) || ( hs == NULL ) ) {
+				_papi_hwi_sample_ring_destroy( ring );
+				_papi_hwi_hotspots_destroy( hs );
+				papi_return( PAPI_ENOMEM );
+			}
+		}
+
+		internal.hotspots.ESI = ESI;
+		internal.hotspots.ring = ring;
+		internal.hotspots.depth = ptr->hotspots.depth;
+
+		/* get the context we should use for this event set */
+		context = _papi_hwi_get_context( internal.hotspots.ESI, NULL );
+		retval = _papi_hwd[cidx]->ctl( context, PAPI_HOTSPOTS, &internal );
+		if ( retval < PAPI_OK ) {
+			_papi_hwi_sample_ring_destroy( ring );
+			_papi_hwi_hotspots_destroy( hs );
+			papi_return( retval );
+		}
+
+		_papi_hwi_sample_ring_destroy( ESI->sample_ring );
+		_papi_hwi_hotspots_destroy( ESI->hotspots );
+		ESI->sample_ring = ring;
+		ESI->hotspots = hs;
+		return ( retval );
+	}
+	case PAPI_VIRTUAL_START:
+	{
+		EventSetInfo_t *ESI;
+
+		ESI = _papi_hwi_lookup_EventSet( ptr->virtual_start.eventset );
+		if ( ESI == NULL )
+			papi_return( PAPI_ENOEVST );
+
+		cidx = valid_ESI_component( ESI );
+		if ( cidx < 0 )
+			papi_return( cidx );
+
+		if ( ( ESI->state & PAPI_STOPPED ) == 0 )
+			papi_return( PAPI_EISRUN );
+
+		internal.virtual_start.ESI = ESI;
+		internal.virtual_start.enable = ptr->virtual_start.enable;
+
+		/* get the context we should use for this event set */
+		context = _papi_hwi_get_context( internal.virtual_start.ESI, NULL );
+		retval = _papi_hwd[cidx]->ctl( context, PAPI_VIRTUAL_START, &internal );
+		papi_return( retval );
+	}
 	case PAPI_DATA_ADDRESS:
 	case PAPI_INSTR_ADDRESS:
 	{
@@ -4093,6 +4862,9 @@ PAPI_get_multiplex( int EventSet )
  * PAPI_DOMAIN		Get domain for EventSet specified in ptr->domain.eventset. Will error if eventset is not bound to a component.
  * PAPI_GRANUL		Get granularity for EventSet specified in ptr->granularity.eventset. Will error if eventset is not bound to a component.
  * PAPI_INHERIT		Get current inheritance state for specified EventSet.
+ * PAPI_READ_STATS	Get counts of the read paths (user space, mixed, system call) taken for EventSet specified in ptr->read_stats.eventset.
+ * PAPI_SAMPLE_RING	Get the size of the overflow sample ring of EventSet specified in ptr->sample_ring.eventset, 0 if not enabled.
+ * PAPI_HOTSPOTS	Get the sample ring size and callchain depth of EventSet specified in ptr->hotspots.eventset, 0 if not enabled.
  * PAPI_PRELOAD		Get LD_PRELOAD environment equivalent.
  * PAPI_CLOCKRATE	Get clockrate in MHz.
  * PAPI_MAX_CPUS	Get number of CPUs.
@@ -4121,6 +4893,9 @@ PAPI_get_multiplex( int EventSet )
  * <tr><td>PAPI_DOMAIN</td><td>Get domain for EventSet specified in ptr->domain.eventset. Will error if eventset is not bound to a component.</td></tr>
  * <tr><td>PAPI_GRANUL</td><td>Get granularity for EventSet specified in ptr->granularity.eventset. Will error if eventset is not bound to a component.</td></tr>
  * <tr><td>PAPI_INHERIT</td><td>Get current inheritance state for specified EventSet.</td></tr>
+ * <tr><td>PAPI_READ_STATS</td><td>Get counts of the read paths (user space, mixed, system call) taken for EventSet specified in ptr->read_stats.eventset.</td></tr>
+ * <tr><td>PAPI_SAMPLE_RING</td><td>Get the size of the overflow sample ring of EventSet specified in ptr->sample_ring.eventset, 0 if not enabled.</td></tr>
+ * <tr><td>PAPI_HOTSPOTS</td><td>Get the sample ring size and callchain depth of EventSet specified in ptr->hotspots.eventset, 0 if not enabled.</td></tr>
  * <tr><td>PAPI_PRELOAD</td><td>Get LD_PRELOAD environment equivalent.</td></tr>
  * <tr><td>PAPI_CLOCKRATE</td><td>Get clockrate in MHz.</td></tr>
  * <tr><td>PAPI_MAX_CPUS</td><td>Get number of CPUs.</td></tr>
@@ -4246,6 +5021,65 @@ PAPI_get_opt( int option, PAPI_option_t * ptr )
 		ptr->inherit.inherit = ESI->inherit.inherit;
 		return ( PAPI_OK );
 	}
+	case PAPI_READ_STATS:
+	{
+		_papi_int_option_t internal;
+		hwd_context_t *context;
+		int cidx, retval;
+
+		if ( ptr == NULL )
+			papi_return( PAPI_EINVAL );
+		ESI = _papi_hwi_lookup_EventSet( ptr->read_stats.eventset );
+		if ( ESI == NULL )
+			papi_return( PAPI_ENOEVST );
+
+		cidx = valid_ESI_component( ESI );
+		if ( cidx < 0 )
+			papi_return( cidx );
+
+		memset( &internal, 0, sizeof ( internal ) );
+		internal.read_stats.ESI = ESI;
+
+		/* get the context we should use for this event set */
+		context = _papi_hwi_get_context( ESI, NULL );
+		retval = _papi_hwd[cidx]->ctl( context, PAPI_READ_STATS, &internal );
+		if ( retval < PAPI_OK )
+			papi_return( retval );
+
+		ptr->read_stats.fast = internal.read_stats.fast;
+		ptr->read_stats.mixed = internal.read_stats.mixed;
+		ptr->read_stats.slow = internal.read_stats.slow;
+		return ( PAPI_OK );
+	}
+	case PAPI_SAMPLE_RING:
+	{
+		if ( ptr == NULL )
+			papi_return( PAPI_EINVAL );
+		ESI = _papi_hwi_lookup_EventSet( ptr->sample_ring.eventset );
+		if ( ESI == NULL )
+			papi_return( PAPI_ENOEVST );
+		if ( ESI->sample_ring == NULL )
+			ptr->sample_ring.size = 0;
+		else
+			ptr->sample_ring.size = ( int ) ( ESI->sample_ring->mask + 1 );
+		return ( PAPI_OK );
+	}
+	case PAPI_HOTSPOTS:
+	{
+		if ( ptr == NULL )
+			papi_return( PAPI_EINVAL );
+		ESI = _papi_hwi_lookup_EventSet( ptr->hotspots.eventset );
+		if ( ESI == NULL )
+			papi_return( PAPI_ENOEVST );
+		if ( ESI->hotspots == NULL ) {
+			ptr->hotspots.size = 0;
+			ptr->hotspots.depth = 0;
+		} else {
+			ptr->hotspots.size = ( int ) ( ESI->sample_ring->mask + 1 );
+			ptr->hotspots.depth = ESI->hotspots->depth;
+		}
+		return ( PAPI_OK );
+	}
 	case PAPI_GRANUL:
 		if ( ptr == NULL )
 			papi_return( PAPI_EINVAL );
@@ -4340,6 +5174,8 @@ PAPI_get_cmp_opt( int option, PAPI_option_t * ptr, int cidx )
      return PAPI_ECMP;
   }
 
+  _papi_hwi_init_pending_component( cidx );
+
 	switch ( option ) {
 		/* For now, MAX_HWCTRS and MAX CTRS are identical.
 		   At some future point, they may map onto different values.
@@ -4465,7 +5301,11 @@ PAPI_shutdown( void )
         EventSetInfo_t *ESI;
         ThreadInfo_t *master;
         DynamicArray_t *map = &_papi_hwi_system_info.global_eventset_map;
-        int i, j = 0, k, retval;
+        EventSetSlot_t *slot;
+        int i, k, retval;
+#ifdef DEBUG
+        int j = 0;
+#endif
 
 
 	if ( init_retval == DEADBEEF ) {
@@ -4479,6 +5319,15 @@ PAPI_shutdown( void )
 
    master = _papi_hwi_lookup_thread( 0 );
 
+   /* EventSets parked for reuse are cleaned up like the others */
+   if ( master ) {
+      while ( ( ESI = master->recycled_eventsets ) != NULL ) {
+	 master->recycled_eventsets = ESI->next_recycled;
+	 ESI->recycled = 0;
+      }
+      master->num_recycled_eventsets = 0;
+   }
+
       /* Count number of running EventSets AND */
       /* Stop any running EventSets in this thread */
 
@@ -4486,23 +5335,27 @@ PAPI_shutdown( void )
 again:
 #endif
    for( i = 0; i < map->totalSlots; i++ ) {
-      ESI = map->dataSlotArray[i];
+      slot = _papi_hwi_eventset_slot( map, i );
+      if ( slot->master != master ) {
+#ifdef DEBUG
+	 /* the sets of other threads are only waited for in DEBUG builds */
+	 ESI = slot->ESI;
+	 if ( slot->master && ESI && ( ESI->state & PAPI_RUNNING ) ) {
+	    j++;
+	 }
+#endif
+	 continue;
+      }
+      ESI = slot->ESI;
       if ( ESI ) {
-	 if ( ESI->master == master ) {
-	    if ( ESI->state & PAPI_RUNNING ) {
-	       if((retval = PAPI_stop( i, NULL )) != PAPI_OK) {
-	    	   APIDBG("Call to PAPI_stop failed: %d\n", retval);
-	       }
-	    }
-	    retval=PAPI_cleanup_eventset( i );
-	    if (retval!=PAPI_OK) PAPIERROR("Error during cleanup.");
-	    _papi_hwi_free_EventSet( ESI );
-	 } 
-         else {
-            if ( ESI->state & PAPI_RUNNING ) {
-	       j++;
+	 if ( ESI->state & PAPI_RUNNING ) {
+	    if((retval = PAPI_stop( i, NULL )) != PAPI_OK) {
+	       APIDBG("Call to PAPI_stop failed: %d\n", retval);
 	    }
 	 }
+	 retval=PAPI_cleanup_eventset( i );
+	 if (retval!=PAPI_OK) PAPIERROR("Error during cleanup.");
+	 _papi_hwi_free_EventSet( ESI );
       }
    }
 
@@ -4548,6 +5401,7 @@ again:
 
 	init_retval = DEADBEEF;
 	init_level = PAPI_NOT_INITED;
+	_papi_mem_thread_exit(  );
 	_papi_mem_cleanup_all(  );
 }
 
@@ -4993,6 +5847,8 @@ PAPI_overflow( int EventSet, int EventCode, int threshold, int flags,
  *	initiates profiling based on the values contained in the array. 
  *	Each structure in the array defines the profiling parameters that are 
  *	normally passed to PAPI_profil(). 
+ *	The regions are sorted by start address when PAPI_sprofil() is called, 
+ *	so changing pr_off afterwards requires calling it again. 
  *	For more information on profiling, @ref PAPI_profil
  *	@manonly
  *
@@ -5049,6 +5905,8 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
    int retval, index, i, buckets;
    int forceSW = 0;
    int cidx;
+   ProfileRegion_t *regions;
+   int num_regions;
 
    /* Check to make sure EventSet exists */
    ESI = _papi_hwi_lookup_EventSet( EventSet );
@@ -5142,9 +6000,14 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
 	 papi_return( PAPI_EINVAL );
       }
 
+      if ( ESI->profile.regions[i] )
+         papi_free( ESI->profile.regions[i] );
+
       /* compact these arrays */
       while ( i < ESI->profile.event_counter - 1 ) {
          ESI->profile.prof[i] = ESI->profile.prof[i + 1];
+         ESI->profile.regions[i] = ESI->profile.regions[i + 1];
+         ESI->profile.num_regions[i] = ESI->profile.num_regions[i + 1];
 	 ESI->profile.count[i] = ESI->profile.count[i + 1];
 	 ESI->profile.threshold[i] = ESI->profile.threshold[i + 1];
 	 ESI->profile.EventIndex[i] = ESI->profile.EventIndex[i + 1];
@@ -5152,6 +6015,8 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
 	 i++;
       }
       ESI->profile.prof[i] = NULL;
+      ESI->profile.regions[i] = NULL;
+      ESI->profile.num_regions[i] = 0;
       ESI->profile.count[i] = 0;
       ESI->profile.threshold[i] = 0;
       ESI->profile.EventIndex[i] = 0;
@@ -5169,6 +6034,13 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
 	 }
       }
 
+      /* sort the regions once here, so samples can binary search them */
+      retval = _papi_hwi_sort_profile_regions( prof, profcnt, &regions,
+					       &num_regions );
+      if ( retval != PAPI_OK ) {
+	 papi_return( retval );
+      }
+
       for( i = 0; i < ESI->profile.event_counter; i++ ) {
 	 if ( ESI->profile.EventCode[i] == EventCode ) {
 	    break;
@@ -5180,6 +6052,10 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
 	 ESI->profile.event_counter++;
 	 ESI->profile.EventCode[i] = EventCode;
       }
+      if ( ESI->profile.regions[i] )
+	 papi_free( ESI->profile.regions[i] );
+      ESI->profile.regions[i] = regions;
+      ESI->profile.num_regions[i] = num_regions;
       ESI->profile.prof[i] = prof;
       ESI->profile.count[i] = profcnt;
       ESI->profile.threshold[i] = threshold;
@@ -5396,7 +6272,7 @@ PAPI_sprofil( PAPI_sprofil_t *prof, int profcnt, int EventSet,
  * @arg PAPI_PROFIL_POSIX	Default type of profiling, similar to profil (3).@n
  * @arg PAPI_PROFIL_RANDOM	Drop a random 25% of the samples.@n
  * @arg PAPI_PROFIL_WEIGHTED	Weight the samples by their value.@n
- * @arg PAPI_PROFIL_COMPRESS	Ignore samples as values in the hash buckets get big.@n
+ * @arg PAPI_PROFIL_COMPRESS	Ignore samples as values in the hash buckets get big compared to the bucket size.@n
  * @arg PAPI_PROFIL_BUCKET_16	Use unsigned short (16 bit) buckets, This is the default bucket.@n
  * @arg PAPI_PROFIL_BUCKET_32	Use unsigned int (32 bit) buckets.@n
  * @arg PAPI_PROFIL_BUCKET_64	Use unsigned long long (64 bit) buckets.@n
@@ -6612,14 +7488,9 @@ int  PAPI_get_component_index(const char *name)
 	APIDBG( "Entry: name: %s\n", name);
   int cidx;
 
-  const PAPI_component_info_t *cinfo;
-
+  /* the name is there before init, so PAPI_LAZY_INIT leaves them be */
   for(cidx=0;cidx<papi_num_components;cidx++) {
-
-     cinfo=PAPI_get_component_info(cidx); 
-     if (cinfo==NULL) return PAPI_ENOCMP;
-
-     if (!strcmp(name,cinfo->name)) {
+     if (!strcmp(name,_papi_hwd[cidx]->cmp_info.name)) {
         return cidx;
      }
   }
@@ -6667,18 +7538,18 @@ PAPI_disable_component( int cidx )
 {
 	APIDBG( "Entry: cidx: %d\n", cidx);
 
-   const PAPI_component_info_t *cinfo;
+   PAPI_component_info_t *cinfo;
 
    /* Can only run before PAPI_library_init() is called */
    if (init_level != PAPI_NOT_INITED) {
       return PAPI_ENOINIT;
    }
      
-   cinfo=PAPI_get_component_info(cidx); 
-   if (cinfo==NULL) return PAPI_ENOCMP;
+   if (_papi_hwi_invalid_cmp(cidx)) return PAPI_ENOCMP;
+   cinfo=&(_papi_hwd[cidx]->cmp_info);
 
-   ((PAPI_component_info_t *)cinfo)->disabled=1;
-   strcpy(((PAPI_component_info_t *)cinfo)->disabled_reason,
+   cinfo->disabled=1;
+   strcpy(cinfo->disabled_reason,
 	       "Disabled by PAPI_disable_component()");
 
    return PAPI_OK;
@@ -276,7 +276,8 @@ failure.
 #define PAPI_ECOUNT		-23    /**< Too many events or attributes */
 #define PAPI_ECOMBO		-24    /**< Bad combination of features */
 #define PAPI_ECMP_DISABLED	-25    /**< Component containing event is disabled */
-#define PAPI_NUM_ERRORS	 26    /**< Number of error messages specified in this API */
+#define PAPI_EDELAY_INIT	-26    /**< Component initialization delayed until first use */
+#define PAPI_NUM_ERRORS	 27    /**< Number of error messages specified in this API */
 
 #define PAPI_NOT_INITED		0
 #define PAPI_LOW_LEVEL_INITED 	1       /* Low level has called library init */
@@ -416,6 +417,7 @@ All of the functions in the PerfAPI should use the following set of constants.
   * @{ */
 #define PAPI_MULTIPLEX_DEFAULT	0x0	/**< Use whatever method is available, prefer kernel of course. */
 #define PAPI_MULTIPLEX_FORCE_SW 0x1	/**< Force PAPI multiplexing instead of kernel */
+#define PAPI_MULTIPLEX_THREAD_TIMER 0x2	/**< PAPI multiplexing rotated by a per-thread timer instead of the process itimer; implies FORCE_SW */
 /** @} */
 
 /** @internal 
@@ -456,6 +458,10 @@ All of the functions in the PerfAPI should use the following set of constants.
 #define PAPI_CPU_ATTACH		27      /**< Specify a cpu number the event set should be tied to */
 #define PAPI_INHERIT		28      /**< Option to set counter inheritance flag */
 #define PAPI_USER_EVENTS_FILE 29	/**< Option to set file from where to parse user defined events */
+#define PAPI_READ_STATS		30      /**< Get counts of the read paths taken for an event set */
+#define PAPI_SAMPLE_RING	31      /**< Option to queue overflow samples in a ring drained by PAPI_read_samples */
+#define PAPI_VIRTUAL_START	32      /**< Option to start/stop/reset an event set from user space, leaving the counters enabled */
+#define PAPI_HOTSPOTS		33      /**< Option to sample callchains and aggregate them by symbol, see PAPI_get_hotspots */
 
 #define PAPI_INIT_SLOTS    64     /*Number of initialized slots in
                                    DynamicArray of EventSets */
@@ -840,6 +846,39 @@ typedef char* PAPI_user_defined_events_file_t;
       int end_off;            /**< hardware specified offset from end address */
    } PAPI_addr_range_option_t;
 
+/** @ingroup papi_data_structures
+  *	@brief counts of the ways a component satisfied PAPI_read() for an event set */
+   typedef struct _papi_read_stats_option {
+      int eventset;           /**< eventset to query */
+      long long fast;         /**< reads done entirely in user space (rdpmc) */
+      long long mixed;        /**< reads where some events needed a system call */
+      long long slow;         /**< reads done entirely with system calls */
+   } PAPI_read_stats_option_t;
+
+/** @ingroup papi_data_structures
+  *	@brief overflow sample ring size for an event set, see PAPI_read_samples() */
+   typedef struct _papi_sample_ring_option {
+      int eventset;           /**< eventset the samples come from */
+      int size;               /**< ring size in bytes (rounded up to a power of 2), 0 to disable */
+   } PAPI_sample_ring_option_t;
+
+/** @ingroup papi_data_structures
+  *	@brief enable virtual start/stop for an event set */
+   typedef struct _papi_virtual_start_option {
+      int eventset;           /**< eventset to change */
+      int enable;             /**< 1 to keep the counters enabled and snapshot them, 0 to use the kernel */
+   } PAPI_virtual_start_option_t;
+
+#define PAPI_HOTSPOT_MAX_DEPTH	127     /**< Most callers recorded per sample, the kernel's default maximum */
+
+/** @ingroup papi_data_structures
+  *	@brief callchain sampling for an event set, see PAPI_get_hotspots() */
+   typedef struct _papi_hotspot_option {
+      int eventset;           /**< eventset the samples come from */
+      int size;               /**< sample ring size in bytes (rounded up to a power of 2), 0 to disable */
+      int depth;              /**< callers recorded per sample, 0 for the sampled address only */
+   } PAPI_hotspot_option_t;
+
 /** @ingroup papi_data_structures 
   *	@union PAPI_option_t
   *	@brief A pointer to the following is passed to PAPI_set/get_opt() */
@@ -863,8 +902,46 @@ typedef char* PAPI_user_defined_events_file_t;
 		PAPI_component_info_t *cmp_info;
 		PAPI_addr_range_option_t addr;
 		PAPI_user_defined_events_file_t events_file;
+		PAPI_read_stats_option_t read_stats;
+		PAPI_sample_ring_option_t sample_ring;
+		PAPI_virtual_start_option_t virtual_start;
+		PAPI_hotspot_option_t hotspots;
 	} PAPI_option_t;
 
+/** @ingroup papi_data_structures
+  *	@brief Header of each record returned by PAPI_read_samples().
+  *
+  *	It is followed by the sample exactly as the component received it;
+  *	for perf_event that is the PERF_RECORD_SAMPLE or PERF_RECORD_LOST
+  *	record the kernel wrote, including its perf_event_header. */
+	typedef struct _papi_sample_record {
+		unsigned int size;        /**< size of the record in bytes, including this header and padding to 8 bytes */
+		int event_index;          /**< index in the event set of the overflowing event */
+	} PAPI_sample_record_t;
+
+/** @ingroup papi_data_structures
+  *	@brief Sample returned by PAPI_read_samples() for event sets using PAPI_HOTSPOTS.
+  *
+  *	It follows the PAPI_sample_record_t header and is itself followed by
+  *	nr caller addresses (unsigned long long), innermost first, which is
+  *	what flame graph tools expect of a stack. */
+	typedef struct _papi_callchain_sample {
+		unsigned long long ip;    /**< address the sample was taken at */
+		int tid;                  /**< thread that was running */
+		int nr;                   /**< number of caller addresses that follow */
+	} PAPI_callchain_sample_t;
+
+/** @ingroup papi_data_structures
+  *	@brief One row of the table returned by PAPI_get_hotspots() */
+	typedef struct _papi_hotspot {
+		caddr_t address;          /**< start of the symbol, or of the library text if there is no symbol */
+		long long self;           /**< samples taken in the symbol itself */
+		long long total;          /**< samples with the symbol anywhere on the callchain */
+		int event_index;          /**< index in the event set of the overflowing event */
+		char symbol[PAPI_MAX_STR_LEN];  /**< symbol name, empty if it could not be found */
+		char dso[PAPI_HUGE_STR_LEN];    /**< executable or shared library the address is in */
+	} PAPI_hotspot_t;
+
 /** @ingroup papi_data_structures
   *	@brief A pointer to the following is passed to PAPI_get_dmem_info() */
 	typedef struct _dmem_t {
@@ -1032,6 +1109,8 @@ enum {
    int   PAPI_create_eventset(int *EventSet); /**< create a new empty PAPI event set */
    int   PAPI_detach(int EventSet); /**< detach specified event set from a previously specified process or thread id */
    int   PAPI_destroy_eventset(int *EventSet); /**< deallocates memory associated with an empty PAPI event set */
+   int   PAPI_recycle_eventset(int *EventSet); /**< park a stopped event set, with its counters still set up, for PAPI_reuse_eventset */
+   int   PAPI_reuse_eventset(int *EventSet, int *Events, int number); /**< get a parked event set with these events, or create one */
    int   PAPI_enum_event(int *EventCode, int modifier); /**< return the event code for the next available preset or natvie event */
    int   PAPI_enum_cmp_event(int *EventCode, int modifier, int cidx); /**< return the event code for the next available component event */
    int   PAPI_event_code_to_name(int EventCode, char *out); /**< translate an integer PAPI event code into an ASCII PAPI preset or native name */
@@ -1070,6 +1149,10 @@ enum {
    int   PAPI_query_event(int EventCode); /**< query if a PAPI event exists */
    int   PAPI_query_named_event(const char *EventName); /**< query if a named PAPI event exists */
    int   PAPI_read(int EventSet, long long * values); /**< read hardware events from an event set with no reset */
+   int   PAPI_read_many(int *EventSets, int n, long long ** values); /**< read hardware events from several event sets with no reset */
+   int   PAPI_read_cpus(int EventSet, long long * values, int *cpus, int *num_cpus); /**< read an event set's hardware events cpu by cpu */
+   int   PAPI_read_samples(int EventSet, void *buf, int bufsiz, int *count, long long *dropped); /**< drain overflow samples queued with PAPI_SAMPLE_RING */
+   int   PAPI_get_hotspots(int EventSet, PAPI_hotspot_t *table, int *count); /**< symbols the samples of PAPI_HOTSPOTS fell in, hottest first */
    int   PAPI_read_ts(int EventSet, long long * values, long long *cyc); /**< read from an eventset with a real-time cycle timestamp */
    int   PAPI_register_thread(void); /**< inform PAPI of the existence of a new thread */
    int   PAPI_remove_event(int EventSet, int EventCode); /**< remove a hardware event from a PAPI event set */
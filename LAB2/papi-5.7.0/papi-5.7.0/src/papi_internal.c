@@ -48,6 +48,7 @@
 /* Advanced definitons */
 static int default_debug_handler( int errorCode );
 static long long handle_derived( EventInfo_t * evi, long long *from );
+static int postfix_compile( int derived, char *ops, struct _postfix_code **code );
 
 /* Global definitions used by other files */
 int init_level = PAPI_NOT_INITED;
@@ -78,6 +79,14 @@ static struct native_event_info *_papi_native_events=NULL;
 static int num_native_events=0;
 static int num_native_chunks=0;
 
+// Open addressing hash tables over _papi_native_events, so looking up an
+// event does not walk every event seen so far.  Slots hold index+1, 0 is
+// empty.  native_event_hash is keyed on (cidx, component_event, name),
+// native_name_hash on the name alone.  Both are kept at most half full.
+static int *native_event_hash=NULL;
+static int *native_name_hash=NULL;
+static unsigned int native_hash_mask=0;
+
 char **_papi_errlist= NULL;
 static int num_error_chunks = 0;
 
@@ -209,17 +218,30 @@ is_supported_by_component(int cidx, char *event_name) {
 	}
 
 	// if a pmu name was found, compare it to the pmu name list if the component info structure (if there is one)
+	// a numbered pmu (skx_unc_upi2) that did not fit in the list also matches its family name (skx_unc_upi)
 	if (pmu_name) {
-		for ( i=0 ; i<PAPI_PMU_MAX ; i++) {
-			if (_papi_hwd[cidx]->cmp_info.pmu_names[i] == NULL) {
-				continue;
+		int pass, len;
+		for ( pass=0 ; pass<2 ; pass++) {
+			for ( i=0 ; i<PAPI_PMU_MAX ; i++) {
+				if (_papi_hwd[cidx]->cmp_info.pmu_names[i] == NULL) {
+					continue;
+				}
+//				INTDBG("pmu_name[%d]: %p (%s)\n", i, _papi_hwd[cidx]->cmp_info.pmu_names[i], _papi_hwd[cidx]->cmp_info.pmu_names[i]);
+				if (strcmp (wptr, _papi_hwd[cidx]->cmp_info.pmu_names[i]) == 0) {
+					INTDBG("EXIT: Component %s supports PMU %s and this event\n", _papi_hwd[cidx]->cmp_info.name, wptr);
+					free (wptr);
+					return 1;
+				}
+			}
+			// try again with the trailing digits taken off
+			len = name_len;
+			while ((len > 0) && isdigit((unsigned char) wptr[len-1])) {
+				len--;
 			}
-//			INTDBG("pmu_name[%d]: %p (%s)\n", i, _papi_hwd[cidx]->cmp_info.pmu_names[i], _papi_hwd[cidx]->cmp_info.pmu_names[i]);
-			if (strcmp (wptr, _papi_hwd[cidx]->cmp_info.pmu_names[i]) == 0) {
-				INTDBG("EXIT: Component %s supports PMU %s and this event\n", _papi_hwd[cidx]->cmp_info.name, wptr);
-				free (wptr);
-				return 1;
+			if ((len == 0) || (wptr[len] == '\0')) {
+				break;
 			}
+			wptr[len] = '\0';
 		}
 	}
 
@@ -309,41 +331,177 @@ const char *_papi_hwi_strip_component_prefix(const char *event_name)
 	return (start);
 }
 
+/* FNV-1a over the event name */
+static unsigned int
+native_name_hashval(const char *event_name) {
+  unsigned int h=2166136261U;
+
+  while (*event_name) {
+     h^=(unsigned char)*event_name++;
+     h*=16777619U;
+  }
+  return h;
+}
+
+static unsigned int
+native_event_hashval(int cidx, int event, const char *event_name) {
+  unsigned int h=native_name_hashval(event_name);
+
+  h^=(unsigned int)event*2654435761U;
+  h^=(unsigned int)cidx*40503U;
+  return h;
+}
+
+/* Put _papi_native_events[index] in both hash tables.  */
+/* Caller holds INTERNAL_LOCK and made room for it.     */
+static void
+native_hash_insert(int index) {
+  struct native_event_info *ev=&_papi_native_events[index];
+  unsigned int slot;
+
+  slot=native_event_hashval(ev->cidx,ev->component_event,ev->evt_name);
+  while (native_event_hash[slot&native_hash_mask]) slot++;
+  native_event_hash[slot&native_hash_mask]=index+1;
+
+  slot=native_name_hashval(ev->evt_name);
+  while (native_name_hash[slot&native_hash_mask]) slot++;
+  native_name_hash[slot&native_hash_mask]=index+1;
+}
+
+/* Make sure there is room for one more event, rehashing into */
+/* tables twice as large when needed.                          */
+static int
+native_hash_grow(void) {
+  unsigned int size;
+  int *event_hash, *name_hash;
+  int i;
+
+  if ((unsigned int)(num_native_events+1)*2 <= native_hash_mask+1 &&
+      native_event_hash!=NULL) {
+     return PAPI_OK;
+  }
+
+  size=(native_event_hash==NULL)?2*NATIVE_EVENT_CHUNKSIZE:
+       2*(native_hash_mask+1);
+
+  event_hash=calloc(size,sizeof(int));
+  name_hash=calloc(size,sizeof(int));
+  if ((event_hash==NULL) || (name_hash==NULL)) {
+     free(event_hash);
+     free(name_hash);
+     return PAPI_ENOMEM;
+  }
+
+  free(native_event_hash);
+  free(native_name_hash);
+  native_event_hash=event_hash;
+  native_name_hash=name_hash;
+  native_hash_mask=size-1;
+
+  for(i=0;i<num_native_events;i++) {
+     if (_papi_native_events[i].evt_name!=NULL) {
+        native_hash_insert(i);
+     }
+  }
+
+  return PAPI_OK;
+}
+
 /* find the papi event code (4000xxx) associated with the specified component, native event, and event name */
 static int
 _papi_hwi_find_native_event(int cidx, int event, const char *event_name) {
   INTDBG("ENTER: cidx: %x, event: %#x, event_name: %s\n", cidx, event, event_name);
 
   int i;
+  unsigned int slot;
 
   // if no event name passed in, it can not be found
-  if (event_name == NULL) {
+  if ((event_name == NULL) || (native_event_hash == NULL)) {
 		INTDBG("EXIT: PAPI_ENOEVNT\n");
 		return PAPI_ENOEVNT;
   }
 
-  for(i=0;i<num_native_events;i++) {
-  	// if we have have not set up this event name yet, look at next
-  	if (_papi_native_events[i].evt_name == NULL) {
-  		continue;
-  	}
-
-  	// is this entry for the correct component and event code
-  	if ((_papi_native_events[i].cidx==cidx) &&
-	(_papi_native_events[i].component_event==event)) {
-		// if this event name matches what we want, return its papi event code
-		if (strcmp(event_name, _papi_native_events[i].evt_name) == 0) {
-			INTDBG("EXIT: event: %#x, component_event: %#x, ntv_idx: %d, event_name: %s\n",
-				i|PAPI_NATIVE_MASK, _papi_native_events[i].component_event, _papi_native_events[i].ntv_idx, _papi_native_events[i].evt_name);
-			return i|PAPI_NATIVE_MASK;
-		}
-    }
+  slot=native_event_hashval(cidx, event, event_name);
+  while ((i=native_event_hash[slot&native_hash_mask]) != 0) {
+	i--;
+	// is this entry for the correct component, event code and name
+	if ((_papi_native_events[i].cidx==cidx) &&
+	    (_papi_native_events[i].component_event==event) &&
+	    (strcmp(event_name, _papi_native_events[i].evt_name) == 0)) {
+		INTDBG("EXIT: event: %#x, component_event: %#x, ntv_idx: %d, event_name: %s\n",
+			i|PAPI_NATIVE_MASK, _papi_native_events[i].component_event, _papi_native_events[i].ntv_idx, _papi_native_events[i].evt_name);
+		return i|PAPI_NATIVE_MASK;
+	}
+	slot++;
   }
 
 	INTDBG("EXIT: PAPI_ENOEVNT\n");
 	return PAPI_ENOEVNT;
 }
 
+/* find a papi event code already handed out for exactly this event name. */
+/* if more than one component registered the name, the one with the       */
+/* lowest index that is enabled and may own the event wins, like the      */
+/* component loop in _papi_hwi_native_name_to_code.                       */
+static int
+_papi_hwi_find_native_event_name(const char *event_name, char *full_event_name) {
+  INTDBG("ENTER: event_name: %s\n", event_name);
+
+  int i, result=PAPI_ENOEVNT, best_cidx=papi_num_components;
+  unsigned int slot;
+
+  if (native_name_hash == NULL) {
+	INTDBG("EXIT: PAPI_ENOEVNT\n");
+	return PAPI_ENOEVNT;
+  }
+
+  slot=native_name_hashval(event_name);
+  while ((i=native_name_hash[slot&native_hash_mask]) != 0) {
+	i--;
+	if ((_papi_native_events[i].cidx < best_cidx) &&
+	    (strcmp(event_name, _papi_native_events[i].evt_name) == 0) &&
+	    (!_papi_hwd[_papi_native_events[i].cidx]->cmp_info.disabled) &&
+	    (is_supported_by_component(_papi_native_events[i].cidx, full_event_name))) {
+		best_cidx=_papi_native_events[i].cidx;
+		result=i|PAPI_NATIVE_MASK;
+	}
+	slot++;
+  }
+
+  INTDBG("EXIT: result: %#x\n", result);
+  return result;
+}
+
+/* ask the component again whether a name _papi_hwi_find_native_event_name */
+/* found still means the same component event.  the component may map a    */
+/* name differently now (default qualifiers, a reloaded event table), and   */
+/* then the code handed out before is stale.                                */
+static int
+_papi_hwi_check_native_event_name(int index, const char *event_name) {
+  INTDBG("ENTER: index: %d, event_name: %s\n", index, event_name);
+
+  struct native_event_info *ev=&_papi_native_events[index];
+  char name[PAPI_HUGE_STR_LEN];
+  unsigned int code;
+  int valid=0;
+
+  if (_papi_hwd[ev->cidx]->ntv_name_to_code != NULL) {
+     _papi_hwi_set_papi_event_code(-1, -1);
+     if (_papi_hwd[ev->cidx]->ntv_name_to_code(event_name, &code) == PAPI_OK) {
+        valid=((int)code == ev->component_event);
+     }
+  } else {
+     _papi_hwi_set_papi_event_code(index|PAPI_NATIVE_MASK, 0);
+     if (_papi_hwd[ev->cidx]->ntv_code_to_name(ev->component_event,
+                                   name, sizeof(name)) == PAPI_OK) {
+        valid=(strcasecmp(name, event_name) == 0);
+     }
+  }
+
+  INTDBG("EXIT: valid: %d\n", valid);
+  return valid;
+}
+
 static int
 _papi_hwi_add_native_event(int cidx, int ntv_event, int ntv_idx, const char *event_name) {
 	INTDBG("ENTER: cidx: %d, ntv_event: %#x, ntv_idx: %d, event_name: %s\n", cidx, ntv_event, ntv_idx, event_name);
@@ -352,6 +510,11 @@ _papi_hwi_add_native_event(int cidx, int ntv_event, int ntv_idx, const char *eve
 
   _papi_hwi_lock( INTERNAL_LOCK );
 
+  if (native_hash_grow()!=PAPI_OK) {
+     new_native_event=PAPI_ENOMEM;
+     goto native_alloc_early_out;
+  }
+
   if (num_native_events>=num_native_chunks*NATIVE_EVENT_CHUNKSIZE) {
      num_native_chunks++;
      _papi_native_events=(struct native_event_info *) realloc(_papi_native_events,
@@ -368,6 +531,7 @@ _papi_hwi_add_native_event(int cidx, int ntv_event, int ntv_idx, const char *eve
   _papi_native_events[num_native_events].ntv_idx=ntv_idx;
   if (event_name != NULL) {
 	  _papi_native_events[num_native_events].evt_name=strdup(event_name);
+	  native_hash_insert(num_native_events);
   } else {
 	  _papi_native_events[num_native_events].evt_name=NULL;
   }
@@ -507,6 +671,7 @@ _papi_hwi_init_errors(void) {
 	/* 23 PAPI_ECOUNT */	_papi_hwi_add_error("Too many events or attributes");
 	/* 24 PAPI_ECOMBO */	_papi_hwi_add_error("Bad combination of features");
 	/* 25 PAPI_ECMP_DISABLED */_papi_hwi_add_error("Component containing event is disabled");
+	/* 26 PAPI_EDELAY_INIT */_papi_hwi_add_error("Component initialization delayed until first use");
 }
 
 int
@@ -672,52 +837,60 @@ default_debug_handler( int errorCode )
 static int
 allocate_eventset_map( DynamicArray_t * map )
 {
-	/* Allocate and clear the Dynamic Array structure */
-	if ( map->dataSlotArray != NULL )
-		papi_free( map->dataSlotArray );
+	/* Chunks of slots are added as EventSets get created */
 	memset( map, 0x00, sizeof ( DynamicArray_t ) );
 
-	/* Allocate space for the EventSetInfo_t pointers */
+	return ( PAPI_OK );
+}
 
-	map->dataSlotArray =
-		( EventSetInfo_t ** ) papi_malloc( PAPI_INIT_SLOTS *
-										   sizeof ( EventSetInfo_t * ) );
-	if ( map->dataSlotArray == NULL ) {
-		return ( PAPI_ENOMEM );
-	}
-	memset( map->dataSlotArray, 0x00,
-			PAPI_INIT_SLOTS * sizeof ( EventSetInfo_t * ) );
-	map->totalSlots = PAPI_INIT_SLOTS;
-	map->availSlots = PAPI_INIT_SLOTS;
-	map->fullSlots = 0;
+static void
+free_eventset_map( DynamicArray_t * map )
+{
+	int i;
 
-	return ( PAPI_OK );
+	for ( i = 0; i < PAPI_EVENTSET_CHUNKS; i++ ) {
+		if ( map->chunks[i] )
+			papi_free( map->chunks[i] );
+	}
+	if ( map->freeSlots )
+		papi_free( map->freeSlots );
+	memset( map, 0x00, sizeof ( DynamicArray_t ) );
 }
 
+/* Add a chunk of PAPI_INIT_SLOTS free ids.  Caller holds INTERNAL_LOCK. */
 static int
 expand_dynamic_array( DynamicArray_t * DA )
 {
-	int number;
-	EventSetInfo_t **n;
+	EventSetSlot_t *chunk;
+	int *n, i, number;
+
+	if ( DA->totalSlots == PAPI_EVENTSET_CHUNKS * PAPI_INIT_SLOTS )
+		return ( PAPI_ENOMEM );
 
-	/*realloc existing PAPI_EVENTSET_MAP.dataSlotArray */
+	number = DA->totalSlots + PAPI_INIT_SLOTS;
 
-	number = DA->totalSlots * 2;
-	n = ( EventSetInfo_t ** ) papi_realloc( DA->dataSlotArray,
-											( size_t ) number *
-											sizeof ( EventSetInfo_t * ) );
+	/* the free stack can hold every id, so pushing never fails */
+	n = ( int * ) papi_realloc( DA->freeSlots,
+								( size_t ) number * sizeof ( int ) );
 	if ( n == NULL )
 		return ( PAPI_ENOMEM );
+	DA->freeSlots = n;
 
-	/* Need to assign this value, what if realloc moved it? */
+	chunk = ( EventSetSlot_t * ) papi_calloc( PAPI_INIT_SLOTS,
+											  sizeof ( EventSetSlot_t ) );
+	if ( chunk == NULL )
+		return ( PAPI_ENOMEM );
 
-	DA->dataSlotArray = n;
+	/* lock-free lookups must see the cleared slots before the chunk */
+	__sync_synchronize(  );
+	DA->chunks[DA->totalSlots / PAPI_INIT_SLOTS] = chunk;
+	__sync_synchronize(  );
 
-	memset( DA->dataSlotArray + DA->totalSlots, 0x00,
-			( size_t ) DA->totalSlots * sizeof ( EventSetInfo_t * ) );
+	/* highest first, so the lowest id is handed out first */
+	for ( i = number - 1; i >= DA->totalSlots; i-- )
+		DA->freeSlots[DA->numFree++] = i;
 
 	DA->totalSlots = number;
-	DA->availSlots = number - DA->fullSlots;
 
 	return ( PAPI_OK );
 }
@@ -802,8 +975,9 @@ _papi_hwi_assign_eventset( EventSetInfo_t *ESI, int cidx )
 					   sizeof ( int ) * 3 ) * ( size_t ) max_counters );
 
    ESI->profile.prof = ( PAPI_sprofil_t ** )
-		papi_malloc( ( sizeof ( PAPI_sprofil_t * ) * ( size_t ) max_counters +
-					   ( size_t ) max_counters * sizeof ( int ) * 4 ) );
+		papi_malloc( ( ( sizeof ( PAPI_sprofil_t * ) + sizeof ( ProfileRegion_t * ) ) *
+					   ( size_t ) max_counters +
+					   ( size_t ) max_counters * sizeof ( int ) * 5 ) );
 
    /* If any of these allocations failed, free things up and fail */
 
@@ -841,6 +1015,10 @@ _papi_hwi_assign_eventset( EventSetInfo_t *ESI, int cidx )
    /* Carve up the profile block into separate arrays */
    ptr = ( char * ) ESI->profile.prof +
 		( sizeof ( PAPI_sprofil_t * ) * max_counters );
+   ESI->profile.regions = ( ProfileRegion_t ** ) ptr;
+   ptr += sizeof ( ProfileRegion_t * ) * max_counters;
+   ESI->profile.num_regions = ( int * ) ptr;
+   ptr += sizeof ( int ) * max_counters;
    ESI->profile.count = ( int * ) ptr;
    ptr += sizeof ( int ) * max_counters;
    ESI->profile.threshold = ( int * ) ptr;
@@ -852,9 +1030,12 @@ _papi_hwi_assign_eventset( EventSetInfo_t *ESI, int cidx )
    /* initialize_EventInfoArray */
 
    for ( i = 0; i < max_counters; i++ ) {
+       ESI->profile.regions[i] = NULL;
+       ESI->profile.num_regions[i] = 0;
        ESI->EventInfoArray[i].event_code=( unsigned int ) PAPI_NULL;
        ESI->EventInfoArray[i].ops = NULL;
        ESI->EventInfoArray[i].derived=NOT_DERIVED;
+       ESI->EventInfoArray[i].code = NULL;
        for ( j = 0; j < PAPI_EVENTS_IN_DERIVED_EVENT; j++ ) {
 	   ESI->EventInfoArray[i].pos[j] = PAPI_NULL;
        }
@@ -893,6 +1074,9 @@ _papi_hwi_free_EventSet( EventSetInfo_t * ESI )
 {
 	_papi_hwi_cleanup_eventset( ESI );
 
+	_papi_hwi_sample_ring_destroy( ESI->sample_ring );
+	_papi_hwi_hotspots_destroy( ESI->hotspots );
+
 #ifdef DEBUG
 	memset( ESI, 0x00, sizeof ( EventSetInfo_t ) );
 #endif
@@ -900,15 +1084,17 @@ _papi_hwi_free_EventSet( EventSetInfo_t * ESI )
 
 }
 
+/* Move a batch of free ids from the global stack to thread's own.  */
+/* The lowest ids are on top of both stacks, so they get reused first. */
 static int
-add_EventSet( EventSetInfo_t * ESI, ThreadInfo_t * master )
+get_EventSet_ids( ThreadInfo_t * thread )
 {
 	DynamicArray_t *map = &_papi_hwi_system_info.global_eventset_map;
-	int i, errorCode;
+	int i, n, errorCode;
 
 	_papi_hwi_lock( INTERNAL_LOCK );
 
-	if ( map->availSlots == 0 ) {
+	if ( map->numFree == 0 ) {
 		errorCode = expand_dynamic_array( map );
 		if ( errorCode < PAPI_OK ) {
 			_papi_hwi_unlock( INTERNAL_LOCK );
@@ -916,21 +1102,53 @@ add_EventSet( EventSetInfo_t * ESI, ThreadInfo_t * master )
 		}
 	}
 
-	i = 0;
-	for ( i = 0; i < map->totalSlots; i++ ) {
-		if ( map->dataSlotArray[i] == NULL ) {
-			ESI->master = master;
-			ESI->EventSetIndex = i;
-			map->fullSlots++;
-			map->availSlots--;
-			map->dataSlotArray[i] = ESI;
-			_papi_hwi_unlock( INTERNAL_LOCK );
-			return ( PAPI_OK );
-		}
-	}
+	n = ( map->numFree < PAPI_EVENTSET_BATCH ) ?
+		map->numFree : PAPI_EVENTSET_BATCH;
+	for ( i = n - 1; i >= 0; i-- )
+		thread->free_eventsets[i] = map->freeSlots[--map->numFree];
+	thread->num_free_eventsets = n;
 
 	_papi_hwi_unlock( INTERNAL_LOCK );
-	return ( PAPI_EBUG );
+
+	return ( PAPI_OK );
+}
+
+/* Give n ids back to the global stack, ids[n-1] ends up on top as it */
+/* was on the thread's stack.  Caller holds INTERNAL_LOCK.            */
+static void
+put_EventSet_ids( const int *ids, int n )
+{
+	DynamicArray_t *map = &_papi_hwi_system_info.global_eventset_map;
+	int i;
+
+	for ( i = 0; i < n; i++ )
+		map->freeSlots[map->numFree++] = ids[i];
+}
+
+/* master is the calling thread, so nobody else touches its free ids */
+static int
+add_EventSet( EventSetInfo_t * ESI, ThreadInfo_t * master )
+{
+	DynamicArray_t *map = &_papi_hwi_system_info.global_eventset_map;
+	EventSetSlot_t *slot;
+	int i, errorCode;
+
+	if ( master->num_free_eventsets == 0 ) {
+		errorCode = get_EventSet_ids( master );
+		if ( errorCode < PAPI_OK )
+			return ( errorCode );
+	}
+
+	i = master->free_eventsets[--master->num_free_eventsets];
+
+	ESI->master = master;
+	ESI->EventSetIndex = i;
+
+	slot = _papi_hwi_eventset_slot( map, i );
+	slot->master = master;
+	slot->ESI = ESI;
+
+	return ( PAPI_OK );
 }
 
 int
@@ -1023,23 +1241,91 @@ int
 _papi_hwi_remove_EventSet( EventSetInfo_t * ESI )
 {
 	DynamicArray_t *map = &_papi_hwi_system_info.global_eventset_map;
+	EventSetSlot_t *slot;
+	ThreadInfo_t *thread;
 	int i;
 
 	i = ESI->EventSetIndex;
 
-	_papi_hwi_lock( INTERNAL_LOCK );
+	/* lookups stop finding it before it goes away */
+	slot = _papi_hwi_eventset_slot( map, i );
+	slot->ESI = NULL;
+	__sync_synchronize(  );
+	slot->master = NULL;
 
 	_papi_hwi_free_EventSet( ESI );
 
-	/* do bookkeeping for PAPI_EVENTSET_MAP */
+	/* The id goes to the calling thread, which may not be the owner */
+	thread = _papi_hwi_lookup_thread( 0 );
+	if ( thread == NULL ) {
+		_papi_hwi_lock( INTERNAL_LOCK );
+		put_EventSet_ids( &i, 1 );
+		_papi_hwi_unlock( INTERNAL_LOCK );
+		return PAPI_OK;
+	}
+
+	if ( thread->num_free_eventsets == 2 * PAPI_EVENTSET_BATCH ) {
+		/* keep the ids on top, give back the ones underneath */
+		_papi_hwi_lock( INTERNAL_LOCK );
+		put_EventSet_ids( thread->free_eventsets, PAPI_EVENTSET_BATCH );
+		_papi_hwi_unlock( INTERNAL_LOCK );
+		memmove( thread->free_eventsets,
+				 thread->free_eventsets + PAPI_EVENTSET_BATCH,
+				 PAPI_EVENTSET_BATCH * sizeof ( int ) );
+		thread->num_free_eventsets = PAPI_EVENTSET_BATCH;
+	}
+	thread->free_eventsets[thread->num_free_eventsets++] = i;
+
+	return PAPI_OK;
+}
+
+/* Free the EventSets owned by master, their ids go back to the global */
+/* stack.  Parked EventSets are freed too.                             */
+void
+_papi_hwi_free_thread_EventSets( ThreadInfo_t * master )
+{
+	DynamicArray_t *map = &_papi_hwi_system_info.global_eventset_map;
+	EventSetSlot_t *slot;
+	EventSetInfo_t *ESI;
+	int i;
+
+	if ( master == NULL )
+		return;
+
+	_papi_hwi_lock( INTERNAL_LOCK );
+
+	for ( i = 0; i < map->totalSlots; i++ ) {
+		slot = _papi_hwi_eventset_slot( map, i );
+		if ( ( slot->ESI == NULL ) || ( slot->master != master ) )
+			continue;
+
+		ESI = slot->ESI;
+		INTDBG( "Attempting to remove %d from tid %ld\n", i, master->tid );
 
-	map->dataSlotArray[i] = NULL;
-	map->availSlots++;
-	map->fullSlots--;
+		slot->ESI = NULL;
+		slot->master = NULL;
+		_papi_hwi_free_EventSet( ESI );
+		put_EventSet_ids( &i, 1 );
+	}
+
+	master->recycled_eventsets = NULL;
+	master->num_recycled_eventsets = 0;
 
 	_papi_hwi_unlock( INTERNAL_LOCK );
+}
 
-	return PAPI_OK;
+/* Give the ids thread did not use back to the global stack */
+void
+_papi_hwi_release_EventSet_ids( ThreadInfo_t * thread )
+{
+	DynamicArray_t *map = &_papi_hwi_system_info.global_eventset_map;
+
+	_papi_hwi_lock( INTERNAL_LOCK );
+	/* unless PAPI_shutdown() already freed the map */
+	if ( map->freeSlots )
+		put_EventSet_ids( thread->free_eventsets, thread->num_free_eventsets );
+	thread->num_free_eventsets = 0;
+	_papi_hwi_unlock( INTERNAL_LOCK );
 }
 
 
@@ -1338,6 +1624,7 @@ _papi_hwi_add_event( EventSetInfo_t * ESI, int EventCode )
 
     int i, j, thisindex, remap, retval = PAPI_OK;
     int cidx;
+    struct _postfix_code *code = NULL;
 
 	/* Sanity check the component */
 	cidx=_papi_hwi_component_index( EventCode );
@@ -1407,12 +1694,21 @@ _papi_hwi_add_event( EventSetInfo_t * ESI, int EventCode )
 	     }
 	  }
 
+	  /* Compile the operation string now so reads don't parse it */
+	  retval = postfix_compile( _papi_hwi_presets[preset_index].derived_int,
+				    _papi_hwi_presets[preset_index].postfix,
+				    &code );
+	  if ( retval != PAPI_OK ) {
+	     return retval;
+	  }
+
 	  /* Try to add the preset. */
 
 	  remap = add_native_events( ESI,
 				     _papi_hwi_presets[preset_index].code,
 				     count, &ESI->EventInfoArray[thisindex] );
 	  if ( remap < 0 ) {
+	     papi_free( code );
 	     return remap;
 	  }
           else {
@@ -1423,6 +1719,7 @@ _papi_hwi_add_event( EventSetInfo_t * ESI, int EventCode )
 				  _papi_hwi_presets[preset_index].derived_int;
 	     ESI->EventInfoArray[thisindex].ops =
 				  _papi_hwi_presets[preset_index].postfix;
+	     ESI->EventInfoArray[thisindex].code = code;
              ESI->NumberOfEvents++;
 	     _papi_hwi_map_events_to_native( ESI );
 
@@ -1480,16 +1777,24 @@ _papi_hwi_add_event( EventSetInfo_t * ESI, int EventCode )
 		   }
 		 }
 
+		 retval = postfix_compile( user_defined_events[index].derived_int,
+					   user_defined_events[index].postfix,
+					   &code );
+		 if ( retval != PAPI_OK )
+		   return retval;
+
 		 remap = add_native_events( ESI,
 			 user_defined_events[index].code,
 			 count, &ESI->EventInfoArray[thisindex] );
 
 		 if ( remap < 0 ) {
+		   papi_free( code );
 		   return remap;
 		 } else {
 		   ESI->EventInfoArray[thisindex].event_code = (unsigned int) EventCode;
 		   ESI->EventInfoArray[thisindex].derived = user_defined_events[index].derived_int;
 		   ESI->EventInfoArray[thisindex].ops = user_defined_events[index].postfix;
+		   ESI->EventInfoArray[thisindex].code = code;
            ESI->NumberOfEvents++;
 		   _papi_hwi_map_events_to_native( ESI );
 		 }
@@ -1682,6 +1987,8 @@ _papi_hwi_remove_event( EventSetInfo_t * ESI, int EventCode )
 	}
 	array = ESI->EventInfoArray;
 
+	papi_free( array[thisindex].code );
+
 	/* Compact the Event Info Array list if it's not the last event */
 	/* clear the newly empty slot in the array */
 	for ( ; thisindex < ESI->NumberOfEvents - 1; thisindex++ )
@@ -1693,35 +2000,24 @@ _papi_hwi_remove_event( EventSetInfo_t * ESI, int EventCode )
 		array[thisindex].pos[j] = PAPI_NULL;
 	array[thisindex].ops = NULL;
 	array[thisindex].derived = NOT_DERIVED;
+	array[thisindex].code = NULL;
 	ESI->NumberOfEvents--;
 
 	return ( PAPI_OK );
 }
 
-int
-_papi_hwi_read( hwd_context_t * context, EventSetInfo_t * ESI,
-				long long *values )
+/* This routine distributes hardware counters to software counters in the
+   order that they were added. Note that the higher level
+   EventInfoArray[i] entries may not be contiguous because the user
+   has the right to remove an event.
+   But if we do compaction after remove event, this function can be
+   changed.
+ */
+static void
+distribute_counters( EventSetInfo_t * ESI, long long *dp, long long *values )
 {
-	INTDBG("ENTER: context: %p, ESI: %p, values: %p\n", context, ESI, values);
-	int retval;
-	long long *dp = NULL;
 	int i, index;
 
-	retval = _papi_hwd[ESI->CmpIdx]->read( context, ESI->ctl_state,
-					       &dp, ESI->state );
-	if ( retval != PAPI_OK ) {
-		INTDBG("EXIT: retval: %d\n", retval);
-	   return retval;
-	}
-
-	/* This routine distributes hardware counters to software counters in the
-	   order that they were added. Note that the higher level
-	   EventInfoArray[i] entries may not be contiguous because the user
-	   has the right to remove an event.
-	   But if we do compaction after remove event, this function can be
-	   changed.
-	 */
-
 	for ( i = 0; i != ESI->NumberOfEvents; i++ ) {
 
 		index = ESI->EventInfoArray[i].pos[0];
@@ -1746,6 +2042,129 @@ _papi_hwi_read( hwd_context_t * context, EventSetInfo_t * ESI,
 #endif
 		}
 	}
+}
+
+int
+_papi_hwi_read( hwd_context_t * context, EventSetInfo_t * ESI,
+				long long *values )
+{
+	INTDBG("ENTER: context: %p, ESI: %p, values: %p\n", context, ESI, values);
+	int retval;
+	long long *dp = NULL;
+
+	retval = _papi_hwd[ESI->CmpIdx]->read( context, ESI->ctl_state,
+					       &dp, ESI->state );
+	if ( retval != PAPI_OK ) {
+		INTDBG("EXIT: retval: %d\n", retval);
+	   return retval;
+	}
+
+	distribute_counters( ESI, dp, values );
+
+	INTDBG("EXIT: PAPI_OK\n");
+	return PAPI_OK;
+}
+
+/* Read several running event sets that all belong to the same component. */
+/* The component gets to read all of the control states in one call; if   */
+/* it does not support that we just read the event sets one at a time.    */
+int
+_papi_hwi_read_many( hwd_context_t ** context, EventSetInfo_t ** ESI,
+		     int num, long long **values )
+{
+	INTDBG("ENTER: context: %p, ESI: %p, num: %d, values: %p\n",
+		context, ESI, num, values);
+	int i, cidx, retval;
+	hwd_control_state_t *ctl_stack[PAPI_READ_MANY_STACK];
+	long long *dp_stack[PAPI_READ_MANY_STACK];
+	hwd_control_state_t **ctl = ctl_stack;
+	long long **dp = dp_stack;
+
+	if ( num <= 0 )
+		return PAPI_EINVAL;
+
+	cidx = ESI[0]->CmpIdx;
+
+	if ( num == 1 )
+		return _papi_hwi_read( context[0], ESI[0], values[0] );
+
+	if ( num > PAPI_READ_MANY_STACK ) {
+		ctl = papi_calloc( ( size_t ) num, sizeof ( hwd_control_state_t * ) );
+		dp = papi_calloc( ( size_t ) num, sizeof ( long long * ) );
+		if ( ( ctl == NULL ) || ( dp == NULL ) ) {
+			retval = PAPI_ENOMEM;
+			goto read_many_done;
+		}
+	}
+
+	for ( i = 0; i < num; i++ ) {
+		ctl[i] = ESI[i]->ctl_state;
+	}
+
+	retval = _papi_hwd[cidx]->read_many( context, ctl, num, dp );
+
+	if ( retval == PAPI_ECMP ) {
+		/* component does not batch reads, do them one at a time */
+		for ( i = 0; i < num; i++ ) {
+			retval = _papi_hwi_read( context[i], ESI[i], values[i] );
+			if ( retval != PAPI_OK )
+				break;
+		}
+		goto read_many_done;
+	}
+
+	if ( retval != PAPI_OK )
+		goto read_many_done;
+
+	for ( i = 0; i < num; i++ ) {
+		distribute_counters( ESI[i], dp[i], values[i] );
+	}
+
+read_many_done:
+	if ( ctl != ctl_stack ) {
+		papi_free( dp );
+		papi_free( ctl );
+	}
+
+	INTDBG("EXIT: retval: %d\n", retval);
+	return retval;
+}
+
+/* Read an event set that counts on several cpus one cpu at a time.  The */
+/* component hands back a row of native counts per cpu, each of which is */
+/* turned into a row of event values.  *num_cpus holds the number of     */
+/* rows values and cpus have room for on entry and the number of cpus on */
+/* return; if there is not enough room nothing is copied.                */
+int
+_papi_hwi_read_cpus( hwd_context_t * context, EventSetInfo_t * ESI,
+		     long long *values, int *cpus, int *num_cpus )
+{
+	INTDBG("ENTER: context: %p, ESI: %p, values: %p, num_cpus: %d\n",
+		context, ESI, values, *num_cpus);
+	int i, retval, rows = 0;
+	int *dp_cpus = NULL;
+	long long *dp = NULL;
+
+	retval = _papi_hwd[ESI->CmpIdx]->read_cpus( context, ESI->ctl_state,
+						    &dp, &dp_cpus, &rows );
+	if ( retval != PAPI_OK ) {
+		INTDBG("EXIT: retval: %d\n", retval);
+		return retval;
+	}
+
+	if ( rows > *num_cpus ) {
+		*num_cpus = rows;
+		INTDBG("EXIT: PAPI_EBUF, %d cpus\n", rows);
+		return PAPI_EBUF;
+	}
+
+	for ( i = 0; i < rows; i++ ) {
+		distribute_counters( ESI, dp + i * ESI->NativeCount,
+				     values + i * ESI->NumberOfEvents );
+		if ( cpus )
+			cpus[i] = dp_cpus[i];
+	}
+	*num_cpus = rows;
 
 	INTDBG("EXIT: PAPI_OK\n");
 	return PAPI_OK;
@@ -1797,6 +2216,8 @@ _papi_hwi_cleanup_eventset( EventSetInfo_t * ESI )
       }
       ESI->EventInfoArray[i].ops = NULL;
       ESI->EventInfoArray[i].derived = NOT_DERIVED;
+      papi_free( ESI->EventInfoArray[i].code );
+      ESI->EventInfoArray[i].code = NULL;
    }
 
    context = _papi_hwi_get_context( ESI, NULL );
@@ -1839,8 +2260,13 @@ _papi_hwi_cleanup_eventset( EventSetInfo_t * ESI )
    if ( ESI->overflow.deadline )
       papi_free( ESI->overflow.deadline );
 
-   if ( ESI->profile.prof )
+   if ( ESI->profile.prof ) {
+      for ( i = 0; i < ESI->profile.event_counter; i++ ) {
+         if ( ESI->profile.regions[i] )
+            papi_free( ESI->profile.regions[i] );
+      }
       papi_free( ESI->profile.prof );
+   }
 
    ESI->ctl_state = NULL;
    ESI->sw_stop = NULL;
@@ -1895,7 +2321,8 @@ _papi_hwi_convert_eventset_to_multiplex( _papi_int_multiplex_t * mpx )
 
 		if ( ( _papi_hwd[ESI->CmpIdx]->cmp_info.kernel_multiplex == 0 ) ||
 			 ( ( _papi_hwd[ESI->CmpIdx]->cmp_info.kernel_multiplex ) &&
-			   ( flags & PAPI_MULTIPLEX_FORCE_SW ) ) ) {
+			   ( flags & ( PAPI_MULTIPLEX_FORCE_SW |
+						   PAPI_MULTIPLEX_THREAD_TIMER ) ) ) ) {
 			retval =
 				MPX_add_events( &ESI->multiplex.mpx_evset, mpxlist, j,
 								ESI->domain.domain,
@@ -1913,8 +2340,11 @@ _papi_hwi_convert_eventset_to_multiplex( _papi_int_multiplex_t * mpx )
 
 	ESI->state |= PAPI_MULTIPLEXING;
 	if ( _papi_hwd[ESI->CmpIdx]->cmp_info.kernel_multiplex &&
-		 ( flags & PAPI_MULTIPLEX_FORCE_SW ) )
+		 ( flags & ( PAPI_MULTIPLEX_FORCE_SW | PAPI_MULTIPLEX_THREAD_TIMER ) ) )
 		ESI->multiplex.flags = PAPI_MULTIPLEX_FORCE_SW;
+	/* The thread timer only matters if PAPI does the multiplexing */
+	if ( flags & PAPI_MULTIPLEX_THREAD_TIMER )
+		ESI->multiplex.flags |= PAPI_MULTIPLEX_THREAD_TIMER;
 	ESI->multiplex.ns = ( int ) mpx->ns;
 
 	return ( PAPI_OK );
@@ -1924,21 +2354,53 @@ _papi_hwi_convert_eventset_to_multiplex( _papi_int_multiplex_t * mpx )
 
 int papi_num_components = ( sizeof ( _papi_hwd ) / sizeof ( *_papi_hwd ) ) - 1;
 
+/* Call the init routine of a component, returning what it returned */
+static int
+init_component( int cidx )
+{
+	int retval;
+
+	retval = _papi_hwd[cidx]->init_component( cidx );
+
+	/* Do some sanity checking */
+	if (retval==PAPI_OK) {
+	   if (_papi_hwd[cidx]->cmp_info.num_cntrs >
+	       _papi_hwd[cidx]->cmp_info.num_mpx_cntrs) {
+	      fprintf(stderr,"Warning!  num_cntrs %d is more than num_mpx_cntrs %d for component %s\n",
+                        _papi_hwd[cidx]->cmp_info.num_cntrs,
+                        _papi_hwd[cidx]->cmp_info.num_mpx_cntrs,
+                        _papi_hwd[cidx]->cmp_info.name);
+	   }
+	}
+
+	return retval;
+}
+
 /*
  * Routine that initializes all available components.
  * A component is available if a pointer to its info vector
  * appears in the NULL terminated_papi_hwd table.
+ *
+ * If PAPI_LAZY_INIT is set in the environment, only component 0
+ * (the cpu component, which also sets up the presets) is initialized
+ * here.  The others are marked PAPI_EDELAY_INIT and initialized by
+ * _papi_hwi_init_pending_component() the first time they are used.
  */
 int
 _papi_hwi_init_global( void )
 {
         int retval, i = 0;
+	int lazy;
+	char *var;
 
 	retval = _papi_hwi_innoculate_os_vector( &_papi_os_vector );
 	if ( retval != PAPI_OK ) {
 	   return retval;
 	}
 
+	var = getenv( "PAPI_LAZY_INIT" );
+	lazy = ( var != NULL ) && ( var[0] != '\0' ) && strcmp( var, "0" );
+
 	while ( _papi_hwd[i] ) {
 
 	   retval = _papi_hwi_innoculate_vector( _papi_hwd[i] );
@@ -1947,20 +2409,15 @@ _papi_hwi_init_global( void )
 	   }
 
 	   /* We can be disabled by user before init */
-	   if (!_papi_hwd[i]->cmp_info.disabled) {
-	      retval = _papi_hwd[i]->init_component( i );
-	      _papi_hwd[i]->cmp_info.disabled=retval;
-
-	      /* Do some sanity checking */
-	      if (retval==PAPI_OK) {
-		if (_papi_hwd[i]->cmp_info.num_cntrs >
-		    _papi_hwd[i]->cmp_info.num_mpx_cntrs) {
-		  fprintf(stderr,"Warning!  num_cntrs %d is more than num_mpx_cntrs %d for component %s\n",
-                        _papi_hwd[i]->cmp_info.num_cntrs,
-                        _papi_hwd[i]->cmp_info.num_mpx_cntrs,
-                        _papi_hwd[i]->cmp_info.name);
-		}
-
+	   if ((!_papi_hwd[i]->cmp_info.disabled) ||
+	       (_papi_hwd[i]->cmp_info.disabled==PAPI_EDELAY_INIT)) {
+	      if ( lazy && ( i > 0 ) ) {
+	         _papi_hwd[i]->cmp_info.disabled=PAPI_EDELAY_INIT;
+	         strncpy(_papi_hwd[i]->cmp_info.disabled_reason,
+	                 "Initialization delayed until first use",
+	                 PAPI_MAX_STR_LEN);
+	      } else {
+	         _papi_hwd[i]->cmp_info.disabled=init_component( i );
 	      }
 	   }
 
@@ -1969,6 +2426,42 @@ _papi_hwi_init_global( void )
 	return PAPI_OK;
 }
 
+/*
+ * Initialize a component PAPI_LAZY_INIT left for its first use, along
+ * with its context in every thread PAPI already knows about.  Returns
+ * the component's disabled value, so PAPI_OK means it can be used.
+ */
+int
+_papi_hwi_init_pending_component( int cidx )
+{
+	int retval;
+
+	if ( _papi_hwd[cidx]->cmp_info.disabled != PAPI_EDELAY_INIT ) {
+	   return _papi_hwd[cidx]->cmp_info.disabled;
+	}
+
+	_papi_hwi_lock( GLOBAL_LOCK );
+
+	/* someone may have beaten us to it */
+	if ( _papi_hwd[cidx]->cmp_info.disabled == PAPI_EDELAY_INIT ) {
+	   INTDBG( "Delayed initialization of component %d (%s)\n",
+		   cidx, _papi_hwd[cidx]->cmp_info.name );
+
+	   _papi_hwd[cidx]->cmp_info.disabled_reason[0] = '\0';
+	   retval = init_component( cidx );
+	   if ( retval == PAPI_OK ) {
+	      /* this marks the component usable, under THREADS_LOCK */
+	      _papi_hwi_init_thread_component( cidx );
+	   } else {
+	      _papi_hwd[cidx]->cmp_info.disabled = retval;
+	   }
+	}
+
+	_papi_hwi_unlock( GLOBAL_LOCK );
+
+	return _papi_hwd[cidx]->cmp_info.disabled;
+}
+
 /* Machine info struct initialization using defaults */
 /* See _papi_mdi definition in papi_internal.h       */
 
@@ -2012,14 +2505,17 @@ _papi_hwi_shutdown_global_internal( void )
 
     free(_papi_native_events);
     _papi_native_events = NULL;        // In case a new library init is done.
+    free(native_event_hash);
+    native_event_hash = NULL;
+    free(native_name_hash);
+    native_name_hash = NULL;
+    native_hash_mask=0;
     num_native_events=0;               // .. 
     num_native_chunks=0;               // .. 
 
     _papi_hwi_free_papi_event_string();
 
-	papi_free(  _papi_hwi_system_info.global_eventset_map.dataSlotArray );
-	memset(  &_papi_hwi_system_info.global_eventset_map,
-		 0x00, sizeof ( DynamicArray_t ) );
+	free_eventset_map( &_papi_hwi_system_info.global_eventset_map );
 
 	_papi_hwi_unlock( INTERNAL_LOCK );
 
@@ -2098,93 +2594,221 @@ handle_derived_add_ps( int *position, long long *from )
 	return ( units_per_second( tmp, from[position[0]] ) );
 }
 
-/* this function implement postfix calculation, it reads in a string where I use:
+/* DERIVED_POSTFIX operation strings use:
       |      as delimiter
       N2     indicate No. 2 native event in the derived preset
       +, -, *, /  as operator
       #      as MHZ(million hz) got from  _papi_hwi_system_info.hw_info.cpu_max_mhz*1000000.0
 
   Haihang (you@cs.utk.edu)
-*/ 
- static long long
- _papi_hwi_postfix_calc( EventInfo_t * evi, long long *hw_counter )
- {
-        char *point = evi->ops, operand[16];
-        double stack[PAPI_EVENTS_IN_DERIVED_EVENT];
-       int i, val, top = 0;
-
-       INTDBG("ENTER: evi: %p, evi->ops: %p (%s), evi->pos[0]: %d, evi->pos[1]: %d, hw_counter: %p (%lld %lld)\n",
-              evi, evi->ops, evi->ops, evi->pos[0], evi->pos[1], hw_counter, hw_counter[0], hw_counter[1]);
-
-        memset(&stack,0,PAPI_EVENTS_IN_DERIVED_EVENT*sizeof(double));
-
-        while ( *point != '\0' ) {
-               if ( *point == '|' ) {  /* consume '|' characters */
-                        point++;
-                } else if ( *point == 'N' ) {   /* to get count for each native event */
-                        point++;
-                       i = 0;
-                       while ( isdigit(*point) ) {
-                               assert(i<16);
-                                operand[i] = *point;
-                                point++;
-                                i++;
-                       }
-                       assert(0<i && i<16);
-                        operand[i] = '\0';
-                       val = atoi( operand );
-                       assert( top < PAPI_EVENTS_IN_DERIVED_EVENT );
-                       assert( 0 <= val && val < PAPI_EVENTS_IN_DERIVED_EVENT );
-                       stack[top] = ( double ) hw_counter[evi->pos[val]];
-                        top++;
-               } else if ( *point == '#' ) {   /* to get mhz */
-                        point++;
-                       assert( top < PAPI_EVENTS_IN_DERIVED_EVENT );
-                        stack[top] = _papi_hwi_system_info.hw_info.cpu_max_mhz * 1000000.0;
-                        top++;
-               } else if ( isdigit( *point ) ) {
-                        i = 0;
-                       while ( isdigit(*point) ) {
-                               assert(i<16);
-                                operand[i] = *point;
-                                point++;
-                                i++;
-                       }
-                       assert(0<i && i<16);
-                        operand[i] = '\0';
-                       assert( top < PAPI_EVENTS_IN_DERIVED_EVENT );
-                        stack[top] = atoi( operand );
-                        top++;
-                } else if ( *point == '+' ) {   /* + calculation */
-                       point++;
-                       assert(top >= 2);
-                        stack[top - 2] += stack[top - 1];
-                        top--;
-                } else if ( *point == '-' ) {   /* - calculation */
-                       point++;
-                       assert(top >= 2);
-                        stack[top - 2] -= stack[top - 1];
-                        top--;
-                } else if ( *point == '*' ) {   /* * calculation */
-                       point++;
-                       assert(top >= 2);
-                        stack[top - 2] *= stack[top - 1];
-                        top--;
-                } else if ( *point == '/' ) {   /* / calculation */
-                       point++;
-                       assert(top >= 2);
-                       /* FIXME should handle runtime divide by zero */
-                        stack[top - 2] /= stack[top - 1];
-                        top--;
-               } else { /* flag an error parsing the preset */
-                       PAPIERROR( "BUG! Unable to parse \"%s\"", evi->ops );
-                       return ( long long ) stack[0];
-                }
-        }
-        assert(top == 1);
-        INTDBG("EXIT: stack[0]: %lld\n", (long long)stack[0]);
-        return ( long long ) stack[0];
- }
+
+  The string is compiled once, when the event is added to an EventSet,
+  into a short list of stack machine instructions so that reading the
+  event does not have to parse text.  Operand indices and stack depth are
+  checked at compile time.  If the string has no division the result
+  is exact in integer arithmetic, so we avoid the round trip through
+  doubles entirely.
+*/
+
+enum {
+	POSTFIX_EVENT,		/* push hw_counter[evi->pos[index]] */
+	POSTFIX_CONST,		/* push value */
+	POSTFIX_ADD,
+	POSTFIX_SUB,
+	POSTFIX_MUL,
+	POSTFIX_DIV
+};
+
+typedef struct _postfix_insn {
+	int op;
+	int index;
+	long long value;
+} postfix_insn_t;
+
+struct _postfix_code {
+	int integer;		/* no division, evaluate with long longs */
+	int num_insns;
+	postfix_insn_t insns[];
+};
+
+static int
+postfix_compile( int derived, char *ops, struct _postfix_code **code )
+{
+	struct _postfix_code *prog;
+	char *point = ops;
+	int n = 0, depth = 0, max_insns;
+	long long val;
+
+	*code = NULL;
+
+	if ( derived != DERIVED_POSTFIX )
+		return PAPI_OK;
+
+	if ( ops == NULL ) {
+		PAPIERROR( "BUG! DERIVED_POSTFIX event without an operation string" );
+		return PAPI_EBUG;
+	}
+
+	/* every instruction uses at least one character */
+	max_insns = ( int ) strlen( ops );
+
+	prog = papi_calloc( 1, sizeof ( struct _postfix_code ) +
+			    ( size_t ) max_insns * sizeof ( postfix_insn_t ) );
+	if ( prog == NULL )
+		return PAPI_ENOMEM;
+
+	prog->integer = 1;
+
+	while ( *point != '\0' ) {
+		if ( *point == '|' ) {	/* consume '|' characters */
+			point++;
+			continue;
+		}
+
+		if ( ( *point == 'N' ) || ( *point == '#' ) || isdigit( *point ) ) {
+			if ( depth >= PAPI_EVENTS_IN_DERIVED_EVENT )
+				goto postfix_error;
+
+			if ( *point == 'N' ) {	/* count for a native event */
+				point++;
+				if ( !isdigit( *point ) )
+					goto postfix_error;
+				val = strtoll( point, &point, 10 );
+				if ( val < 0 || val >= PAPI_EVENTS_IN_DERIVED_EVENT )
+					goto postfix_error;
+				prog->insns[n].op = POSTFIX_EVENT;
+				prog->insns[n].index = ( int ) val;
+			} else if ( *point == '#' ) {	/* mhz */
+				point++;
+				prog->insns[n].op = POSTFIX_CONST;
+				prog->insns[n].value = ( long long )
+					_papi_hwi_system_info.hw_info.cpu_max_mhz * 1000000LL;
+			} else {
+				prog->insns[n].op = POSTFIX_CONST;
+				prog->insns[n].value = strtoll( point, &point, 10 );
+			}
+			depth++;
+		} else {
+			switch ( *point ) {
+			case '+':
+				prog->insns[n].op = POSTFIX_ADD;
+				break;
+			case '-':
+				prog->insns[n].op = POSTFIX_SUB;
+				break;
+			case '*':
+				prog->insns[n].op = POSTFIX_MUL;
+				break;
+			case '/':
+				prog->insns[n].op = POSTFIX_DIV;
+				prog->integer = 0;
+				break;
+			default:
+				goto postfix_error;
+			}
+			point++;
+			if ( depth < 2 )
+				goto postfix_error;
+			depth--;
+		}
+		n++;
+	}
+
+	if ( depth != 1 )
+		goto postfix_error;
+
+	prog->num_insns = n;
+	*code = prog;
+
+	INTDBG( "compiled \"%s\" to %d instructions (%s)\n", ops, n,
+		prog->integer ? "integer" : "floating point" );
+
+	return PAPI_OK;
+
+postfix_error:
+	PAPIERROR( "BUG! Unable to parse \"%s\"", ops );
+	papi_free( prog );
+	return PAPI_EBUG;
+}
+
+static long long
+_papi_hwi_postfix_calc( EventInfo_t * evi, long long *hw_counter )
+{
+	struct _postfix_code *prog = evi->code;
+	postfix_insn_t *insn, *end;
+	int top = 0;
+
+	INTDBG("ENTER: evi: %p, evi->ops: %p (%s), evi->pos[0]: %d, evi->pos[1]: %d, hw_counter: %p (%lld %lld)\n",
+	       evi, evi->ops, evi->ops, evi->pos[0], evi->pos[1], hw_counter, hw_counter[0], hw_counter[1]);
+
+	if ( prog == NULL ) {
+		PAPIERROR( "BUG! DERIVED_POSTFIX event was not compiled" );
+		return ( long long ) 0;
+	}
+
+	end = prog->insns + prog->num_insns;
+
+	if ( prog->integer ) {
+		long long stack[PAPI_EVENTS_IN_DERIVED_EVENT];
+
+		for ( insn = prog->insns; insn < end; insn++ ) {
+			switch ( insn->op ) {
+			case POSTFIX_EVENT:
+				stack[top++] = hw_counter[evi->pos[insn->index]];
+				break;
+			case POSTFIX_CONST:
+				stack[top++] = insn->value;
+				break;
+			case POSTFIX_ADD:
+				stack[top - 2] += stack[top - 1];
+				top--;
+				break;
+			case POSTFIX_SUB:
+				stack[top - 2] -= stack[top - 1];
+				top--;
+				break;
+			case POSTFIX_MUL:
+				stack[top - 2] *= stack[top - 1];
+				top--;
+				break;
+			}
+		}
+		INTDBG("EXIT: stack[0]: %lld\n", stack[0]);
+		return stack[0];
+	} else {
+		double stack[PAPI_EVENTS_IN_DERIVED_EVENT];
+
+		for ( insn = prog->insns; insn < end; insn++ ) {
+			switch ( insn->op ) {
+			case POSTFIX_EVENT:
+				stack[top++] = ( double ) hw_counter[evi->pos[insn->index]];
+				break;
+			case POSTFIX_CONST:
+				stack[top++] = ( double ) insn->value;
+				break;
+			case POSTFIX_ADD:
+				stack[top - 2] += stack[top - 1];
+				top--;
+				break;
+			case POSTFIX_SUB:
+				stack[top - 2] -= stack[top - 1];
+				top--;
+				break;
+			case POSTFIX_MUL:
+				stack[top - 2] *= stack[top - 1];
+				top--;
+				break;
+			case POSTFIX_DIV:
+				/* FIXME should handle runtime divide by zero */
+				stack[top - 2] /= stack[top - 1];
+				top--;
+				break;
+			}
+		}
+		INTDBG("EXIT: stack[0]: %lld\n", (long long)stack[0]);
+		return ( long long ) stack[0];
+	}
+}
 
 static long long
 handle_derived( EventInfo_t * evi, long long *from )
@@ -2443,7 +3067,7 @@ _papi_hwi_native_name_to_code( const char *in, int *out )
 	char name[PAPI_HUGE_STR_LEN];	/* make sure it's big enough */
 
 	unsigned int i;
-	int cidx;
+	int cidx, n;
 	char *full_event_name;
 
 	if (in == NULL) {
@@ -2455,10 +3079,38 @@ _papi_hwi_native_name_to_code( const char *in, int *out )
 
 	in = _papi_hwi_strip_component_prefix(in);
 
-	// look in each component
-	for(cidx=0; cidx < papi_num_components; cidx++) {
+	// names we have handed out a code for before only need the component
+	// that owns them to confirm the code, not a search of every component
+	retval = _papi_hwi_find_native_event_name(in, full_event_name);
+	if ((retval >= 0) &&
+	    _papi_hwi_check_native_event_name(retval & PAPI_NATIVE_AND_MASK, in)) {
+		*out = retval;
+		_papi_hwi_set_papi_event_code(-1, -1);
+		free (full_event_name);
+		INTDBG("EXIT: PAPI_OK  event: %s code: %#x (cached)\n", in, *out);
+		return PAPI_OK;
+	}
+	retval = PAPI_ENOEVNT;
 
-		if (_papi_hwd[cidx]->cmp_info.disabled) continue;
+	// look in each component, first those already initialized, then
+	// those PAPI_LAZY_INIT left for later (which we initialize here)
+	for(n=0; n < 2*papi_num_components; n++) {
+
+		cidx = n % papi_num_components;
+
+		if (n < papi_num_components) {
+			if (_papi_hwd[cidx]->cmp_info.disabled) continue;
+		} else {
+			if (_papi_hwd[cidx]->cmp_info.disabled != PAPI_EDELAY_INIT) continue;
+
+			// do not bring up a component the name says is not the one
+			if ((strstr(full_event_name, ":::") != NULL) &&
+			    (is_supported_by_component(cidx, full_event_name) == 0)) {
+				continue;
+			}
+
+			if (_papi_hwi_init_pending_component(cidx) != PAPI_OK) continue;
+		}
 
 		// if this component does not support the pmu
 		// which defines this event, no need to call it
@@ -2650,12 +3302,21 @@ EventSetInfo_t *
 _papi_hwi_lookup_EventSet( int eventset )
 {
 	const DynamicArray_t *map = &_papi_hwi_system_info.global_eventset_map;
+	const EventSetSlot_t *chunk;
 	EventSetInfo_t *set;
 
-	if ( ( eventset < 0 ) || ( eventset > map->totalSlots ) )
+	if ( ( eventset < 0 ) ||
+		 ( eventset >= PAPI_EVENTSET_CHUNKS * PAPI_INIT_SLOTS ) )
+		return ( NULL );
+
+	/* chunks are filled in once and never move, so no lock is needed */
+	chunk = map->chunks[eventset / PAPI_INIT_SLOTS];
+	if ( chunk == NULL )
 		return ( NULL );
 
-	set = map->dataSlotArray[eventset];
+	set = chunk[eventset % PAPI_INIT_SLOTS].ESI;
+	if ( ( set == NULL ) || ( set->recycled ) )
+		return ( NULL );
 #ifdef DEBUG
 	if ( ( ISLEVEL( DEBUG_THREADS ) ) && ( _papi_hwi_thread_id_fn ) &&
 		 ( set->master->tid != _papi_hwi_thread_id_fn(  ) ) )
@@ -2676,7 +3337,7 @@ _papi_hwi_is_sw_multiplex(EventSetInfo_t *ESI)
    /* Does the component support kernel multiplexing */
    if ( _papi_hwd[ESI->CmpIdx]->cmp_info.kernel_multiplex ) {
       /* Have we forced software multiplexing */
-      if ( ESI->multiplex.flags == PAPI_MULTIPLEX_FORCE_SW ) {
+      if ( ESI->multiplex.flags & PAPI_MULTIPLEX_FORCE_SW ) {
 	 return 1;
       }
       /* Nope, using hardware multiplexing */
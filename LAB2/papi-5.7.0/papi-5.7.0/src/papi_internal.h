@@ -155,9 +155,18 @@ typedef struct _EventSetInheritInfo
 	int inherit;
 } EventSetInheritInfo_t;
 
+/** One PAPI_sprofil_t region of a profile, as found by its start address
+ *  @internal */
+typedef struct _ProfileRegion {
+   caddr_t pr_off;      /**< start address of the region */
+   int index;           /**< of the region in the PAPI_sprofil_t array */
+} ProfileRegion_t;
+
 /** @internal */
 typedef struct _EventSetProfileInfo {
    PAPI_sprofil_t **prof;
+   ProfileRegion_t **regions;  /**< regions sorted by pr_off, for lookups */
+   int *num_regions;
    int *count;     /**< Number of buffers */
    int *threshold;
    int *EventIndex;
@@ -179,6 +188,7 @@ typedef struct _EventInfo {
    int pos[PAPI_EVENTS_IN_DERIVED_EVENT];   /**< position in the counter array for this events components */
    char *ops;                   /**< operation string of preset (points into preset event struct) */
    int derived;                 /**< Counter derivation command used for derived events */
+   struct _postfix_code *code;  /**< ops compiled when the event was added, for DERIVED_POSTFIX */
 } EventInfo_t;
 
 /** This contains info about each native event added to the EventSet.
@@ -229,6 +239,11 @@ typedef struct _masterevent {
    struct _masterevent *next;
 } MasterEvent;
 
+/* Linux can direct a POSIX timer signal at a single thread */
+#if defined(__linux__)
+#define MPX_THREAD_TIMER
+#endif
+
 /** @internal */
 typedef struct _threadlist {
 #ifdef PTHREADS
@@ -242,6 +257,12 @@ typedef struct _threadlist {
    MasterEvent *cur_event;
    /** List of multiplexing events for this thread */
    MasterEvent *head;
+#ifdef MPX_THREAD_TIMER
+   /** Private rotation timer, see PAPI_MULTIPLEX_THREAD_TIMER */
+   timer_t timer;
+   int has_timer;
+   int timer_armed;
+#endif
    /** Pointer to next thread */
    struct _threadlist *next;
 } Threadlist;
@@ -306,17 +327,46 @@ typedef struct _EventSetInfo {
   EventSetCpuInfo_t cpu;
   EventSetProfileInfo_t profile;
   EventSetInheritInfo_t inherit;
+  struct _papi_sample_ring *sample_ring; /**< overflow samples for PAPI_read_samples, NULL if not enabled */
+  struct _papi_hotspots *hotspots; /**< samples of sample_ring aggregated by symbol, NULL if not enabled */
+  int recycled;                /**< parked by PAPI_recycle_eventset, invisible to lookups */
+  struct _EventSetInfo *next_recycled; /**< next EventSet parked by the same thread */
 } EventSetInfo_t;
 
-/** @internal */
+/** EventSet ids index chunks of PAPI_INIT_SLOTS slots that are never
+ *  moved or freed before PAPI shuts down, so looking an id up takes no
+ *  lock.  Free ids are kept on a stack under INTERNAL_LOCK and handed to
+ *  threads in batches (see ThreadInfo_t), so creating and destroying
+ *  EventSets only takes the lock once every PAPI_EVENTSET_BATCH times.
+ *  This caps the ids at PAPI_EVENTSET_CHUNKS * PAPI_INIT_SLOTS (262144)
+ *  EventSets alive at once, past that PAPI_create_eventset() fails with
+ *  PAPI_ENOMEM.
+ *	@internal */
+#define PAPI_EVENTSET_CHUNKS 4096
+
+typedef struct _eventset_slot {
+   EventSetInfo_t *volatile ESI;  /**< NULL if the id is free */
+   struct _ThreadInfo *master;    /**< owner, so scans need not touch ESI */
+} EventSetSlot_t;
+
 typedef struct _dynamic_array {
-   EventSetInfo_t **dataSlotArray;      /**< array of ptrs to EventSets */
-   int totalSlots;              /**< number of slots in dataSlotArrays      */
-   int availSlots;              /**< number of open slots in dataSlotArrays */
-   int fullSlots;               /**< number of full slots in dataSlotArray    */
-   int lowestEmptySlot;         /**< index of lowest empty dataSlotArray    */
+   EventSetSlot_t *volatile chunks[PAPI_EVENTSET_CHUNKS]; /**< PAPI_INIT_SLOTS slots each */
+   volatile int totalSlots;     /**< number of slots in the chunks allocated */
+   int *freeSlots;              /**< stack of free ids, lowest on top       */
+   int numFree;                 /**< number of ids on freeSlots             */
 } DynamicArray_t;
 
+/** The slot of EventSet id i, i must be below totalSlots
+ *	@internal */
+#define _papi_hwi_eventset_slot( map, i ) \
+   ( &(map)->chunks[( i ) / PAPI_INIT_SLOTS][( i ) % PAPI_INIT_SLOTS] )
+
+/** PAPI_read_many() keeps its per call arrays on the stack for up to
+ *  this many EventSets, only bigger calls allocate them.  Enough for a
+ *  few dozen EventSets, that is 2 KB of stack on 64 bit.
+ *	@internal */
+#define PAPI_READ_MANY_STACK 64
+
 /* Component option types for _papi_hwd_ctl. */
 
 typedef struct _papi_int_attach {
@@ -384,6 +434,29 @@ typedef struct _papi_int_addr_range { /* if both are zero, range is disabled */
                                  /**< if offsets are undefined, they are both set to -1 */
 } _papi_int_addr_range_t;
 
+typedef struct _papi_int_sample_ring {
+   EventSetInfo_t *ESI;
+   struct _papi_sample_ring *ring;
+} _papi_int_sample_ring_t;
+
+typedef struct _papi_int_hotspots {
+   EventSetInfo_t *ESI;
+   struct _papi_sample_ring *ring;
+   int depth;
+} _papi_int_hotspots_t;
+
+typedef struct _papi_int_read_stats {
+   EventSetInfo_t *ESI;
+   long long fast;
+   long long mixed;
+   long long slow;
+} _papi_int_read_stats_t;
+
+typedef struct _papi_int_virtual_start {
+   EventSetInfo_t *ESI;
+   int enable;
+} _papi_int_virtual_start_t;
+
 typedef union _papi_int_option_t {
    _papi_int_overflow_t overflow;
    _papi_int_profile_t profile;
@@ -395,6 +468,10 @@ typedef union _papi_int_option_t {
 	_papi_int_inherit_t inherit;
 	_papi_int_granularity_t granularity;
 	_papi_int_addr_range_t address_range;
+	_papi_int_read_stats_t read_stats;
+	_papi_int_sample_ring_t sample_ring;
+	_papi_int_virtual_start_t virtual_start;
+	_papi_int_hotspots_t hotspots;
 } _papi_int_option_t;
 
 /** Hardware independent context
@@ -458,14 +535,21 @@ int _papi_hwi_create_eventset( int *EventSet, ThreadInfo_t * handle );
 int _papi_hwi_lookup_EventCodeIndex( const EventSetInfo_t * ESI,
 				     unsigned int EventCode );
 int _papi_hwi_remove_EventSet( EventSetInfo_t * ESI );
+void _papi_hwi_free_thread_EventSets( ThreadInfo_t * master );
+void _papi_hwi_release_EventSet_ids( ThreadInfo_t * thread );
 void _papi_hwi_map_events_to_native( EventSetInfo_t *ESI);
 int _papi_hwi_add_event( EventSetInfo_t * ESI, int EventCode );
 int _papi_hwi_remove_event( EventSetInfo_t * ESI, int EventCode );
 int _papi_hwi_read( hwd_context_t * context, EventSetInfo_t * ESI,
 		    long long *values );
+int _papi_hwi_read_many( hwd_context_t ** context, EventSetInfo_t ** ESI,
+			 int num, long long **values );
+int _papi_hwi_read_cpus( hwd_context_t * context, EventSetInfo_t * ESI,
+			 long long *values, int *cpus, int *num_cpus );
 int _papi_hwi_cleanup_eventset( EventSetInfo_t * ESI );
 int _papi_hwi_convert_eventset_to_multiplex( _papi_int_multiplex_t * mpx );
 int _papi_hwi_init_global( void );
+int _papi_hwi_init_pending_component( int cidx );
 int _papi_hwi_init_global_internal( void );
 int _papi_hwi_init_os(void);
 void _papi_hwi_init_errors(void);
@@ -28,12 +28,15 @@ struct native_event_t {
 #define PMU_TYPE_UNCORE 2
 #define PMU_TYPE_OS     4
 
+struct pe_name_index;
+
 struct native_event_table_t {
    struct native_event_t *native_events;
    int num_native_events;
    int allocated_native_events;
    pfm_pmu_info_t default_pmu;
    int pmu_type;
+   struct pe_name_index * volatile name_index;  /* hashed event names */
 };
 
 
@@ -11,6 +11,16 @@
  * allocated through these calls.
  * The optional epilog is enabled if DEBUG is defined, and contains 
  * a distinctive pattern that allows checking for pointer overflow.
+ *
+ * The linked list, and the global lock that protects it, only exist in
+ * DEBUG builds.  Otherwise the prolog points to the per-thread pool the
+ * block came from.  Blocks are rounded up to a power of two size class,
+ * carved out of slabs and recycled through the pool's free lists, so steady
+ * state allocation takes neither a lock nor a call to malloc.  Blocks freed
+ * by another thread are handed back to their pool through a lock free list.
+ * The slabs, and the blocks too big for a size class, are kept on global
+ * lists so that _papi_valid_free can tell our blocks from anybody else's
+ * and _papi_mem_cleanup_all can give everything back.
  */
 
 #define IN_MEM_FILE
@@ -28,7 +38,11 @@
  * This is usually the size of a pointer, but in some cases needs to be bigger
  * to preserve data alignment.
  */
+#ifdef DEBUG
 #define MEM_PROLOG (2*sizeof(void *))
+#else
+#define MEM_PROLOG 16		/* room for a pmem_hdr_t */
+#endif
 
 /* If you are tracing memory, then DEBUG must be set also. */
 #ifdef DEBUG
@@ -42,6 +56,8 @@
 #define MEM_EPILOG_4 0xA
 #endif
 
+#ifdef DEBUG
+
 /* Local global variables */
 static pmem_t *mem_head = NULL;
 
@@ -109,17 +125,6 @@ _papi_realloc( char *file, int line, void *ptr, size_t size )
 	return ( mem_ptr->ptr );
 }
 
-void *
-_papi_calloc( char *file, int line, size_t nmemb, size_t size )
-{
-	void *ptr = _papi_malloc( file, line, size * nmemb );
-
-	if ( !ptr )
-		return ( NULL );
-	memset( ptr, 0, size * nmemb );
-	return ( ptr );
-}
-
 void *
 _papi_malloc( char *file, int line, size_t size )
 {
@@ -165,26 +170,6 @@ _papi_malloc( char *file, int line, size_t size )
 	return ( NULL );
 }
 
-char *
-_papi_strdup( char *file, int line, const char *s )
-{
-	size_t size;
-	char *ptr;
-
-	if ( !s )
-		return ( NULL );
-
-	/* String Length +1 for \0 */
-	size = strlen( s ) + 1;
-	ptr = ( char * ) _papi_malloc( file, line, size );
-
-	if ( !ptr )
-		return ( NULL );
-
-	memcpy( ptr, s, size );
-	return ( ptr );
-}
-
 /** Only frees the memory if PAPI malloced it 
   * returns 1 if pointer was valid; 0 if not */
 int
@@ -484,3 +469,621 @@ _papi_mem_check_all_overflow(  )
 #endif
 	return ( fnd );
 }
+
+/* Threads have no pool of their own in DEBUG builds */
+void
+_papi_mem_thread_exit(  )
+{
+}
+
+#else /* !DEBUG */
+
+/* Size classes run from 16 bytes to 4 KB, larger blocks go straight */
+/* to malloc and free.                                                */
+#define MEM_POOL_MIN_SHIFT	4
+#define MEM_POOL_CLASSES	9
+#define MEM_POOL_MAGIC		0x9a9e
+#define MEM_POOL_FREED		0xf4ee
+
+#define MEM_POOL_CLASS_SIZE(c)	( ( size_t ) 1 << ( ( c ) + MEM_POOL_MIN_SHIFT ) )
+
+/* Size class blocks are carved out of slabs, which are only given */
+/* back to the system by _papi_mem_cleanup_all()                   */
+#define MEM_SLAB_SIZE		65536
+#define MEM_SLAB_HDR		32	/* room for a pmem_slab_t */
+
+typedef struct pmem_slab
+{
+	struct pmem_slab *next;		/* on slab_head */
+	char *end;
+	char *volatile used;		/* blocks are carved up to here */
+} pmem_slab_t;
+
+typedef struct pmem_pool
+{
+	void *free[MEM_POOL_CLASSES];	/* owner only */
+	void *volatile remote;		/* freed by other threads */
+	pmem_slab_t *slab;		/* carving from this one, owner only */
+	int owned;			/* a thread is using this pool */
+	long bytes;			/* allocated minus freed through this pool */
+	long blocks;
+	struct pmem_pool *next;
+} pmem_pool_t;
+
+/* Lives in the prolog, right in front of the pointer handed out */
+typedef struct pmem_hdr
+{
+	pmem_pool_t *pool;		/* NULL for blocks not in a size class */
+	unsigned int size;		/* requested size */
+	unsigned short cls;		/* never changes once carved */
+	unsigned short magic;
+} pmem_hdr_t;
+
+/* Blocks not in a size class are kept on big_head, their links */
+/* go in front of the prolog                                    */
+typedef struct pmem_big
+{
+	struct pmem_big *next;
+	struct pmem_big *prev;
+} pmem_big_t;
+
+#define MEM_BIG_PROLOG	( 2 * MEM_PROLOG )
+
+#define MEM_HDR(p)	( ( pmem_hdr_t * ) ( ( char * ) ( p ) - sizeof ( pmem_hdr_t ) ) )
+#define MEM_NEXT(p)	( *( void ** ) ( p ) )
+#define MEM_BIG(p)	( ( pmem_big_t * ) ( ( char * ) ( p ) - MEM_BIG_PROLOG ) )
+#define MEM_BLOCK_SIZE(c)	( MEM_PROLOG + MEM_POOL_CLASS_SIZE( c ) )
+
+/* Local global variables, the lists are protected by MEMORY_LOCK */
+static pmem_pool_t *pool_head = NULL;
+static pmem_slab_t *slab_head = NULL;
+static pmem_big_t *big_head = NULL;
+
+/* Frees and resizes by a thread without a pool are counted here, */
+/* so that it need not make one                                   */
+static volatile long orphan_bytes = 0;
+static volatile long orphan_blocks = 0;
+
+#if defined(HAVE_THREAD_LOCAL_STORAGE)
+static THREAD_LOCAL_STORAGE_KEYWORD pmem_pool_t *my_pool = NULL;
+#define POOL_LOCK()
+#define POOL_UNLOCK()
+/* the shared lists take MEMORY_LOCK */
+#define LIST_LOCK()		_papi_hwi_lock( MEMORY_LOCK )
+#define LIST_UNLOCK()	_papi_hwi_unlock( MEMORY_LOCK )
+#else
+/* No cheap way to find our own pool, so everybody shares one, and */
+/* the shared lists are only touched with MEMORY_LOCK already held */
+static pmem_pool_t *my_pool = NULL;
+#define POOL_LOCK()	_papi_hwi_lock( MEMORY_LOCK )
+#define POOL_UNLOCK()	_papi_hwi_unlock( MEMORY_LOCK )
+#define LIST_LOCK()
+#define LIST_UNLOCK()
+#endif
+
+/* Local Prototypes */
+static pmem_pool_t *get_pool( void );
+static void *carve_block( pmem_pool_t * pool, unsigned short cls );
+static void insert_big( pmem_big_t * big );
+static void remove_big( pmem_big_t * big );
+static int find_block( void *ptr );
+static void count_bytes( long bytes, long blocks );
+static void drain_remote( pmem_pool_t * pool );
+static int leak_report( void );
+
+void *
+_papi_realloc( char *file, int line, void *ptr, size_t size )
+{
+	pmem_hdr_t *hdr;
+	pmem_big_t *big;
+	void *nptr;
+	long old;
+
+	if ( !ptr )
+		return ( _papi_malloc( file, line, size ) );
+
+	if ( size == 0 ) {
+		_papi_free( file, line, ptr );
+		return ( NULL );
+	}
+
+	hdr = MEM_HDR( ptr );
+
+	old = hdr->size;
+
+	/* Still fits in its size class, or stays out of the classes */
+	if ( ( hdr->pool && size <= MEM_POOL_CLASS_SIZE( hdr->cls ) ) ||
+		 ( !hdr->pool && size > MEM_POOL_CLASS_SIZE( MEM_POOL_CLASSES - 1 ) ) ) {
+		POOL_LOCK(  );
+		if ( !hdr->pool ) {
+			/* the block moves, so it comes off the list meanwhile */
+			LIST_LOCK(  );
+			remove_big( MEM_BIG( ptr ) );
+			big = ( pmem_big_t * ) realloc( MEM_BIG( ptr ),
+											size + MEM_BIG_PROLOG );
+			if ( big )
+				ptr = ( char * ) big + MEM_BIG_PROLOG;
+			insert_big( MEM_BIG( ptr ) );
+			LIST_UNLOCK(  );
+			if ( !big ) {
+				POOL_UNLOCK(  );
+				return ( NULL );
+			}
+			hdr = MEM_HDR( ptr );
+		}
+		hdr->size = ( unsigned int ) size;
+
+		count_bytes( ( long ) size - old, 0 );
+		POOL_UNLOCK(  );
+
+		MEMDBG( "%p: Re-allocated: %lu bytes from File: %s  Line: %d\n",
+				ptr, ( unsigned long ) size, file, line );
+		return ( ptr );
+	}
+
+	nptr = _papi_malloc( file, line, size );
+	if ( !nptr )
+		return ( NULL );
+	memcpy( nptr, ptr, hdr->size < size ? hdr->size : size );
+	_papi_free( file, line, ptr );
+
+	return ( nptr );
+}
+
+void *
+_papi_malloc( char *file, int line, size_t size )
+{
+	pmem_pool_t *pool;
+	pmem_hdr_t *hdr;
+	pmem_big_t *big;
+	void *ptr = NULL;
+	unsigned short cls = 0;
+
+	( void ) file;			 /*unused */
+	( void ) line;			 /*unused */
+
+	if ( size == 0 ) {
+		MEMDBG( "Attempting to allocate %lu bytes from File: %s  Line: %d\n",
+				( unsigned long ) size, file, line );
+		return ( NULL );
+	}
+
+	while ( cls < MEM_POOL_CLASSES && MEM_POOL_CLASS_SIZE( cls ) < size )
+		cls++;
+
+	POOL_LOCK(  );
+	pool = get_pool(  );
+
+	if ( pool && cls < MEM_POOL_CLASSES ) {
+		if ( !pool->free[cls] && pool->remote )
+			drain_remote( pool );
+		ptr = pool->free[cls];
+		if ( ptr )
+			pool->free[cls] = MEM_NEXT( ptr );
+		else
+			ptr = carve_block( pool, cls );
+	}
+
+	/* Blocks without a pool (we could not make one) are plain mallocs */
+	if ( !ptr ) {
+		big = ( pmem_big_t * ) malloc( MEM_BIG_PROLOG + size );
+		if ( !big ) {
+			POOL_UNLOCK(  );
+			return ( NULL );
+		}
+		LIST_LOCK(  );
+		insert_big( big );
+		LIST_UNLOCK(  );
+		ptr = ( char * ) big + MEM_BIG_PROLOG;
+		pool = NULL;
+		cls = MEM_POOL_CLASSES;
+	}
+
+	hdr = MEM_HDR( ptr );
+	hdr->pool = pool;
+	hdr->size = ( unsigned int ) size;
+	hdr->cls = cls;
+	hdr->magic = MEM_POOL_MAGIC;
+
+	count_bytes( ( long ) size, 1 );
+	POOL_UNLOCK(  );
+
+	MEMDBG( "%p: Allocated %lu bytes from File: %s  Line: %d\n",
+			ptr, ( unsigned long ) size, file, line );
+	return ( ptr );
+}
+
+/** Only frees the memory if PAPI malloced it 
+  * returns 1 if pointer was valid; 0 if not */
+int
+_papi_valid_free( char *file, int line, void *ptr )
+{
+	int valid;
+
+	if ( !ptr )
+		return ( 0 );
+
+	/* The header is only looked at once we know the block is ours */
+	_papi_hwi_lock( MEMORY_LOCK );
+	valid = find_block( ptr );
+	_papi_hwi_unlock( MEMORY_LOCK );
+
+	if ( valid )
+		_papi_free( file, line, ptr );
+	return ( valid );
+}
+
+/** Frees up the ptr */
+void
+_papi_free( char *file, int line, void *ptr )
+{
+	pmem_hdr_t *hdr;
+	pmem_pool_t *owner;
+	void *head;
+
+	if ( !ptr ) {
+		( void ) file;
+		( void ) line;
+		return;
+	}
+
+	hdr = MEM_HDR( ptr );
+	owner = hdr->pool;
+	hdr->magic = MEM_POOL_FREED;
+
+	MEMDBG( "%p: Freeing %d bytes from File: %s  Line: %d\n", ptr,
+			hdr->size, file, line );
+
+	/* Freeing never makes a pool, a block whose pool is not ours */
+	/* goes back to it through its remote list                    */
+	POOL_LOCK(  );
+	count_bytes( -( long ) hdr->size, -1 );
+
+	if ( !owner ) {
+		LIST_LOCK(  );
+		remove_big( MEM_BIG( ptr ) );
+		LIST_UNLOCK(  );
+		POOL_UNLOCK(  );
+		free( MEM_BIG( ptr ) );
+		return;
+	}
+
+	if ( owner == my_pool ) {
+		MEM_NEXT( ptr ) = owner->free[hdr->cls];
+		owner->free[hdr->cls] = ptr;
+	} else {
+		do {
+			head = owner->remote;
+			MEM_NEXT( ptr ) = head;
+		} while ( !__sync_bool_compare_and_swap( &owner->remote, head, ptr ) );
+	}
+	POOL_UNLOCK(  );
+}
+
+/** Print information about the memory including file and location it came from */
+void
+_papi_mem_print_info( void *ptr )
+{
+	fprintf( stderr, "%p: Allocated %d bytes\n", ptr, MEM_HDR( ptr )->size );
+	return;
+}
+
+/** Print out all memory information */
+void
+_papi_mem_print_stats(  )
+{
+	pmem_pool_t *pool;
+
+	/* Only DEBUG builds know about each allocation */
+	_papi_hwi_lock( MEMORY_LOCK );
+	for ( pool = pool_head; pool; pool = pool->next ) {
+		fprintf( stderr, "%p: Pool %s, %ld blocks, %ld bytes\n", pool,
+				 pool->owned ? "in use" : "idle", pool->blocks, pool->bytes );
+	}
+	_papi_hwi_unlock( MEMORY_LOCK );
+}
+
+/** Return the amount of memory overhead of the PAPI library and the memory system
+ * PAPI_MEM_LIB_OVERHEAD is the library overhead
+ * PAPI_MEM_OVERHEAD is the memory overhead
+ * They both can be | together
+ * This only includes "malloc'd memory"
+ */
+int
+_papi_mem_overhead( int type )
+{
+	pmem_pool_t *pool;
+	long size = 0;
+
+	_papi_hwi_lock( MEMORY_LOCK );
+	for ( pool = pool_head; pool; pool = pool->next ) {
+		if ( type & PAPI_MEM_LIB_OVERHEAD )
+			size += pool->bytes;
+		if ( type & PAPI_MEM_OVERHEAD )
+			size += pool->blocks * ( long ) MEM_PROLOG;
+	}
+	if ( type & PAPI_MEM_LIB_OVERHEAD )
+		size += orphan_bytes;
+	if ( type & PAPI_MEM_OVERHEAD )
+		size += orphan_blocks * ( long ) MEM_PROLOG;
+	_papi_hwi_unlock( MEMORY_LOCK );
+	return ( int ) size;
+}
+
+/** Clean all memory up and print out memory leak information to stderr
+ *  if PAPI_DEBUG asks for LEAK.  Every pool goes back to empty, the pools
+ *  themselves stay for the threads that still point at them. */
+void
+_papi_mem_cleanup_all(  )
+{
+	pmem_pool_t *pool;
+	pmem_slab_t *slab, *next_slab;
+	pmem_big_t *big, *next_big;
+	pmem_hdr_t *hdr;
+	char *blk;
+	long cnt = 0;
+	int report = leak_report(  );
+
+	_papi_hwi_lock( MEMORY_LOCK );
+
+	for ( slab = slab_head; slab; slab = next_slab ) {
+		next_slab = slab->next;
+		for ( blk = ( char * ) slab + MEM_SLAB_HDR; blk < slab->used;
+			  blk += MEM_BLOCK_SIZE( hdr->cls ) ) {
+			hdr = MEM_HDR( blk + MEM_PROLOG );
+			if ( hdr->magic != MEM_POOL_MAGIC )
+				continue;
+			if ( report ) {
+				fprintf( stderr, "MEMORY LEAK: %p of %u bytes\n",
+						 blk + MEM_PROLOG, hdr->size );
+			}
+			cnt += hdr->size;
+		}
+		free( slab );
+	}
+	slab_head = NULL;
+
+	for ( big = big_head; big; big = next_big ) {
+		next_big = big->next;
+		hdr = MEM_HDR( ( char * ) big + MEM_BIG_PROLOG );
+		if ( report ) {
+			fprintf( stderr, "MEMORY LEAK: %p of %u bytes\n",
+					 ( char * ) big + MEM_BIG_PROLOG, hdr->size );
+		}
+		cnt += hdr->size;
+		free( big );
+	}
+	big_head = NULL;
+
+	for ( pool = pool_head; pool; pool = pool->next ) {
+		memset( pool->free, 0, sizeof ( pool->free ) );
+		pool->remote = NULL;
+		pool->slab = NULL;
+		pool->bytes = 0;
+		pool->blocks = 0;
+	}
+	orphan_bytes = 0;
+	orphan_blocks = 0;
+
+	_papi_hwi_unlock( MEMORY_LOCK );
+
+	if ( report && 0 != cnt ) {
+		fprintf( stderr, "TOTAL MEMORY LEAK: %ld bytes.\n", cnt );
+	}
+}
+
+int
+_papi_mem_check_all_overflow(  )
+{
+	return ( 0 );
+}
+
+/** The calling thread is done with PAPI, let the next new thread take
+ *  its pool over, with the blocks it caches, rather than start an empty
+ *  one.  The pool itself stays, blocks still in use point at it. */
+void
+_papi_mem_thread_exit(  )
+{
+#if defined(HAVE_THREAD_LOCAL_STORAGE)
+	if ( !my_pool )
+		return;
+
+	_papi_hwi_lock( MEMORY_LOCK );
+	drain_remote( my_pool );
+	my_pool->owned = 0;
+	_papi_hwi_unlock( MEMORY_LOCK );
+	my_pool = NULL;
+#endif
+}
+
+/**********************************************************************
+ * Private helper routines for papi memory management                 *
+ **********************************************************************/
+
+/* Find the pool of the calling thread, adopting an idle one or making */
+/* a new one on first use.  Returns NULL if we are out of memory.      */
+static pmem_pool_t *
+get_pool( void )
+{
+	pmem_pool_t *pool;
+
+	if ( my_pool )
+		return ( my_pool );
+
+	LIST_LOCK(  );
+	for ( pool = pool_head; pool; pool = pool->next ) {
+		if ( !pool->owned )
+			break;
+	}
+	if ( !pool ) {
+		pool = ( pmem_pool_t * ) calloc( 1, sizeof ( pmem_pool_t ) );
+		if ( pool ) {
+			pool->next = pool_head;
+			pool_head = pool;
+		}
+	}
+	if ( pool )
+		pool->owned = 1;
+	LIST_UNLOCK(  );
+
+	my_pool = pool;
+	return ( pool );
+}
+
+/* Cut a new block of a size class from the pool's slab, starting a */
+/* new slab when it is full.  Returns NULL if we are out of memory. */
+static void *
+carve_block( pmem_pool_t * pool, unsigned short cls )
+{
+	pmem_slab_t *slab = pool->slab;
+	char *blk;
+
+	if ( !slab || slab->used + MEM_BLOCK_SIZE( cls ) > slab->end ) {
+		slab = ( pmem_slab_t * ) malloc( MEM_SLAB_SIZE );
+		if ( !slab )
+			return ( NULL );
+		slab->end = ( char * ) slab + MEM_SLAB_SIZE;
+		slab->used = ( char * ) slab + MEM_SLAB_HDR;
+		LIST_LOCK(  );
+		slab->next = slab_head;
+		slab_head = slab;
+		LIST_UNLOCK(  );
+		pool->slab = slab;
+	}
+
+	blk = slab->used;
+	MEM_HDR( blk + MEM_PROLOG )->cls = cls;
+	MEM_HDR( blk + MEM_PROLOG )->magic = MEM_POOL_FREED;
+	/* find_block() walks up to used, the header must be there first */
+	__sync_synchronize(  );
+	slab->used = blk + MEM_BLOCK_SIZE( cls );
+
+	return ( blk + MEM_PROLOG );
+}
+
+/* Do not lock these routines, but lock in routines using these */
+static void
+insert_big( pmem_big_t * big )
+{
+	big->prev = NULL;
+	big->next = big_head;
+	if ( big_head )
+		big_head->prev = big;
+	big_head = big;
+}
+
+static void
+remove_big( pmem_big_t * big )
+{
+	if ( big->prev )
+		big->prev->next = big->next;
+	if ( big->next )
+		big->next->prev = big->prev;
+	if ( big == big_head )
+		big_head = big->next;
+}
+
+/* Returns 1 if ptr is a block handed out by _papi_malloc and not */
+/* freed yet.  Called with MEMORY_LOCK held.                      */
+static int
+find_block( void *ptr )
+{
+	pmem_slab_t *slab;
+	pmem_big_t *big;
+	char *blk, *used;
+
+	for ( slab = slab_head; slab; slab = slab->next ) {
+		if ( ( char * ) ptr <= ( char * ) slab || ( char * ) ptr >= slab->end )
+			continue;
+		used = slab->used;
+		__sync_synchronize(  );
+		for ( blk = ( char * ) slab + MEM_SLAB_HDR; blk < used;
+			  blk += MEM_BLOCK_SIZE( MEM_HDR( blk + MEM_PROLOG )->cls ) ) {
+			if ( blk + MEM_PROLOG == ptr )
+				return ( MEM_HDR( ptr )->magic == MEM_POOL_MAGIC );
+		}
+		return ( 0 );
+	}
+
+	for ( big = big_head; big; big = big->next ) {
+		if ( ( char * ) big + MEM_BIG_PROLOG == ptr )
+			return ( 1 );
+	}
+	return ( 0 );
+}
+
+/* Charge an allocation change to our pool, or to the orphan counters */
+/* if we have none.  Counters may go negative in one pool, only the   */
+/* sum matters.                                                       */
+static void
+count_bytes( long bytes, long blocks )
+{
+	if ( my_pool ) {
+		my_pool->bytes += bytes;
+		my_pool->blocks += blocks;
+	} else {
+		__sync_fetch_and_add( &orphan_bytes, bytes );
+		__sync_fetch_and_add( &orphan_blocks, blocks );
+	}
+}
+
+/* Move blocks other threads freed into our free lists */
+static void
+drain_remote( pmem_pool_t * pool )
+{
+	void *ptr, *next;
+
+	ptr = __sync_lock_test_and_set( &pool->remote, NULL );
+	for ( ; ptr; ptr = next ) {
+		next = MEM_NEXT( ptr );
+		MEM_NEXT( ptr ) = pool->free[MEM_HDR( ptr )->cls];
+		pool->free[MEM_HDR( ptr )->cls] = ptr;
+	}
+}
+
+/* Pooled builds have no debug output, but PAPI_DEBUG=LEAK still */
+/* asks for the leak report at shutdown                          */
+static int
+leak_report( void )
+{
+	char *var = getenv( "PAPI_DEBUG" );
+
+	return ( var && ( strstr( var, "LEAK" ) || strstr( var, "ALL" ) ) );
+}
+
+#endif /* DEBUG */
+
+/**********************************************************************
+ * Routines shared by both allocators                                 *
+ **********************************************************************/
+
+void *
+_papi_calloc( char *file, int line, size_t nmemb, size_t size )
+{
+	void *ptr = _papi_malloc( file, line, size * nmemb );
+
+	if ( !ptr )
+		return ( NULL );
+	memset( ptr, 0, size * nmemb );
+	return ( ptr );
+}
+
+char *
+_papi_strdup( char *file, int line, const char *s )
+{
+	size_t size;
+	char *ptr;
+
+	if ( !s )
+		return ( NULL );
+
+	/* String Length +1 for \0 */
+	size = strlen( s ) + 1;
+	ptr = ( char * ) _papi_malloc( file, line, size );
+
+	if ( !ptr )
+		return ( NULL );
+
+	memcpy( ptr, s, size );
+	return ( ptr );
+}
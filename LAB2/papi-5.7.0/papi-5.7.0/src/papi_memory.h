@@ -30,6 +30,7 @@ typedef struct pmem
 #define papi_mem_print_stats() ;
 #define papi_mem_overhead(a) ;
 #define papi_mem_check_all_overflow() ;
+#define papi_mem_thread_exit() ;
 #else
 #define papi_malloc(a) _papi_malloc(__FILE__,__LINE__, a)
 #define papi_free(a) _papi_free(__FILE__,__LINE__, a)
@@ -42,6 +43,7 @@ typedef struct pmem
 #define papi_mem_print_stats _papi_mem_print_stats
 #define papi_mem_overhead(a) _papi_mem_overhead(a)
 #define papi_mem_check_all_overflow _papi_mem_check_all_overflow
+#define papi_mem_thread_exit _papi_mem_thread_exit
 #endif
 #endif
 
@@ -56,6 +58,7 @@ void _papi_mem_print_info( void *ptr );
 void _papi_mem_print_stats(  );
 int _papi_mem_overhead( int );
 int _papi_mem_check_all_overflow(  );
+void _papi_mem_thread_exit(  );
 
 #define PAPI_MEM_LIB_OVERHEAD	1	/* PAPI Library Overhead */
 #define PAPI_MEM_OVERHEAD	2	/* Memory Overhead */
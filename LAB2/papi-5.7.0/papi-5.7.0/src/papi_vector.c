@@ -128,6 +128,14 @@ _papi_hwi_innoculate_vector( papi_vector_t * v )
 		v->read = ( int ( * )
 					( hwd_context_t *, hwd_control_state_t *, long long **,
 					  int ) ) vec_int_dummy;
+	if ( !v->read_many )
+		v->read_many = ( int ( * )
+					( hwd_context_t **, hwd_control_state_t **, int,
+					  long long ** ) ) vec_int_dummy;
+	if ( !v->read_cpus )
+		v->read_cpus = ( int ( * )
+					( hwd_context_t *, hwd_control_state_t *, long long **,
+					  int **, int * ) ) vec_int_dummy;
 	if ( !v->reset )
 		v->reset = ( int ( * )( hwd_context_t *, hwd_control_state_t * ) )
 			vec_int_dummy;
@@ -305,6 +313,10 @@ vector_print_table( papi_vector_t * v, int print_func )
 	vector_print_routine( ( void * ) v->start, "_papi_hwd_start", print_func );
 	vector_print_routine( ( void * ) v->stop, "_papi_hwd_stop", print_func );
 	vector_print_routine( ( void * ) v->read, "_papi_hwd_read", print_func );
+	vector_print_routine( ( void * ) v->read_many, "_papi_hwd_read_many",
+						  print_func );
+	vector_print_routine( ( void * ) v->read_cpus, "_papi_hwd_read_cpus",
+						  print_func );
 	vector_print_routine( ( void * ) v->reset, "_papi_hwd_reset", print_func );
 	vector_print_routine( ( void * ) v->write, "_papi_hwd_write", print_func );
 	vector_print_routine( ( void * ) v->cleanup_eventset, 
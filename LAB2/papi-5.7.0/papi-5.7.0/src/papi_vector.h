@@ -28,6 +28,12 @@ typedef struct papi_vectors {
     int		(*start)		(hwd_context_t *, hwd_control_state_t *);		/**< */
     int		(*stop)			(hwd_context_t *, hwd_control_state_t *);		/**< */
     int		(*read)			(hwd_context_t *, hwd_control_state_t *, long long **, int);	/**< */
+    int		(*read_many)		(hwd_context_t **, hwd_control_state_t **, int, long long **);
+		/**< read several control states in one call.  Components that
+		     do not provide it are read one control state at a time */
+    int		(*read_cpus)		(hwd_context_t *, hwd_control_state_t *, long long **, int **, int *);
+		/**< read a control state counting on several cpus, one row of
+		     counts per cpu, along with the cpus the rows are for */
     int		(*reset)		(hwd_context_t *, hwd_control_state_t *);		/**< */
     int		(*write)		(hwd_context_t *, hwd_control_state_t *, long long[]);			/**< */
 	int			(*cleanup_eventset)	( hwd_control_state_t * );				/**< */
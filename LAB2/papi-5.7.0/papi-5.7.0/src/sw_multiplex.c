@@ -153,6 +153,22 @@ static struct itimerval itime;
 static const struct itimerval itimestop = { {0, 0}, {0, 0} };
 static struct sigaction oaction;
 
+#ifdef MPX_THREAD_TIMER
+#include <time.h>
+#include <sys/syscall.h>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* Per-thread timers (PAPI_MULTIPLEX_THREAD_TIMER) are aimed at the
+ * thread that owns the event list and carry its Threadlist in the
+ * signal value, so the handler neither rebroadcasts nor searches tlist.
+ */
+static struct itimerspec thread_itime;
+static const struct itimerspec thread_itimestop = { {0, 0}, {0, 0} };
+#endif
+
 /* END Globals */
 
 #ifdef PTHREADS
@@ -174,7 +190,7 @@ static void mpx_delete_events( MPX_EventSet * );
 static void mpx_delete_one_event( MPX_EventSet * mpx_events, int Event );
 static int mpx_insert_events( MPX_EventSet *, int *event_list, int num_events,
 							  int domain, int granularity );
-static void mpx_handler( int signal );
+static void mpx_handler( int signal, siginfo_t * info, void *context );
 
 inline_static void
 mpx_hold( void )
@@ -214,26 +230,45 @@ mpx_init_timers( int interval )
 	itime.it_value.tv_usec = interval;
 #endif
 
+#ifdef MPX_THREAD_TIMER
+	thread_itime.it_interval.tv_sec = itime.it_interval.tv_usec / 1000000;
+	thread_itime.it_interval.tv_nsec =
+		( itime.it_interval.tv_usec % 1000000 ) * 1000;
+	thread_itime.it_value.tv_sec = itime.it_value.tv_usec / 1000000;
+	thread_itime.it_value.tv_nsec = ( itime.it_value.tv_usec % 1000000 ) * 1000;
+#endif
+
 	sigemptyset( &sigreset );
 	sigaddset( &sigreset, _papi_os_info.itimer_sig );
 }
 
 static int
-mpx_startup_itimer( void )
+mpx_startup_handler( void )
 {
 	struct sigaction sigact;
 
-	/* Set up the signal handler and the timer that triggers it */
-
 	MPXDBG( "PID %d\n", getpid(  ) );
 	memset( &sigact, 0, sizeof ( sigact ) );
-	sigact.sa_flags = SA_RESTART;
-	sigact.sa_handler = mpx_handler;
+	sigact.sa_flags = SA_RESTART | SA_SIGINFO;
+	sigact.sa_sigaction = mpx_handler;
 
 	if ( sigaction( _papi_os_info.itimer_sig, &sigact, NULL ) == -1 ) {
 		PAPIERROR( "sigaction start errno %d", errno );
 		return PAPI_ESYS;
 	}
+	return ( PAPI_OK );
+}
+
+static int
+mpx_startup_itimer( void )
+{
+	int retval;
+
+	/* Set up the signal handler and the timer that triggers it */
+
+	retval = mpx_startup_handler(  );
+	if ( retval != PAPI_OK )
+		return retval;
 
 	if ( setitimer( _papi_os_info.itimer_num, &itime, NULL ) == -1 ) {
 		sigaction( _papi_os_info.itimer_sig, &oaction, NULL );
@@ -264,6 +299,58 @@ mpx_shutdown_itimer( void )
 	}
 }
 
+#ifdef MPX_THREAD_TIMER
+static int
+mpx_startup_thread_timer( Threadlist * t )
+{
+	struct sigevent sev;
+	clockid_t clock;
+	int retval;
+
+	if ( t->timer_armed )
+		return ( PAPI_OK );
+
+	retval = mpx_startup_handler(  );
+	if ( retval != PAPI_OK )
+		return retval;
+
+	if ( !t->has_timer ) {
+		/* Follow the flavour of the process itimer we replace */
+		clock = ( _papi_os_info.itimer_num == ITIMER_REAL ) ?
+			CLOCK_MONOTONIC : CLOCK_THREAD_CPUTIME_ID;
+
+		memset( &sev, 0, sizeof ( sev ) );
+		sev.sigev_notify = SIGEV_THREAD_ID;
+		sev.sigev_signo = _papi_os_info.itimer_sig;
+		sev.sigev_value.sival_ptr = t;
+		sev.sigev_notify_thread_id = ( pid_t ) syscall( SYS_gettid );
+
+		if ( timer_create( clock, &sev, &t->timer ) == -1 ) {
+			MPXDBG( "timer_create errno %d\n", errno );
+			return PAPI_ESYS;
+		}
+		t->has_timer = 1;
+	}
+
+	if ( timer_settime( t->timer, 0, &thread_itime, NULL ) == -1 ) {
+		PAPIERROR( "timer_settime start errno %d", errno );
+		return PAPI_ESYS;
+	}
+	t->timer_armed = 1;
+	MPXDBG( "thread timer armed for %p\n", t );
+	return ( PAPI_OK );
+}
+
+static void
+mpx_shutdown_thread_timer( Threadlist * t )
+{
+	MPXDBG( "thread timer off for %p\n", t );
+	if ( timer_settime( t->timer, 0, &thread_itimestop, NULL ) == -1 )
+		PAPIERROR( "timer_settime stop errno %d", errno );
+	t->timer_armed = 0;
+}
+#endif
+
 static MasterEvent *
 get_my_threads_master_event_list( void )
 {
@@ -342,6 +429,10 @@ mpx_add_event( MPX_EventSet ** mpx_events, int EventCode, int domain,
 
 		t->head = NULL;
 		t->cur_event = NULL;
+#ifdef MPX_THREAD_TIMER
+		t->has_timer = 0;
+		t->timer_armed = 0;
+#endif
 		t->next = tlist;
 		tlist = t;
 		MPXDBG( "New head is at %p(%lu).\n", tlist,
@@ -442,13 +533,17 @@ int _PNE_PM_RUN_CYC;
 
 
 static void
-mpx_handler( int signal )
+mpx_handler( int signal, siginfo_t * info, void *context )
 {
 	int retval;
 	MasterEvent *mev, *head;
 	Threadlist *me = NULL;
+	int per_thread = 0;
+#if defined(MPX_THREAD_TIMER) && defined(REGENERATE)
+	Threadlist *owner = NULL;
+#endif
 #ifdef REGENERATE
-	int lastthread;
+	int lastthread = 1;		/* unless other threads still have to respond */
 #endif
 #ifdef MPX_DEBUG_OVERHEAD
 	long long usec;
@@ -460,9 +555,24 @@ mpx_handler( int signal )
 #endif
 
 	signal = signal;		 /* unused */
+	( void ) context;
 
 	MPXDBG( "Handler in thread\n" );
 
+#ifdef MPX_THREAD_TIMER
+	/* A per-thread timer tells us whose events to rotate */
+	if ( info != NULL && info->si_code == SI_TIMER &&
+		 info->si_value.sival_ptr != NULL ) {
+		me = ( Threadlist * ) info->si_value.sival_ptr;
+		per_thread = 1;
+#ifdef REGENERATE
+		owner = me;
+#endif
+	}
+#else
+	( void ) info;
+#endif
+
 	/* This handler can be invoked either when a timer expires
 	 * or when another thread in this handler responding to the
 	 * timer signals other threads.  We have to distinguish
@@ -493,9 +603,12 @@ mpx_handler( int signal )
 	 * is signaled while it holds the lock, we will have deadlock.
 	 * Therefore, noninterrupt functions that update *this* list
 	 * must disable the signal that invokes this handler.
+	 * None of this applies to per-thread timers: each one is
+	 * delivered only to the thread that owns the event list.
 	 */
 
 #ifdef PTHREADS
+	if ( !per_thread ) {
 	_papi_hwi_lock( MULTIPLEX_LOCK );
 
 	if ( threads_responding == 0 ) {	/* this thread caught the timer sig */
@@ -526,10 +639,14 @@ mpx_handler( int signal )
 	lastthread = ( threads_responding == 0 );
 #endif
 	_papi_hwi_unlock( MULTIPLEX_LOCK );
+	}
 #endif
 
 	/* See if this thread has an active event list */
-	head = get_my_threads_master_event_list(  );
+	if ( per_thread )
+		head = me->head;
+	else
+		head = get_my_threads_master_event_list(  );
 	if ( head != NULL ) {
 
 		/* Get the thread header for this master event set.  It's
@@ -628,7 +745,7 @@ mpx_handler( int signal )
 		}
 	}
 #ifdef ANY_THREAD_GETS_SIGNAL
-	else {
+	else if ( !per_thread ) {
 		Threadlist *t;
 		for ( t = tlist; t != NULL; t = t->next ) {
 			if ( ( t->tid == _papi_hwi_thread_id_fn(  ) ) ||
@@ -656,6 +773,16 @@ mpx_handler( int signal )
 	 * MIN_CYCLES check above should alleviate this.
 	 */
 	/* Reset the timer once all threads have responded */
+#ifdef MPX_THREAD_TIMER
+	if ( per_thread ) {
+		/* A per-thread timer is one-shot too, and only its own thread */
+		/* responds, so that thread restarts it unless it was stopped  */
+		if ( owner->timer_armed ) {
+			retval = timer_settime( owner->timer, 0, &thread_itime, NULL );
+			assert( retval == 0 );
+		}
+	} else
+#endif
 	if ( lastthread ) {
 		retval = setitimer( _papi_os_info.itimer_num, &itime, NULL );
 		assert( retval == 0 );
@@ -689,7 +816,7 @@ MPX_add_events( MPX_EventSet ** mpx_events, int *event_list, int num_events,
 }
 
 int
-MPX_start( MPX_EventSet * mpx_events )
+MPX_start( MPX_EventSet * mpx_events, int flags )
 {
 	int retval = PAPI_OK;
 	int i;
@@ -814,6 +941,18 @@ MPX_start( MPX_EventSet * mpx_events )
 
 	mpx_release(  );
 
+#ifdef MPX_THREAD_TIMER
+	if ( flags & PAPI_MULTIPLEX_THREAD_TIMER ) {
+		retval = mpx_startup_thread_timer( t );
+		if ( retval == PAPI_OK )
+			return retval;
+		/* No per-thread timers here, fall back to the process itimer */
+		MPXDBG( "falling back to the itimer\n" );
+	}
+#else
+	( void ) flags;
+#endif
+
 	retval = mpx_startup_itimer(  );
 
 	return retval;
@@ -1049,7 +1188,13 @@ MPX_stop( MPX_EventSet * mpx_events, long long *values )
 			if ( thr->cur_event != NULL ) {
 				retval = PAPI_start( thr->cur_event->papi_event );
 				assert( retval == PAPI_OK );
-			} else {
+			}
+#ifdef MPX_THREAD_TIMER
+			else if ( thr->timer_armed ) {
+				mpx_shutdown_thread_timer( thr );
+			}
+#endif
+			else {
 				mpx_shutdown_itimer(  );
 			}
 		}
@@ -1110,6 +1255,10 @@ MPX_shutdown( void )
 
 		while(t!=NULL) {
 		   next=t->next;
+#ifdef MPX_THREAD_TIMER
+		   if ( t->has_timer )
+			  timer_delete( t->timer );
+#endif
 		   papi_free( t );
 		   t = next;			
 		}
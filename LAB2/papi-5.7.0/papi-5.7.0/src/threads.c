@@ -27,9 +27,22 @@
    extern int _papi_hwi_init_global_threads(void);
    extern int _papi_hwi_shutdown_thread(ThreadInfo_t *thread); */
 
-/* list of threads, gets initialized to master process with TID of getpid() */
+/* hash of threads, gets initialized to master process with TID of getpid() */
 
-volatile ThreadInfo_t *_papi_hwi_thread_head;
+ThreadInfo_t *volatile _papi_hwi_thread_hash[PAPI_THREAD_HASH_SIZE];
+
+/* our thread when there is no thread id function */
+
+ThreadInfo_t *volatile _papi_hwi_thread_self;
+
+/* number of threads in the hash */
+
+static int num_threads;
+
+/* ThreadInfo_t's no longer in the hash, kept for reuse so lock free  */
+/* lookups never touch freed memory.  Protected by THREADS_LOCK.       */
+
+static ThreadInfo_t *retired_threads;
 
 /* If we have TLS, this variable ALWAYS points to our thread descriptor. It's like magic! */
 
@@ -95,16 +108,29 @@ lookup_and_set_thread_symbols( void )
 static ThreadInfo_t *
 allocate_thread( int tid )
 {
-	ThreadInfo_t *thread;
+	ThreadInfo_t *thread, *next;
 	int i;
 
 	/* The Thread EventSet is special. It is not in the EventSet list, but is pointed
 	   to by each EventSet of that particular thread. */
 
-	thread = ( ThreadInfo_t * ) papi_malloc( sizeof ( ThreadInfo_t ) );
-	if ( thread == NULL )
-		return ( NULL );
-	memset( thread, 0x00, sizeof ( ThreadInfo_t ) );
+	_papi_hwi_lock( THREADS_LOCK );
+	thread = retired_threads;
+	if ( thread )
+		retired_threads = thread->retired_next;
+	_papi_hwi_unlock( THREADS_LOCK );
+
+	if ( thread == NULL ) {
+		thread = ( ThreadInfo_t * ) papi_malloc( sizeof ( ThreadInfo_t ) );
+		if ( thread == NULL )
+			return ( NULL );
+		memset( thread, 0x00, sizeof ( ThreadInfo_t ) );
+	} else {
+		/* keep the bucket link until hash_thread() replaces it */
+		next = thread->next;
+		memset( thread, 0x00, sizeof ( ThreadInfo_t ) );
+		thread->next = next;
+	}
 
 	thread->context =
 		( hwd_context_t ** ) papi_malloc( sizeof ( hwd_context_t * ) *
@@ -163,6 +189,7 @@ allocate_thread( int tid )
 static void
 free_thread( ThreadInfo_t ** thread )
 {
+	ThreadInfo_t *next;
 	int i;
 	THRDBG( "Freeing thread %ld at %p\n", ( *thread )->tid, *thread );
 
@@ -177,38 +204,61 @@ free_thread( ThreadInfo_t ** thread )
 	if ( ( *thread )->running_eventset )
 		papi_free( ( *thread )->running_eventset );
 
+	/* A lookup may still be standing on it, so it keeps its bucket */
+	/* link and goes on the retired list through a field of its own */
+	next = ( *thread )->next;
 	memset( *thread, 0x00, sizeof ( ThreadInfo_t ) );
-	papi_free( *thread );
+	( *thread )->next = next;
+
+	_papi_hwi_lock( THREADS_LOCK );
+	( *thread )->retired_next = retired_threads;
+	retired_threads = *thread;
+	_papi_hwi_unlock( THREADS_LOCK );
+
 	*thread = NULL;
 }
 
+/* Add to the hash, caller holds THREADS_LOCK */
 static void
-insert_thread( ThreadInfo_t * entry, int tid )
+hash_thread( ThreadInfo_t * entry )
 {
-	_papi_hwi_lock( THREADS_LOCK );
+	unsigned int bucket = _papi_hwi_thread_hashval( entry->tid );
+
+	entry->next = _papi_hwi_thread_hash[bucket];
+	/* entry must be complete before lookups can see it */
+	__sync_synchronize(  );
+	_papi_hwi_thread_hash[bucket] = entry;
+}
 
-	if ( _papi_hwi_thread_head == NULL ) {	/* 0 elements */
-		THRDBG( "_papi_hwi_thread_head is NULL\n" );
-		entry->next = entry;
-	} else if ( _papi_hwi_thread_head->next == _papi_hwi_thread_head ) {	/* 1 elements */
-		THRDBG( "_papi_hwi_thread_head was thread %ld at %p\n",
-				_papi_hwi_thread_head->tid, _papi_hwi_thread_head );
-		_papi_hwi_thread_head->next = entry;
-		entry->next = ( ThreadInfo_t * ) _papi_hwi_thread_head;
-	} else {				 /* 2+ elements */
-
-		THRDBG( "_papi_hwi_thread_head was thread %ld at %p\n",
-				_papi_hwi_thread_head->tid, _papi_hwi_thread_head );
-		entry->next = _papi_hwi_thread_head->next;
-		_papi_hwi_thread_head->next = entry;
+/* Remove from the hash, caller holds THREADS_LOCK.  entry->next is left */
+/* alone so a lookup standing on entry can carry on down the bucket.      */
+static int
+unhash_thread( ThreadInfo_t * entry )
+{
+	ThreadInfo_t *volatile *prev;
+
+	for ( prev = &_papi_hwi_thread_hash[_papi_hwi_thread_hashval( entry->tid )];
+		  *prev != NULL; prev = &( *prev )->next ) {
+		if ( *prev == entry ) {
+			*prev = entry->next;
+			return ( PAPI_OK );
+		}
 	}
+	return ( PAPI_EBUG );
+}
 
-	_papi_hwi_thread_head = entry;
+/* The caller holds THREADS_LOCK */
+static void
+insert_thread( ThreadInfo_t * entry, int tid )
+{
+	hash_thread( entry );
+	num_threads++;
 
-	THRDBG( "_papi_hwi_thread_head now thread %ld at %p\n",
-			_papi_hwi_thread_head->tid, _papi_hwi_thread_head );
+	if ( tid == 0 )
+		_papi_hwi_thread_self = entry;
 
-	_papi_hwi_unlock( THREADS_LOCK );
+	THRDBG( "Inserted thread %ld at %p, %d threads\n",
+			entry->tid, entry, num_threads );
 
 #if defined(HAVE_THREAD_LOCAL_STORAGE)
 	/* Don't set the current local thread if we are a fake attach thread */
@@ -217,51 +267,26 @@ insert_thread( ThreadInfo_t * entry, int tid )
 	   THRDBG( "TLS for thread %ld is now %p\n", entry->tid,
 			_papi_hwi_my_thread );
 	}
-#else
-	( void ) tid;
 #endif
 }
 
 static int
 remove_thread( ThreadInfo_t * entry )
 {
-	ThreadInfo_t *tmp = NULL, *prev = NULL;
-
 	_papi_hwi_lock( THREADS_LOCK );
 
-	THRDBG( "_papi_hwi_thread_head was thread %ld at %p\n",
-			_papi_hwi_thread_head->tid, _papi_hwi_thread_head );
-
-	/* Find the preceding element and the matched element,
-	   short circuit if we've seen the head twice */
-
-	for ( tmp = ( ThreadInfo_t * ) _papi_hwi_thread_head;
-		  ( entry != tmp ) || ( prev == NULL ); tmp = tmp->next ) {
-		prev = tmp;
-	}
-
-	if ( tmp != entry ) {
+	if ( unhash_thread( entry ) != PAPI_OK ) {
+		_papi_hwi_unlock( THREADS_LOCK );
 		THRDBG( "Thread %ld at %p was not found in the thread list!\n",
 				entry->tid, entry );
 		return ( PAPI_EBUG );
 	}
+	num_threads--;
 
-	/* Only 1 element in list */
+	if ( _papi_hwi_thread_self == entry )
+		_papi_hwi_thread_self = NULL;
 
-	if ( prev == tmp ) {
-		_papi_hwi_thread_head = NULL;
-		tmp->next = NULL;
-		THRDBG( "_papi_hwi_thread_head now NULL\n" );
-	} else {
-		prev->next = tmp->next;
-		/* If we're removing the head, better advance it! */
-		if ( _papi_hwi_thread_head == tmp ) {
-			_papi_hwi_thread_head = tmp->next;
-			THRDBG( "_papi_hwi_thread_head now thread %ld at %p\n",
-					_papi_hwi_thread_head->tid, _papi_hwi_thread_head );
-		}
-		THRDBG( "Removed thread %p from list\n", tmp );
-	}
+	THRDBG( "Removed thread %p from list, %d threads\n", entry, num_threads );
 
 	_papi_hwi_unlock( THREADS_LOCK );
 
@@ -286,12 +311,18 @@ _papi_hwi_initialize_thread( ThreadInfo_t ** dest, int tid )
 		return PAPI_ENOMEM;
 	}
 
-	/* Call the component to fill in anything special. */
+	/* Call the component to fill in anything special.  A component */
+	/* PAPI_LAZY_INIT brings up flips from PAPI_EDELAY_INIT while    */
+	/* holding THREADS_LOCK, so with it held here it either shows as */
+	/* enabled now or finds this thread in its walk of the list.     */
+
+	_papi_hwi_lock( THREADS_LOCK );
 
 	for ( i = 0; i < papi_num_components; i++ ) {
 	    if (_papi_hwd[i]->cmp_info.disabled) continue;
 	    retval = _papi_hwd[i]->init_thread( thread->context[i] );
 	    if ( retval ) {
+	       _papi_hwi_unlock( THREADS_LOCK );
 	       free_thread( &thread );
 	       *dest = NULL;
 	       return retval;
@@ -300,10 +331,42 @@ _papi_hwi_initialize_thread( ThreadInfo_t ** dest, int tid )
 
 	insert_thread( thread, tid );
 
+	_papi_hwi_unlock( THREADS_LOCK );
+
 	*dest = thread;
 	return PAPI_OK;
 }
 
+/* Set up the context of component cidx in every thread we know about, */
+/* for a component initialized after them because of PAPI_LAZY_INIT,   */
+/* and mark it usable before a new thread can register.                */
+
+int
+_papi_hwi_init_thread_component( int cidx )
+{
+	ThreadInfo_t *foo;
+	int b, retval = PAPI_OK;
+
+	_papi_hwi_lock( THREADS_LOCK );
+
+	for ( b = 0; ( b < PAPI_THREAD_HASH_SIZE ) && ( retval == PAPI_OK ); b++ ) {
+		for ( foo = _papi_hwi_thread_hash[b];
+		      ( foo != NULL ) && ( retval == PAPI_OK ); foo = foo->next ) {
+			THRDBG( "Initializing component %d for thread %ld\n",
+				cidx, foo->tid );
+			retval = _papi_hwd[cidx]->init_thread( foo->context[cidx] );
+		}
+	}
+
+	/* only look usable once the threads are set up */
+	__sync_synchronize(  );
+	_papi_hwd[cidx]->cmp_info.disabled = retval;
+
+	_papi_hwi_unlock( THREADS_LOCK );
+
+	return retval;
+}
+
 #if defined(ANY_THREAD_GETS_SIGNAL)
 
 /* This is ONLY defined for systems that enable ANY_THREAD_GETS_SIGNAL
@@ -315,12 +378,13 @@ _papi_hwi_initialize_thread( ThreadInfo_t ** dest, int tid )
 int
 _papi_hwi_broadcast_signal( unsigned int mytid )
 {
-	int i, retval, didsomething = 0;
-	volatile ThreadInfo_t *foo = NULL;
+	int i, b, retval;
+	ThreadInfo_t *foo = NULL;
 
 	_papi_hwi_lock( THREADS_LOCK );
 
-	for ( foo = _papi_hwi_thread_head; foo != NULL; foo = foo->next ) {
+	for ( b = 0; b < PAPI_THREAD_HASH_SIZE; b++ )
+	for ( foo = _papi_hwi_thread_hash[b]; foo != NULL; foo = foo->next ) {
 		/* xxxx Should this be hardcoded to index 0 or walk the list or what? */
 		for ( i = 0; i < papi_num_components; i++ ) {
 			if ( ( foo->tid != mytid ) && ( foo->running_eventset[i] ) &&
@@ -332,12 +396,12 @@ _papi_hwi_broadcast_signal( unsigned int mytid )
 				  (foo->running_eventset[i]->state & PAPI_OVERFLOWING ? _papi_hwd[i]->cmp_info.hardware_intr_sig : _papi_os_info.itimer_sig));
 			  retval = (*_papi_hwi_thread_kill_fn)(foo->tid, 
 				  (foo->running_eventset[i]->state & PAPI_OVERFLOWING ? _papi_hwd[i]->cmp_info.hardware_intr_sig : _papi_os_info.itimer_sig));
-			  if (retval != 0)
+			  if (retval != 0) {
+				_papi_hwi_unlock( THREADS_LOCK );
 				return(PAPI_EMISC);
+			  }
 			}
 		}
-		if ( foo->next == _papi_hwi_thread_head )
-		  break;
 	}
 	_papi_hwi_unlock( THREADS_LOCK );
 
@@ -352,9 +416,11 @@ int
 _papi_hwi_set_thread_id_fn( unsigned long ( *id_fn ) ( void ) )
 {
 #if !defined(ANY_THREAD_GETS_SIGNAL)
+	ThreadInfo_t *master = ( ThreadInfo_t * ) _papi_hwi_thread_self;
+
 	/* Check for multiple threads still in the list, if so, we can't change it */
 
-	if ( _papi_hwi_thread_head->next != _papi_hwi_thread_head )
+	if ( ( num_threads != 1 ) || ( master == NULL ) )
 		return ( PAPI_EINVAL );
 
 	/* We can't change the thread id function from one to another, 
@@ -367,12 +433,17 @@ _papi_hwi_set_thread_id_fn( unsigned long ( *id_fn ) ( void ) )
 
 	THRDBG( "Set new thread id function to %p\n", id_fn );
 
+	/* The tid is the hash key */
+	_papi_hwi_lock( THREADS_LOCK );
+	unhash_thread( master );
 	if ( id_fn )
-		_papi_hwi_thread_head->tid = ( *_papi_hwi_thread_id_fn ) (  );
+		master->tid = ( *_papi_hwi_thread_id_fn ) (  );
 	else
-		_papi_hwi_thread_head->tid = ( unsigned long ) getpid(  );
+		master->tid = ( unsigned long ) getpid(  );
+	hash_thread( master );
+	_papi_hwi_unlock( THREADS_LOCK );
 
-	THRDBG( "New master tid is %ld\n", _papi_hwi_thread_head->tid );
+	THRDBG( "New master tid is %ld\n", master->tid );
 #else
 	THRDBG( "Skipping set of thread id function\n" );
 #endif
@@ -381,45 +452,12 @@ _papi_hwi_set_thread_id_fn( unsigned long ( *id_fn ) ( void ) )
 }
 
 
-static int _papi_hwi_thread_free_eventsets(long tid) {
-
-   EventSetInfo_t *ESI;
-   ThreadInfo_t *master;
-   DynamicArray_t *map = &_papi_hwi_system_info.global_eventset_map;
-   int i;
-
-   master = _papi_hwi_lookup_thread( tid );
-
-   _papi_hwi_lock( INTERNAL_LOCK );
-
-   for( i = 0; i < map->totalSlots; i++ ) {
-      ESI = map->dataSlotArray[i];
-      if ( ( ESI ) && (ESI->master!=NULL) ) {
-
-	 if ( ESI->master == master ) {
-	    THRDBG("Attempting to remove %d from tid %ld\n",ESI->EventSetIndex,tid);
-
-	    /* Code copied from _papi_hwi_remove_EventSet(ESI);      */
-	    _papi_hwi_free_EventSet( ESI );
-	    map->dataSlotArray[i] = NULL;
-	    map->availSlots++;
-	    map->fullSlots--;
-	 }
-      }
-   }
-
-   _papi_hwi_unlock( INTERNAL_LOCK );
-
-   return PAPI_OK;
-}
-
-
 int
 _papi_hwi_shutdown_thread( ThreadInfo_t * thread, int force_shutdown )
 {
 	int retval = PAPI_OK;
 	unsigned long tid;
-	int i, failure = 0;
+	int i, self, failure = 0;
 
 	if ( _papi_hwi_thread_id_fn )
 		tid = ( *_papi_hwi_thread_id_fn ) (  );
@@ -433,7 +471,9 @@ _papi_hwi_shutdown_thread( ThreadInfo_t * thread, int force_shutdown )
 
 	if ((thread->tid==tid) || ( thread->allocator_tid == tid ) || force_shutdown) {
 
-                _papi_hwi_thread_free_eventsets(tid);
+                /* free its EventSets and give back the ids it did not use */
+                _papi_hwi_free_thread_EventSets( thread );
+                _papi_hwi_release_EventSet_ids( thread );
 
 		remove_thread( thread );
 		THRDBG( "Shutting down thread %ld at %p\n", thread->tid, thread );
@@ -442,7 +482,12 @@ _papi_hwi_shutdown_thread( ThreadInfo_t * thread, int force_shutdown )
 		   retval = _papi_hwd[i]->shutdown_thread( thread->context[i]);
 		   if ( retval != PAPI_OK ) failure = retval;
 		}
+		self = ( thread->tid == tid );
 		free_thread( &thread );
+		/* only the calling thread can give up its memory pool */
+		if ( self ) {
+			papi_mem_thread_exit(  );
+		}
 		return ( failure );
 	}
 
@@ -456,8 +501,8 @@ _papi_hwi_shutdown_thread( ThreadInfo_t * thread, int force_shutdown )
 int
 _papi_hwi_shutdown_global_threads( void )
 {
-        int err,num_threads,i;
-	ThreadInfo_t *tmp,*next;
+        int err,b;
+	ThreadInfo_t *tmp;
 	unsigned long our_tid;
 
 	tmp = _papi_hwi_lookup_thread( 0 );
@@ -474,48 +519,40 @@ _papi_hwi_shutdown_global_threads( void )
 
 	   err = _papi_hwi_shutdown_thread( tmp, 1 );
 
-	   /* count threads */
-	   tmp = ( ThreadInfo_t * ) _papi_hwi_thread_head;
-	   num_threads=0;
-	   while(tmp!=NULL) {
-	      num_threads++;
-	      if (tmp->next==_papi_hwi_thread_head) break;
-	      tmp=tmp->next;
-	   }
+	   /* Shut down all the other threads, each one leaves the hash */
+	   for(b=0;b<PAPI_THREAD_HASH_SIZE;b++) {
+	      while((tmp=_papi_hwi_thread_hash[b])!=NULL) {
 
-	   /* Shut down all threads allocated by this thread */
-	   /* Urgh it's a circular list where we removed in the loop  */
-	   /* so the only sane way to do it is get a count in advance */
-	   tmp = ( ThreadInfo_t * ) _papi_hwi_thread_head;
-
-	   for(i=0;i<num_threads;i++) {
-
-	      next=tmp->next;
-
-	      THRDBG("looking at #%d %ld our_tid: %ld alloc_tid: %ld\n",
-		     i,tmp->tid,our_tid,tmp->allocator_tid);
+	         THRDBG("looking at %ld our_tid: %ld alloc_tid: %ld\n",
+		     tmp->tid,our_tid,tmp->allocator_tid);
 
 		 THRDBG("Also removing thread %ld\n",tmp->tid);
 	         err = _papi_hwi_shutdown_thread( tmp, 1 );
-
-	      tmp=next;
-
+	      }
 	   }
 	}
 
 
 #ifdef DEBUG
 	if ( ISLEVEL( DEBUG_THREADS ) ) {
-		if ( _papi_hwi_thread_head ) {
-			THRDBG( "Thread head %p still exists!\n", _papi_hwi_thread_head );
+		if ( num_threads ) {
+			THRDBG( "%d threads still exist!\n", num_threads );
 		}
 	}
 #endif
 
+	/* Nobody should be looking up threads anymore */
+	while ( ( tmp = retired_threads ) != NULL ) {
+		retired_threads = tmp->retired_next;
+		papi_free( tmp );
+	}
+
 #if defined(HAVE_THREAD_LOCAL_STORAGE)
 	_papi_hwi_my_thread = NULL;
 #endif
-	_papi_hwi_thread_head = NULL;
+	memset( ( void * ) _papi_hwi_thread_hash, 0, sizeof ( _papi_hwi_thread_hash ) );
+	_papi_hwi_thread_self = NULL;
+	num_threads = 0;
 	_papi_hwi_thread_id_fn = NULL;
 #if defined(ANY_THREAD_GETS_SIGNAL)
 	_papi_hwi_thread_kill_fn = NULL;
@@ -535,7 +572,9 @@ _papi_hwi_init_global_threads( void )
 #if defined(HAVE_THREAD_LOCAL_STORAGE)
 	_papi_hwi_my_thread = NULL;
 #endif
-	_papi_hwi_thread_head = NULL;
+	memset( ( void * ) _papi_hwi_thread_hash, 0, sizeof ( _papi_hwi_thread_hash ) );
+	_papi_hwi_thread_self = NULL;
+	num_threads = 0;
 	_papi_hwi_thread_id_fn = NULL;
 #if defined(ANY_THREAD_GETS_SIGNAL)
 	_papi_hwi_thread_kill_fn = NULL;
@@ -554,13 +593,13 @@ _papi_hwi_init_global_threads( void )
 int
 _papi_hwi_gather_all_thrspec_data( int tag, PAPI_all_thr_spec_t * where )
 {
-	int didsomething = 0;
+	int didsomething = 0, b;
 	ThreadInfo_t *foo = NULL;
 
 	_papi_hwi_lock( THREADS_LOCK );
 
-	for ( foo = ( ThreadInfo_t * ) _papi_hwi_thread_head; foo != NULL;
-		  foo = foo->next ) {
+	for ( b = 0; b < PAPI_THREAD_HASH_SIZE; b++ ) {
+	for ( foo = _papi_hwi_thread_hash[b]; foo != NULL; foo = foo->next ) {
 		/* If we want thread ID's */
 		if ( where->id )
 			memcpy( &where->id[didsomething], &foo->tid,
@@ -574,12 +613,12 @@ _papi_hwi_gather_all_thrspec_data( int tag, PAPI_all_thr_spec_t * where )
 
 		if ( ( where->id ) || ( where->data ) ) {
 			if ( didsomething >= where->num )
-				break;
+				goto done;
 		}
-
-		if ( foo->next == _papi_hwi_thread_head )
-			break;
 	}
+	}
+
+done:
 
 	where->num = didsomething;
 	_papi_hwi_unlock( THREADS_LOCK );
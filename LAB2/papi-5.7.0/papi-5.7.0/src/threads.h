@@ -20,22 +20,46 @@
 #error "lookup_and_set_thread_symbols and _papi_hwi_broadcast_signal have only been tested on AIX"
 #endif
 
+/** EventSet ids are moved between a thread and the global free stack  */
+/*  PAPI_EVENTSET_BATCH at a time, a thread holds at most twice that.   */
+/*  A thread parks at most PAPI_RECYCLE_MAX EventSets for reuse.        */
+#define PAPI_EVENTSET_BATCH 16
+#define PAPI_RECYCLE_MAX 16
+
 typedef struct _ThreadInfo
 {
 	unsigned long int tid;
 	unsigned long int allocator_tid;
-	struct _ThreadInfo *next;
+	struct _ThreadInfo *volatile next;	/* next in hash bucket */
+	struct _ThreadInfo *retired_next;	/* next unused ThreadInfo_t */
 	hwd_context_t **context;
 	void *thread_storage[PAPI_MAX_TLS];
 	EventSetInfo_t **running_eventset;
 	EventSetInfo_t *from_esi;          /* ESI used for last update this control state */
 	int wants_signal;
+	int free_eventsets[2 * PAPI_EVENTSET_BATCH]; /* ids to hand out, lowest last */
+	int num_free_eventsets;
+	EventSetInfo_t *recycled_eventsets;  /* parked by PAPI_recycle_eventset */
+	int num_recycled_eventsets;
 } ThreadInfo_t;
 
-/** The list of threads, gets initialized to master process with TID of getpid() 
+/** Hash table of threads by tid, gets initialized to master process with
+ *  TID of getpid().  Lookups walk a bucket without any lock; entries are
+ *  only changed under THREADS_LOCK and ThreadInfo_t's are not returned
+ *  to malloc until PAPI shuts down, so a walk racing with a removal can
+ *  at worst miss, and misses are retried under the lock.
+ *	@internal */
+
+#define PAPI_THREAD_HASH_BITS 10
+#define PAPI_THREAD_HASH_SIZE ( 1 << PAPI_THREAD_HASH_BITS )
+
+extern ThreadInfo_t *volatile _papi_hwi_thread_hash[PAPI_THREAD_HASH_SIZE];
+
+/** Without a thread id function there is only one thread of our own,
+ *  the last one registered with a tid of 0 (others are attach targets).
  *	@internal */
 
-extern volatile ThreadInfo_t *_papi_hwi_thread_head;
+extern ThreadInfo_t *volatile _papi_hwi_thread_self;
 
 /* If we have TLS, this variable ALWAYS points to our thread descriptor. It's like magic! */
 
@@ -54,6 +78,7 @@ extern unsigned long int ( *_papi_hwi_thread_id_fn ) ( void );
 extern int ( *_papi_hwi_thread_kill_fn ) ( int, int );
 
 extern int _papi_hwi_initialize_thread( ThreadInfo_t ** dest, int tid );
+extern int _papi_hwi_init_thread_component( int cidx );
 extern int _papi_hwi_init_global_threads( void );
 extern int _papi_hwi_shutdown_thread( ThreadInfo_t * thread, int force );
 extern int _papi_hwi_shutdown_global_threads( void );
@@ -88,6 +113,29 @@ _papi_hwi_unlock( int lck )
 	return ( PAPI_OK );
 }
 
+/* pthread_self() values are page aligned, gettid() values are small */
+inline_static unsigned int
+_papi_hwi_thread_hashval( unsigned long int tid )
+{
+	unsigned int h = ( unsigned int ) ( tid ^ ( tid >> 12 ) ^ ( ( tid >> 16 ) >> 16 ) );
+
+	return ( h * 2654435761U ) >> ( 32 - PAPI_THREAD_HASH_BITS );
+}
+
+inline_static ThreadInfo_t *
+_papi_hwi_thread_bucket_find( unsigned long int tid )
+{
+	ThreadInfo_t *tmp;
+
+	for ( tmp = _papi_hwi_thread_hash[_papi_hwi_thread_hashval( tid )];
+		  tmp != NULL; tmp = tmp->next ) {
+		THRDBG( "Examining thread tid %#lx at %p\n", tmp->tid, tmp );
+		if ( tmp->tid == tid )
+			break;
+	}
+	return ( tmp );
+}
+
 inline_static ThreadInfo_t *
 _papi_hwi_lookup_thread( int custom_tid )
 {
@@ -103,8 +151,8 @@ _papi_hwi_lookup_thread( int custom_tid )
 #else
 	   if ( _papi_hwi_thread_id_fn == NULL ) {
 	      THRDBG( "Threads not initialized, returning master thread at %p\n",
-				_papi_hwi_thread_head );
-	      return ( ( ThreadInfo_t * ) _papi_hwi_thread_head );
+				_papi_hwi_thread_self );
+	      return ( ( ThreadInfo_t * ) _papi_hwi_thread_self );
 	   }
 
 	   tid = ( *_papi_hwi_thread_id_fn ) (  );
@@ -115,28 +163,21 @@ _papi_hwi_lookup_thread( int custom_tid )
 	}
 	THRDBG( "Threads initialized, looking for thread %#lx\n", tid );
 
-	_papi_hwi_lock( THREADS_LOCK );
+	tmp = _papi_hwi_thread_bucket_find( tid );
 
-	tmp = ( ThreadInfo_t * ) _papi_hwi_thread_head;
-	while ( tmp != NULL ) {
-		THRDBG( "Examining thread tid %#lx at %p\n", tmp->tid, tmp );
-		if ( tmp->tid == tid )
-			break;
-		tmp = tmp->next;
-		if ( tmp == _papi_hwi_thread_head ) {
-			tmp = NULL;
-			break;
-		}
+	/* We may have raced with a thread being removed, make sure */
+	if ( tmp == NULL ) {
+	   _papi_hwi_lock( THREADS_LOCK );
+	   tmp = _papi_hwi_thread_bucket_find( tid );
+	   _papi_hwi_unlock( THREADS_LOCK );
 	}
 
 	if ( tmp ) {
-		_papi_hwi_thread_head = tmp;
 		THRDBG( "Found thread %ld at %p\n", tid, tmp );
 	} else {
 		THRDBG( "Did not find tid %ld\n", tid );
 	}
 
-	_papi_hwi_unlock( THREADS_LOCK );
 	return ( tmp );
 
 }
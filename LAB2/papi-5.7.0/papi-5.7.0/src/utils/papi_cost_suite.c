@@ -0,0 +1,673 @@
+/** file papi_cost_suite.c
+  * @brief papi_cost_suite utility.
+  *	@page papi_cost_suite
+  * @section  NAME
+  *		papi_cost_suite - measures the distribution of PAPI read costs.
+  *
+  *	@section Synopsis
+  *		papi_cost_suite [-hj] [-n events] [-T threads] [-t iterations]
+  *
+  *	@section Description
+  *		papi_cost_suite is a PAPI utility program that runs a set of
+  *		benchmarks and reports the min / median / 99th percentile / max
+  *		cost, in cycles, of the PAPI calls a measured program makes most
+  *		often.  It measures PAPI_start/stop pairs and PAPI_read on
+  *		event sets of 1 to n events, on inherited event sets (read()
+  *		of each event), on derived presets, on kernel and software
+  *		multiplexed event sets, from several threads reading
+  *		concurrently, and on an event set attached to another process.
+  *		For each benchmark it also reports how the component satisfied
+  *		the reads (see PAPI_READ_STATS), so rdpmc, grouped read() and
+  *		per-event read() costs can be told apart.  Setting
+  *		PAPI_PERF_EVENT_NO_RDPMC in the environment turns off rdpmc
+  *		in the perf_event component to get the read() numbers for
+  *		the same benchmarks.
+  *		With -j the results are printed as JSON, so they can be
+  *		compared between PAPI releases or machines.
+  *
+  *	@section Options
+  *	<ul>
+  *		<li>-h	Display help information about this utility.
+  *		<li>-j	Print the results as JSON.
+  *		<li>-n < events >	Largest number of events in an event set. The default is 8.
+  *		<li>-T < threads >	Number of threads reading concurrently. The default is 4.
+  *		<li>-t < iterations >	Number of timed calls per benchmark. The default is 100,000.
+  *	</ul>
+  *
+  *	@section Bugs
+  *		There are no known bugs in this utility. If you find a bug,
+  *		it should be reported to the PAPI Mailing List at <ptools-perfapi@icl.utk.edu>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "papi.h"
+
+#define MAX_EVENTS	16
+#define MAX_RESULTS	64
+
+/* The kinds of event set a benchmark can use */
+#define SET_PLAIN	0
+#define SET_INHERIT	1
+#define SET_MPX		2
+#define SET_MPX_SW	3
+#define SET_ATTACH	4
+
+typedef struct {
+	char scenario[PAPI_MIN_STR_LEN];
+	int num_events;
+	int threads;
+	int status;		/* PAPI_OK, or why the benchmark was skipped */
+	long long min, p50, p99, max;
+	double mean;
+	long long fast, mixed, slow;	/* PAPI_READ_STATS, -1 if unknown */
+} result_t;
+
+typedef struct {
+	int *events;
+	int num_events;
+	int iters;
+	long long *array;
+	long long fast, mixed, slow;
+	int status;
+} thread_arg_t;
+
+static result_t results[MAX_RESULTS];
+static int num_results;
+static pthread_barrier_t barrier;
+
+static void
+print_help( void )
+{
+	printf( "This is the PAPI cost suite program.\n" );
+	printf( "It reports min / median / 99th percentile / max cycles for\n" );
+	printf( "PAPI start/stop and PAPI_read on various kinds of event sets.\n\n" );
+	printf( "Usage: papi_cost_suite [options]\n" );
+	printf( "\t-h            help\n" );
+	printf( "\t-j            print the results as JSON\n" );
+	printf( "\t-n events     largest number of events in an event set (default 8)\n" );
+	printf( "\t-T threads    number of threads reading concurrently (default 4)\n" );
+	printf( "\t-t iterations timed calls per benchmark (default 100000)\n" );
+	printf( "\nSet PAPI_PERF_EVENT_NO_RDPMC to measure perf_event without rdpmc.\n" );
+}
+
+/* Long Long compare function for qsort */
+static int
+cmp_ll( const void *a, const void *b )
+{
+	long long x = *( const long long * ) a, y = *( const long long * ) b;
+
+	return ( x > y ) - ( x < y );
+}
+
+static result_t *
+new_result( const char *scenario, int num_events, int threads )
+{
+	result_t *r;
+
+	if ( num_results == MAX_RESULTS ) {
+		fprintf( stderr, "Too many results\n" );
+		exit( 1 );
+	}
+
+	r = &results[num_results++];
+	memset( r, 0, sizeof ( *r ) );
+	strncpy( r->scenario, scenario, PAPI_MIN_STR_LEN - 1 );
+	r->num_events = num_events;
+	r->threads = threads;
+	r->fast = r->mixed = r->slow = -1;
+	return r;
+}
+
+/* Sort the timings and fill in the distribution of r */
+static void
+summarize( result_t *r, long long *array, int n )
+{
+	double sum = 0;
+	int i;
+
+	qsort( array, ( size_t ) n, sizeof ( long long ), cmp_ll );
+
+	for ( i = 0; i < n; i++ )
+		sum += ( double ) array[i];
+
+	r->min = array[0];
+	r->max = array[n - 1];
+	r->p50 = array[n / 2];
+	r->p99 = array[( ( long long ) n * 99 ) / 100];
+	r->mean = sum / n;
+}
+
+static void
+read_stats( int EventSet, long long *fast, long long *mixed, long long *slow )
+{
+	PAPI_option_t opt;
+
+	memset( &opt, 0, sizeof ( opt ) );
+	opt.read_stats.eventset = EventSet;
+	if ( PAPI_get_opt( PAPI_READ_STATS, &opt ) == PAPI_OK ) {
+		*fast = opt.read_stats.fast;
+		*mixed = opt.read_stats.mixed;
+		*slow = opt.read_stats.slow;
+	}
+}
+
+static void
+free_set( int *EventSet )
+{
+	PAPI_cleanup_eventset( *EventSet );
+	PAPI_destroy_eventset( EventSet );
+}
+
+/* Create an event set of the given kind counting the first n events */
+/* of list.  pid is only used for SET_ATTACH.                        */
+static int
+make_set( int *EventSet, int *list, int n, int kind, pid_t pid )
+{
+	PAPI_option_t opt;
+	int i, retval;
+
+	*EventSet = PAPI_NULL;
+	retval = PAPI_create_eventset( EventSet );
+	if ( retval != PAPI_OK )
+		return retval;
+
+	if ( kind != SET_PLAIN ) {
+		retval = PAPI_assign_eventset_component( *EventSet, 0 );
+		if ( retval != PAPI_OK )
+			goto fail;
+	}
+
+	memset( &opt, 0, sizeof ( opt ) );
+
+	switch ( kind ) {
+	case SET_INHERIT:
+		opt.inherit.eventset = *EventSet;
+		opt.inherit.inherit = PAPI_INHERIT_ALL;
+		retval = PAPI_set_opt( PAPI_INHERIT, &opt );
+		break;
+	case SET_MPX:
+		retval = PAPI_set_multiplex( *EventSet );
+		break;
+	case SET_MPX_SW:
+		PAPI_get_opt( PAPI_DEF_ITIMER, &opt );
+		opt.multiplex.ns = opt.itimer.ns;
+		opt.multiplex.eventset = *EventSet;
+		opt.multiplex.flags = PAPI_MULTIPLEX_FORCE_SW;
+		retval = PAPI_set_opt( PAPI_MULTIPLEX, &opt );
+		break;
+	case SET_ATTACH:
+		retval = PAPI_attach( *EventSet, ( unsigned long ) pid );
+		break;
+	default:
+		retval = PAPI_OK;
+		break;
+	}
+	if ( retval != PAPI_OK )
+		goto fail;
+
+	for ( i = 0; i < n; i++ ) {
+		retval = PAPI_add_event( *EventSet, list[i] );
+		if ( retval != PAPI_OK )
+			goto fail;
+	}
+
+	return PAPI_OK;
+
+fail:
+	free_set( EventSet );
+	return retval;
+}
+
+/* Time iters PAPI_read calls on a started event set */
+static int
+time_reads( int EventSet, long long *array, int iters )
+{
+	long long values[MAX_EVENTS], t;
+	int i, retval;
+
+	retval = PAPI_start( EventSet );
+	if ( retval != PAPI_OK )
+		return retval;
+
+	/* warm up */
+	PAPI_read( EventSet, values );
+
+	for ( i = 0; i < iters; i++ ) {
+		t = PAPI_get_real_cyc(  );
+		PAPI_read( EventSet, values );
+		array[i] = PAPI_get_real_cyc(  ) - t;
+	}
+
+	return PAPI_stop( EventSet, values );
+}
+
+/* Time iters PAPI_start/PAPI_stop pairs */
+static int
+time_start_stop( int EventSet, long long *array, int iters )
+{
+	long long values[MAX_EVENTS], t;
+	int i, retval;
+
+	for ( i = 0; i < iters; i++ ) {
+		t = PAPI_get_real_cyc(  );
+		retval = PAPI_start( EventSet );
+		if ( retval == PAPI_OK )
+			retval = PAPI_stop( EventSet, values );
+		array[i] = PAPI_get_real_cyc(  ) - t;
+		if ( retval != PAPI_OK )
+			return retval;
+	}
+
+	return PAPI_OK;
+}
+
+/* Build an event set of the given kind, time reads on it and record */
+/* the distribution under scenario.                                  */
+static void
+bench_read( const char *scenario, int *list, int n, int kind, pid_t pid,
+			long long *array, int iters )
+{
+	result_t *r = new_result( scenario, n, 1 );
+	int EventSet;
+
+	r->status = make_set( &EventSet, list, n, kind, pid );
+	if ( r->status != PAPI_OK )
+		return;
+
+	r->status = time_reads( EventSet, array, iters );
+	if ( r->status == PAPI_OK ) {
+		summarize( r, array, iters );
+		read_stats( EventSet, &r->fast, &r->mixed, &r->slow );
+	}
+
+	free_set( &EventSet );
+}
+
+static void *
+thread_reads( void *arg )
+{
+	thread_arg_t *t = ( thread_arg_t * ) arg;
+	int EventSet = PAPI_NULL;
+
+	t->fast = t->mixed = t->slow = -1;
+
+	t->status = PAPI_register_thread(  );
+	if ( t->status == PAPI_OK )
+		t->status = make_set( &EventSet, t->events, t->num_events,
+							  SET_PLAIN, 0 );
+
+	/* Everybody reads at the same time */
+	pthread_barrier_wait( &barrier );
+
+	if ( t->status == PAPI_OK ) {
+		t->status = time_reads( EventSet, t->array, t->iters );
+		read_stats( EventSet, &t->fast, &t->mixed, &t->slow );
+		free_set( &EventSet );
+	}
+
+	PAPI_unregister_thread(  );
+	return NULL;
+}
+
+static void
+bench_threads( int *list, int n, int threads, int iters )
+{
+	result_t *r = new_result( "read_threads", n, threads );
+	thread_arg_t *args;
+	pthread_t *tids;
+	long long *array;
+	int i;
+
+	args = calloc( ( size_t ) threads, sizeof ( thread_arg_t ) );
+	tids = calloc( ( size_t ) threads, sizeof ( pthread_t ) );
+	array = malloc( ( size_t ) threads * iters * sizeof ( long long ) );
+	if ( args == NULL || tids == NULL || array == NULL ) {
+		r->status = PAPI_ENOMEM;
+		goto out;
+	}
+
+	pthread_barrier_init( &barrier, NULL, ( unsigned ) threads );
+
+	for ( i = 0; i < threads; i++ ) {
+		args[i].events = list;
+		args[i].num_events = n;
+		args[i].iters = iters;
+		args[i].array = array + ( size_t ) i * iters;
+		if ( pthread_create( &tids[i], NULL, thread_reads, &args[i] ) ) {
+			fprintf( stderr, "pthread_create failed\n" );
+			exit( 1 );
+		}
+	}
+
+	r->fast = r->mixed = r->slow = 0;
+	for ( i = 0; i < threads; i++ ) {
+		pthread_join( tids[i], NULL );
+		if ( args[i].status != PAPI_OK )
+			r->status = args[i].status;
+		r->fast += args[i].fast;
+		r->mixed += args[i].mixed;
+		r->slow += args[i].slow;
+	}
+
+	pthread_barrier_destroy( &barrier );
+
+	if ( r->status == PAPI_OK )
+		summarize( r, array, threads * iters );
+	else
+		r->fast = r->mixed = r->slow = -1;
+
+out:
+	free( array );
+	free( tids );
+	free( args );
+}
+
+static void
+bench_attach( int *list, int n, long long *array, int iters )
+{
+	pid_t pid;
+	int status;
+
+	pid = fork(  );
+	if ( pid < 0 ) {
+		new_result( "read_attached", n, 1 )->status = PAPI_ESYS;
+		return;
+	}
+	if ( pid == 0 ) {
+		for ( ;; )
+			pause(  );
+	}
+
+	bench_read( "read_attached", list, n, SET_ATTACH, pid, array, iters );
+
+	kill( pid, SIGKILL );
+	waitpid( pid, &status, 0 );
+}
+
+/* Search for a derived preset of type "type" */
+static int
+find_derived( const char *type )
+{
+	PAPI_event_info_t info;
+	int i = 0 | PAPI_PRESET_MASK;
+
+	PAPI_enum_event( &i, PAPI_ENUM_FIRST );
+
+	do {
+		if ( ( PAPI_get_event_info( i, &info ) == PAPI_OK ) &&
+			 ( info.count > 0 ) ) {
+			if ( strcmp( info.derived, type ) == 0 ) {
+				return i;
+			}
+		}
+	} while ( PAPI_enum_event( &i, PAPI_PRESET_ENUM_AVAIL ) == PAPI_OK );
+
+	return PAPI_NULL;
+}
+
+static void
+bench_derived( const char *scenario, const char *type, const char *alt,
+			   long long *array, int iters )
+{
+	int event;
+
+	event = find_derived( type );
+	if ( ( event == PAPI_NULL ) && ( alt != NULL ) )
+		event = find_derived( alt );
+
+	if ( event == PAPI_NULL ) {
+		new_result( scenario, 1, 1 )->status = PAPI_ENOEVNT;
+		return;
+	}
+
+	bench_read( scenario, &event, 1, SET_PLAIN, 0, array, iters );
+}
+
+/* Collect the available presets that are not derived (all) and   */
+/* the largest subset of them that can be counted together (comp). */
+static void
+find_events( int *all, int *num_all, int *comp, int *num_comp, int max )
+{
+	PAPI_event_info_t info;
+	int i = 0 | PAPI_PRESET_MASK;
+	int EventSet = PAPI_NULL;
+
+	*num_all = *num_comp = 0;
+
+	if ( PAPI_create_eventset( &EventSet ) != PAPI_OK )
+		return;
+
+	PAPI_enum_event( &i, PAPI_ENUM_FIRST );
+
+	do {
+		if ( ( PAPI_get_event_info( i, &info ) != PAPI_OK ) ||
+			 ( info.count == 0 ) )
+			continue;
+		if ( strcmp( info.derived, "NOT_DERIVED" ) != 0 )
+			continue;
+		if ( *num_all < MAX_EVENTS )
+			all[( *num_all )++] = i;
+		if ( ( *num_comp < max ) &&
+			 ( PAPI_add_event( EventSet, i ) == PAPI_OK ) )
+			comp[( *num_comp )++] = i;
+	} while ( PAPI_enum_event( &i, PAPI_PRESET_ENUM_AVAIL ) == PAPI_OK );
+
+	free_set( &EventSet );
+}
+
+static const char *
+read_path( result_t *r )
+{
+	if ( ( r->fast < 0 ) || ( r->fast + r->mixed + r->slow == 0 ) )
+		return "-";
+	if ( ( r->mixed == 0 ) && ( r->slow == 0 ) )
+		return "rdpmc";
+	if ( ( r->fast == 0 ) && ( r->mixed == 0 ) )
+		return "read()";
+	return "mixed";
+}
+
+static void
+print_text( int iters )
+{
+	result_t *r;
+	int i;
+
+	printf( "\nCycles per call over %d iterations\n\n", iters );
+	printf( "%-22s %6s %7s %10s %10s %10s %10s %12s %s\n",
+			"benchmark", "events", "threads", "min", "p50", "p99", "max",
+			"mean", "path" );
+
+	for ( i = 0; i < num_results; i++ ) {
+		r = &results[i];
+		if ( r->status != PAPI_OK ) {
+			printf( "%-22s %6d %7d skipped: %s\n", r->scenario,
+					r->num_events, r->threads, PAPI_strerror( r->status ) );
+			continue;
+		}
+		printf( "%-22s %6d %7d %10lld %10lld %10lld %10lld %12.1f %s\n",
+				r->scenario, r->num_events, r->threads, r->min, r->p50,
+				r->p99, r->max, r->mean, read_path( r ) );
+	}
+}
+
+static void
+print_json( int iters )
+{
+	const PAPI_component_info_t *cmpinfo;
+	result_t *r;
+	int i, ver;
+
+	ver = PAPI_get_opt( PAPI_LIB_VERSION, NULL );
+	cmpinfo = PAPI_get_component_info( 0 );
+
+	printf( "{\n" );
+	printf( "  \"papi_version\": \"%d.%d.%d.%d\",\n",
+			PAPI_VERSION_MAJOR( ver ), PAPI_VERSION_MINOR( ver ),
+			PAPI_VERSION_REVISION( ver ), PAPI_VERSION_INCREMENT( ver ) );
+	printf( "  \"component\": \"%s\",\n", cmpinfo ? cmpinfo->name : "" );
+	printf( "  \"rdpmc\": %d,\n", cmpinfo ? cmpinfo->fast_counter_read : 0 );
+	printf( "  \"unit\": \"cycles\",\n" );
+	printf( "  \"iterations\": %d,\n", iters );
+	printf( "  \"results\": [" );
+
+	for ( i = 0; i < num_results; i++ ) {
+		r = &results[i];
+		printf( "%s\n    { \"benchmark\": \"%s\", \"events\": %d, \"threads\": %d, ",
+				i ? "," : "", r->scenario, r->num_events, r->threads );
+		if ( r->status != PAPI_OK ) {
+			printf( "\"status\": \"skipped\", \"reason\": \"%s\" }",
+					PAPI_strerror( r->status ) );
+			continue;
+		}
+		printf( "\"status\": \"ok\", \"min\": %lld, \"p50\": %lld, "
+				"\"p99\": %lld, \"max\": %lld, \"mean\": %.1f, "
+				"\"reads_fast\": %lld, \"reads_mixed\": %lld, "
+				"\"reads_slow\": %lld }",
+				r->min, r->p50, r->p99, r->max, r->mean,
+				r->fast, r->mixed, r->slow );
+	}
+
+	printf( "\n  ]\n}\n" );
+}
+
+int
+main( int argc, char **argv )
+{
+	int c, i, n, retval;
+	int json = 0, max_events = 8, threads = 4, iters = 100000;
+	int all[MAX_EVENTS], comp[MAX_EVENTS], num_all, num_comp;
+	int EventSet;
+	long long *array, t;
+	result_t *r;
+
+	while ( ( c = getopt( argc, argv, "hjn:T:t:" ) ) != -1 ) {
+		switch ( c ) {
+		case 'j':
+			json = 1;
+			break;
+		case 'n':
+			max_events = atoi( optarg );
+			break;
+		case 'T':
+			threads = atoi( optarg );
+			break;
+		case 't':
+			iters = atoi( optarg );
+			break;
+		case 'h':
+		default:
+			print_help(  );
+			exit( 1 );
+		}
+	}
+
+	if ( max_events < 1 || max_events > MAX_EVENTS || threads < 1 ||
+		 iters < 1 ) {
+		print_help(  );
+		exit( 1 );
+	}
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		fprintf( stderr, "PAPI_library_init failed\n" );
+		exit( 1 );
+	}
+
+	retval = PAPI_thread_init( ( unsigned long ( * )( void ) ) pthread_self );
+	if ( retval != PAPI_OK ) {
+		fprintf( stderr, "PAPI_thread_init failed\n" );
+		exit( 1 );
+	}
+
+	retval = PAPI_multiplex_init(  );
+	if ( retval != PAPI_OK ) {
+		fprintf( stderr, "PAPI_multiplex_init failed\n" );
+		exit( 1 );
+	}
+
+	array = malloc( ( size_t ) iters * sizeof ( long long ) );
+	if ( array == NULL ) {
+		fprintf( stderr, "Error allocating memory for results\n" );
+		exit( 1 );
+	}
+
+	if ( !json ) {
+		printf( "Cost of PAPI start/stop and reads on various event sets.\n" );
+		printf( "This test takes a while. Please be patient...\n" );
+	}
+
+	/* How much of each number is the timer itself */
+	r = new_result( "timer", 0, 1 );
+	for ( i = 0; i < iters; i++ ) {
+		t = PAPI_get_real_cyc(  );
+		array[i] = PAPI_get_real_cyc(  ) - t;
+	}
+	summarize( r, array, iters );
+
+	find_events( all, &num_all, comp, &num_comp, max_events );
+
+	if ( num_comp == 0 ) {
+		new_result( "start_stop", 0, 1 )->status = PAPI_ENOEVNT;
+		new_result( "read", 0, 1 )->status = PAPI_ENOEVNT;
+	}
+	else {
+		n = ( num_comp < 2 ) ? num_comp : 2;
+		r = new_result( "start_stop", n, 1 );
+		r->status = make_set( &EventSet, comp, n, SET_PLAIN, 0 );
+		if ( r->status == PAPI_OK ) {
+			r->status = time_start_stop( EventSet, array, iters );
+			if ( r->status == PAPI_OK )
+				summarize( r, array, iters );
+			free_set( &EventSet );
+		}
+
+		for ( n = 1; n <= num_comp; n++ )
+			bench_read( "read", comp, n, SET_PLAIN, 0, array, iters );
+
+		/* Inherited event sets are read with one read() per event */
+		bench_read( "read_inherit", comp, 1, SET_INHERIT, 0, array, iters );
+		if ( num_comp > 1 )
+			bench_read( "read_inherit", comp, num_comp, SET_INHERIT, 0,
+						array, iters );
+
+		n = ( num_comp < 2 ) ? num_comp : 2;
+		bench_threads( comp, n, threads, iters );
+		bench_attach( comp, n, array, iters );
+	}
+
+	bench_derived( "read_derived_add", "DERIVED_ADD", "DERIVED_SUB",
+				   array, iters );
+	bench_derived( "read_derived_postfix", "DERIVED_POSTFIX", NULL,
+				   array, iters );
+
+	/* Multiplex every preset we found, usually more than fit */
+	if ( num_all == 0 ) {
+		new_result( "read_multiplex", 0, 1 )->status = PAPI_ENOEVNT;
+		new_result( "read_multiplex_sw", 0, 1 )->status = PAPI_ENOEVNT;
+	}
+	else {
+		bench_read( "read_multiplex", all, num_all, SET_MPX, 0,
+					array, iters );
+		bench_read( "read_multiplex_sw", all, num_all, SET_MPX_SW, 0,
+					array, iters );
+	}
+
+	if ( json )
+		print_json( iters );
+	else
+		print_text( iters );
+
+	free( array );
+	PAPI_shutdown(  );
+
+	return 0;
+}
@@ -0,0 +1,150 @@
+/** file papi_name_lookup_cost.c
+  * @brief papi_name_lookup_cost utility.
+  *	@page papi_name_lookup_cost
+  * @section  NAME
+  *		papi_name_lookup_cost - measures the cost of native event name lookups.
+  *
+  *	@section Synopsis
+  *		papi_name_lookup_cost [-h] [-x max] [-r reps]
+  *
+  *	@section Description
+  *		papi_name_lookup_cost is a PAPI utility program that measures how
+  *		long PAPI_event_name_to_code() takes for native events as the number
+  *		of native events PAPI knows about grows.  Native events are enumerated
+  *		from every enabled component; each time the number of events seen
+  *		doubles, all names seen so far are looked up again and the average
+  *		time per lookup is printed.
+  *
+  *	@section Options
+  *	<ul>
+  *		<li>-h	Display help information about this utility.
+  *		<li>-x < max >	Stop after this many native events. The default is 65536.
+  *		<li>-r < reps >	Number of times each name is looked up per
+  *			measurement. The default is 10.
+  *	</ul>
+  *
+  *	@section Bugs
+  *		There are no known bugs in this utility. If you find a bug,
+  *		it should be reported to the PAPI Mailing List at <ptools-perfapi@icl.utk.edu>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "papi.h"
+
+static void
+print_help( void )
+{
+	printf( "This is the PAPI native event name lookup cost program.\n" );
+	printf( "It measures PAPI_event_name_to_code() for native events\n" );
+	printf( "against the number of native events known to PAPI.\n\n" );
+	printf( "Usage: papi_name_lookup_cost [options]\n" );
+	printf( "\t-h            help\n" );
+	printf( "\t-x max        stop after max native events (default 65536)\n" );
+	printf( "\t-r reps       lookups of each name per measurement (default 10)\n" );
+}
+
+/* Look up the first n names reps times, return ns per lookup */
+static double
+time_lookups( char **names, int n, int reps )
+{
+	long long start, end;
+	int i, r, code;
+
+	start = PAPI_get_real_nsec(  );
+	for ( r = 0; r < reps; r++ ) {
+		for ( i = 0; i < n; i++ ) {
+			if ( PAPI_event_name_to_code( names[i], &code ) != PAPI_OK ) {
+				fprintf( stderr, "Lookup of %s failed\n", names[i] );
+				exit( 1 );
+			}
+		}
+	}
+	end = PAPI_get_real_nsec(  );
+
+	return ( double ) ( end - start ) / ( ( double ) n * reps );
+}
+
+int
+main( int argc, char **argv )
+{
+	int retval, c, cidx, code, num = 0, next = 1;
+	int max = 65536, reps = 10;
+	char name[PAPI_MAX_STR_LEN];
+	char **names;
+
+	while ( ( c = getopt( argc, argv, "hx:r:" ) ) != -1 ) {
+		switch ( c ) {
+		case 'x':
+			max = atoi( optarg );
+			break;
+		case 'r':
+			reps = atoi( optarg );
+			break;
+		case 'h':
+		default:
+			print_help(  );
+			exit( c == 'h' ? 0 : 1 );
+		}
+	}
+
+	if ( ( max < 1 ) || ( reps < 1 ) ) {
+		print_help(  );
+		exit( 1 );
+	}
+
+	retval = PAPI_library_init( PAPI_VER_CURRENT );
+	if ( retval != PAPI_VER_CURRENT ) {
+		fprintf( stderr, "PAPI_library_init failed: %s\n",
+			 PAPI_strerror( retval ) );
+		exit( 1 );
+	}
+
+	names = calloc( ( size_t ) max, sizeof ( char * ) );
+	if ( names == NULL ) {
+		fprintf( stderr, "Out of memory\n" );
+		exit( 1 );
+	}
+
+	printf( "%12s %16s\n", "events", "ns/lookup" );
+
+	for ( cidx = 0; cidx < PAPI_num_components(  ) && num < max; cidx++ ) {
+		code = 0 | PAPI_NATIVE_MASK;
+		if ( PAPI_enum_cmp_event( &code, PAPI_ENUM_FIRST, cidx ) != PAPI_OK )
+			continue;
+
+		do {
+			if ( PAPI_event_code_to_name( code, name ) != PAPI_OK )
+				continue;
+
+			/* only keep names that resolve back */
+			if ( PAPI_event_name_to_code( name, &retval ) != PAPI_OK )
+				continue;
+
+			names[num++] = strdup( name );
+			if ( num == next ) {
+				printf( "%12d %16.1f\n", num,
+					time_lookups( names, num, reps ) );
+				next *= 2;
+			}
+		} while ( num < max &&
+			  PAPI_enum_cmp_event( &code, PAPI_ENUM_EVENTS, cidx ) == PAPI_OK );
+	}
+
+	if ( num == 0 ) {
+		printf( "No native events available\n" );
+	} else if ( num != next / 2 ) {
+		printf( "%12d %16.1f\n", num, time_lookups( names, num, reps ) );
+	}
+
+	while ( num > 0 )
+		free( names[--num] );
+	free( names );
+
+	PAPI_shutdown(  );
+
+	return 0;
+}